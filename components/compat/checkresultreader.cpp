@@ -24,11 +24,17 @@
 #include "base/objectlock.h"
 #include "base/logger_fwd.h"
 #include "base/convert.h"
+#include "base/exception.h"
 #include "base/application.h"
 #include "base/utility.h"
 #include <boost/smart_ptr/make_shared.hpp>
+#include <boost/exception/diagnostic_information.hpp>
 #include <fstream>
 
+#ifdef HAVE_SYS_INOTIFY_H
+#	include <sys/inotify.h>
+#endif /* HAVE_SYS_INOTIFY_H */
+
 using namespace icinga;
 
 REGISTER_TYPE(CheckResultReader);
@@ -38,10 +44,50 @@ REGISTER_TYPE(CheckResultReader);
  */
 void CheckResultReader::Start(void)
 {
+	m_ActiveTasks = 0;
+	m_ProcessedCount = 0;
+	m_Latency = 0;
+	m_MaxLatency = 0;
+
+	DynamicObject::OnStarted.connect(boost::bind(&CheckResultReader::ObjectChangedHandler, this));
+	DynamicObject::OnStopped.connect(boost::bind(&CheckResultReader::ObjectChangedHandler, this));
+
+	/* Without inotify we have to poll the spool directory. With inotify the
+	 * timer only picks up files we might have missed, e.g. when the kernel's
+	 * event queue overflowed. */
+	double interval = 5;
+
+#ifdef HAVE_SYS_INOTIFY_H
+	int fd = inotify_init();
+
+	if (fd >= 0 && inotify_add_watch(fd, GetSpoolDir().CStr(), IN_CLOSE_WRITE | IN_MOVED_TO) >= 0) {
+		Utility::SetCloExec(fd);
+
+		m_NotifyThread = boost::thread(boost::bind(&CheckResultReader::NotifyThreadProc, this, fd));
+		m_NotifyThread.detach();
+
+		interval = 60;
+	} else {
+		std::ostringstream msgbuf;
+		msgbuf << "Could not watch checkresult spool directory '" << GetSpoolDir() << "' using inotify: "
+		    << strerror(errno) << ". Falling back to polling.";
+		Log(LogWarning, "compat", msgbuf.str());
+
+		if (fd >= 0)
+			(void) close(fd);
+	}
+#endif /* HAVE_SYS_INOTIFY_H */
+
 	m_ReadTimer = boost::make_shared<Timer>();
 	m_ReadTimer->OnTimerExpired.connect(boost::bind(&CheckResultReader::ReadTimerHandler, this));
-	m_ReadTimer->SetInterval(5);
+	m_ReadTimer->SetInterval(interval);
 	m_ReadTimer->Start();
+	m_ReadTimer->Reschedule(0);
+
+	m_StatsTimer = boost::make_shared<Timer>();
+	m_StatsTimer->OnTimerExpired.connect(boost::bind(&CheckResultReader::StatsTimerHandler, this));
+	m_StatsTimer->SetInterval(15);
+	m_StatsTimer->Start();
 }
 
 /**
@@ -58,71 +104,282 @@ String CheckResultReader::GetSpoolDir(void) const
 /**
  * @threadsafety Always.
  */
-void CheckResultReader::ReadTimerHandler(void) const
+void CheckResultReader::ReadTimerHandler(void)
+{
+	Utility::Glob(GetSpoolDir() + "/c??????.ok", boost::bind(&CheckResultReader::EnqueueCheckResultFile, this, _1));
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+void CheckResultReader::NotifyThreadProc(int fd)
+{
+	Utility::SetThreadName("CR Notify");
+
+	String spoolDir = GetSpoolDir();
+	std::vector<char> buffer(64 * 1024);
+
+	for (;;) {
+		ssize_t rc = read(fd, &buffer[0], buffer.size());
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+
+			std::ostringstream msgbuf;
+			msgbuf << "Could not read inotify events for checkresult spool directory '" << spoolDir << "': "
+			    << strerror(errno) << ". Falling back to polling.";
+			Log(LogWarning, "compat", msgbuf.str());
+
+			(void) close(fd);
+			m_ReadTimer->SetInterval(5);
+
+			return;
+		}
+
+		for (ssize_t offset = 0; offset < rc; ) {
+			const inotify_event *event = reinterpret_cast<const inotify_event *>(&buffer[offset]);
+			offset += sizeof(inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				Log(LogWarning, "compat", "inotify event queue overflowed. Rescanning checkresult spool directory.");
+				Utility::QueueAsyncCallback(boost::bind(&CheckResultReader::ReadTimerHandler, this));
+				continue;
+			}
+
+			if (event->len == 0)
+				continue;
+
+			/* Only c??????.ok files, just like the glob in ReadTimerHandler. */
+			size_t len = strlen(event->name);
+
+			if (len != 10 || event->name[0] != 'c' || strcmp(event->name + 7, ".ok") != 0)
+				continue;
+
+			EnqueueCheckResultFile(spoolDir + "/" + event->name);
+		}
+	}
+}
+#endif /* HAVE_SYS_INOTIFY_H */
+
+/**
+ * Queues a checkresult file for processing. Files which are already in
+ * the queue are ignored, so the timer and inotify can safely report the
+ * same file.
+ *
+ * @threadsafety Always.
+ */
+void CheckResultReader::EnqueueCheckResultFile(const String& path)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	if (!m_QueuedFiles.insert(path).second)
+		return;
+
+	m_Queue.push_back(path);
+
+	size_t cpus = boost::thread::hardware_concurrency();
+
+	if (m_ActiveTasks < std::max(cpus, static_cast<size_t>(1))) {
+		m_ActiveTasks++;
+		Utility::QueueAsyncCallback(boost::bind(&CheckResultReader::ProcessQueue, this));
+	}
+}
+
+/**
+ * Processes queued checkresult files until the queue is empty. Up to one
+ * of these tasks per CPU runs on the thread pool.
+ *
+ * @threadsafety Always.
+ */
+void CheckResultReader::ProcessQueue(void)
+{
+	for (;;) {
+		String path;
+
+		{
+			boost::mutex::scoped_lock lock(m_Mutex);
+
+			if (m_Queue.empty()) {
+				m_ActiveTasks--;
+				return;
+			}
+
+			path = m_Queue.front();
+			m_Queue.pop_front();
+		}
+
+		try {
+			ProcessCheckResultFile(path);
+		} catch (const std::exception& ex) {
+			std::ostringstream msgbuf;
+			msgbuf << "Could not process checkresult file '" << path << "': " << boost::diagnostic_information(ex);
+			Log(LogWarning, "compat", msgbuf.str());
+		}
+
+		boost::mutex::scoped_lock lock(m_Mutex);
+		m_QueuedFiles.erase(path);
+	}
+}
+
+/**
+ * Looks up a service. Successful lookups are cached until the next time an
+ * object is added or removed.
+ *
+ * @threadsafety Always.
+ */
+Service::Ptr CheckResultReader::LookupService(const String& hostName, const String& serviceName)
+{
+	std::pair<String, String> key = std::make_pair(hostName, serviceName);
+
+	{
+		boost::mutex::scoped_lock lock(m_CacheMutex);
+
+		std::map<std::pair<String, String>, Service::Ptr>::const_iterator it = m_ServiceCache.find(key);
+
+		if (it != m_ServiceCache.end())
+			return it->second;
+	}
+
+	Host::Ptr host = Host::GetByName(hostName);
+
+	if (!host)
+		return Service::Ptr();
+
+	Service::Ptr service = host->GetServiceByShortName(serviceName);
+
+	if (service) {
+		boost::mutex::scoped_lock lock(m_CacheMutex);
+		m_ServiceCache[key] = service;
+	}
+
+	return service;
+}
+
+void CheckResultReader::ObjectChangedHandler(void)
 {
-	Utility::Glob(GetSpoolDir() + "/c??????.ok", boost::bind(&CheckResultReader::ProcessCheckResultFile, this, _1));
+	boost::mutex::scoped_lock lock(m_CacheMutex);
+	m_ServiceCache.clear();
 }
 
-void CheckResultReader::ProcessCheckResultFile(const String& path) const
+static bool KeyEquals(const char *begin, const char *end, const char *key)
+{
+	size_t len = strlen(key);
+
+	return static_cast<size_t>(end - begin) == len && memcmp(begin, key, len) == 0;
+}
+
+void CheckResultReader::ProcessCheckResultFile(const String& path)
 {
 	String crfile = String(path.Begin(), path.End() - 3); /* Remove the ".ok" extension. */
 
-	std::ifstream fp;
-	fp.exceptions(std::ifstream::badbit);
-	fp.open(crfile.CStr());
+	int fd = open(crfile.CStr(), O_RDONLY);
+
+	if (fd < 0) {
+		/* Somebody else (i.e. an earlier task) got to this file first. */
+		if (errno == ENOENT && unlink(path.CStr()) < 0 && errno == ENOENT)
+			return;
 
-	std::map<String, String> attrs;
+		BOOST_THROW_EXCEPTION(posix_error()
+		    << boost::errinfo_api_function("open")
+		    << boost::errinfo_errno(errno)
+		    << boost::errinfo_file_name(crfile));
+	}
 
-	while (fp.good()) {
-		std::string line;
-		std::getline(fp, line);
+	struct stat statbuf;
 
-		if (line.empty() || line[0] == '#')
-			continue; /* Ignore comments and empty lines. */
+	if (fstat(fd, &statbuf) < 0) {
+		(void) close(fd);
+		BOOST_THROW_EXCEPTION(posix_error()
+		    << boost::errinfo_api_function("fstat")
+		    << boost::errinfo_errno(errno)
+		    << boost::errinfo_file_name(crfile));
+	}
 
-		size_t pos = line.find_first_of('=');
+	std::vector<char> buffer(statbuf.st_size);
+	size_t length = 0;
 
-		if (pos == std::string::npos)
-			continue; /* Ignore invalid lines. */
+	while (length < buffer.size()) {
+		ssize_t rc = read(fd, &buffer[length], buffer.size() - length);
 
-		String key = line.substr(0, pos);
-		String value = line.substr(pos + 1);
+		if (rc < 0 && errno == EINTR)
+			continue;
 
-		attrs[key] = value;
+		if (rc < 0) {
+			(void) close(fd);
+			BOOST_THROW_EXCEPTION(posix_error()
+			    << boost::errinfo_api_function("read")
+			    << boost::errinfo_errno(errno)
+			    << boost::errinfo_file_name(crfile));
+		}
+
+		if (rc == 0)
+			break;
+
+		length += rc;
 	}
 
+	(void) close(fd);
+
 	/* Remove the checkresult files. */
 	(void)unlink(path.CStr());
 	(void)unlink(crfile.CStr());
 
-	Host::Ptr host = Host::GetByName(attrs["host_name"]);
+	String hostName, serviceDescription, output, returnCode, startTime, finishTime;
 
-	if (!host) {
-		Log(LogWarning, "compat", "Ignoring checkresult file for host '" + attrs["host_name"] +
-		    "': Host does not exist.");
+	const char *data = buffer.empty() ? NULL : &buffer[0];
+	const char *end = data + length;
 
-		return;
+	while (data < end) {
+		const char *eol = static_cast<const char *>(memchr(data, '\n', end - data));
+
+		if (!eol)
+			eol = end;
+
+		const char *line = data;
+		data = eol + 1;
+
+		if (line == eol || *line == '#')
+			continue; /* Ignore comments and empty lines. */
+
+		const char *eq = static_cast<const char *>(memchr(line, '=', eol - line));
+
+		if (!eq)
+			continue; /* Ignore invalid lines. */
+
+		String value(eq + 1, eol);
+
+		if (KeyEquals(line, eq, "host_name"))
+			hostName = value;
+		else if (KeyEquals(line, eq, "service_description"))
+			serviceDescription = value;
+		else if (KeyEquals(line, eq, "output"))
+			output = value;
+		else if (KeyEquals(line, eq, "return_code"))
+			returnCode = value;
+		else if (KeyEquals(line, eq, "start_time"))
+			startTime = value;
+		else if (KeyEquals(line, eq, "finish_time"))
+			finishTime = value;
 	}
 
-	Service::Ptr service = host->GetServiceByShortName(attrs["service_description"]);
+	Service::Ptr service = LookupService(hostName, serviceDescription);
 
 	if (!service) {
-		Log(LogWarning, "compat", "Ignoring checkresult file for host '" + attrs["host_name"] +
-		    "', service '" + attrs["service_description"] + "': Service does not exist.");
+		Log(LogWarning, "compat", "Ignoring checkresult file for host '" + hostName +
+		    "', service '" + serviceDescription + "': Service does not exist.");
 
 		return;
 	}
 
-	Dictionary::Ptr result = PluginCheckTask::ParseCheckOutput(attrs["output"]);
-	result->Set("state", PluginCheckTask::ExitStatusToState(Convert::ToLong(attrs["return_code"])));
-	result->Set("execution_start", Convert::ToDouble(attrs["start_time"]));
-	result->Set("execution_end", Convert::ToDouble(attrs["finish_time"]));
+	Dictionary::Ptr result = PluginCheckTask::ParseCheckOutput(output);
+	result->Set("state", PluginCheckTask::ExitStatusToState(Convert::ToLong(returnCode)));
+	result->Set("execution_start", Convert::ToDouble(startTime));
+	result->Set("execution_end", Convert::ToDouble(finishTime));
 	result->Set("active", 1);
 
 	service->ProcessCheckResult(result);
 
-	Log(LogDebug, "compat", "Processed checkresult file for host '" + attrs["host_name"] +
-		    "', service '" + attrs["service_description"] + "'");
+	Log(LogDebug, "compat", "Processed checkresult file for host '" + hostName +
+		    "', service '" + serviceDescription + "'");
 
 	{
 		ObjectLock olock(service);
@@ -132,6 +389,52 @@ void CheckResultReader::ProcessCheckResultFile(const String& path) const
 		 * active checks. */
 		service->SetNextCheck(Utility::GetTime() + service->GetCheckInterval());
 	}
+
+	double latency = Utility::GetTime() - statbuf.st_mtime;
+
+	if (latency < 0)
+		latency = 0;
+
+	boost::mutex::scoped_lock lock(m_Mutex);
+	m_ProcessedCount++;
+	m_Latency += latency;
+
+	if (latency > m_MaxLatency)
+		m_MaxLatency = latency;
+}
+
+/**
+ * Logs the number of queued and processed checkresult files and how long
+ * it took to process them since they were written.
+ */
+void CheckResultReader::StatsTimerHandler(void)
+{
+	size_t backlog;
+	long processed;
+	double latency, maxLatency;
+
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		backlog = m_Queue.size();
+		processed = m_ProcessedCount;
+		latency = m_Latency;
+		maxLatency = m_MaxLatency;
+
+		m_ProcessedCount = 0;
+		m_Latency = 0;
+		m_MaxLatency = 0;
+	}
+
+	if (backlog == 0 && processed == 0)
+		return;
+
+	std::ostringstream msgbuf;
+	msgbuf << "Checkresult files for '" << GetName() << "': Backlog: " << backlog
+	    << "; Processed: " << processed
+	    << "; Avg latency: " << (long)(processed > 0 ? latency * 1000 / processed : 0) << "ms"
+	    << "; Max latency: " << (long)(maxLatency * 1000) << "ms";
+	Log(LogInformation, "compat", msgbuf.str());
 }
 
 void CheckResultReader::InternalSerialize(const Dictionary::Ptr& bag, int attributeTypes) const
@@ -22,7 +22,11 @@
 
 #include "base/dynamicobject.h"
 #include "base/timer.h"
-#include <fstream>
+#include "icinga/service.h"
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <set>
 
 namespace icinga
 {
@@ -50,8 +54,33 @@ private:
 	String m_SpoolDir;
 
 	Timer::Ptr m_ReadTimer;
-	void ReadTimerHandler(void) const;
-	void ProcessCheckResultFile(const String& path) const;
+	Timer::Ptr m_StatsTimer;
+
+#ifdef HAVE_SYS_INOTIFY_H
+	boost::thread m_NotifyThread;
+
+	void NotifyThreadProc(int fd);
+#endif /* HAVE_SYS_INOTIFY_H */
+
+	boost::mutex m_Mutex;
+	std::deque<String> m_Queue;
+	std::set<String> m_QueuedFiles;
+	size_t m_ActiveTasks;
+	long m_ProcessedCount;
+	double m_Latency;
+	double m_MaxLatency;
+
+	boost::mutex m_CacheMutex;
+	std::map<std::pair<String, String>, Service::Ptr> m_ServiceCache;
+
+	void ReadTimerHandler(void);
+	void StatsTimerHandler(void);
+	void ObjectChangedHandler(void);
+
+	void EnqueueCheckResultFile(const String& path);
+	void ProcessQueue(void);
+	void ProcessCheckResultFile(const String& path);
+	Service::Ptr LookupService(const String& hostName, const String& serviceName);
 };
 
 }
@@ -39,8 +39,16 @@
 #include <boost/tuple/tuple.hpp>
 #include <boost/exception/diagnostic_information.hpp>
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <algorithm>
 #include <fstream>
 
+#ifndef _WIN32
+#	include <sys/uio.h>
+#	include <poll.h>
+#endif /* _WIN32 */
+
 using namespace icinga;
 
 REGISTER_TYPE(CompatComponent);
@@ -58,6 +66,25 @@ void CompatComponent::Start(void)
 {
 	DynamicObject::Start();
 
+	m_StatusInvalid = true;
+	m_ObjectsInvalid = true;
+
+	DynamicObject::OnStateChanged.connect(boost::bind(&CompatComponent::StateChangedHandler, this, _1));
+	Service::OnNextCheckChanged.connect(boost::bind(&CompatComponent::ServiceChangedHandler, this, _1));
+	Service::OnForceNextCheckChanged.connect(boost::bind(&CompatComponent::ServiceChangedHandler, this, _1));
+	Service::OnEnableActiveChecksChanged.connect(boost::bind(&CompatComponent::ServiceChangedHandler, this, _1));
+	Service::OnEnablePassiveChecksChanged.connect(boost::bind(&CompatComponent::ServiceChangedHandler, this, _1));
+	Service::OnFlappingChanged.connect(boost::bind(&CompatComponent::ServiceChangedHandler, this, _1));
+	Service::OnNotificationSentChanged.connect(boost::bind(&CompatComponent::ServiceChangedHandler, this, _1));
+	Service::OnCommentAdded.connect(boost::bind(&CompatComponent::ServiceChangedHandler, this, _1));
+	Service::OnCommentRemoved.connect(boost::bind(&CompatComponent::ServiceChangedHandler, this, _1));
+	Service::OnDowntimeAdded.connect(boost::bind(&CompatComponent::ServiceChangedHandler, this, _1));
+	Service::OnDowntimeRemoved.connect(boost::bind(&CompatComponent::ServiceChangedHandler, this, _1));
+	Service::OnDowntimeTriggered.connect(boost::bind(&CompatComponent::ServiceChangedHandler, this, _1));
+	DynamicObject::OnStarted.connect(boost::bind(&CompatComponent::ConfigChangedHandler, this));
+	DynamicObject::OnStopped.connect(boost::bind(&CompatComponent::ConfigChangedHandler, this));
+	ExternalCommandProcessor::OnNewExternalCommand.connect(boost::bind(&CompatComponent::ExternalCommandHandler, this, _2, _3));
+
 	m_StatusTimer = boost::make_shared<Timer>();
 	m_StatusTimer->SetInterval(15);
 	m_StatusTimer->OnTimerExpired.connect(boost::bind(&CompatComponent::StatusTimerHandler, this));
@@ -96,6 +123,22 @@ String CompatComponent::GetObjectsPath(void) const
 		return m_ObjectsPath;
 }
 
+/**
+ * Retrieves the number of tasks status.dat and objects.cache are rendered
+ * with.
+ *
+ * @returns status_threads from config, or the number of CPUs
+ */
+size_t CompatComponent::GetStatusThreads(void) const
+{
+	if (!m_StatusThreads.IsEmpty())
+		return std::max(1L, static_cast<long>(m_StatusThreads));
+
+	size_t cpus = boost::thread::hardware_concurrency();
+
+	return (cpus > 0) ? cpus : 1;
+}
+
 /**
  * Retrieves the icinga.cmd path.
  *
@@ -111,6 +154,135 @@ String CompatComponent::GetCommandPath(void) const
 
 
 #ifndef _WIN32
+/**
+ * An external command which has been read from the command pipe.
+ */
+struct PipeCommand
+{
+	double Time;
+	String Command;
+	std::vector<String> Arguments;
+};
+
+struct CommandTasks
+{
+	boost::mutex Mutex;
+	boost::condition_variable CV;
+	int Pending;
+};
+
+static void ExecutePipeCommand(const PipeCommand& command)
+{
+	try {
+		ExternalCommandProcessor::Execute(command.Time, command.Command, command.Arguments);
+	} catch (const std::exception& ex) {
+		std::ostringstream msgbuf;
+		msgbuf << "External command failed: " << boost::diagnostic_information(ex);
+		Log(LogWarning, "compat", msgbuf.str());
+	}
+}
+
+static void ExecutePipeCommands(const std::vector<PipeCommand> *commands, CommandTasks *tasks)
+{
+	BOOST_FOREACH(const PipeCommand& command, *commands) {
+		ExecutePipeCommand(command);
+	}
+
+	boost::mutex::scoped_lock lock(tasks->Mutex);
+	tasks->Pending--;
+	tasks->CV.notify_all();
+}
+
+static void WaitForPipeCommands(CommandTasks *tasks)
+{
+	boost::mutex::scoped_lock lock(tasks->Mutex);
+
+	while (tasks->Pending > 0)
+		tasks->CV.wait(lock);
+}
+
+static void DispatchPipeCommands(std::vector<std::vector<PipeCommand> > *partitions, CommandTasks *tasks)
+{
+	BOOST_FOREACH(const std::vector<PipeCommand>& partition, *partitions) {
+		if (partition.empty())
+			continue;
+
+		{
+			boost::mutex::scoped_lock lock(tasks->Mutex);
+			tasks->Pending++;
+		}
+
+		Utility::QueueAsyncCallback(boost::bind(&ExecutePipeCommands, &partition, tasks));
+	}
+}
+
+/**
+ * Finds the service a check result command is for. Commands for the same
+ * service always end up in the same partition so they're processed in the
+ * order in which they were read.
+ *
+ * @returns the service, or an empty pointer for all other commands
+ */
+static Service::Ptr GetPipeCommandService(const PipeCommand& command)
+{
+	if (command.Command == "PROCESS_SERVICE_CHECK_RESULT" && command.Arguments.size() >= 2)
+		return Service::GetByNamePair(command.Arguments[0], command.Arguments[1]);
+
+	if (command.Command == "PROCESS_HOST_CHECK_RESULT" && command.Arguments.size() >= 1) {
+		Host::Ptr host = Host::GetByName(command.Arguments[0]);
+
+		if (host)
+			return host->GetHostCheckService();
+	}
+
+	return Service::Ptr();
+}
+
+/**
+ * Executes a batch of external commands. Check results are partitioned by
+ * service and processed in parallel on the thread pool. Any other command
+ * waits for all commands read before it and is executed on its own, so
+ * that e.g. a DISABLE_PASSIVE_SVC_CHECKS is never reordered with the check
+ * results around it.
+ *
+ * The partitions are still being processed when this function returns;
+ * the next batch waits for them.
+ */
+static void ProcessPipeCommands(const std::vector<PipeCommand>& commands,
+    std::vector<std::vector<PipeCommand> > *partitions, CommandTasks *tasks)
+{
+	WaitForPipeCommands(tasks);
+
+	BOOST_FOREACH(std::vector<PipeCommand>& partition, *partitions) {
+		partition.clear();
+	}
+
+	BOOST_FOREACH(const PipeCommand& command, commands) {
+		Service::Ptr service = GetPipeCommandService(command);
+
+		if (service) {
+			size_t index = boost::hash_value(service.get()) % partitions->size();
+			(*partitions)[index].push_back(command);
+			continue;
+		}
+
+		DispatchPipeCommands(partitions, tasks);
+		WaitForPipeCommands(tasks);
+
+		BOOST_FOREACH(std::vector<PipeCommand>& partition, *partitions) {
+			partition.clear();
+		}
+
+		ExecutePipeCommand(command);
+	}
+
+	DispatchPipeCommands(partitions, tasks);
+
+	std::ostringstream msgbuf;
+	msgbuf << "Dispatched " << commands.size() << " external commands.";
+	Log(LogDebug, "compat", msgbuf.str());
+}
+
 void CompatComponent::CommandPipeThread(const String& commandPath)
 {
 	struct stat statbuf;
@@ -136,51 +308,139 @@ void CompatComponent::CommandPipeThread(const String& commandPath)
 		    << boost::errinfo_file_name(commandPath));
 	}
 
-	for (;;) {
-		int fd;
+	int fd = open(commandPath.CStr(), O_RDONLY | O_NONBLOCK);
 
-		do {
-			fd = open(commandPath.CStr(), O_RDONLY);
-		} while (fd < 0 && errno == EINTR);
+	if (fd < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+		    << boost::errinfo_api_function("open")
+		    << boost::errinfo_errno(errno)
+		    << boost::errinfo_file_name(commandPath));
+	}
 
-		if (fd < 0) {
-			BOOST_THROW_EXCEPTION(posix_error()
-			    << boost::errinfo_api_function("open")
-			    << boost::errinfo_errno(errno)
-			    << boost::errinfo_file_name(commandPath));
-		}
+	/* Keep a writer open so that read() doesn't keep returning EOF whenever
+	 * the last client has closed the pipe. */
+	int wfd = open(commandPath.CStr(), O_WRONLY | O_NONBLOCK);
+
+	if (wfd < 0) {
+		(void) close(fd);
+		BOOST_THROW_EXCEPTION(posix_error()
+		    << boost::errinfo_api_function("open")
+		    << boost::errinfo_errno(errno)
+		    << boost::errinfo_file_name(commandPath));
+	}
 
-		FILE *fp = fdopen(fd, "r");
+	Utility::SetCloExec(fd);
+	Utility::SetCloExec(wfd);
+
+	const size_t maxBatchSize = 10000;
+	const size_t maxLineLength = 1024 * 1024;
+
+	std::vector<char> buffer(128 * 1024);
+	String partial;
+	bool discard = false;
+
+	std::vector<PipeCommand> batch;
+	batch.reserve(maxBatchSize);
+
+	size_t cpus = boost::thread::hardware_concurrency();
+	std::vector<std::vector<PipeCommand> > partitions((cpus > 0) ? cpus : 1);
+
+	CommandTasks tasks;
+	tasks.Pending = 0;
+
+	for (;;) {
+		pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
 
-		if (fp == NULL) {
-			(void) close(fd);
 			BOOST_THROW_EXCEPTION(posix_error()
-			    << boost::errinfo_api_function("fdopen")
+			    << boost::errinfo_api_function("poll")
 			    << boost::errinfo_errno(errno));
 		}
 
-		char line[2048];
+		/* Drain the pipe (or fill up the batch) before dispatching anything. */
+		while (batch.size() < maxBatchSize) {
+			ssize_t rc = read(fd, &buffer[0], buffer.size());
 
-		while (fgets(line, sizeof(line), fp) != NULL) {
-			// remove trailing new-line
-			while (strlen(line) > 0 &&
-			    (line[strlen(line) - 1] == '\r' || line[strlen(line) - 1] == '\n'))
-				line[strlen(line) - 1] = '\0';
+			if (rc < 0) {
+				if (errno == EINTR)
+					continue;
 
-			String command = line;
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					break;
 
-			try {
-				Log(LogInformation, "compat", "Executing external command: " + command);
+				BOOST_THROW_EXCEPTION(posix_error()
+				    << boost::errinfo_api_function("read")
+				    << boost::errinfo_errno(errno)
+				    << boost::errinfo_file_name(commandPath));
+			}
 
-				ExternalCommandProcessor::Execute(command);
-			} catch (const std::exception& ex) {
-				std::ostringstream msgbuf;
-				msgbuf << "External command failed: " << boost::diagnostic_information(ex);
-				Log(LogWarning, "compat", msgbuf.str());
+			if (rc == 0)
+				break;
+
+			const char *begin = &buffer[0];
+			const char *end = begin + rc;
+
+			for (;;) {
+				const char *eol = static_cast<const char *>(memchr(begin, '\n', end - begin));
+
+				if (!eol) {
+					if (!discard && partial.GetLength() + (end - begin) > maxLineLength) {
+						Log(LogWarning, "compat", "Discarding external command which is longer than "
+						    + Convert::ToString(static_cast<long>(maxLineLength)) + " bytes.");
+						partial = String();
+						discard = true;
+					}
+
+					if (!discard)
+						partial += String(begin, end);
+
+					break;
+				}
+
+				const char *last = eol;
+
+				if (last > begin && *(last - 1) == '\r')
+					last--;
+
+				if (discard) {
+					discard = false;
+				} else {
+					String line;
+
+					if (partial.IsEmpty()) {
+						line = String(begin, last);
+					} else {
+						partial += String(begin, last);
+						std::swap(line, partial);
+					}
+
+					if (!line.IsEmpty()) {
+						PipeCommand command;
+
+						try {
+							ExternalCommandProcessor::Parse(line, &command.Time, &command.Command, &command.Arguments);
+							batch.push_back(command);
+						} catch (const std::exception& ex) {
+							std::ostringstream msgbuf;
+							msgbuf << "External command failed: " << boost::diagnostic_information(ex);
+							Log(LogWarning, "compat", msgbuf.str());
+						}
+					}
+				}
+
+				begin = eol + 1;
 			}
 		}
 
-		fclose(fp);
+		if (!batch.empty()) {
+			ProcessPipeCommands(batch, &partitions, &tasks);
+			batch.clear();
+		}
 	}
 }
 #endif /* _WIN32 */
@@ -439,7 +699,6 @@ void CompatComponent::DumpServiceStatusAttrs(std::ostream& fp, const Service::Pt
 	   << "\t" << "last_time_warn=" << static_cast<long>(attrs->Get("last_time_warn")) << "\n"
 	   << "\t" << "last_time_critical=" << static_cast<long>(attrs->Get("last_time_critical")) << "\n"
 	   << "\t" << "last_time_unknown=" << static_cast<long>(attrs->Get("last_time_unknown")) << "\n"
-	   << "\t" << "last_update=" << static_cast<long>(attrs->Get("last_update")) << "\n"
 	   << "\t" << "notifications_enabled=" << attrs->Get("notifications_enabled") << "\n"
 	   << "\t" << "active_checks_enabled=" << attrs->Get("active_checks_enabled") << "\n"
 	   << "\t" << "passive_checks_enabled=" << attrs->Get("passive_checks_enabled") << "\n"
@@ -578,21 +837,370 @@ void CompatComponent::DumpCustomAttributes(std::ostream& fp, const DynamicObject
 	}
 }
 
+void CompatComponent::StateChangedHandler(const DynamicObject::Ptr& object)
+{
+	Service::Ptr service = dynamic_pointer_cast<Service>(object);
+
+	if (service) {
+		ServiceChangedHandler(service);
+		return;
+	}
+
+	Host::Ptr host = dynamic_pointer_cast<Host>(object);
+
+	if (host) {
+		boost::mutex::scoped_lock lock(m_DirtyMutex);
+		m_DirtyObjects.insert(host);
+	}
+}
+
 /**
- * Periodically writes the status.dat and objects.cache files.
+ * Marks the cached status of a service as out of date. The host's status
+ * is rendered from its host check service so it is re-rendered as well.
  */
-void CompatComponent::StatusTimerHandler(void)
+void CompatComponent::ServiceChangedHandler(const Service::Ptr& service)
 {
-	Log(LogInformation, "compat", "Writing compat status information");
+	Host::Ptr host = service->GetHost();
 
-	String statuspath = GetStatusPath();
-	String objectspath = GetObjectsPath();
-	String statuspathtmp = statuspath + ".tmp"; /* XXX make this a global definition */
-	String objectspathtmp = objectspath + ".tmp";
+	boost::mutex::scoped_lock lock(m_DirtyMutex);
+	m_DirtyObjects.insert(service);
+
+	if (host)
+		m_DirtyObjects.insert(host);
+}
+
+void CompatComponent::ConfigChangedHandler(void)
+{
+	boost::mutex::scoped_lock lock(m_DirtyMutex);
+	m_StatusInvalid = true;
+	m_ObjectsInvalid = true;
+}
+
+/**
+ * Most external commands change attributes for which there are no
+ * signals. The objects they refer to are derived from the command name:
+ * Host and service commands take the host name (and the service name)
+ * as their first arguments, group commands the group name. Commands
+ * which refer to comments or downtimes by ID fire signals of their own.
+ */
+void CompatComponent::ExternalCommandHandler(const String& command, const std::vector<String>& arguments)
+{
+	if (arguments.empty() || command == "PROCESS_HOST_CHECK_RESULT" || command == "PROCESS_SERVICE_CHECK_RESULT")
+		return;
+
+	std::set<Service::Ptr> services;
+
+	if (command.Find("HOSTGROUP") != String::NPos) {
+		HostGroup::Ptr hg = HostGroup::GetByName(arguments[0]);
+
+		if (hg) {
+			BOOST_FOREACH(const Host::Ptr& host, hg->GetMembers()) {
+				std::set<Service::Ptr> hostServices = host->GetServices();
+				services.insert(hostServices.begin(), hostServices.end());
+			}
+		}
+	} else if (command.Find("SERVICEGROUP") != String::NPos) {
+		ServiceGroup::Ptr sg = ServiceGroup::GetByName(arguments[0]);
 
-	std::ofstream statusfp;
-	statusfp.open(statuspathtmp.CStr(), std::ofstream::out | std::ofstream::trunc);
+		if (sg) {
+			BOOST_FOREACH(const Service::Ptr& service, sg->GetMembers()) {
+				services.insert(service);
 
+				Host::Ptr host = service->GetHost();
+				Service::Ptr hc = host ? host->GetHostCheckService() : Service::Ptr();
+
+				if (hc)
+					services.insert(hc);
+			}
+		}
+	} else if (command.Find("HOST_SVC") != String::NPos) {
+		Host::Ptr host = Host::GetByName(arguments[0]);
+
+		if (host)
+			services = host->GetServices();
+	} else if (command.Find("SVC") != String::NPos) {
+		if (arguments.size() >= 2) {
+			Service::Ptr service = Service::GetByNamePair(arguments[0], arguments[1]);
+
+			if (service)
+				services.insert(service);
+		}
+	} else if (command.Find("HOST") != String::NPos) {
+		Host::Ptr host = Host::GetByName(arguments[0]);
+		Service::Ptr hc = host ? host->GetHostCheckService() : Service::Ptr();
+
+		if (hc)
+			services.insert(hc);
+	}
+
+	BOOST_FOREACH(const Service::Ptr& service, services) {
+		ServiceChangedHandler(service);
+	}
+}
+
+/**
+ * Checks whether a service's status depends on the current time, e.g.
+ * because comments or downtimes expire. These aren't cached.
+ */
+bool CompatComponent::IsStatusVolatile(const Service::Ptr& service)
+{
+	Dictionary::Ptr comments = service->GetComments();
+
+	if (comments && comments->GetLength() > 0)
+		return true;
+
+	Dictionary::Ptr downtimes = service->GetDowntimes();
+
+	if (downtimes && downtimes->GetLength() > 0)
+		return true;
+
+	return (service->GetAcknowledgementExpiry() != 0);
+}
+
+/**
+ * Checks whether a host's status can't be cached. Hosts with parents are
+ * shown as unreachable depending on their parents' states, which don't mark
+ * the host as changed.
+ */
+bool CompatComponent::IsHostStatusVolatile(const Host::Ptr& host)
+{
+	if (!host->GetParentHosts().empty() || !host->GetParentServices().empty())
+		return true;
+
+	Service::Ptr hc = host->GetHostCheckService();
+
+	return (hc && IsStatusVolatile(hc));
+}
+
+void CompatComponent::DumpStatus(std::ostream& fp, const DynamicObject::Ptr& object)
+{
+	Service::Ptr service = dynamic_pointer_cast<Service>(object);
+
+	if (service)
+		DumpServiceStatus(fp, service);
+	else
+		DumpHostStatus(fp, static_pointer_cast<Host>(object));
+}
+
+/**
+ * Keeps track of the render tasks which haven't finished yet.
+ */
+struct RenderTasks
+{
+	boost::mutex Mutex;
+	boost::condition_variable CV;
+	int Pending;
+};
+
+static void RenderChunk(const std::vector<DynamicObject::Ptr>& objects, size_t begin, size_t end,
+    const CompatComponent::RenderFunction& render, std::vector<String> *results,
+    std::vector<char> *failed, RenderTasks *tasks)
+{
+	for (size_t i = begin; i < end; i++) {
+		try {
+			std::ostringstream fp;
+			fp << std::fixed;
+			render(fp, objects[i]);
+			(*results)[i] = fp.str();
+		} catch (const std::exception& ex) {
+			std::ostringstream msgbuf;
+			msgbuf << "Exception while rendering compat object '" << objects[i]->GetName() << "': "
+			       << boost::diagnostic_information(ex);
+			Log(LogCritical, "compat", msgbuf.str());
+
+			(*failed)[i] = 1;
+		}
+	}
+
+	if (tasks) {
+		boost::mutex::scoped_lock lock(tasks->Mutex);
+		tasks->Pending--;
+		tasks->CV.notify_all();
+	}
+}
+
+/**
+ * Renders objects on the thread pool. Each task renders a contiguous range
+ * of objects and results[i] holds the text for objects[i], so the output
+ * is in the same order as the objects. failed[i] is set if objects[i]
+ * couldn't be rendered.
+ */
+void CompatComponent::RenderObjects(const std::vector<DynamicObject::Ptr>& objects,
+    const RenderFunction& render, std::vector<String> *results, std::vector<char> *failed) const
+{
+	results->clear();
+	results->resize(objects.size());
+
+	failed->clear();
+	failed->resize(objects.size(), 0);
+
+	size_t count = GetStatusThreads();
+
+	/* Not worth the trouble for a handful of objects. */
+	if (count > objects.size() / 256)
+		count = objects.size() / 256;
+
+	if (count <= 1) {
+		RenderChunk(objects, 0, objects.size(), render, results, failed, NULL);
+		return;
+	}
+
+	RenderTasks tasks;
+	tasks.Pending = count - 1;
+
+	size_t chunk = (objects.size() + count - 1) / count;
+
+	for (size_t i = 1; i < count; i++) {
+		size_t begin = i * chunk;
+		size_t end = std::min(begin + chunk, objects.size());
+
+		Utility::QueueAsyncCallback(boost::bind(&RenderChunk, boost::cref(objects), begin, end,
+		    boost::cref(render), results, failed, &tasks));
+	}
+
+	/* The timer handler runs on the thread pool as well, so render the
+	 * first chunk ourselves rather than just waiting for the others. */
+	RenderChunk(objects, 0, std::min(chunk, objects.size()), render, results, failed, NULL);
+
+	boost::mutex::scoped_lock lock(tasks.Mutex);
+
+	while (tasks.Pending > 0)
+		tasks.CV.wait(lock);
+}
+
+/**
+ * Writes buffers to a file using as few system calls as possible.
+ */
+static void WriteBuffers(const String& path, const std::vector<const String *>& buffers)
+{
+#ifndef _WIN32
+	int fd = open(path.CStr(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+		    << boost::errinfo_api_function("open")
+		    << boost::errinfo_errno(errno)
+		    << boost::errinfo_file_name(path));
+	}
+
+	std::vector<struct iovec> iov;
+	iov.reserve(IOV_MAX);
+
+	std::vector<const String *>::size_type index = 0;
+
+	while (index < buffers.size() || !iov.empty()) {
+		while (index < buffers.size() && iov.size() < IOV_MAX) {
+			const String *buffer = buffers[index++];
+
+			if (buffer->IsEmpty())
+				continue;
+
+			struct iovec vec;
+			vec.iov_base = const_cast<char *>(buffer->CStr());
+			vec.iov_len = buffer->GetLength();
+			iov.push_back(vec);
+		}
+
+		if (iov.empty())
+			break;
+
+		ssize_t rc = writev(fd, &iov[0], iov.size());
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+
+			int error = errno;
+			(void) close(fd);
+
+			BOOST_THROW_EXCEPTION(posix_error()
+			    << boost::errinfo_api_function("writev")
+			    << boost::errinfo_errno(error)
+			    << boost::errinfo_file_name(path));
+		}
+
+		/* Drop the buffers which were written completely and advance
+		 * into a partially written one. */
+		std::vector<struct iovec>::size_type done = 0;
+
+		while (done < iov.size() && static_cast<size_t>(rc) >= iov[done].iov_len) {
+			rc -= iov[done].iov_len;
+			done++;
+		}
+
+		if (done < iov.size()) {
+			iov[done].iov_base = static_cast<char *>(iov[done].iov_base) + rc;
+			iov[done].iov_len -= rc;
+		}
+
+		iov.erase(iov.begin(), iov.begin() + done);
+	}
+
+	if (close(fd) < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+		    << boost::errinfo_api_function("close")
+		    << boost::errinfo_errno(errno)
+		    << boost::errinfo_file_name(path));
+	}
+#else /* _WIN32 */
+	std::ofstream fp;
+	fp.open(path.CStr(), std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+
+	BOOST_FOREACH(const String *buffer, buffers) {
+		fp.write(buffer->CStr(), buffer->GetLength());
+	}
+
+	fp.close();
+#endif /* _WIN32 */
+}
+
+static void RenameFile(const String& from, const String& to)
+{
+#ifdef _WIN32
+	_unlink(to.CStr());
+#endif /* _WIN32 */
+
+	if (rename(from.CStr(), to.CStr()) < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+		    << boost::errinfo_api_function("rename")
+		    << boost::errinfo_errno(errno)
+		    << boost::errinfo_file_name(from));
+	}
+}
+
+/**
+ * Writes the status.dat file. The host and service sections are cached
+ * and only re-rendered when the object has changed.
+ */
+void CompatComponent::WriteStatusFile(void)
+{
+	double start = Utility::GetTime();
+
+	std::set<DynamicObject::Ptr> dirty;
+	bool invalid;
+
+	{
+		boost::mutex::scoped_lock lock(m_DirtyMutex);
+		dirty.swap(m_DirtyObjects);
+		invalid = m_StatusInvalid;
+		m_StatusInvalid = false;
+	}
+
+	if (invalid) {
+		m_StatusCache.clear();
+	} else {
+		BOOST_FOREACH(const DynamicObject::Ptr& object, dirty) {
+			m_StatusCache.erase(object);
+		}
+
+		BOOST_FOREACH(const DynamicObject::Ptr& object, m_VolatileStatus) {
+			m_StatusCache.erase(object);
+		}
+	}
+
+	m_VolatileStatus.clear();
+
+	std::ostringstream statusfp;
 	statusfp << std::fixed;
 
 	statusfp << "# Icinga status file" << "\n"
@@ -625,66 +1233,161 @@ void CompatComponent::StatusTimerHandler(void)
 		 << "\t" << "}" << "\n"
 		 << "\n";
 
-	std::ofstream objectfp;
-	objectfp.open(objectspathtmp.CStr(), std::ofstream::out | std::ofstream::trunc);
+	String header = statusfp.str();
 
-	objectfp << std::fixed;
+	DynamicObjectSnapshot<Host> hosts = DynamicType::GetSnapshot<Host>();
+	DynamicObjectSnapshot<Service> services = DynamicType::GetSnapshot<Service>();
 
-	objectfp << "# Icinga objects cache file" << "\n"
-		 << "# This file is auto-generated. Do not modify this file." << "\n"
-		 << "\n";
+	std::vector<DynamicObject::Ptr> objects;
+	objects.reserve(hosts.GetLength() + services.GetLength());
+	objects.insert(objects.end(), hosts.GetObjects().begin(), hosts.GetObjects().end());
+	objects.insert(objects.end(), services.GetObjects().begin(), services.GetObjects().end());
 
-	BOOST_FOREACH(const Host::Ptr& host, DynamicType::GetObjects<Host>()) {
-		std::ostringstream tempstatusfp;
-		tempstatusfp << std::fixed;
-		DumpHostStatus(tempstatusfp, host);
-		statusfp << tempstatusfp.str();
+	std::vector<DynamicObject::Ptr> missing;
 
-		std::ostringstream tempobjectfp;
-		tempobjectfp << std::fixed;
-		DumpHostObject(tempobjectfp, host);
-		objectfp << tempobjectfp.str();
+	BOOST_FOREACH(const DynamicObject::Ptr& object, objects) {
+		if (m_StatusCache.find(object) == m_StatusCache.end())
+			missing.push_back(object);
 	}
 
-	BOOST_FOREACH(const HostGroup::Ptr& hg, DynamicType::GetObjects<HostGroup>()) {
-		std::ostringstream tempobjectfp;
-		tempobjectfp << std::fixed;
+	std::vector<String> fragments;
+	std::vector<char> failed;
+	RenderObjects(missing, boost::bind(&CompatComponent::DumpStatus, this, _1, _2), &fragments, &failed);
 
-		tempobjectfp << "define hostgroup {" << "\n"
-			 << "\t" << "hostgroup_name" << "\t" << hg->GetName() << "\n";
+	for (std::vector<DynamicObject::Ptr>::size_type i = 0; i < missing.size(); i++) {
+		const DynamicObject::Ptr& object = missing[i];
+
+		/* Objects which aren't cached are rendered again next time. */
+		if (failed[i])
+			continue;
+
+		const String& fragment = fragments[i];
+		std::pair<String, String>& entry = m_StatusCache[object];
+		size_t pos = fragment.FindFirstOf("\n");
+
+		if (pos == String::NPos) {
+			entry.first = String();
+			entry.second = fragment;
+		} else {
+			entry.first = fragment.SubStr(0, pos + 1);
+			entry.second = fragment.SubStr(pos + 1);
+		}
+
+		Service::Ptr service = dynamic_pointer_cast<Service>(object);
+		bool isVolatile;
+
+		if (service)
+			isVolatile = IsStatusVolatile(service);
+		else
+			isVolatile = IsHostStatusVolatile(static_pointer_cast<Host>(object));
+
+		if (isVolatile)
+			m_VolatileStatus.push_back(object);
+	}
+
+	String lastUpdate = "\tlast_update=" + Convert::ToString(static_cast<long>(Utility::GetTime())) + "\n";
+
+	std::vector<const String *> buffers;
+	buffers.push_back(&header);
 
-		DumpCustomAttributes(tempobjectfp, hg);
+	BOOST_FOREACH(const DynamicObject::Ptr& object, objects) {
+		std::map<DynamicObject::Ptr, std::pair<String, String> >::const_iterator it = m_StatusCache.find(object);
 
-		tempobjectfp << "\t" << "members" << "\t";
-		DumpNameList(tempobjectfp, hg->GetMembers());
-		tempobjectfp << "\n"
-			     << "\t" << "}" << "\n";
+		if (it == m_StatusCache.end())
+			continue;
+
+		if (!it->second.first.IsEmpty()) {
+			buffers.push_back(&it->second.first);
+			buffers.push_back(&lastUpdate);
+		}
 
-		objectfp << tempobjectfp.str();
+		buffers.push_back(&it->second.second);
 	}
 
-	BOOST_FOREACH(const Service::Ptr& service, DynamicType::GetObjects<Service>()) {
-		std::ostringstream tempstatusfp;
-		tempstatusfp << std::fixed;
-		DumpServiceStatus(tempstatusfp, service);
-		statusfp << tempstatusfp.str();
+	String statuspath = GetStatusPath();
+	String statuspathtmp = statuspath + ".tmp"; /* XXX make this a global definition */
+
+	WriteBuffers(statuspathtmp, buffers);
+	RenameFile(statuspathtmp, statuspath);
 
-		std::ostringstream tempobjectfp;
-		tempobjectfp << std::fixed;
-		DumpServiceObject(tempobjectfp, service);
-		objectfp << tempobjectfp.str();
+	std::ostringstream msgbuf;
+	msgbuf << "Wrote status for " << objects.size() << " objects (" << missing.size() << " rendered) in "
+	       << Utility::GetTime() - start << " seconds.";
+	Log(LogInformation, "compat", msgbuf.str());
+}
+
+/**
+ * Writes the objects.cache file. This is only done after the configuration
+ * has changed.
+ */
+void CompatComponent::WriteObjectsFile(void)
+{
+	{
+		boost::mutex::scoped_lock lock(m_DirtyMutex);
+
+		if (!m_ObjectsInvalid)
+			return;
+
+		m_ObjectsInvalid = false;
 	}
 
-	BOOST_FOREACH(const ServiceGroup::Ptr& sg, DynamicType::GetObjects<ServiceGroup>()) {
-		std::ostringstream tempobjectfp;
-		tempobjectfp << std::fixed;
+	double start = Utility::GetTime();
+
+	DynamicObjectSnapshot<Host> hosts = DynamicType::GetSnapshot<Host>();
+
+	std::vector<String> hostfragments;
+	std::vector<char> hostfailed;
+	RenderObjects(hosts.GetObjects(), boost::bind(&CompatComponent::DumpHostObject, this, _1,
+	    boost::bind(&static_pointer_cast<Host, DynamicObject>, _2)), &hostfragments, &hostfailed);
 
-		tempobjectfp << "define servicegroup {" << "\n"
+	DynamicObjectSnapshot<Service> services = DynamicType::GetSnapshot<Service>();
+
+	std::vector<String> servicefragments;
+	std::vector<char> servicefailed;
+	RenderObjects(services.GetObjects(), boost::bind(&CompatComponent::DumpServiceObject, this, _1,
+	    boost::bind(&static_pointer_cast<Service, DynamicObject>, _2)), &servicefragments, &servicefailed);
+
+	if (std::find(hostfailed.begin(), hostfailed.end(), 1) != hostfailed.end() ||
+	    std::find(servicefailed.begin(), servicefailed.end(), 1) != servicefailed.end()) {
+		/* Write what we have and try again next time. */
+		boost::mutex::scoped_lock lock(m_DirtyMutex);
+		m_ObjectsInvalid = true;
+	}
+
+	std::ostringstream objectfp;
+	objectfp << std::fixed;
+
+	objectfp << "# Icinga objects cache file" << "\n"
+		 << "# This file is auto-generated. Do not modify this file." << "\n"
+		 << "\n";
+
+	String header = objectfp.str();
+
+	objectfp.str("");
+
+	BOOST_FOREACH(const HostGroup::Ptr& hg, DynamicType::GetSnapshot<HostGroup>()) {
+		objectfp << "define hostgroup {" << "\n"
+			 << "\t" << "hostgroup_name" << "\t" << hg->GetName() << "\n";
+
+		DumpCustomAttributes(objectfp, hg);
+
+		objectfp << "\t" << "members" << "\t";
+		DumpNameList(objectfp, hg->GetMembers());
+		objectfp << "\n"
+			 << "\t" << "}" << "\n";
+	}
+
+	String hostgroups = objectfp.str();
+
+	objectfp.str("");
+
+	BOOST_FOREACH(const ServiceGroup::Ptr& sg, DynamicType::GetSnapshot<ServiceGroup>()) {
+		objectfp << "define servicegroup {" << "\n"
 			 << "\t" << "servicegroup_name" << "\t" << sg->GetName() << "\n";
 
-		DumpCustomAttributes(tempobjectfp, sg);
+		DumpCustomAttributes(objectfp, sg);
 
-		tempobjectfp << "\t" << "members" << "\t";
+		objectfp << "\t" << "members" << "\t";
 
 		std::vector<String> sglist;
 		BOOST_FOREACH(const Service::Ptr& service, sg->GetMembers()) {
@@ -697,19 +1400,14 @@ void CompatComponent::StatusTimerHandler(void)
 			sglist.push_back(service->GetShortName());
 		}
 
-		DumpStringList(tempobjectfp, sglist);
+		DumpStringList(objectfp, sglist);
 
-		tempobjectfp << "\n"
+		objectfp << "\n"
 			 << "}" << "\n";
-
-		objectfp << tempobjectfp.str();
 	}
 
-	BOOST_FOREACH(const User::Ptr& user, DynamicType::GetObjects<User>()) {
-		std::ostringstream tempobjectfp;
-		tempobjectfp << std::fixed;
-
-		tempobjectfp << "define contact {" << "\n"
+	BOOST_FOREACH(const User::Ptr& user, DynamicType::GetSnapshot<User>()) {
+		objectfp << "define contact {" << "\n"
 			 << "\t" << "contact_name" << "\t" << user->GetName() << "\n"
 			 << "\t" << "alias" << "\t" << user->GetDisplayName() << "\n"
 			 << "\t" << "service_notification_options" << "\t" << "w,u,c,r,f,s" << "\n"
@@ -718,65 +1416,71 @@ void CompatComponent::StatusTimerHandler(void)
 			 << "\t" << "service_notifications_enabled" << "\t" << 1 << "\n"
 			 << "\t" << "}" << "\n"
 			 << "\n";
-
-		objectfp << tempobjectfp.str();
 	}
 
-	BOOST_FOREACH(const UserGroup::Ptr& ug, DynamicType::GetObjects<UserGroup>()) {
-		std::ostringstream tempobjectfp;
-		tempobjectfp << std::fixed;
-
-		tempobjectfp << "define contactgroup {" << "\n"
+	BOOST_FOREACH(const UserGroup::Ptr& ug, DynamicType::GetSnapshot<UserGroup>()) {
+		objectfp << "define contactgroup {" << "\n"
 			 << "\t" << "contactgroup_name" << "\t" << ug->GetName() << "\n"
 			 << "\t" << "alias" << "\t" << ug->GetDisplayName() << "\n";
 
-		tempobjectfp << "\t" << "members" << "\t";
-		DumpNameList(tempobjectfp, ug->GetMembers());
-		tempobjectfp << "\n"
-			     << "\t" << "}" << "\n";
-
-		objectfp << tempobjectfp.str();
+		objectfp << "\t" << "members" << "\t";
+		DumpNameList(objectfp, ug->GetMembers());
+		objectfp << "\n"
+			 << "\t" << "}" << "\n";
 	}
 
-	BOOST_FOREACH(const Command::Ptr& command, DynamicType::GetObjects<CheckCommand>()) {
+	BOOST_FOREACH(const Command::Ptr& command, DynamicType::GetSnapshot<CheckCommand>()) {
 		DumpCommand(objectfp, command);
 	}
 
-	BOOST_FOREACH(const Command::Ptr& command, DynamicType::GetObjects<NotificationCommand>()) {
+	BOOST_FOREACH(const Command::Ptr& command, DynamicType::GetSnapshot<NotificationCommand>()) {
 		DumpCommand(objectfp, command);
 	}
 
-	BOOST_FOREACH(const Command::Ptr& command, DynamicType::GetObjects<EventCommand>()) {
+	BOOST_FOREACH(const Command::Ptr& command, DynamicType::GetSnapshot<EventCommand>()) {
 		DumpCommand(objectfp, command);
 	}
 
-	BOOST_FOREACH(const TimePeriod::Ptr& tp, DynamicType::GetObjects<TimePeriod>()) {
+	BOOST_FOREACH(const TimePeriod::Ptr& tp, DynamicType::GetSnapshot<TimePeriod>()) {
 		DumpTimePeriod(objectfp, tp);
 	}
 
-	statusfp.close();
-	objectfp.close();
+	String trailer = objectfp.str();
 
-#ifdef _WIN32
-	_unlink(statuspath.CStr());
-	_unlink(objectspath.CStr());
-#endif /* _WIN32 */
+	std::vector<const String *> buffers;
+	buffers.push_back(&header);
 
-	statusfp.close();
-	if (rename(statuspathtmp.CStr(), statuspath.CStr()) < 0) {
-		BOOST_THROW_EXCEPTION(posix_error()
-		    << boost::errinfo_api_function("rename")
-		    << boost::errinfo_errno(errno)
-		    << boost::errinfo_file_name(statuspathtmp));
+	BOOST_FOREACH(const String& fragment, hostfragments) {
+		buffers.push_back(&fragment);
 	}
 
-	objectfp.close();
-	if (rename(objectspathtmp.CStr(), objectspath.CStr()) < 0) {
-		BOOST_THROW_EXCEPTION(posix_error()
-		    << boost::errinfo_api_function("rename")
-		    << boost::errinfo_errno(errno)
-		    << boost::errinfo_file_name(objectspathtmp));
+	buffers.push_back(&hostgroups);
+
+	BOOST_FOREACH(const String& fragment, servicefragments) {
+		buffers.push_back(&fragment);
 	}
+
+	buffers.push_back(&trailer);
+
+	String objectspath = GetObjectsPath();
+	String objectspathtmp = objectspath + ".tmp";
+
+	WriteBuffers(objectspathtmp, buffers);
+	RenameFile(objectspathtmp, objectspath);
+
+	std::ostringstream msgbuf;
+	msgbuf << "Wrote objects for " << hosts.GetLength() << " hosts and " << services.GetLength() << " services in "
+	       << Utility::GetTime() - start << " seconds.";
+	Log(LogInformation, "compat", msgbuf.str());
+}
+
+/**
+ * Periodically writes the status.dat and objects.cache files.
+ */
+void CompatComponent::StatusTimerHandler(void)
+{
+	WriteStatusFile();
+	WriteObjectsFile();
 }
 
 void CompatComponent::InternalSerialize(const Dictionary::Ptr& bag, int attributeTypes) const
@@ -787,6 +1491,7 @@ void CompatComponent::InternalSerialize(const Dictionary::Ptr& bag, int attribut
 		bag->Set("status_path", m_StatusPath);
 		bag->Set("objects_path", m_ObjectsPath);
 		bag->Set("command_path", m_CommandPath);
+		bag->Set("status_threads", m_StatusThreads);
 	}
 }
 
@@ -798,5 +1503,6 @@ void CompatComponent::InternalDeserialize(const Dictionary::Ptr& bag, int attrib
 		m_StatusPath = bag->Get("status_path");
 		m_ObjectsPath = bag->Get("objects_path");
 		m_CommandPath = bag->Get("command_path");
+		m_StatusThreads = bag->Get("status_threads");
 	}
 }
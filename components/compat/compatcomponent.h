@@ -29,6 +29,8 @@
 #include "base/timer.h"
 #include "base/utility.h"
 #include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/function.hpp>
 #include <iostream>
 
 namespace icinga
@@ -42,6 +44,8 @@ class CompatComponent : public DynamicObject
 public:
 	DECLARE_PTR_TYPEDEFS(CompatComponent);
 
+	typedef boost::function<void (std::ostream&, const DynamicObject::Ptr&)> RenderFunction;
+
 protected:
 	virtual void Start(void);
 
@@ -52,6 +56,7 @@ private:
 	String m_StatusPath;
 	String m_ObjectsPath;
 	String m_CommandPath;
+	Value m_StatusThreads;
 
 #ifndef _WIN32
 	boost::thread m_CommandThread;
@@ -61,9 +66,20 @@ private:
 
 	Timer::Ptr m_StatusTimer;
 
+	/* Only used by the status timer. Each fragment is split after its
+	 * first line, which is where the current "last_update" goes. */
+	std::map<DynamicObject::Ptr, std::pair<String, String> > m_StatusCache;
+	std::vector<DynamicObject::Ptr> m_VolatileStatus;
+
+	boost::mutex m_DirtyMutex;
+	std::set<DynamicObject::Ptr> m_DirtyObjects;
+	bool m_StatusInvalid;
+	bool m_ObjectsInvalid;
+
 	String GetStatusPath(void) const;
 	String GetObjectsPath(void) const;
 	String GetCommandPath(void) const;
+	size_t GetStatusThreads(void) const;
 
 	void DumpCommand(std::ostream& fp, const Command::Ptr& command);
 	void DumpTimePeriod(std::ostream& fp, const TimePeriod::Ptr& tp);
@@ -110,6 +126,20 @@ private:
 
 	void DumpCustomAttributes(std::ostream& fp, const DynamicObject::Ptr& object);
 
+	void StateChangedHandler(const DynamicObject::Ptr& object);
+	void ServiceChangedHandler(const Service::Ptr& service);
+	void ConfigChangedHandler(void);
+	void ExternalCommandHandler(const String& command, const std::vector<String>& arguments);
+
+	void DumpStatus(std::ostream& fp, const DynamicObject::Ptr& object);
+	void RenderObjects(const std::vector<DynamicObject::Ptr>& objects,
+	    const RenderFunction& render, std::vector<String> *results, std::vector<char> *failed) const;
+	static bool IsStatusVolatile(const Service::Ptr& service);
+	static bool IsHostStatusVolatile(const Host::Ptr& host);
+
+	void WriteStatusFile(void);
+	void WriteObjectsFile(void);
+
 	void StatusTimerHandler(void);
 };
 
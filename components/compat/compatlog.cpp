@@ -22,6 +22,8 @@
 #include "icinga/checkcommand.h"
 #include "icinga/notification.h"
 #include "icinga/macroprocessor.h"
+#include "icinga/compatlogbuffer.h"
+#include "icinga/compatlogarchive.h"
 #include "config/configcompilercontext.h"
 #include "base/dynamictype.h"
 #include "base/objectlock.h"
@@ -34,6 +36,7 @@
 #include <boost/smart_ptr/make_shared.hpp>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/exception/diagnostic_information.hpp>
 
 using namespace icinga;
 
@@ -41,7 +44,7 @@ REGISTER_TYPE(CompatLog);
 REGISTER_SCRIPTFUNCTION(ValidateRotationMethod, &CompatLog::ValidateRotationMethod);
 
 CompatLog::CompatLog(void)
-	: m_LastRotation(0)
+	: m_LastRotation(0), m_QueueStopped(false), m_Fd(-1), m_Offset(0), m_BufferStart(0)
 { }
 
 /**
@@ -58,10 +61,33 @@ void CompatLog::Start(void)
 	m_RotationTimer->OnTimerExpired.connect(boost::bind(&CompatLog::RotationTimerHandler, this));
 	m_RotationTimer->Start();
 
-	ReopenFile(false);
+	if (!CompatLogArchive::IsCompressionSupported(GetArchiveCompression())) {
+		Log(LogWarning, "compat", "Compression method '" + GetArchiveCompression() + "' for compat log '"
+		    + GetName() + "' is not supported. Archives will not be compressed.");
+	}
+
+	/* The writer thread opens the log file before it processes any lines. */
+	m_WriterThread = boost::thread(boost::bind(&CompatLog::WriterThreadProc, this));
+
 	ScheduleNextRotation();
 }
 
+void CompatLog::Stop(void)
+{
+	m_RotationTimer->Stop();
+
+	{
+		boost::mutex::scoped_lock lock(m_QueueMutex);
+		m_QueueStopped = true;
+		m_QueueCV.notify_all();
+	}
+
+	/* The writer thread flushes all queued lines before it exits. */
+	m_WriterThread.join();
+
+	DynamicObject::Stop();
+}
+
 /**
  * @threadsafety Always.
  */
@@ -84,6 +110,64 @@ String CompatLog::GetRotationMethod(void) const
 		return "HOURLY";
 }
 
+/**
+ * Retrieves the method which is used to compress rotated log files.
+ *
+ * @returns archive_compression from config, or "none"
+ * @threadsafety Always.
+ */
+String CompatLog::GetArchiveCompression(void) const
+{
+	if (!m_ArchiveCompression.IsEmpty())
+		return m_ArchiveCompression;
+	else
+		return "none";
+}
+
+/**
+ * Retrieves how long lines may be buffered before they're written to the
+ * log file.
+ *
+ * @returns flush_interval from config, or 1 second
+ * @threadsafety Always.
+ */
+double CompatLog::GetFlushInterval(void) const
+{
+	if (!m_FlushInterval.IsEmpty())
+		return m_FlushInterval;
+	else
+		return 1;
+}
+
+/**
+ * Retrieves how many bytes may be buffered before they're written to the
+ * log file.
+ *
+ * @returns flush_size from config, or 64 KiB
+ * @threadsafety Always.
+ */
+size_t CompatLog::GetFlushSize(void) const
+{
+	if (!m_FlushSize.IsEmpty())
+		return std::max(0L, static_cast<long>(m_FlushSize));
+	else
+		return 64 * 1024;
+}
+
+/**
+ * Retrieves whether the log file is synced to disk after each write.
+ *
+ * @returns sync from config, or false
+ * @threadsafety Always.
+ */
+bool CompatLog::GetSync(void) const
+{
+	if (!m_Sync.IsEmpty())
+		return m_Sync;
+	else
+		return false;
+}
+
 /**
  * @threadsafety Always.
  */
@@ -127,41 +211,23 @@ void CompatLog::CheckResultHandler(const Service::Ptr& service, const Dictionary
                 boost::algorithm::replace_all(output, "\n", "\\n");
         }
 
-	std::ostringstream msgbuf;
-	msgbuf << "SERVICE ALERT: "
-	       << host->GetName() << ";"
-	       << service->GetShortName() << ";"
-	       << Service::StateToString(static_cast<ServiceState>(state_after)) << ";"
-	       << Service::StateTypeToString(static_cast<StateType>(stateType_after)) << ";"
-	       << attempt_after << ";"
-	       << output << ""
-	       << "";
+	/* This runs for every state change, so don't bother with a stringstream. */
+	String stateType = Service::StateTypeToString(static_cast<StateType>(stateType_after));
+	String attempt = Convert::ToString(attempt_after);
 
-	{
-		ObjectLock olock(this);
-		WriteLine(msgbuf.str());
-	}
+	WriteLine("SERVICE ALERT: " + host->GetName() + ";"
+	    + service->GetShortName() + ";"
+	    + Service::StateToString(static_cast<ServiceState>(state_after)) + ";"
+	    + stateType + ";"
+	    + attempt + ";"
+	    + output);
 
 	if (service == host->GetHostCheckService()) {
-		std::ostringstream msgbuf;
-		msgbuf << "HOST ALERT: "
-		       << host->GetName() << ";"
-		       << Host::StateToString(Host::CalculateState(static_cast<ServiceState>(state_after), host_reachable_after)) << ";"
-		       << Service::StateTypeToString(static_cast<StateType>(stateType_after)) << ";"
-		       << attempt_after << ";"
-		       << output << ""
-		       << "";
-
-		{
-			ObjectLock olock(this);
-			WriteLine(msgbuf.str());
-		}
-
-	}
-
-	{
-		ObjectLock olock(this);
-		Flush();
+		WriteLine("HOST ALERT: " + host->GetName() + ";"
+		    + Host::StateToString(Host::CalculateState(static_cast<ServiceState>(state_after), host_reachable_after)) + ";"
+		    + stateType + ";"
+		    + attempt + ";"
+		    + output);
 	}
 }
 
@@ -278,10 +344,7 @@ void CompatLog::NotificationSentHandler(const Service::Ptr& service, const User:
 		<< raw_output << author_comment
                 << "";
 
-        {
-                ObjectLock oLock(this);
-                WriteLine(msgbuf.str());
-        }
+        WriteLine(msgbuf.str());
 
         if (service == host->GetHostCheckService()) {
                 std::ostringstream msgbuf;
@@ -294,15 +357,7 @@ void CompatLog::NotificationSentHandler(const Service::Ptr& service, const User:
 			<< raw_output << author_comment
                         << "";
 
-                {
-                        ObjectLock oLock(this);
-                        WriteLine(msgbuf.str());
-                }
-        }
-
-        {
-                ObjectLock oLock(this);
-                Flush();
+                WriteLine(msgbuf.str());
         }
 }
 
@@ -345,10 +400,7 @@ void CompatLog::FlappingHandler(const Service::Ptr& service, FlappingState flapp
                 << flapping_output
                 << "";
 
-        {
-                ObjectLock oLock(this);
-                WriteLine(msgbuf.str());
-        }
+        WriteLine(msgbuf.str());
 
         if (service == host->GetHostCheckService()) {
                 std::ostringstream msgbuf;
@@ -358,71 +410,243 @@ void CompatLog::FlappingHandler(const Service::Ptr& service, FlappingState flapp
                         << flapping_output
                         << "";
 
-                {
-                        ObjectLock oLock(this);
-                        WriteLine(msgbuf.str());
-                }
+                WriteLine(msgbuf.str());
         }
+}
 
-        {
-                ObjectLock oLock(this);
-                Flush();
-        }
+/**
+ * Queues a line for the writer thread.
+ *
+ * @threadsafety Always.
+ */
+void CompatLog::WriteLine(const String& line)
+{
+	CompatLogEntry entry;
+	entry.Line = line;
+	entry.Rotate = false;
+	entry.Timestamp = Utility::GetTime();
 
+	EnqueueEntry(entry);
 }
 
-void CompatLog::WriteLine(const String& line)
+/**
+ * @threadsafety Always.
+ */
+void CompatLog::EnqueueEntry(const CompatLogEntry& entry)
 {
-	ASSERT(OwnsLock());
+	boost::mutex::scoped_lock lock(m_QueueMutex);
 
-	if (!m_OutputFile.good())
-		return;
+	m_Queue.push_back(entry);
 
-	m_OutputFile << "[" << (long)Utility::GetTime() << "] " << line << "\n";
+	/* The writer thread takes all queued entries at once, so it's only
+	 * waiting for us if the queue was empty. */
+	if (m_Queue.size() == 1)
+		m_QueueCV.notify_all();
 }
 
-void CompatLog::Flush(void)
+void CompatLog::WriterThreadProc(void)
 {
-	ASSERT(OwnsLock());
+	Utility::SetThreadName("Compat Log");
+
+	try {
+		ReopenFile(false, Utility::GetTime());
+	} catch (const std::exception& ex) {
+		std::ostringstream msgbuf;
+		msgbuf << "Exception while opening compat log file: " << boost::diagnostic_information(ex);
+		Log(LogCritical, "compat", msgbuf.str());
+	}
+
+	std::vector<CompatLogEntry> entries;
+
+	for (;;) {
+		bool stopped;
 
-	if (!m_OutputFile.good())
+		{
+			boost::mutex::scoped_lock lock(m_QueueMutex);
+
+			while (m_Queue.empty() && !m_QueueStopped) {
+				if (m_Buffer.empty()) {
+					m_QueueCV.wait(lock);
+					continue;
+				}
+
+				double wait = m_BufferStart + GetFlushInterval() - Utility::GetTime();
+
+				if (wait <= 0)
+					break;
+
+				m_QueueCV.timed_wait(lock, boost::posix_time::milliseconds(static_cast<long>(wait * 1000)));
+			}
+
+			entries.swap(m_Queue);
+			stopped = m_QueueStopped;
+		}
+
+		try {
+			long lastTime = -1;
+			String timestamp;
+
+			BOOST_FOREACH(const CompatLogEntry& entry, entries) {
+				if (entry.Rotate) {
+					ReopenFile(true, entry.Timestamp);
+					continue;
+				}
+
+				long time = static_cast<long>(entry.Timestamp);
+
+				/* Most of the lines in a batch share the same second. */
+				if (time != lastTime) {
+					timestamp = "[" + Convert::ToString(time) + "] ";
+					lastTime = time;
+				}
+
+				AppendLine(timestamp, entry.Line);
+			}
+
+			if (stopped || m_Buffer.size() >= GetFlushSize() ||
+			    (!m_Buffer.empty() && Utility::GetTime() >= m_BufferStart + GetFlushInterval()))
+				Flush();
+		} catch (const std::exception& ex) {
+			std::ostringstream msgbuf;
+			msgbuf << "Exception while writing compat log file: " << boost::diagnostic_information(ex);
+			Log(LogCritical, "compat", msgbuf.str());
+		}
+
+		entries.clear();
+
+		if (stopped)
+			break;
+	}
+
+	if (m_Fd >= 0) {
+		(void) close(m_Fd);
+		m_Fd = -1;
+	}
+}
+
+/**
+ * Adds a line to the write buffer.
+ *
+ * Note: Must only be called by the writer thread.
+ */
+void CompatLog::AppendLine(const String& timestamp, const String& line)
+{
+	if (m_Fd < 0)
 		return;
 
-	m_OutputFile << std::flush;
+	if (m_Buffer.empty())
+		m_BufferStart = Utility::GetTime();
+
+	CompatLogBufferEntry entry;
+	entry.Offset = m_Offset + m_Buffer.size();
+	entry.Line = timestamp + line;
+
+	m_Buffer.append(entry.Line.CStr(), entry.Line.GetLength());
+	m_Buffer += '\n';
+
+	m_BufferedLines.push_back(entry);
+
+	if (m_Buffer.size() >= GetFlushSize())
+		Flush();
 }
 
 /**
- * @threadsafety Always.
+ * Writes the buffered lines to the log file.
+ *
+ * Note: Must only be called by the writer thread.
  */
-void CompatLog::ReopenFile(bool rotate)
+void CompatLog::Flush(void)
 {
-	ObjectLock olock(this);
+	if (m_Buffer.empty())
+		return;
+
+	size_t written = 0;
+
+	while (m_Fd >= 0 && written < m_Buffer.size()) {
+		ssize_t rc = write(m_Fd, m_Buffer.c_str() + written, m_Buffer.size() - written);
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+
+		if (rc < 0) {
+			Log(LogWarning, "compat", "Could not write compat log file '" + GetLogDir() + "/icinga.log': "
+			    + strerror(errno) + ". Log output will be lost.");
+			break;
+		}
+
+		written += rc;
+	}
+
+	m_Offset += written;
+
+#ifndef _WIN32
+	if (written > 0 && GetSync() && fdatasync(m_Fd) < 0) {
+		Log(LogWarning, "compat", "Could not sync compat log file '" + GetLogDir() + "/icinga.log': "
+		    + strerror(errno));
+	}
+#endif /* _WIN32 */
+
+	/* Only tell readers about lines which are actually in the file. */
+	String path = GetLogDir() + "/icinga.log";
+
+	BOOST_FOREACH(const CompatLogBufferEntry& entry, m_BufferedLines) {
+		if (entry.Offset + entry.Line.GetLength() + 1 > static_cast<size_t>(m_Offset))
+			break;
 
+		CompatLogBuffer::AddLine(path, entry.Offset, entry.Line);
+	}
+
+	m_Buffer.clear();
+	m_BufferedLines.clear();
+}
+
+/**
+ * Note: Must only be called by the writer thread.
+ */
+void CompatLog::ReopenFile(bool rotate, double timestamp)
+{
 	String tempFile = GetLogDir() + "/icinga.log";
 
-	if (m_OutputFile) {
-		m_OutputFile.close();
+	if (m_Fd >= 0) {
+		Flush();
+
+		(void) close(m_Fd);
+		m_Fd = -1;
 
 		if (rotate) {
-			String archiveFile = GetLogDir() + "/archives/icinga-" + Utility::FormatDateTime("%m-%d-%Y-%H", Utility::GetTime()) + ".log";
+			String archiveFile = GetLogDir() + "/archives/icinga-" + Utility::FormatDateTime("%m-%d-%Y-%H", timestamp) + ".log";
 
 			Log(LogInformation, "compat", "Rotating compat log file '" + tempFile + "' -> '" + archiveFile + "'");
-			(void) rename(tempFile.CStr(), archiveFile.CStr());
+
+			String method = GetArchiveCompression();
+
+			if (rename(tempFile.CStr(), archiveFile.CStr()) >= 0 && method != "none" &&
+			    CompatLogArchive::IsCompressionSupported(method))
+				Utility::QueueAsyncCallback(boost::bind(&CompatLogArchive::Compress, archiveFile, method));
 		}
 	}
 
-	m_OutputFile.open(tempFile.CStr(), std::ofstream::app);
+	m_Fd = open(tempFile.CStr(), O_WRONLY | O_APPEND | O_CREAT, 0644);
 
-	if (!m_OutputFile.good()) {
+	if (m_Fd < 0) {
 		Log(LogWarning, "icinga", "Could not open compat log file '" + tempFile + "' for writing. Log output will be lost.");
 
 		return;
 	}
 
-	WriteLine("LOG ROTATION: " + GetRotationMethod());
-	WriteLine("LOG VERSION: 2.0");
+	Utility::SetCloExec(m_Fd);
+
+	off_t offset = lseek(m_Fd, 0, SEEK_END);
+	m_Offset = (offset < 0) ? 0 : offset;
+
+	CompatLogBuffer::Reset(tempFile, m_Offset);
 
-	BOOST_FOREACH(const Host::Ptr& host, DynamicType::GetObjects<Host>()) {
+	String prefix = "[" + Convert::ToString(static_cast<long>(timestamp)) + "] ";
+
+	AppendLine(prefix, "LOG ROTATION: " + GetRotationMethod());
+	AppendLine(prefix, "LOG VERSION: 2.0");
+
+	BOOST_FOREACH(const Host::Ptr& host, DynamicType::GetSnapshot<Host>()) {
 		Service::Ptr hc = host->GetHostCheckService();
 
 		if (!hc)
@@ -440,10 +664,10 @@ void CompatLog::ReopenFile(bool rotate)
 		       << hc->GetCurrentCheckAttempt() << ";"
 		       << "";
 
-		WriteLine(msgbuf.str());
+		AppendLine(prefix, msgbuf.str());
 	}
 
-	BOOST_FOREACH(const Service::Ptr& service, DynamicType::GetObjects<Service>()) {
+	BOOST_FOREACH(const Service::Ptr& service, DynamicType::GetSnapshot<Service>()) {
 		Host::Ptr host = service->GetHost();
 
 		if (!host)
@@ -458,7 +682,7 @@ void CompatLog::ReopenFile(bool rotate)
 		       << service->GetCurrentCheckAttempt() << ";"
 		       << "";
 
-		WriteLine(msgbuf.str());
+		AppendLine(prefix, msgbuf.str());
 	}
 
 	Flush();
@@ -518,13 +742,13 @@ void CompatLog::ScheduleNextRotation(void)
  */
 void CompatLog::RotationTimerHandler(void)
 {
-	try {
-		ReopenFile(true);
-	} catch (...) {
-		ScheduleNextRotation();
+	/* The writer thread rotates the file once it has written all lines
+	 * which were queued before this request. */
+	CompatLogEntry entry;
+	entry.Rotate = true;
+	entry.Timestamp = Utility::GetTime();
 
-		throw;
-	}
+	EnqueueEntry(entry);
 
 	ScheduleNextRotation();
 }
@@ -547,6 +771,10 @@ void CompatLog::InternalSerialize(const Dictionary::Ptr& bag, int attributeTypes
 	if (attributeTypes & Attribute_Config) {
 		bag->Set("log_dir", m_LogDir);
 		bag->Set("rotation_method", m_RotationMethod);
+		bag->Set("flush_interval", m_FlushInterval);
+		bag->Set("flush_size", m_FlushSize);
+		bag->Set("sync", m_Sync);
+		bag->Set("archive_compression", m_ArchiveCompression);
 	}
 }
 
@@ -557,5 +785,9 @@ void CompatLog::InternalDeserialize(const Dictionary::Ptr& bag, int attributeTyp
 	if (attributeTypes & Attribute_Config) {
 		m_LogDir = bag->Get("log_dir");
 		m_RotationMethod = bag->Get("rotation_method");
+		m_FlushInterval = bag->Get("flush_interval");
+		m_FlushSize = bag->Get("flush_size");
+		m_Sync = bag->Get("sync");
+		m_ArchiveCompression = bag->Get("archive_compression");
 	}
 }
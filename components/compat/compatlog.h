@@ -21,13 +21,30 @@
 #define COMPATLOG_H
 
 #include "icinga/service.h"
+#include "icinga/compatlogbuffer.h"
 #include "base/dynamicobject.h"
 #include "base/timer.h"
-#include <fstream>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <vector>
 
 namespace icinga
 {
 
+/**
+ * A line which is waiting to be written to the compat log, or a request to
+ * rotate the log file.
+ *
+ * @ingroup compat
+ */
+struct CompatLogEntry
+{
+	String Line;
+	bool Rotate;
+	double Timestamp; /**< When the event happened. */
+};
+
 /**
  * An Icinga compat log writer.
  *
@@ -43,11 +60,16 @@ public:
 
 	String GetLogDir(void) const;
 	String GetRotationMethod(void) const;
+	double GetFlushInterval(void) const;
+	size_t GetFlushSize(void) const;
+	bool GetSync(void) const;
+	String GetArchiveCompression(void) const;
 
 	static void ValidateRotationMethod(const String& location, const Dictionary::Ptr& attrs);
 
 protected:
 	virtual void Start(void);
+	virtual void Stop(void);
 
 	virtual void InternalSerialize(const Dictionary::Ptr& bag, int attributeTypes) const;
 	virtual void InternalDeserialize(const Dictionary::Ptr& bag, int attributeTypes);
@@ -55,10 +77,32 @@ protected:
 private:
 	String m_LogDir;
 	String m_RotationMethod;
+	Value m_FlushInterval;
+	Value m_FlushSize;
+	Value m_Sync;
+	String m_ArchiveCompression;
 
 	double m_LastRotation;
 
+	boost::mutex m_QueueMutex;
+	boost::condition_variable m_QueueCV;
+	std::vector<CompatLogEntry> m_Queue;
+	bool m_QueueStopped;
+
+	boost::thread m_WriterThread;
+
+	/* Only used by the writer thread. */
+	int m_Fd;
+	long m_Offset;
+	std::string m_Buffer;
+	double m_BufferStart;
+	std::vector<CompatLogBufferEntry> m_BufferedLines;
+
 	void WriteLine(const String& line);
+	void EnqueueEntry(const CompatLogEntry& entry);
+
+	void WriterThreadProc(void);
+	void AppendLine(const String& timestamp, const String& line);
 	void Flush(void);
 
 	void CheckResultHandler(const Service::Ptr& service, const Dictionary::Ptr& cr);
@@ -70,8 +114,7 @@ private:
 	void RotationTimerHandler(void);
 	void ScheduleNextRotation(void);
 
-	std::ofstream m_OutputFile;
-	void ReopenFile(bool rotate);
+	void ReopenFile(bool rotate, double timestamp);
 };
 
 }
@@ -36,13 +36,6 @@ void IdoMysqlDbConnection::Start(void)
 {
 	DbConnection::Start();
 
-	m_Connected = false;
-
-	m_TxTimer = boost::make_shared<Timer>();
-	m_TxTimer->SetInterval(5);
-	m_TxTimer->OnTimerExpired.connect(boost::bind(&IdoMysqlDbConnection::TxTimerHandler, this));
-	m_TxTimer->Start();
-
 	m_ReconnectTimer = boost::make_shared<Timer>();
 	m_ReconnectTimer->SetInterval(10);
 	m_ReconnectTimer->OnTimerExpired.connect(boost::bind(&IdoMysqlDbConnection::ReconnectTimerHandler, this));
@@ -53,137 +46,141 @@ void IdoMysqlDbConnection::Start(void)
 
 void IdoMysqlDbConnection::Stop(void)
 {
+	DbConnection::Stop();
+
 	boost::mutex::scoped_lock lock(m_ConnectionMutex);
 
 	if (!m_Connected)
 		return;
 
+	FlushInsertBatches();
 	Query("COMMIT");
-	mysql_close(&m_Connection);
+	Disconnect();
 }
 
-void IdoMysqlDbConnection::TxTimerHandler(void)
+/**
+ * Commits the current transaction and starts a new one. This is called
+ * by the writer thread when the transaction is due.
+ */
+void IdoMysqlDbConnection::NewTransaction(void)
 {
 	boost::mutex::scoped_lock lock(m_ConnectionMutex);
 
 	if (!m_Connected)
 		return;
 
+	FlushInsertBatches();
 	Query("COMMIT");
 	Query("BEGIN");
 }
 
 void IdoMysqlDbConnection::ReconnectTimerHandler(void)
 {
-	{
-		boost::mutex::scoped_lock lock(m_ConnectionMutex);
-
-		if (m_Connected) {
-			/* Check if we're really still connected */
-			if (mysql_ping(&m_Connection) == 0)
-				return;
-
-			mysql_close(&m_Connection);
-			m_Connected = false;
-		}
+	Enqueue(boost::bind(&IdoMysqlDbConnection::Reconnect, this));
+}
 
-		String ihost, iuser, ipasswd, idb;
-		const char *host, *user , *passwd, *db;
-		long port;
+/* caller must hold m_ConnectionMutex */
+void IdoMysqlDbConnection::Disconnect(void)
+{
+	/* Rows which weren't sent yet are lost along with the rest of the
+	 * open transaction. */
+	m_InsertBatches.clear();
 
-		ihost = m_Host;
-		iuser = m_User;
-		ipasswd = m_Password;
-		idb = m_Database;
+	ClearStatements();
+	mysql_close(&m_Connection);
+	m_Connected = false;
+}
 
-		host = (!ihost.IsEmpty()) ? ihost.CStr() : NULL;
-		port = m_Port;
-		user = (!iuser.IsEmpty()) ? iuser.CStr() : NULL;
-		passwd = (!ipasswd.IsEmpty()) ? ipasswd.CStr() : NULL;
-		db = (!idb.IsEmpty()) ? idb.CStr() : NULL;
+/**
+ * Connects to the database unless the current connection still works.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ *
+ * @returns true if a new connection was established.
+ */
+bool IdoMysqlDbConnection::Connect(void)
+{
+	if (m_Connected) {
+		/* Check if we're really still connected */
+		if (mysql_ping(&m_Connection) == 0)
+			return false;
 
-		if (!mysql_init(&m_Connection))
-			BOOST_THROW_EXCEPTION(std::bad_alloc());
+		Disconnect();
+	}
 
-		if (!mysql_real_connect(&m_Connection, host, user, passwd, db, port, NULL, 0))
-			BOOST_THROW_EXCEPTION(std::runtime_error(mysql_error(&m_Connection)));
+	String ihost, iuser, ipasswd, idb;
+	const char *host, *user , *passwd, *db;
+	long port;
 
-		m_Connected = true;
+	ihost = m_Host;
+	iuser = m_User;
+	ipasswd = m_Password;
+	idb = m_Database;
 
-		String instanceName = "default";
+	host = (!ihost.IsEmpty()) ? ihost.CStr() : NULL;
+	port = m_Port;
+	user = (!iuser.IsEmpty()) ? iuser.CStr() : NULL;
+	passwd = (!ipasswd.IsEmpty()) ? ipasswd.CStr() : NULL;
+	db = (!idb.IsEmpty()) ? idb.CStr() : NULL;
 
-		if (!m_InstanceName.IsEmpty())
-			instanceName = m_InstanceName;
+	if (!mysql_init(&m_Connection))
+		BOOST_THROW_EXCEPTION(std::bad_alloc());
 
-		Array::Ptr rows = Query("SELECT instance_id FROM " + GetTablePrefix() + "instances WHERE instance_name = '" + Escape(instanceName) + "'");
+	if (!mysql_real_connect(&m_Connection, host, user, passwd, db, port, NULL, 0))
+		BOOST_THROW_EXCEPTION(std::runtime_error(mysql_error(&m_Connection)));
 
-		if (rows->GetLength() == 0) {
-			Query("INSERT INTO " + GetTablePrefix() + "instances (instance_name, instance_description) VALUES ('" + Escape(instanceName) + "', '" + m_InstanceDescription + "')");
-			m_InstanceID = GetLastInsertID();
-		} else {
-			Dictionary::Ptr row = rows->Get(0);
-			m_InstanceID = DbReference(row->Get("instance_id"));
-		}
+	m_Connected = true;
 
-		std::ostringstream msgbuf;
-		msgbuf << "MySQL IDO instance id: " << static_cast<long>(m_InstanceID);
-		Log(LogInformation, "ido_mysql", msgbuf.str());
+	return true;
+}
 
-		ClearConfigTables();
+/* caller must hold m_ConnectionMutex */
+DbReference IdoMysqlDbConnection::LoadInstanceID(void)
+{
+	String instanceName = "default";
 
-		Query("UPDATE " + GetTablePrefix() + "objects SET is_active = 0");
+	if (!m_InstanceName.IsEmpty())
+		instanceName = m_InstanceName;
 
-		std::ostringstream q1buf;
-		q1buf << "SELECT object_id, objecttype_id, name1, name2 FROM " + GetTablePrefix() + "objects WHERE instance_id = " << static_cast<long>(m_InstanceID);
-		rows = Query(q1buf.str());
+	DbReference instanceID;
 
-		ObjectLock olock(rows);
-		BOOST_FOREACH(const Dictionary::Ptr& row, rows) {
-			DbType::Ptr dbtype = DbType::GetByID(row->Get("objecttype_id"));
+	Array::Ptr rows = Query("SELECT instance_id FROM " + GetTablePrefix() + "instances WHERE instance_name = '" + Escape(instanceName) + "'");
 
-			if (!dbtype)
-				continue;
+	if (rows->GetLength() == 0) {
+		Query("INSERT INTO " + GetTablePrefix() + "instances (instance_name, instance_description) VALUES ('" + Escape(instanceName) + "', '" + m_InstanceDescription + "')");
+		instanceID = GetLastInsertID();
+	} else {
+		Dictionary::Ptr row = rows->Get(0);
+		instanceID = DbReference(row->Get("instance_id"));
+	}
 
-			DbObject::Ptr dbobj = dbtype->GetOrCreateObjectByName(row->Get("name1"), row->Get("name2"));
-			SetObjectID(dbobj, DbReference(row->Get("object_id")));
-		}
+	std::ostringstream msgbuf;
+	msgbuf << "MySQL IDO instance id: " << static_cast<long>(instanceID);
+	Log(LogInformation, "ido_mysql", msgbuf.str());
 
-		Query("BEGIN");
-	}
+	return instanceID;
+}
 
-	UpdateAllObjects();
+/* caller must hold m_ConnectionMutex */
+bool IdoMysqlDbConnection::HasConfigHashColumn(void)
+{
+	return (Query("SHOW COLUMNS FROM " + GetTablePrefix() + "objects LIKE 'config_hash'")->GetLength() > 0);
 }
 
-void IdoMysqlDbConnection::ClearConfigTables(void)
+/* caller must hold m_ConnectionMutex */
+void IdoMysqlDbConnection::UpdateConfigHash(const DbReference& objectid, const String& hash)
 {
-	/* TODO make hardcoded table names modular */
-	ClearConfigTable("commands");
-	ClearConfigTable("contact_addresses");
-	ClearConfigTable("contact_notificationcommands");
-	ClearConfigTable("contactgroup_members");
-	ClearConfigTable("contactgroups");
-	ClearConfigTable("contacts");
-	ClearConfigTable("customvariables");
-	ClearConfigTable("host_contactgroups");
-	ClearConfigTable("host_contacts");
-	ClearConfigTable("host_parenthosts");
-	ClearConfigTable("hostdependencies");
-	ClearConfigTable("hostgroup_members");
-	ClearConfigTable("hostgroups");
-	ClearConfigTable("hosts");
-	ClearConfigTable("service_contactgroups");
-	ClearConfigTable("service_contacts");
-	ClearConfigTable("servicedependencies");
-	ClearConfigTable("servicegroup_members");
-	ClearConfigTable("servicegroups");
-	ClearConfigTable("services");
-	ClearConfigTable("timeperiod_timeranges");
-	ClearConfigTable("timeperiods");
+	std::vector<Value> params;
+	params.push_back(hash);
+	params.push_back(static_cast<long>(objectid));
+
+	ExecuteStatement("UPDATE " + GetTablePrefix() + "objects SET config_hash = ? WHERE object_id = ?", params);
 }
 
-void IdoMysqlDbConnection::ClearConfigTable(const String& table)
+/* caller must hold m_ConnectionMutex */
+void IdoMysqlDbConnection::FlushQueries(void)
 {
-	Query("DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " + Convert::ToString(static_cast<long>(m_InstanceID)));
+	FlushInsertBatches();
 }
 
 Array::Ptr IdoMysqlDbConnection::Query(const String& query)
@@ -191,7 +188,7 @@ Array::Ptr IdoMysqlDbConnection::Query(const String& query)
 	Log(LogDebug, "ido_mysql", "Query: " + query);
 
 	if (mysql_query(&m_Connection, query.CStr()) != 0)
-	    BOOST_THROW_EXCEPTION(std::runtime_error(mysql_error(&m_Connection)));
+		ThrowError(mysql_errno(&m_Connection), mysql_error(&m_Connection));
 
 	MYSQL_RES *result = mysql_store_result(&m_Connection);
 
@@ -218,23 +215,235 @@ Array::Ptr IdoMysqlDbConnection::Query(const String& query)
 	return rows;
 }
 
+/**
+ * Throws an exception for a failed statement. InnoDB rolls back the whole
+ * transaction to resolve a deadlock: In that case we start a new one and
+ * throw a DbDeadlockError so the writer thread replays the rolled back
+ * work items.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ */
+void IdoMysqlDbConnection::ThrowError(unsigned int code, const String& message)
+{
+	if (code == ER_LOCK_DEADLOCK) {
+		/* The pending rows belong to the rolled back work items. */
+		m_InsertBatches.clear();
+
+		if (mysql_query(&m_Connection, "BEGIN") != 0)
+			BOOST_THROW_EXCEPTION(std::runtime_error(mysql_error(&m_Connection)));
+
+		BOOST_THROW_EXCEPTION(DbDeadlockError(message));
+	}
+
+	BOOST_THROW_EXCEPTION(std::runtime_error(message));
+}
+
 DbReference IdoMysqlDbConnection::GetLastInsertID(void)
 {
 	return DbReference(mysql_insert_id(&m_Connection));
 }
 
+/* caller must hold m_ConnectionMutex */
 String IdoMysqlDbConnection::Escape(const String& s)
 {
-	ssize_t length = s.GetLength();
-	char *to = new char[s.GetLength() * 2 + 1];
+	size_t length = s.GetLength();
+
+	if (m_EscapeBuffer.size() < length * 2 + 1)
+		m_EscapeBuffer.resize(length * 2 + 1);
+
+	unsigned long count = mysql_real_escape_string(&m_Connection, &m_EscapeBuffer[0], s.CStr(), length);
+
+	return String(&m_EscapeBuffer[0], &m_EscapeBuffer[0] + count);
+}
+
+/* caller must hold m_ConnectionMutex */
+MYSQL_STMT *IdoMysqlDbConnection::GetStatement(const String& sql)
+{
+	std::map<String, MYSQL_STMT *>::const_iterator it = m_Statements.find(sql);
 
-	mysql_real_escape_string(&m_Connection, to, s.CStr(), length);
+	if (it != m_Statements.end())
+		return it->second;
 
-	String result = String(to);
+	Log(LogDebug, "ido_mysql", "Preparing statement: " + sql);
 
-	delete [] to;
+	MYSQL_STMT *stmt = mysql_stmt_init(&m_Connection);
 
-	return result;
+	if (!stmt)
+		BOOST_THROW_EXCEPTION(std::bad_alloc());
+
+	if (mysql_stmt_prepare(stmt, sql.CStr(), sql.GetLength()) != 0) {
+		String error = mysql_stmt_error(stmt);
+		mysql_stmt_close(stmt);
+		BOOST_THROW_EXCEPTION(std::runtime_error(error));
+	}
+
+	m_Statements[sql] = stmt;
+
+	return stmt;
+}
+
+/**
+ * Executes a prepared statement. Number parameters are bound as integers,
+ * everything else as strings.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ *
+ * @returns The insert ID for the statement.
+ */
+DbReference IdoMysqlDbConnection::ExecuteStatement(const String& sql, const std::vector<Value>& params)
+{
+	MYSQL_STMT *stmt = GetStatement(sql);
+
+	ASSERT(mysql_stmt_param_count(stmt) == params.size());
+
+	std::vector<MYSQL_BIND> binds(params.size());
+	std::vector<String> strings(params.size());
+	std::vector<long long> numbers(params.size());
+	std::vector<unsigned long> lengths(params.size());
+
+	for (std::vector<Value>::size_type i = 0; i < params.size(); i++) {
+		MYSQL_BIND& bind = binds[i];
+		memset(&bind, 0, sizeof(bind));
+
+		if (params[i].GetType() == ValueNumber) {
+			numbers[i] = static_cast<long>(params[i]);
+
+			bind.buffer_type = MYSQL_TYPE_LONGLONG;
+			bind.buffer = &numbers[i];
+		} else {
+			strings[i] = params[i];
+			lengths[i] = strings[i].GetLength();
+
+			bind.buffer_type = MYSQL_TYPE_STRING;
+			bind.buffer = const_cast<char *>(strings[i].CStr());
+			bind.buffer_length = lengths[i];
+			bind.length = &lengths[i];
+		}
+	}
+
+	if (!binds.empty() && mysql_stmt_bind_param(stmt, &binds[0]) != 0)
+		BOOST_THROW_EXCEPTION(std::runtime_error(mysql_stmt_error(stmt)));
+
+	Log(LogDebug, "ido_mysql", "Statement: " + sql);
+
+	if (mysql_stmt_execute(stmt) != 0)
+		ThrowError(mysql_stmt_errno(stmt), mysql_stmt_error(stmt));
+
+	return DbReference(mysql_stmt_insert_id(stmt));
+}
+
+/* caller must hold m_ConnectionMutex */
+void IdoMysqlDbConnection::ClearStatements(void)
+{
+	MYSQL_STMT *stmt;
+	BOOST_FOREACH(boost::tie(boost::tuples::ignore, stmt), m_Statements) {
+		mysql_stmt_close(stmt);
+	}
+
+	m_Statements.clear();
+	m_SchemaStatements.clear();
+}
+
+/**
+ * Returns the upsert statement for rows with a fixed column layout. The
+ * statement is only built and prepared once for each schema.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ */
+MYSQL_STMT *IdoMysqlDbConnection::GetSchemaStatement(const DbSchema::Ptr& schema)
+{
+	std::map<DbSchema::Ptr, MYSQL_STMT *>::const_iterator it = m_SchemaStatements.find(schema);
+
+	if (it != m_SchemaStatements.end())
+		return it->second;
+
+	String cols, values, updates;
+
+	for (size_t i = 0; i < schema->GetColumnCount(); i++) {
+		const String& column = schema->GetColumnName(i);
+
+		if (i > 0) {
+			cols += ", ";
+			values += ", ";
+			updates += ", ";
+		}
+
+		cols += column;
+		values += (schema->GetColumnType(i) == DbColumnTimestamp) ? "FROM_UNIXTIME(?)" : "?";
+		updates += column + " = VALUES(" + column + ")";
+	}
+
+	MYSQL_STMT *stmt = GetStatement("INSERT INTO " + GetTablePrefix() + schema->GetTable() +
+	    " (" + cols + ") VALUES (" + values + ") ON DUPLICATE KEY UPDATE " + updates);
+
+	m_SchemaStatements[schema] = stmt;
+
+	return stmt;
+}
+
+/**
+ * Upserts a row with a fixed column layout. The row's values are bound to
+ * the schema's statement by index, using the columns' types.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ */
+void IdoMysqlDbConnection::ExecuteRow(const DbQuery& query)
+{
+	const DbSchema::Ptr& schema = query.Schema;
+	MYSQL_STMT *stmt = GetSchemaStatement(schema);
+
+	size_t count = schema->GetColumnCount();
+
+	ASSERT(query.Row.size() == count);
+
+	std::vector<MYSQL_BIND> binds(count);
+	std::vector<double> numbers(count);
+	std::vector<String> strings(count);
+	std::vector<unsigned long> lengths(count);
+
+	for (size_t i = 0; i < count; i++) {
+		MYSQL_BIND& bind = binds[i];
+		memset(&bind, 0, sizeof(bind));
+
+		const Value& value = query.Row[i];
+		DbColumnType type = schema->GetColumnType(i);
+
+		if (type == DbColumnInstance) {
+			numbers[i] = static_cast<long>(m_InstanceID);
+		} else if (value.IsEmpty()) {
+			bind.buffer_type = MYSQL_TYPE_NULL;
+			continue;
+		} else if (type == DbColumnString) {
+			strings[i] = value;
+			lengths[i] = strings[i].GetLength();
+
+			bind.buffer_type = MYSQL_TYPE_STRING;
+			bind.buffer = const_cast<char *>(strings[i].CStr());
+			bind.buffer_length = lengths[i];
+			bind.length = &lengths[i];
+			continue;
+		} else if (type == DbColumnObject) {
+			Value id;
+
+			if (!FieldToReference(value, &id))
+				return;
+
+			numbers[i] = id;
+		} else
+			numbers[i] = value;
+
+		bind.buffer_type = MYSQL_TYPE_DOUBLE;
+		bind.buffer = &numbers[i];
+	}
+
+	if (mysql_stmt_bind_param(stmt, &binds[0]) != 0)
+		BOOST_THROW_EXCEPTION(std::runtime_error(mysql_stmt_error(stmt)));
+
+	if (mysql_stmt_execute(stmt) != 0)
+		ThrowError(mysql_stmt_errno(stmt), mysql_stmt_error(stmt));
+
+	if (query.Object && query.StatusUpdate)
+		SetStatusUpdate(query.Object, true);
 }
 
 Dictionary::Ptr IdoMysqlDbConnection::FetchRow(MYSQL_RES *result)
@@ -325,55 +534,243 @@ bool IdoMysqlDbConnection::FieldToEscapedString(const String& key, const Value&
 	Value rawvalue = DbValue::ExtractValue(value);
 
 	if (rawvalue.IsObjectType<DynamicObject>()) {
-		DbObject::Ptr dbobjcol = DbObject::GetOrCreateByObject(rawvalue);
-
-		if (!dbobjcol) {
-			*result = 0;
-			return true;
-		}
+		if (!FieldToReference(value, result))
+			return false;
+	} else if (DbValue::IsRowInsertID(value)) {
+		/* The row this refers to couldn't be inserted. */
+		if (rawvalue.IsEmpty())
+			return false;
+
+		*result = static_cast<long>(rawvalue);
+	} else if (DbValue::IsTimestamp(value)) {
+		long ts = rawvalue;
+		std::ostringstream msgbuf;
+		msgbuf << "FROM_UNIXTIME(" << ts << ")";
+		*result = Value(msgbuf.str());
+	} else if (DbValue::IsTimestampNow(value)) {
+		*result = "NOW()";
+	} else {
+		*result = "'" + Escape(rawvalue) + "'";
+	}
 
-		DbReference dbrefcol;
+	return true;
+}
 
-		if (DbValue::IsObjectInsertID(value)) {
-			dbrefcol = GetInsertID(dbobjcol);
+/* caller must hold m_ConnectionMutex */
+bool IdoMysqlDbConnection::FieldToParameter(const String& key, const Value& value, String *expr, std::vector<Value> *params)
+{
+	if (key == "instance_id") {
+		*expr = "?";
+		params->push_back(static_cast<long>(m_InstanceID));
+		return true;
+	}
 
-			ASSERT(dbrefcol.IsValid());
-		} else {
-			dbrefcol = GetObjectID(dbobjcol);
+	Value rawvalue = DbValue::ExtractValue(value);
 
-			if (!dbrefcol.IsValid()) {
-				InternalActivateObject(dbobjcol);
+	if (rawvalue.IsObjectType<DynamicObject>()) {
+		Value id;
 
-				dbrefcol = GetObjectID(dbobjcol);
+		if (!FieldToEscapedString(key, value, &id))
+			return false;
 
-				if (!dbrefcol.IsValid())
-					return false;
-			}
-		}
+		*expr = "?";
+		params->push_back(id);
+	} else if (DbValue::IsRowInsertID(value)) {
+		if (rawvalue.IsEmpty())
+			return false;
 
-		*result = static_cast<long>(dbrefcol);
+		*expr = "?";
+		params->push_back(static_cast<long>(rawvalue));
 	} else if (DbValue::IsTimestamp(value)) {
-		long ts = rawvalue;
-		std::ostringstream msgbuf;
-		msgbuf << "FROM_UNIXTIME(" << ts << ")";
-		*result = Value(msgbuf.str());
+		*expr = "FROM_UNIXTIME(?)";
+		params->push_back(static_cast<long>(rawvalue));
 	} else if (DbValue::IsTimestampNow(value)) {
-		*result = "NOW()";
+		*expr = "NOW()";
 	} else {
-		*result = "'" + Escape(rawvalue) + "'";
+		*expr = "?";
+		params->push_back(static_cast<String>(rawvalue));
 	}
 
 	return true;
 }
 
+/**
+ * Returns the columns and values for a query, in column order.
+ */
+void IdoMysqlDbConnection::GetQueryFields(const DbQuery& query, std::vector<std::pair<String, Value> > *fields)
+{
+	ObjectLock olock(query.Fields);
+
+	String key;
+	Value value;
+	BOOST_FOREACH(boost::tie(key, value), query.Fields) {
+		fields->push_back(std::make_pair(key, value));
+	}
+}
+
+/**
+ * Adds a row to the pending multi-row INSERT for its table. Rows for
+ * different tables are collected in separate batches, so interleaved
+ * history rows don't split each other's batches. A batch is sent when it
+ * is full and all batches are sent before any other statement is executed.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ *
+ * @param query The query.
+ * @param upsert Whether to update the row if it already exists.
+ */
+void IdoMysqlDbConnection::AddInsertToBatch(const DbQuery& query, bool upsert)
+{
+	String cols;
+	String values;
+	String updates;
+
+	{
+		std::vector<std::pair<String, Value> > fields;
+		GetQueryFields(query, &fields);
+
+		String key;
+		Value value;
+		bool first = true;
+		BOOST_FOREACH(boost::tie(key, value), fields) {
+			if (!FieldToEscapedString(key, value, &value))
+				return;
+
+			if (!first) {
+				cols += ", ";
+				values += ", ";
+				updates += ", ";
+			}
+
+			cols += key;
+			values += Convert::ToString(value);
+			updates += key + " = VALUES(" + key + ")";
+
+			if (first)
+				first = false;
+		}
+	}
+
+	if (!upsert)
+		updates = String();
+
+	InsertBatch& batch = m_InsertBatches[query.Table + "\n" + cols + "\n" + updates];
+
+	if (batch.Rows.empty()) {
+		batch.Table = query.Table;
+		batch.Columns = cols;
+		batch.Updates = updates;
+	}
+
+	batch.Rows.push_back("(" + values + ")");
+
+	if (batch.Rows.size() >= 250)
+		FlushInsertBatch(batch);
+}
+
+/* caller must hold m_ConnectionMutex */
+void IdoMysqlDbConnection::FlushInsertBatches(void)
+{
+	if (m_InsertBatches.empty())
+		return;
+
+	std::map<String, InsertBatch> batches;
+	batches.swap(m_InsertBatches);
+
+	for (std::map<String, InsertBatch>::iterator it = batches.begin(); it != batches.end(); it++)
+		FlushInsertBatch(it->second);
+}
+
+/* caller must hold m_ConnectionMutex */
+void IdoMysqlDbConnection::FlushInsertBatch(InsertBatch& batch)
+{
+	if (batch.Rows.empty())
+		return;
+
+	std::vector<String> rows;
+	rows.swap(batch.Rows);
+
+	String prefix = "INSERT INTO " + GetTablePrefix() + batch.Table + " (" + batch.Columns + ") VALUES ";
+	String suffix;
+
+	if (!batch.Updates.IsEmpty())
+		suffix = " ON DUPLICATE KEY UPDATE " + batch.Updates;
+
+	if (rows.size() == 1) {
+		Query(prefix + rows[0] + suffix);
+		return;
+	}
+
+	std::ostringstream qbuf;
+	qbuf << prefix;
+
+	bool first = true;
+	BOOST_FOREACH(const String& row, rows) {
+		if (!first)
+			qbuf << ", ";
+
+		qbuf << row;
+
+		if (first)
+			first = false;
+	}
+
+	qbuf << suffix;
+
+	try {
+		Query(qbuf.str());
+	} catch (const DbDeadlockError&) {
+		throw;
+	} catch (const std::exception&) {
+		/* Don't lose the whole batch because of a single bad row
+		 * (e.g. one which violates a unique key). */
+		BOOST_FOREACH(const String& row, rows) {
+			try {
+				Query(prefix + row + suffix);
+			} catch (const DbDeadlockError&) {
+				throw;
+			} catch (const std::exception& ex) {
+				Log(LogWarning, "ido_mysql", "Could not insert row into table '" + batch.Table + "': " + ex.what());
+			}
+		}
+	}
+}
+
 void IdoMysqlDbConnection::ExecuteQuery(const DbQuery& query)
 {
 	boost::mutex::scoped_lock lock(m_ConnectionMutex);
 
+	/* Don't leave an ID from a rolled back attempt behind if the row
+	 * can't be inserted this time. */
+	if (query.InsertID)
+		query.InsertID->SetValue(Empty);
+
 	if (!m_Connected)
 		return;
 
+	/* Nobody needs the insert ID for these rows, so they can be sent
+	 * as part of a multi-row INSERT. */
+	if (query.Type == DbQueryInsert && !query.Object && !query.InsertID) {
+		AddInsertToBatch(query, false);
+		return;
+	}
+
+	/* Rows without an object (e.g. programstatus) are upserted using the
+	 * table's unique key. */
+	if (query.Type == (DbQueryInsert | DbQueryUpdate) && !query.Object) {
+		AddInsertToBatch(query, true);
+		return;
+	}
+
+	FlushInsertBatches();
+
+	if (query.Schema) {
+		ExecuteRow(query);
+		return;
+	}
+
 	std::ostringstream qbuf, where;
+	std::vector<Value> params, whereParams;
 	int type;
 
 	if (query.WhereCriteria) {
@@ -383,15 +780,16 @@ void IdoMysqlDbConnection::ExecuteQuery(const DbQuery& query)
 
 		String key;
 		Value value;
+		String expr;
 		bool first = true;
 		BOOST_FOREACH(boost::tie(key, value), query.WhereCriteria) {
-			if (!FieldToEscapedString(key, value, &value))
+			if (!FieldToParameter(key, value, &expr, &whereParams))
 				return;
 
 			if (!first)
 				where << " AND ";
 
-			where << key << " = " << value;
+			where << key << " = " << expr;
 
 			if (first)
 				first = false;
@@ -410,19 +808,18 @@ void IdoMysqlDbConnection::ExecuteQuery(const DbQuery& query)
 		else
 			ASSERT(!"Invalid query flags.");
 
+		/* We don't know whether the row exists yet: let the unique key
+		 * on the table decide whether to insert or update it. */
 		if (hasid)
 			type = DbQueryUpdate;
-		else {
-			if (query.WhereCriteria)
-				Query("DELETE FROM " + GetTablePrefix() + query.Table + where.str());
-
-			type = DbQueryInsert;
-		}
+		else
+			type = DbQueryInsert | DbQueryUpdate;
 	} else
 		type = query.Type;
 
 	switch (type) {
 		case DbQueryInsert:
+		case DbQueryInsert | DbQueryUpdate:
 			qbuf << "INSERT INTO " << GetTablePrefix() << query.Table;
 			break;
 		case DbQueryUpdate:
@@ -435,46 +832,63 @@ void IdoMysqlDbConnection::ExecuteQuery(const DbQuery& query)
 			ASSERT(!"Invalid query type.");
 	}
 
-	if (type == DbQueryInsert || type == DbQueryUpdate) {
+	if (type & (DbQueryInsert | DbQueryUpdate)) {
 		String cols;
 		String values;
+		String updates;
 
-		ObjectLock olock(query.Fields);
+		std::vector<std::pair<String, Value> > fields;
+		GetQueryFields(query, &fields);
 
 		String key;
 		Value value;
+		String expr;
 		bool first = true;
-		BOOST_FOREACH(boost::tie(key, value), query.Fields) {
-			if (!FieldToEscapedString(key, value, &value))
+		BOOST_FOREACH(boost::tie(key, value), fields) {
+			if (!FieldToParameter(key, value, &expr, &params))
 				return;
 
-			if (type == DbQueryInsert) {
+			if (type & DbQueryInsert) {
 				if (!first) {
 					cols += ", ";
 					values += ", ";
+					updates += ", ";
 				}
 
 				cols += key;
-				values += Convert::ToString(value);
+				values += expr;
+				updates += key + " = VALUES(" + key + ")";
 			} else {
 				if (!first)
-					qbuf << ", ";
+					qbuf << ",";
 
-				qbuf << " " << key << " = " << value;
+				qbuf << " " << key << " = " << expr;
 			}
 
 			if (first)
 				first = false;
 		}
 
-		if (type == DbQueryInsert)
+		if (type & DbQueryInsert)
 			qbuf << " (" << cols << ") VALUES (" << values << ")";
+
+		if (type == (DbQueryInsert | DbQueryUpdate)) {
+			qbuf << " ON DUPLICATE KEY UPDATE " << updates;
+
+			/* Make sure we get the row's ID even if it was updated. */
+			if (query.ConfigUpdate) {
+				String idColumn = query.Object->GetType()->GetTable() + "_id";
+				qbuf << ", " << idColumn << " = LAST_INSERT_ID(" << idColumn << ")";
+			}
+		}
 	}
 
-	if (type != DbQueryInsert)
+	if (!(type & DbQueryInsert)) {
 		qbuf << where.str();
+		params.insert(params.end(), whereParams.begin(), whereParams.end());
+	}
 
-	Query(qbuf.str());
+	DbReference insertId = ExecuteStatement(qbuf.str(), params);
 
 	if (query.Object) {
 		if (query.ConfigUpdate)
@@ -482,9 +896,32 @@ void IdoMysqlDbConnection::ExecuteQuery(const DbQuery& query)
 		else if (query.StatusUpdate)
 			SetStatusUpdate(query.Object, true);
 
-		if (type == DbQueryInsert && query.ConfigUpdate)
-			SetInsertID(query.Object, GetLastInsertID());
+		if ((type & DbQueryInsert) && query.ConfigUpdate)
+			SetInsertID(query.Object, insertId);
 	}
+
+	if (query.InsertID && (type & DbQueryInsert))
+		query.InsertID->SetValue(static_cast<long>(insertId));
+}
+
+/**
+ * Deletes one chunk of expired rows from a history table.
+ */
+long IdoMysqlDbConnection::CleanUpExecuteQuery(const String& table, const String& timeColumn, double maxTime, long limit)
+{
+	boost::mutex::scoped_lock lock(m_ConnectionMutex);
+
+	if (!m_Connected)
+		return 0;
+
+	FlushInsertBatches();
+
+	std::ostringstream qbuf;
+	qbuf << "DELETE FROM " << GetTablePrefix() << table << " WHERE instance_id = " << static_cast<long>(m_InstanceID)
+	     << " AND " << timeColumn << " < FROM_UNIXTIME(" << static_cast<long>(maxTime) << ") LIMIT " << limit;
+	Query(qbuf.str());
+
+	return mysql_affected_rows(&m_Connection);
 }
 
 void IdoMysqlDbConnection::InternalSerialize(const Dictionary::Ptr& bag, int attributeTypes) const
@@ -25,6 +25,7 @@
 #include "base/timer.h"
 #include "ido/dbconnection.h"
 #include <mysql/mysql.h>
+#include <mysql/mysqld_error.h>
 
 namespace icinga
 {
@@ -51,8 +52,30 @@ protected:
 	virtual void ActivateObject(const DbObject::Ptr& dbobj);
 	virtual void DeactivateObject(const DbObject::Ptr& dbobj);
 	virtual void ExecuteQuery(const DbQuery& query);
+	virtual long CleanUpExecuteQuery(const String& table, const String& timeColumn, double maxTime, long limit);
+	virtual void NewTransaction(void);
+
+	virtual bool Connect(void);
+	virtual void Disconnect(void);
+	virtual DbReference LoadInstanceID(void);
+	virtual bool HasConfigHashColumn(void);
+	virtual Array::Ptr Query(const String& query);
+	virtual void UpdateConfigHash(const DbReference& objectid, const String& hash);
+	virtual void FlushQueries(void);
+	virtual void InternalActivateObject(const DbObject::Ptr& dbobj);
 
 private:
+	/**
+	 * Rows for a multi-row INSERT.
+	 */
+	struct InsertBatch
+	{
+		String Table;
+		String Columns;
+		String Updates;
+		std::vector<String> Rows;
+	};
+
 	String m_Host;
 	Value m_Port;
 	String m_User;
@@ -61,28 +84,38 @@ private:
 	String m_InstanceName;
 	String m_InstanceDescription;
 
-	DbReference m_InstanceID;
-
-	boost::mutex m_ConnectionMutex;
-	bool m_Connected;
 	MYSQL m_Connection;
 
 	Timer::Ptr m_ReconnectTimer;
-	Timer::Ptr m_TxTimer;
 
-	Array::Ptr Query(const String& query);
+	std::map<String, MYSQL_STMT *> m_Statements;
+	std::map<DbSchema::Ptr, MYSQL_STMT *> m_SchemaStatements;
+
+	std::map<String, InsertBatch> m_InsertBatches;
+
+	std::vector<char> m_EscapeBuffer;
+
+	void ThrowError(unsigned int code, const String& message);
 	DbReference GetLastInsertID(void);
 	String Escape(const String& s);
 	Dictionary::Ptr FetchRow(MYSQL_RES *result);
 
 	bool FieldToEscapedString(const String& key, const Value& value, Value *result);
-	void InternalActivateObject(const DbObject::Ptr& dbobj);
+	bool FieldToParameter(const String& key, const Value& value, String *expr, std::vector<Value> *params);
 
-	void TxTimerHandler(void);
-	void ReconnectTimerHandler(void);
+	MYSQL_STMT *GetStatement(const String& sql);
+	DbReference ExecuteStatement(const String& sql, const std::vector<Value>& params);
+	void ClearStatements(void);
+
+	MYSQL_STMT *GetSchemaStatement(const DbSchema::Ptr& schema);
+	void ExecuteRow(const DbQuery& query);
 
-	void ClearConfigTables(void);
-	void ClearConfigTable(const String& table);
+	static void GetQueryFields(const DbQuery& query, std::vector<std::pair<String, Value> > *fields);
+	void AddInsertToBatch(const DbQuery& query, bool upsert);
+	void FlushInsertBatch(InsertBatch& batch);
+	void FlushInsertBatches(void);
+
+	void ReconnectTimerHandler(void);
 };
 
 }
@@ -0,0 +1,14 @@
+-- --------------------------------------------------------
+-- Adds the 'config_hash' column to the IDOUtils 'objects' table.
+--
+-- IdoMysqlDbConnection stores a checksum of each object's config rows in
+-- this column and only rewrites the config tables for objects whose
+-- checksum has changed when it (re-)connects to the database. Without the
+-- column all config tables are rewritten.
+--
+-- Change the table prefix if you're not using the default 'icinga_'.
+--
+-- Usage: mysql -u root -p icinga < config_hash.sql
+-- --------------------------------------------------------
+
+ALTER TABLE icinga_objects ADD COLUMN config_hash VARCHAR(64) DEFAULT NULL;
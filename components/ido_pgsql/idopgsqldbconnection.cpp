@@ -0,0 +1,1151 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "base/logger_fwd.h"
+#include "base/objectlock.h"
+#include "base/convert.h"
+#include "base/utility.h"
+#include "ido/dbtype.h"
+#include "ido/dbvalue.h"
+#include "ido_pgsql/idopgsqldbconnection.h"
+#include <boost/tuple/tuple.hpp>
+#include <boost/smart_ptr/make_shared.hpp>
+#include <boost/foreach.hpp>
+
+using namespace icinga;
+
+REGISTER_TYPE(IdoPgsqlDbConnection);
+
+void IdoPgsqlDbConnection::Start(void)
+{
+	DbConnection::Start();
+
+	m_Connection = NULL;
+	m_PipelineLength = 0;
+	m_Savepoint = false;
+
+	m_ReconnectTimer = boost::make_shared<Timer>();
+	m_ReconnectTimer->SetInterval(10);
+	m_ReconnectTimer->OnTimerExpired.connect(boost::bind(&IdoPgsqlDbConnection::ReconnectTimerHandler, this));
+	m_ReconnectTimer->Start();
+
+	ASSERT(PQisthreadsafe());
+}
+
+void IdoPgsqlDbConnection::Stop(void)
+{
+	DbConnection::Stop();
+
+	boost::mutex::scoped_lock lock(m_ConnectionMutex);
+
+	if (!m_Connected)
+		return;
+
+	FlushCopy();
+	Query("COMMIT");
+	Disconnect();
+}
+
+/**
+ * Commits the current transaction and starts a new one. This is called
+ * by the writer thread when the transaction is due.
+ */
+void IdoPgsqlDbConnection::NewTransaction(void)
+{
+	boost::mutex::scoped_lock lock(m_ConnectionMutex);
+
+	if (!m_Connected)
+		return;
+
+	FlushCopy();
+	Query("COMMIT");
+	Query("BEGIN");
+
+	m_Savepoint = false;
+}
+
+/**
+ * Sets a savepoint before an isolated work item is executed. Any error
+ * aborts the whole transaction in PostgreSQL, so this is how the writer
+ * thread keeps the other work items of a replayed transaction.
+ */
+void IdoPgsqlDbConnection::SetSavepoint(void)
+{
+	boost::mutex::scoped_lock lock(m_ConnectionMutex);
+
+	if (!m_Connected)
+		return;
+
+	/* Rows from earlier work items must not be part of the savepoint. */
+	FlushCopy();
+	Query("SAVEPOINT ido_work_item");
+
+	m_Savepoint = true;
+}
+
+void IdoPgsqlDbConnection::ReleaseSavepoint(void)
+{
+	boost::mutex::scoped_lock lock(m_ConnectionMutex);
+
+	if (!m_Connected || !m_Savepoint)
+		return;
+
+	/* Errors have to show up before the savepoint is released. */
+	FlushCopy();
+	Query("RELEASE SAVEPOINT ido_work_item");
+
+	m_Savepoint = false;
+}
+
+void IdoPgsqlDbConnection::RollbackSavepoint(void)
+{
+	boost::mutex::scoped_lock lock(m_ConnectionMutex);
+
+	if (!m_Connected || !m_Savepoint)
+		return;
+
+	/* The pending rows belong to the failed work item. */
+	m_CopyBatches.clear();
+
+	try {
+		FlushPipeline();
+	} catch (const DbDeadlockError&) {
+		throw;
+	} catch (const std::exception&) {
+		/* The statements are rolled back below. */
+	}
+
+	Query("ROLLBACK TO SAVEPOINT ido_work_item");
+	Query("RELEASE SAVEPOINT ido_work_item");
+
+	m_Savepoint = false;
+}
+
+void IdoPgsqlDbConnection::ReconnectTimerHandler(void)
+{
+	Enqueue(boost::bind(&IdoPgsqlDbConnection::Reconnect, this));
+}
+
+/* caller must hold m_ConnectionMutex */
+void IdoPgsqlDbConnection::Disconnect(void)
+{
+	PQfinish(m_Connection);
+	m_Connection = NULL;
+	m_Connected = false;
+	m_Savepoint = false;
+
+	/* Prepared statements and pending rows don't survive the session. */
+	m_Statements.clear();
+	m_SchemaStatements.clear();
+	m_PipelineLength = 0;
+	m_CopyBatches.clear();
+}
+
+/**
+ * Connects to the database unless the current connection still works.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ *
+ * @returns true if a new connection was established.
+ */
+bool IdoPgsqlDbConnection::Connect(void)
+{
+	if (m_Connected) {
+		/* Check if we're really still connected */
+		if (PQstatus(m_Connection) == CONNECTION_OK) {
+			try {
+				Query("SELECT 1");
+				return false;
+			} catch (const std::exception&) {
+				/* reconnect below */
+			}
+		}
+
+		Disconnect();
+	}
+
+	String port;
+
+	if (!m_Port.IsEmpty())
+		port = Convert::ToString(m_Port);
+
+	/* Empty values are ignored by libpq, i.e. its defaults are used. */
+	const char *keywords[] = { "host", "port", "user", "password", "dbname", NULL };
+	const char *values[] = { m_Host.CStr(), port.CStr(), m_User.CStr(), m_Password.CStr(), m_Database.CStr(), NULL };
+
+	m_Connection = PQconnectdbParams(keywords, values, 0);
+
+	if (!m_Connection)
+		BOOST_THROW_EXCEPTION(std::bad_alloc());
+
+	if (PQstatus(m_Connection) != CONNECTION_OK) {
+		String error = PQerrorMessage(m_Connection);
+		PQfinish(m_Connection);
+		m_Connection = NULL;
+		BOOST_THROW_EXCEPTION(std::runtime_error(error));
+	}
+
+	m_Connected = true;
+
+	return true;
+}
+
+/* caller must hold m_ConnectionMutex */
+DbReference IdoPgsqlDbConnection::LoadInstanceID(void)
+{
+	String instanceName = "default";
+
+	if (!m_InstanceName.IsEmpty())
+		instanceName = m_InstanceName;
+
+	std::vector<Value> params;
+	params.push_back(instanceName);
+
+	Array::Ptr rows = QueryStatement("SELECT instance_id FROM " + GetTablePrefix() + "instances WHERE instance_name = $1", params);
+
+	if (rows->GetLength() == 0) {
+		params.push_back(m_InstanceDescription);
+		rows = QueryStatement("INSERT INTO " + GetTablePrefix() + "instances (instance_name, instance_description) VALUES ($1, $2) RETURNING instance_id", params);
+	}
+
+	Dictionary::Ptr row = rows->Get(0);
+	DbReference instanceID = DbReference(row->Get("instance_id"));
+
+	std::ostringstream msgbuf;
+	msgbuf << "PostgreSQL IDO instance id: " << static_cast<long>(instanceID);
+	Log(LogInformation, "ido_pgsql", msgbuf.str());
+
+	return instanceID;
+}
+
+/* caller must hold m_ConnectionMutex */
+bool IdoPgsqlDbConnection::HasConfigHashColumn(void)
+{
+	std::vector<Value> params;
+	params.push_back(GetTablePrefix() + "objects");
+
+	return (QueryStatement("SELECT column_name FROM information_schema.columns WHERE table_name = $1 AND column_name = 'config_hash'", params)->GetLength() > 0);
+}
+
+/* caller must hold m_ConnectionMutex */
+void IdoPgsqlDbConnection::UpdateConfigHash(const DbReference& objectid, const String& hash)
+{
+	std::vector<Value> params;
+	params.push_back(hash);
+	params.push_back(static_cast<long>(objectid));
+
+	ExecuteStatement("UPDATE " + GetTablePrefix() + "objects SET config_hash = $1 WHERE object_id = $2", params);
+}
+
+/* caller must hold m_ConnectionMutex */
+void IdoPgsqlDbConnection::FlushQueries(void)
+{
+	FlushCopy();
+	FlushPipeline();
+}
+
+/* caller must hold m_ConnectionMutex */
+Array::Ptr IdoPgsqlDbConnection::Query(const String& query)
+{
+	FlushPipeline();
+
+	Log(LogDebug, "ido_pgsql", "Query: " + query);
+
+	return FetchRows(PQexec(m_Connection, query.CStr()));
+}
+
+/**
+ * Converts the result of a synchronous query into an array of rows and
+ * frees it.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ *
+ * @returns The rows, or an empty pointer if the command didn't return any.
+ */
+Array::Ptr IdoPgsqlDbConnection::FetchRows(PGresult *result)
+{
+	if (!result)
+		BOOST_THROW_EXCEPTION(std::runtime_error(PQerrorMessage(m_Connection)));
+
+	ExecStatusType status = PQresultStatus(result);
+
+	if (status == PGRES_COMMAND_OK) {
+		PQclear(result);
+		return Array::Ptr();
+	}
+
+	if (status != PGRES_TUPLES_OK) {
+		String error = PQresultErrorMessage(result);
+		String sqlState = GetSQLState(result);
+		PQclear(result);
+
+		CheckTransaction(sqlState, error);
+
+		BOOST_THROW_EXCEPTION(std::runtime_error(error));
+	}
+
+	Array::Ptr rows = boost::make_shared<Array>();
+
+	int columns = PQnfields(result);
+
+	for (int i = 0; i < PQntuples(result); i++) {
+		Dictionary::Ptr row = boost::make_shared<Dictionary>();
+
+		for (int k = 0; k < columns; k++) {
+			Value value;
+
+			if (!PQgetisnull(result, i, k)) {
+				const char *data = PQgetvalue(result, i, k);
+				value = String(data, data + PQgetlength(result, i, k));
+			}
+
+			row->Set(PQfname(result, k), value);
+		}
+
+		rows->Add(row);
+	}
+
+	PQclear(result);
+
+	return rows;
+}
+
+/**
+ * Returns the SQLSTATE error code for a result.
+ */
+String IdoPgsqlDbConnection::GetSQLState(const PGresult *result)
+{
+	const char *sqlState = PQresultErrorField(result, PG_DIAG_SQLSTATE);
+
+	if (!sqlState)
+		return String();
+
+	return sqlState;
+}
+
+/**
+ * Any error aborts the current transaction in PostgreSQL: All statements
+ * up to the next ROLLBACK would fail. Roll back and start over so that
+ * later updates aren't lost as well.
+ *
+ * Deadlocks and serialization failures are transient: In that case a
+ * DbDeadlockError is thrown so the writer thread replays the rolled back
+ * work items. For other errors a DbRollbackError is thrown and the writer
+ * thread replays the work items one by one, each in its own savepoint, so
+ * that only the failing work item is lost. While a savepoint is set the
+ * writer thread rolls back to it by itself.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ */
+void IdoPgsqlDbConnection::CheckTransaction(const String& sqlState, const String& error)
+{
+	/* deadlock_detected, serialization_failure */
+	bool deadlock = (sqlState == "40P01" || sqlState == "40001");
+
+	PGTransactionStatusType status = PQtransactionStatus(m_Connection);
+
+	if (deadlock) {
+		if (status == PQTRANS_INERROR) {
+			PQclear(PQexec(m_Connection, "ROLLBACK"));
+			PQclear(PQexec(m_Connection, "BEGIN"));
+		} else if (status == PQTRANS_IDLE) {
+			/* COMMIT failed and has already ended the transaction. */
+			PQclear(PQexec(m_Connection, "BEGIN"));
+		}
+
+		/* The pending rows belong to the rolled back work items. */
+		m_CopyBatches.clear();
+		m_Savepoint = false;
+
+		BOOST_THROW_EXCEPTION(DbDeadlockError(error));
+	}
+
+	if (status != PQTRANS_INERROR || m_Savepoint)
+		return;
+
+	PQclear(PQexec(m_Connection, "ROLLBACK"));
+	PQclear(PQexec(m_Connection, "BEGIN"));
+
+	m_CopyBatches.clear();
+
+	BOOST_THROW_EXCEPTION(DbRollbackError(error));
+}
+
+/**
+ * Returns the name of the prepared statement for the specified SQL text,
+ * preparing it if necessary.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ */
+String IdoPgsqlDbConnection::GetStatement(const String& sql)
+{
+	std::map<String, String>::const_iterator it = m_Statements.find(sql);
+
+	if (it != m_Statements.end())
+		return it->second;
+
+	/* Statements are prepared synchronously. This happens only once for
+	 * each statement and keeps errors out of the pipeline. */
+	FlushPipeline();
+
+	String name = "stmt" + Convert::ToString(static_cast<long>(m_Statements.size() + 1));
+
+	Log(LogDebug, "ido_pgsql", "Preparing statement '" + name + "': " + sql);
+
+	FetchRows(PQprepare(m_Connection, name.CStr(), sql.CStr(), 0, NULL));
+
+	m_Statements[sql] = name;
+
+	return name;
+}
+
+/**
+ * Converts statement parameters to their text representation. Empty values
+ * are sent as NULL.
+ */
+void IdoPgsqlDbConnection::GetParameterValues(const std::vector<Value>& params,
+    std::vector<String> *strings, std::vector<const char *> *values)
+{
+	strings->resize(params.size());
+	values->resize(params.size());
+
+	for (std::vector<Value>::size_type i = 0; i < params.size(); i++) {
+		if (params[i].IsEmpty()) {
+			(*values)[i] = NULL;
+			continue;
+		}
+
+		(*strings)[i] = params[i];
+		(*values)[i] = (*strings)[i].CStr();
+	}
+}
+
+/**
+ * Executes a prepared statement and returns its rows.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ */
+Array::Ptr IdoPgsqlDbConnection::QueryStatement(const String& sql, const std::vector<Value>& params)
+{
+	String name = GetStatement(sql);
+
+	FlushPipeline();
+
+	std::vector<String> strings;
+	std::vector<const char *> values;
+	GetParameterValues(params, &strings, &values);
+
+	Log(LogDebug, "ido_pgsql", "Statement: " + sql);
+
+	return FetchRows(PQexecPrepared(m_Connection, name.CStr(), values.size(),
+	    values.empty() ? NULL : &values[0], NULL, NULL, 0));
+}
+
+/**
+ * Executes a prepared statement whose result isn't needed. The statement
+ * is queued in the connection's pipeline and its result is only checked
+ * when the pipeline is synchronized, i.e. we don't wait for a round trip
+ * for every statement.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ */
+void IdoPgsqlDbConnection::ExecuteStatement(const String& sql, const std::vector<Value>& params)
+{
+	String name = GetStatement(sql);
+
+	std::vector<String> strings;
+	std::vector<const char *> values;
+	GetParameterValues(params, &strings, &values);
+
+	Log(LogDebug, "ido_pgsql", "Statement: " + sql);
+
+	SendPrepared(name, values);
+}
+
+/**
+ * Sends a prepared statement through the pipeline (or executes it right
+ * away if libpq doesn't support pipelining).
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ */
+void IdoPgsqlDbConnection::SendPrepared(const String& name, const std::vector<const char *>& values)
+{
+#ifdef LIBPQ_HAS_PIPELINING
+	if (PQpipelineStatus(m_Connection) == PQ_PIPELINE_OFF && PQenterPipelineMode(m_Connection) != 1)
+		BOOST_THROW_EXCEPTION(std::runtime_error(PQerrorMessage(m_Connection)));
+
+	if (PQsendQueryPrepared(m_Connection, name.CStr(), values.size(),
+	    values.empty() ? NULL : &values[0], NULL, NULL, 0) != 1)
+		BOOST_THROW_EXCEPTION(std::runtime_error(PQerrorMessage(m_Connection)));
+
+	m_PipelineLength++;
+
+	/* The results are only read when the pipeline is synchronized. Don't
+	 * let them pile up: the server stops reading our statements when we
+	 * don't read its results. */
+	if (m_PipelineLength >= 256)
+		FlushPipeline();
+#else /* LIBPQ_HAS_PIPELINING */
+	FetchRows(PQexecPrepared(m_Connection, name.CStr(), values.size(),
+	    values.empty() ? NULL : &values[0], NULL, NULL, 0));
+#endif /* LIBPQ_HAS_PIPELINING */
+}
+
+/**
+ * Waits for the results of all pipelined statements and leaves pipeline
+ * mode so that synchronous queries can be sent.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ */
+void IdoPgsqlDbConnection::FlushPipeline(void)
+{
+#ifdef LIBPQ_HAS_PIPELINING
+	if (PQpipelineStatus(m_Connection) == PQ_PIPELINE_OFF)
+		return;
+
+	int count = m_PipelineLength;
+	m_PipelineLength = 0;
+
+	if (PQpipelineSync(m_Connection) != 1)
+		BOOST_THROW_EXCEPTION(std::runtime_error(PQerrorMessage(m_Connection)));
+
+	int failed = 0;
+	String error, sqlState;
+
+	for (;;) {
+		PGresult *result = PQgetResult(m_Connection);
+
+		/* NULL terminates the results for each statement. */
+		if (!result) {
+			if (PQstatus(m_Connection) != CONNECTION_OK)
+				BOOST_THROW_EXCEPTION(std::runtime_error(PQerrorMessage(m_Connection)));
+
+			continue;
+		}
+
+		ExecStatusType status = PQresultStatus(result);
+
+		if (status == PGRES_PIPELINE_SYNC) {
+			PQclear(result);
+			break;
+		}
+
+		if (status == PGRES_FATAL_ERROR) {
+			error = PQresultErrorMessage(result);
+			sqlState = GetSQLState(result);
+			failed++;
+		} else if (status == PGRES_PIPELINE_ABORTED)
+			failed++;
+
+		PQclear(result);
+	}
+
+	if (PQexitPipelineMode(m_Connection) != 1)
+		BOOST_THROW_EXCEPTION(std::runtime_error(PQerrorMessage(m_Connection)));
+
+	if (failed > 0) {
+		std::ostringstream msgbuf;
+		msgbuf << failed << " of " << count << " pipelined statements failed: " << error;
+		Log(LogWarning, "ido_pgsql", msgbuf.str());
+
+		CheckTransaction(sqlState, error);
+	}
+#endif /* LIBPQ_HAS_PIPELINING */
+}
+
+void IdoPgsqlDbConnection::ActivateObject(const DbObject::Ptr& dbobj)
+{
+	boost::mutex::scoped_lock lock(m_ConnectionMutex);
+	InternalActivateObject(dbobj);
+}
+
+void IdoPgsqlDbConnection::InternalActivateObject(const DbObject::Ptr& dbobj)
+{
+	if (!m_Connected)
+		return;
+
+	DbReference dbref = GetObjectID(dbobj);
+	std::vector<Value> params;
+
+	if (!dbref.IsValid()) {
+		params.push_back(static_cast<long>(m_InstanceID));
+		params.push_back(dbobj->GetType()->GetTypeID());
+		params.push_back(dbobj->GetName1());
+		params.push_back(dbobj->GetName2());
+
+		Array::Ptr rows = QueryStatement("INSERT INTO " + GetTablePrefix() + "objects (instance_id, objecttype_id, name1, name2, is_active)"
+		    " VALUES ($1, $2, $3, $4, 1) RETURNING object_id", params);
+
+		Dictionary::Ptr row = rows->Get(0);
+		SetObjectID(dbobj, DbReference(row->Get("object_id")));
+	} else {
+		params.push_back(static_cast<long>(dbref));
+		ExecuteStatement("UPDATE " + GetTablePrefix() + "objects SET is_active = 1 WHERE object_id = $1", params);
+	}
+}
+
+void IdoPgsqlDbConnection::DeactivateObject(const DbObject::Ptr& dbobj)
+{
+	boost::mutex::scoped_lock lock(m_ConnectionMutex);
+
+	if (!m_Connected)
+		return;
+
+	DbReference dbref = GetObjectID(dbobj);
+
+	if (!dbref.IsValid())
+		return;
+
+	std::vector<Value> params;
+	params.push_back(static_cast<long>(dbref));
+	ExecuteStatement("UPDATE " + GetTablePrefix() + "objects SET is_active = 0 WHERE object_id = $1", params);
+
+	/* Note that we're _NOT_ clearing the db refs via SetReference/SetConfigUpdate/SetStatusUpdate
+	 * because the object is still in the database. */
+}
+
+/* caller must hold m_ConnectionMutex */
+bool IdoPgsqlDbConnection::FieldToParameter(const String& key, const Value& value, String *expr, std::vector<Value> *params)
+{
+	Value rawvalue = DbValue::ExtractValue(value);
+	Value param;
+
+	if (key == "instance_id") {
+		param = static_cast<long>(m_InstanceID);
+	} else if (rawvalue.IsObjectType<DynamicObject>()) {
+		if (!FieldToReference(value, &param))
+			return false;
+	} else if (DbValue::IsTimestampNow(value)) {
+		*expr = "NOW()";
+		return true;
+	} else if (DbValue::IsRowInsertID(value) && rawvalue.IsEmpty()) {
+		/* The row this refers to couldn't be inserted. */
+		return false;
+	} else
+		param = rawvalue;
+
+	params->push_back(param);
+
+	String placeholder = "$" + Convert::ToString(static_cast<long>(params->size()));
+
+	if (DbValue::IsTimestamp(value))
+		*expr = "to_timestamp(" + placeholder + ")";
+	else
+		*expr = placeholder;
+
+	return true;
+}
+
+/**
+ * Converts a column value to the text format used by COPY.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ */
+bool IdoPgsqlDbConnection::FieldToCopyValue(const String& key, const Value& value, String *result)
+{
+	Value rawvalue = DbValue::ExtractValue(value);
+
+	if (key == "instance_id") {
+		*result = Convert::ToString(static_cast<long>(m_InstanceID));
+	} else if (rawvalue.IsObjectType<DynamicObject>()) {
+		Value id;
+
+		if (!FieldToReference(value, &id))
+			return false;
+
+		*result = Convert::ToString(id);
+	} else if (DbValue::IsRowInsertID(value) && rawvalue.IsEmpty()) {
+		return false;
+	} else if (DbValue::IsTimestampNow(value)) {
+		*result = Utility::FormatDateTime("%Y-%m-%d %H:%M:%S %z", Utility::GetTime());
+	} else if (rawvalue.IsEmpty()) {
+		*result = "\\N";
+	} else if (DbValue::IsTimestamp(value)) {
+		*result = Utility::FormatDateTime("%Y-%m-%d %H:%M:%S %z", rawvalue);
+	} else {
+		String text = rawvalue;
+
+		result->Clear();
+
+		BOOST_FOREACH(char ch, text) {
+			switch (ch) {
+				case '\\':
+					*result += "\\\\";
+					break;
+				case '\t':
+					*result += "\\t";
+					break;
+				case '\n':
+					*result += "\\n";
+					break;
+				case '\r':
+					*result += "\\r";
+					break;
+				default:
+					*result += ch;
+			}
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Returns the columns and values for a query, in column order.
+ */
+void IdoPgsqlDbConnection::GetQueryFields(const DbQuery& query, std::vector<std::pair<String, Value> > *fields)
+{
+	ObjectLock olock(query.Fields);
+
+	String key;
+	Value value;
+	BOOST_FOREACH(boost::tie(key, value), query.Fields) {
+		fields->push_back(std::make_pair(key, value));
+	}
+}
+
+/**
+ * Returns the columns which identify the row for an upsert. The table must
+ * have a unique index on these columns.
+ */
+String IdoPgsqlDbConnection::GetUpsertKey(const DbQuery& query)
+{
+	String columns;
+
+	ObjectLock olock(query.WhereCriteria);
+
+	String key;
+	BOOST_FOREACH(boost::tie(key, boost::tuples::ignore), query.WhereCriteria) {
+		if (!columns.IsEmpty())
+			columns += ", ";
+
+		columns += key;
+	}
+
+	return columns;
+}
+
+/**
+ * Adds a row to the pending COPY for its table. Rows for different tables
+ * are collected in separate batches. A batch is sent when it is full and
+ * all batches are sent before any other statement is executed.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ */
+void IdoPgsqlDbConnection::AddRowToCopy(const DbQuery& query)
+{
+	String cols;
+	String line;
+
+	{
+		std::vector<std::pair<String, Value> > fields;
+		GetQueryFields(query, &fields);
+
+		String key;
+		Value value;
+		String text;
+		BOOST_FOREACH(boost::tie(key, value), fields) {
+			if (!FieldToCopyValue(key, value, &text))
+				return;
+
+			if (!cols.IsEmpty()) {
+				cols += ", ";
+				line += "\t";
+			}
+
+			cols += key;
+			line += text;
+		}
+	}
+
+	line += "\n";
+
+	CopyBatch& batch = m_CopyBatches[query.Table + "\n" + cols];
+
+	if (batch.Count == 0) {
+		batch.Table = query.Table;
+		batch.Columns = cols;
+	}
+
+	batch.Data += line;
+	batch.Count++;
+
+	if (batch.Count >= 1000)
+		FlushCopyBatch(batch);
+}
+
+/* caller must hold m_ConnectionMutex */
+void IdoPgsqlDbConnection::FlushCopy(void)
+{
+	if (m_CopyBatches.empty())
+		return;
+
+	std::map<String, CopyBatch> batches;
+	batches.swap(m_CopyBatches);
+
+	for (std::map<String, CopyBatch>::iterator it = batches.begin(); it != batches.end(); it++)
+		FlushCopyBatch(it->second);
+}
+
+/* caller must hold m_ConnectionMutex */
+void IdoPgsqlDbConnection::FlushCopyBatch(CopyBatch& batch)
+{
+	if (batch.Count == 0)
+		return;
+
+	String data;
+	data.swap(batch.Data);
+
+	int count = batch.Count;
+	batch.Count = 0;
+
+	/* COPY can't be used in pipeline mode. */
+	FlushPipeline();
+
+	String sql = "COPY " + GetTablePrefix() + batch.Table + " (" + batch.Columns + ") FROM STDIN";
+
+	Log(LogDebug, "ido_pgsql", "Query: " + sql);
+
+	PGresult *result = PQexec(m_Connection, sql.CStr());
+
+	if (!result || PQresultStatus(result) != PGRES_COPY_IN) {
+		FetchRows(result);
+		BOOST_THROW_EXCEPTION(std::runtime_error("Unexpected result for COPY command."));
+	}
+
+	PQclear(result);
+
+	if (PQputCopyData(m_Connection, data.CStr(), data.GetLength()) != 1 || PQputCopyEnd(m_Connection, NULL) != 1)
+		BOOST_THROW_EXCEPTION(std::runtime_error(PQerrorMessage(m_Connection)));
+
+	String error, sqlState;
+
+	while ((result = PQgetResult(m_Connection))) {
+		if (PQresultStatus(result) != PGRES_COMMAND_OK) {
+			error = PQresultErrorMessage(result);
+			sqlState = GetSQLState(result);
+		}
+
+		PQclear(result);
+	}
+
+	if (!error.IsEmpty()) {
+		std::ostringstream msgbuf;
+		msgbuf << "Could not copy " << count << " rows into table '" << batch.Table << "': " << error;
+
+		CheckTransaction(sqlState, msgbuf.str());
+
+		BOOST_THROW_EXCEPTION(std::runtime_error(msgbuf.str()));
+	}
+}
+
+/**
+ * Returns the name of the upsert statement for rows with a fixed column
+ * layout. The statement is only built and prepared once for each schema.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ */
+String IdoPgsqlDbConnection::GetSchemaStatement(const DbSchema::Ptr& schema)
+{
+	std::map<DbSchema::Ptr, String>::const_iterator it = m_SchemaStatements.find(schema);
+
+	if (it != m_SchemaStatements.end())
+		return it->second;
+
+	String cols, values, excluded;
+
+	for (size_t i = 0; i < schema->GetColumnCount(); i++) {
+		const String& column = schema->GetColumnName(i);
+		String placeholder = "$" + Convert::ToString(static_cast<long>(i + 1));
+
+		if (i > 0) {
+			cols += ", ";
+			values += ", ";
+			excluded += ", ";
+		}
+
+		cols += column;
+
+		if (schema->GetColumnType(i) == DbColumnTimestamp)
+			values += "to_timestamp(" + placeholder + ")";
+		else
+			values += placeholder;
+
+		excluded += column + " = EXCLUDED." + column;
+	}
+
+	String name = GetStatement("INSERT INTO " + GetTablePrefix() + schema->GetTable() + " (" + cols + ") VALUES (" + values + ")"
+	    " ON CONFLICT (" + schema->GetColumnName(0) + ") DO UPDATE SET " + excluded);
+
+	m_SchemaStatements[schema] = name;
+
+	return name;
+}
+
+/**
+ * Upserts a row with a fixed column layout. The row's values are passed to
+ * the schema's statement by index, using the columns' types.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ */
+void IdoPgsqlDbConnection::ExecuteRow(const DbQuery& query)
+{
+	const DbSchema::Ptr& schema = query.Schema;
+	String name = GetSchemaStatement(schema);
+
+	size_t count = schema->GetColumnCount();
+
+	ASSERT(query.Row.size() == count);
+
+	std::vector<String> strings(count);
+	std::vector<const char *> values(count);
+
+	for (size_t i = 0; i < count; i++) {
+		const Value& value = query.Row[i];
+		DbColumnType type = schema->GetColumnType(i);
+
+		if (type == DbColumnInstance) {
+			strings[i] = Convert::ToString(static_cast<long>(m_InstanceID));
+		} else if (value.IsEmpty()) {
+			values[i] = NULL;
+			continue;
+		} else if (type == DbColumnObject) {
+			Value id;
+
+			if (!FieldToReference(value, &id))
+				return;
+
+			strings[i] = Convert::ToString(id);
+		} else
+			strings[i] = value;
+
+		values[i] = strings[i].CStr();
+	}
+
+	SendPrepared(name, values);
+
+	if (query.Object && query.StatusUpdate)
+		SetStatusUpdate(query.Object, true);
+}
+
+void IdoPgsqlDbConnection::ExecuteQuery(const DbQuery& query)
+{
+	boost::mutex::scoped_lock lock(m_ConnectionMutex);
+
+	/* Don't leave an ID from a rolled back attempt behind if the row
+	 * can't be inserted this time. */
+	if (query.InsertID)
+		query.InsertID->SetValue(Empty);
+
+	if (!m_Connected)
+		return;
+
+	/* Nobody needs the insert ID for these rows, so they can be sent
+	 * using COPY. */
+	if (query.Type == DbQueryInsert && !query.Object && !query.InsertID) {
+		AddRowToCopy(query);
+		return;
+	}
+
+	FlushCopy();
+
+	if (query.Schema) {
+		ExecuteRow(query);
+		return;
+	}
+
+	int type;
+
+	/* Rows without an object (e.g. programstatus) are always upserted
+	 * using the table's unique key. */
+	if ((query.Type & DbQueryInsert) && (query.Type & DbQueryUpdate) && query.Object) {
+		bool hasid;
+
+		if (query.ConfigUpdate)
+			hasid = GetConfigUpdate(query.Object);
+		else if (query.StatusUpdate)
+			hasid = GetStatusUpdate(query.Object);
+		else
+			ASSERT(!"Invalid query flags.");
+
+		if (hasid)
+			type = DbQueryUpdate;
+		else
+			type = DbQueryInsert | DbQueryUpdate;
+	} else
+		type = query.Type;
+
+	std::vector<Value> params;
+	String cols, values, updates, excluded;
+
+	if (type & (DbQueryInsert | DbQueryUpdate)) {
+		std::vector<std::pair<String, Value> > fields;
+		GetQueryFields(query, &fields);
+
+		String key;
+		Value value;
+		String expr;
+		BOOST_FOREACH(boost::tie(key, value), fields) {
+			if (!FieldToParameter(key, value, &expr, &params))
+				return;
+
+			if (!cols.IsEmpty()) {
+				cols += ", ";
+				values += ", ";
+				updates += ", ";
+				excluded += ", ";
+			}
+
+			cols += key;
+			values += expr;
+			updates += key + " = " + expr;
+			excluded += key + " = EXCLUDED." + key;
+		}
+	}
+
+	/* The WHERE clause's parameters follow the SET clause's. */
+	std::vector<Value> whereParams(params);
+	String where;
+
+	if (query.WhereCriteria) {
+		ObjectLock olock(query.WhereCriteria);
+
+		String key;
+		Value value;
+		String expr;
+		BOOST_FOREACH(boost::tie(key, value), query.WhereCriteria) {
+			if (!FieldToParameter(key, value, &expr, &whereParams))
+				return;
+
+			where += (where.IsEmpty() ? " WHERE " : " AND ") + key + " = " + expr;
+		}
+	}
+
+	String table = GetTablePrefix() + query.Table;
+	DbReference insertId;
+
+	switch (type) {
+		case DbQueryInsert:
+			if (query.InsertID) {
+				QueryStatement("INSERT INTO " + table + " (" + cols + ") VALUES (" + values + ")", params);
+
+				Array::Ptr rows = Query("SELECT lastval() AS id");
+				Dictionary::Ptr row = rows->Get(0);
+				query.InsertID->SetValue(static_cast<long>(row->Get("id")));
+			} else
+				ExecuteStatement("INSERT INTO " + table + " (" + cols + ") VALUES (" + values + ")", params);
+			break;
+		case DbQueryInsert | DbQueryUpdate:
+			if (query.ConfigUpdate) {
+				/* Config tables don't necessarily have a unique index on the
+				 * object ID. Try to update the existing row first. */
+				String idColumn = query.Object->GetType()->GetTable() + "_id";
+
+				ASSERT(!where.IsEmpty());
+
+				Array::Ptr rows = QueryStatement("UPDATE " + table + " SET " + updates + where + " RETURNING " + idColumn, whereParams);
+
+				if (rows->GetLength() == 0)
+					rows = QueryStatement("INSERT INTO " + table + " (" + cols + ") VALUES (" + values + ") RETURNING " + idColumn, params);
+
+				Dictionary::Ptr row = rows->Get(0);
+				insertId = DbReference(row->Get(idColumn));
+			} else {
+				/* We don't know whether the row exists yet: let the unique key
+				 * on the table decide whether to insert or update it. */
+				ExecuteStatement("INSERT INTO " + table + " (" + cols + ") VALUES (" + values + ")"
+				    " ON CONFLICT (" + GetUpsertKey(query) + ") DO UPDATE SET " + excluded, params);
+			}
+			break;
+		case DbQueryUpdate:
+			ExecuteStatement("UPDATE " + table + " SET " + updates + where, whereParams);
+			break;
+		case DbQueryDelete:
+			ExecuteStatement("DELETE FROM " + table + where, whereParams);
+			break;
+		default:
+			ASSERT(!"Invalid query type.");
+	}
+
+	if (query.Object) {
+		if (query.ConfigUpdate)
+			SetConfigUpdate(query.Object, true);
+		else if (query.StatusUpdate)
+			SetStatusUpdate(query.Object, true);
+
+		if ((type & DbQueryInsert) && query.ConfigUpdate)
+			SetInsertID(query.Object, insertId);
+	}
+}
+
+/**
+ * Deletes one chunk of expired rows from a history table.
+ */
+long IdoPgsqlDbConnection::CleanUpExecuteQuery(const String& table, const String& timeColumn, double maxTime, long limit)
+{
+	boost::mutex::scoped_lock lock(m_ConnectionMutex);
+
+	if (!m_Connected)
+		return 0;
+
+	FlushCopy();
+
+	/* DELETE doesn't support LIMIT. */
+	String tableName = GetTablePrefix() + table;
+
+	std::vector<Value> params;
+	params.push_back(static_cast<long>(m_InstanceID));
+	params.push_back(maxTime);
+	params.push_back(limit);
+
+	Array::Ptr rows = QueryStatement("DELETE FROM " + tableName + " WHERE ctid IN (SELECT ctid FROM " + tableName +
+	    " WHERE instance_id = $1 AND " + timeColumn + " < to_timestamp($2) LIMIT $3) RETURNING 1", params);
+
+	return rows->GetLength();
+}
+
+void IdoPgsqlDbConnection::InternalSerialize(const Dictionary::Ptr& bag, int attributeTypes) const
+{
+	DbConnection::InternalSerialize(bag, attributeTypes);
+
+	if (attributeTypes & Attribute_Config) {
+		bag->Set("host", m_Host);
+		bag->Set("port", m_Port);
+		bag->Set("user", m_User);
+		bag->Set("password", m_Password);
+		bag->Set("database", m_Database);
+		bag->Set("instance_name", m_InstanceName);
+		bag->Set("instance_description", m_InstanceDescription);
+	}
+}
+
+void IdoPgsqlDbConnection::InternalDeserialize(const Dictionary::Ptr& bag, int attributeTypes)
+{
+	DbConnection::InternalDeserialize(bag, attributeTypes);
+
+	if (attributeTypes & Attribute_Config) {
+		m_Host = bag->Get("host");
+		m_Port = bag->Get("port");
+		m_User = bag->Get("user");
+		m_Password = bag->Get("password");
+		m_Database = bag->Get("database");
+		m_InstanceName = bag->Get("instance_name");
+		m_InstanceDescription = bag->Get("instance_description");
+	}
+}
@@ -0,0 +1,131 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef IDOPGSQLDBCONNECTION_H
+#define IDOPGSQLDBCONNECTION_H
+
+#include "base/array.h"
+#include "base/dynamictype.h"
+#include "base/timer.h"
+#include "ido/dbconnection.h"
+#include <libpq-fe.h>
+
+namespace icinga
+{
+
+/**
+ * An IDO PostgreSQL database connection.
+ *
+ * @ingroup ido
+ */
+class IdoPgsqlDbConnection : public DbConnection
+{
+public:
+	DECLARE_PTR_TYPEDEFS(IdoPgsqlDbConnection);
+
+protected:
+	virtual void Start(void);
+	virtual void Stop(void);
+
+	virtual void InternalSerialize(const Dictionary::Ptr& bag, int attributeTypes) const;
+	virtual void InternalDeserialize(const Dictionary::Ptr& bag, int attributeTypes);
+
+	virtual void ActivateObject(const DbObject::Ptr& dbobj);
+	virtual void DeactivateObject(const DbObject::Ptr& dbobj);
+	virtual void ExecuteQuery(const DbQuery& query);
+	virtual long CleanUpExecuteQuery(const String& table, const String& timeColumn, double maxTime, long limit);
+	virtual void NewTransaction(void);
+	virtual void SetSavepoint(void);
+	virtual void ReleaseSavepoint(void);
+	virtual void RollbackSavepoint(void);
+
+	virtual bool Connect(void);
+	virtual void Disconnect(void);
+	virtual DbReference LoadInstanceID(void);
+	virtual bool HasConfigHashColumn(void);
+	virtual Array::Ptr Query(const String& query);
+	virtual void UpdateConfigHash(const DbReference& objectid, const String& hash);
+	virtual void FlushQueries(void);
+	virtual void InternalActivateObject(const DbObject::Ptr& dbobj);
+
+private:
+	/**
+	 * Rows for a COPY, in COPY's text format.
+	 */
+	struct CopyBatch
+	{
+		String Table;
+		String Columns;
+		String Data;
+		int Count;
+
+		CopyBatch(void)
+			: Count(0)
+		{ }
+	};
+
+	String m_Host;
+	Value m_Port;
+	String m_User;
+	String m_Password;
+	String m_Database;
+	String m_InstanceName;
+	String m_InstanceDescription;
+
+	PGconn *m_Connection;
+
+	Timer::Ptr m_ReconnectTimer;
+
+	std::map<String, String> m_Statements;
+	std::map<DbSchema::Ptr, String> m_SchemaStatements;
+	int m_PipelineLength;
+	bool m_Savepoint;
+
+	std::map<String, CopyBatch> m_CopyBatches;
+
+	Array::Ptr QueryStatement(const String& sql, const std::vector<Value>& params);
+	void ExecuteStatement(const String& sql, const std::vector<Value>& params);
+	void SendPrepared(const String& name, const std::vector<const char *>& values);
+	Array::Ptr FetchRows(PGresult *result);
+
+	String GetStatement(const String& sql);
+	static void GetParameterValues(const std::vector<Value>& params,
+	    std::vector<String> *strings, std::vector<const char *> *values);
+	void FlushPipeline(void);
+	static String GetSQLState(const PGresult *result);
+	void CheckTransaction(const String& sqlState, const String& error);
+
+	bool FieldToParameter(const String& key, const Value& value, String *expr, std::vector<Value> *params);
+	bool FieldToCopyValue(const String& key, const Value& value, String *result);
+
+	static void GetQueryFields(const DbQuery& query, std::vector<std::pair<String, Value> > *fields);
+	static String GetUpsertKey(const DbQuery& query);
+	void AddRowToCopy(const DbQuery& query);
+	void FlushCopy(void);
+	void FlushCopyBatch(CopyBatch& batch);
+
+	String GetSchemaStatement(const DbSchema::Ptr& schema);
+	void ExecuteRow(const DbQuery& query);
+
+	void ReconnectTimerHandler(void);
+};
+
+}
+
+#endif /* IDOPGSQLDBCONNECTION_H */
@@ -21,9 +21,21 @@
 
 using namespace livestatus;
 
-Aggregator::Aggregator(void)
+Aggregator::Aggregator(const String& attr)
+	: m_Attribute(attr)
 { }
 
+/**
+ * Extracts the aggregator's column from the row and feeds it
+ * into ApplyValue().
+ */
+void Aggregator::Apply(const Table::Ptr& table, const Value& row)
+{
+	Column column = table->GetColumn(m_Attribute);
+
+	ApplyValue(column.ExtractValue(row));
+}
+
 void Aggregator::SetFilter(const Filter::Ptr& filter)
 {
 	m_Filter = filter;
@@ -33,3 +45,13 @@ Filter::Ptr Aggregator::GetFilter(void) const
 {
 	return m_Filter;
 }
+
+/**
+ * Returns the name of the column this aggregator operates on. Aggregators
+ * which only evaluate their filter (i.e. "Stats: state = 0") return an
+ * empty string.
+ */
+String Aggregator::GetAttribute(void) const
+{
+	return m_Attribute;
+}
@@ -34,16 +34,21 @@ class Aggregator : public Object
 public:
 	DECLARE_PTR_TYPEDEFS(Aggregator);
 
-	virtual void Apply(const Table::Ptr& table, const Value& row) = 0;
+	virtual void Apply(const Table::Ptr& table, const Value& row);
+	virtual void ApplyValue(const Value& value) = 0;
 	virtual double GetResult(void) const = 0;
+	virtual Aggregator::Ptr Clone(void) const = 0;
+
 	void SetFilter(const Filter::Ptr& filter);
+	Filter::Ptr GetFilter(void) const;
+
+	String GetAttribute(void) const;
 
 protected:
-	Aggregator(void);
-	
-	Filter::Ptr GetFilter(void) const;
-	
+	Aggregator(const String& attr = String());
+
 private:
+	String m_Attribute;
 	Filter::Ptr m_Filter;
 };
 
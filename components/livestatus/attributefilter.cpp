@@ -30,6 +30,21 @@ AttributeFilter::AttributeFilter(const String& column, const String& op, const S
 	: m_Column(column), m_Operator(op), m_Operand(operand)
 { }
 
+String AttributeFilter::GetColumn(void) const
+{
+	return m_Column;
+}
+
+String AttributeFilter::GetOperator(void) const
+{
+	return m_Operator;
+}
+
+String AttributeFilter::GetOperand(void) const
+{
+	return m_Operand;
+}
+
 bool AttributeFilter::Apply(const Table::Ptr& table, const Value& row)
 {
 	Column column = table->GetColumn(m_Column);
@@ -39,6 +39,10 @@ public:
 
 	virtual bool Apply(const Table::Ptr& table, const Value& row);
 
+	String GetColumn(void) const;
+	String GetOperator(void) const;
+	String GetOperand(void) const;
+
 protected:
 	String m_Column;
 	String m_Operator;
@@ -18,21 +18,16 @@
  ******************************************************************************/
 
 #include "livestatus/avgaggregator.h"
+#include <boost/smart_ptr/make_shared.hpp>
 
 using namespace livestatus;
 
 AvgAggregator::AvgAggregator(const String& attr)
-    : m_Avg(0), m_AvgCount(0)
-{
-	m_AvgAttr = attr;
-}
+    : Aggregator(attr), m_Avg(0), m_AvgCount(0)
+{ }
 
-void AvgAggregator::Apply(const Table::Ptr& table, const Value& row)
+void AvgAggregator::ApplyValue(const Value& value)
 {
-	Column column = table->GetColumn(m_AvgAttr);
-
-	Value value = column.ExtractValue(row);
-
 	m_Avg += value;
 	m_AvgCount++;
 }
@@ -41,3 +36,8 @@ double AvgAggregator::GetResult(void) const
 {
 	return (m_Avg / m_AvgCount);
 }
+
+Aggregator::Ptr AvgAggregator::Clone(void) const
+{
+	return boost::make_shared<AvgAggregator>(GetAttribute());
+}
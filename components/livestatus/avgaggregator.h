@@ -36,13 +36,13 @@ public:
 
 	AvgAggregator(const String& attr);
 
-	virtual void Apply(const Table::Ptr& table, const Value& row);
+	virtual void ApplyValue(const Value& value);
 	virtual double GetResult(void) const;
+	virtual Aggregator::Ptr Clone(void) const;
 
 private:
 	double m_Avg;
 	double m_AvgCount;
-	String m_AvgAttr;
 };
 
 }
@@ -50,14 +50,17 @@ String CommandsTable::GetName(void) const
 
 void CommandsTable::FetchRows(const AddRowFunction& addRowFn)
 {
-	BOOST_FOREACH(const DynamicObject::Ptr& object, DynamicType::GetObjects<CheckCommand>()) {
-		addRowFn(object);
+	BOOST_FOREACH(const DynamicObject::Ptr& object, DynamicType::GetSnapshot<CheckCommand>()) {
+		if (!addRowFn(object))
+			return;
 	}
-	BOOST_FOREACH(const DynamicObject::Ptr& object, DynamicType::GetObjects<EventCommand>()) {
-		addRowFn(object);
+	BOOST_FOREACH(const DynamicObject::Ptr& object, DynamicType::GetSnapshot<EventCommand>()) {
+		if (!addRowFn(object))
+			return;
 	}
-	BOOST_FOREACH(const DynamicObject::Ptr& object, DynamicType::GetObjects<NotificationCommand>()) {
-		addRowFn(object);
+	BOOST_FOREACH(const DynamicObject::Ptr& object, DynamicType::GetSnapshot<NotificationCommand>()) {
+		if (!addRowFn(object))
+			return;
 	}
 }
 
@@ -58,7 +58,7 @@ String CommentsTable::GetName(void) const
 
 void CommentsTable::FetchRows(const AddRowFunction& addRowFn)
 {
-	BOOST_FOREACH(const Service::Ptr& service, DynamicType::GetObjects<Service>()) {
+	BOOST_FOREACH(const Service::Ptr& service, DynamicType::GetSnapshot<Service>()) {
 		Dictionary::Ptr comments = service->GetComments();
 
 		if (!comments)
@@ -68,8 +68,11 @@ void CommentsTable::FetchRows(const AddRowFunction& addRowFn)
 
 		String id;
 		BOOST_FOREACH(boost::tie(id, boost::tuples::ignore), comments) {
-			if (Service::GetOwnerByCommentID(id) == service)
-				addRowFn(id);
+			if (Service::GetOwnerByCommentID(id) != service)
+				continue;
+
+			if (!addRowFn(id))
+				return;
 		}
 	}
 }
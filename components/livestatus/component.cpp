@@ -18,6 +18,8 @@
  ******************************************************************************/
 
 #include "livestatus/component.h"
+#include "icinga/service.h"
+#include "icinga/compatlogbuffer.h"
 #include "base/objectlock.h"
 #include "base/dynamictype.h"
 #include "base/logger_fwd.h"
@@ -26,6 +28,7 @@
 #include "base/networkstream.h"
 #include "base/application.h"
 #include <boost/smart_ptr/make_shared.hpp>
+#include <boost/foreach.hpp>
 
 using namespace icinga;
 using namespace livestatus;
@@ -43,6 +46,17 @@ void LivestatusComponent::Start(void)
 {
 	DynamicObject::Start();
 
+	m_Connections.push_back(Service::OnNewCheckResult.connect(boost::bind(&Query::Trigger, TriggerCheck)));
+	m_Connections.push_back(DynamicObject::OnStateChanged.connect(&LivestatusComponent::StateChangedHandler));
+	m_Connections.push_back(DynamicObject::OnStarted.connect(&LivestatusComponent::ObjectCountChangedHandler));
+	m_Connections.push_back(DynamicObject::OnStopped.connect(&LivestatusComponent::ObjectCountChangedHandler));
+	m_Connections.push_back(Service::OnCommentAdded.connect(boost::bind(&Query::Trigger, TriggerComment)));
+	m_Connections.push_back(Service::OnCommentRemoved.connect(boost::bind(&Query::Trigger, TriggerComment)));
+	m_Connections.push_back(Service::OnDowntimeAdded.connect(boost::bind(&Query::Trigger, TriggerDowntime)));
+	m_Connections.push_back(Service::OnDowntimeRemoved.connect(boost::bind(&Query::Trigger, TriggerDowntime)));
+	m_Connections.push_back(Service::OnDowntimeTriggered.connect(boost::bind(&Query::Trigger, TriggerDowntime)));
+	m_Connections.push_back(CompatLogBuffer::OnLineAdded.connect(boost::bind(&Query::Trigger, TriggerLog)));
+
 	if (GetSocketType() == "tcp") {
 		TcpSocket::Ptr socket = boost::make_shared<TcpSocket>();
 		socket->Bind(GetHost(), GetPort(), AF_INET);
@@ -65,6 +79,23 @@ void LivestatusComponent::Start(void)
 	}
 }
 
+/**
+ * Stops the component.
+ */
+void LivestatusComponent::Stop(void)
+{
+	BOOST_FOREACH(boost::signals2::connection& connection, m_Connections) {
+		connection.disconnect();
+	}
+
+	m_Connections.clear();
+
+	/* Don't leave clients blocked in WaitTrigger/WaitCondition queries. */
+	Query::CancelWaits();
+
+	DynamicObject::Stop();
+}
+
 String LivestatusComponent::GetSocketType(void) const
 {
 	Value socketType = m_SocketType;
@@ -101,6 +132,15 @@ String LivestatusComponent::GetPort(void) const
 		return service;
 }
 
+String LivestatusComponent::GetCompatLogPath(void) const
+{
+	Value logPath = m_CompatLogPath;
+	if (logPath.IsEmpty())
+		return Application::GetLocalStateDir() + "/log/icinga2/compat";
+	else
+		return logPath;
+}
+
 int LivestatusComponent::GetClientsConnected(void)
 {
 	boost::mutex::scoped_lock lock(l_ComponentMutex);
@@ -115,6 +155,23 @@ int LivestatusComponent::GetConnections(void)
 	return l_Connections;
 }
 
+void LivestatusComponent::StateChangedHandler(const DynamicObject::Ptr& object)
+{
+	if (dynamic_pointer_cast<Service>(object) || dynamic_pointer_cast<Host>(object))
+		Query::Trigger(TriggerState);
+}
+
+/**
+ * The program status changes when hosts or services are added or removed
+ * (num_hosts, num_services), e.g. when the configuration is reloaded. The
+ * global enable_* flags are constants in this version.
+ */
+void LivestatusComponent::ObjectCountChangedHandler(const DynamicObject::Ptr& object)
+{
+	if (dynamic_pointer_cast<Service>(object) || dynamic_pointer_cast<Host>(object))
+		Query::Trigger(TriggerProgram);
+}
+
 void LivestatusComponent::ServerThreadProc(const Socket::Ptr& server)
 {
 	server->Listen();
@@ -152,7 +209,7 @@ void LivestatusComponent::ClientThreadProc(const Socket::Ptr& client)
 				break;
 		}
 
-		Query::Ptr query = boost::make_shared<Query>(lines);
+		Query::Ptr query = boost::make_shared<Query>(lines, GetCompatLogPath());
 		if (!query->Execute(stream))
 			break;
 	}
@@ -172,6 +229,7 @@ void LivestatusComponent::InternalSerialize(const Dictionary::Ptr& bag, int attr
 		bag->Set("socket_path", m_SocketPath);
 		bag->Set("host", m_Host);
 		bag->Set("port", m_Port);
+		bag->Set("compat_log_path", m_CompatLogPath);
 	}
 }
 
@@ -184,5 +242,6 @@ void LivestatusComponent::InternalDeserialize(const Dictionary::Ptr& bag, int at
 		m_SocketPath = bag->Get("socket_path");
 		m_Host = bag->Get("host");
 		m_Port = bag->Get("port");
+		m_CompatLogPath = bag->Get("compat_log_path");
 	}
 }
@@ -24,6 +24,7 @@
 #include "base/dynamicobject.h"
 #include "base/socket.h"
 #include <boost/thread/thread.hpp>
+#include <boost/signals2.hpp>
 
 using namespace icinga;
 
@@ -40,12 +41,14 @@ public:
 	String GetSocketPath(void) const;
 	String GetHost(void) const;
 	String GetPort(void) const;
+	String GetCompatLogPath(void) const;
 
 	static int GetClientsConnected(void);
 	static int GetConnections(void);
 
 protected:
 	virtual void Start(void);
+	virtual void Stop(void);
 
 	virtual void InternalSerialize(const Dictionary::Ptr& bag, int attributeTypes) const;
 	virtual void InternalDeserialize(const Dictionary::Ptr& bag, int attributeTypes);
@@ -55,6 +58,12 @@ private:
 	String m_SocketPath;
 	String m_Host;
 	String m_Port;
+	String m_CompatLogPath;
+
+	std::vector<boost::signals2::connection> m_Connections;
+
+	static void StateChangedHandler(const DynamicObject::Ptr& object);
+	static void ObjectCountChangedHandler(const DynamicObject::Ptr& object);
 
 	void ServerThreadProc(const Socket::Ptr& server);
 	void ClientThreadProc(const Socket::Ptr& client);
@@ -45,8 +45,9 @@ String ContactGroupsTable::GetName(void) const
 
 void ContactGroupsTable::FetchRows(const AddRowFunction& addRowFn)
 {
-	BOOST_FOREACH(const UserGroup::Ptr& ug, DynamicType::GetObjects<UserGroup>()) {
-		addRowFn(ug);
+	BOOST_FOREACH(const UserGroup::Ptr& ug, DynamicType::GetSnapshot<UserGroup>()) {
+		if (!addRowFn(ug))
+			return;
 	}
 }
 
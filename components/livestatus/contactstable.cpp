@@ -63,8 +63,9 @@ String ContactsTable::GetName(void) const
 
 void ContactsTable::FetchRows(const AddRowFunction& addRowFn)
 {
-	BOOST_FOREACH(const User::Ptr& user, DynamicType::GetObjects<User>()) {
-		addRowFn(user);
+	BOOST_FOREACH(const User::Ptr& user, DynamicType::GetSnapshot<User>()) {
+		if (!addRowFn(user))
+			return;
 	}
 }
 
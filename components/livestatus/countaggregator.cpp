@@ -18,6 +18,7 @@
  ******************************************************************************/
 
 #include "livestatus/countaggregator.h"
+#include <boost/smart_ptr/make_shared.hpp>
 
 using namespace livestatus;
 
@@ -31,7 +32,17 @@ void CountAggregator::Apply(const Table::Ptr& table, const Value& row)
 		m_Count++;
 }
 
+void CountAggregator::ApplyValue(const Value&)
+{
+	m_Count++;
+}
+
 double CountAggregator::GetResult(void) const
 {
 	return m_Count;
 }
+
+Aggregator::Ptr CountAggregator::Clone(void) const
+{
+	return boost::make_shared<CountAggregator>();
+}
@@ -37,7 +37,9 @@ public:
 	CountAggregator(void);
 
 	virtual void Apply(const Table::Ptr& table, const Value& row);
+	virtual void ApplyValue(const Value& value);
 	virtual double GetResult(void) const;
+	virtual Aggregator::Ptr Clone(void) const;
 	
 private:
 	int m_Count;
@@ -58,7 +58,7 @@ String DowntimesTable::GetName(void) const
 
 void DowntimesTable::FetchRows(const AddRowFunction& addRowFn)
 {
-	BOOST_FOREACH(const Service::Ptr& service, DynamicType::GetObjects<Service>()) {
+	BOOST_FOREACH(const Service::Ptr& service, DynamicType::GetSnapshot<Service>()) {
 		Dictionary::Ptr downtimes = service->GetDowntimes();
 
 		if (!downtimes)
@@ -68,8 +68,11 @@ void DowntimesTable::FetchRows(const AddRowFunction& addRowFn)
 
 		String id;
 		BOOST_FOREACH(boost::tie(id, boost::tuples::ignore), downtimes) {
-			if (Service::GetOwnerByDowntimeID(id) == service)
-				addRowFn(id);
+			if (Service::GetOwnerByDowntimeID(id) != service)
+				continue;
+
+			if (!addRowFn(id))
+				return;
 		}
 	}
 }
@@ -69,8 +69,9 @@ String HostGroupsTable::GetName(void) const
 
 void HostGroupsTable::FetchRows(const AddRowFunction& addRowFn)
 {
-	BOOST_FOREACH(const HostGroup::Ptr& hg, DynamicType::GetObjects<HostGroup>()) {
-		addRowFn(hg);
+	BOOST_FOREACH(const HostGroup::Ptr& hg, DynamicType::GetSnapshot<HostGroup>()) {
+		if (!addRowFn(hg))
+			return;
 	}
 }
 
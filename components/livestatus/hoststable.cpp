@@ -167,8 +167,9 @@ String HostsTable::GetName(void) const
 
 void HostsTable::FetchRows(const AddRowFunction& addRowFn)
 {
-	BOOST_FOREACH(const Host::Ptr& host, DynamicType::GetObjects<Host>()) {
-		addRowFn(host);
+	BOOST_FOREACH(const Host::Ptr& host, DynamicType::GetSnapshot<Host>()) {
+		if (!addRowFn(host))
+			return;
 	}
 }
 
@@ -18,21 +18,16 @@
  ******************************************************************************/
 
 #include "livestatus/invavgaggregator.h"
+#include <boost/smart_ptr/make_shared.hpp>
 
 using namespace livestatus;
 
 InvAvgAggregator::InvAvgAggregator(const String& attr)
-    : m_InvAvg(0), m_InvAvgCount(0)
-{
-	m_InvAvgAttr = attr;
-}
+    : Aggregator(attr), m_InvAvg(0), m_InvAvgCount(0)
+{ }
 
-void InvAvgAggregator::Apply(const Table::Ptr& table, const Value& row)
+void InvAvgAggregator::ApplyValue(const Value& value)
 {
-	Column column = table->GetColumn(m_InvAvgAttr);
-
-	Value value = column.ExtractValue(row);
-
 	m_InvAvg += (1.0 / value);
 	m_InvAvgCount++;
 }
@@ -41,3 +36,8 @@ double InvAvgAggregator::GetResult(void) const
 {
 	return (m_InvAvg / m_InvAvgCount);
 }
+
+Aggregator::Ptr InvAvgAggregator::Clone(void) const
+{
+	return boost::make_shared<InvAvgAggregator>(GetAttribute());
+}
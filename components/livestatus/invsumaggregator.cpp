@@ -18,21 +18,16 @@
  ******************************************************************************/
 
 #include "livestatus/invsumaggregator.h"
+#include <boost/smart_ptr/make_shared.hpp>
 
 using namespace livestatus;
 
 InvSumAggregator::InvSumAggregator(const String& attr)
-    : m_InvSum(0)
-{
-	m_InvSumAttr = attr;
-}
+    : Aggregator(attr), m_InvSum(0)
+{ }
 
-void InvSumAggregator::Apply(const Table::Ptr& table, const Value& row)
+void InvSumAggregator::ApplyValue(const Value& value)
 {
-	Column column = table->GetColumn(m_InvSumAttr);
-
-	Value value = column.ExtractValue(row);
-
 	m_InvSum += (1.0 / value);
 }
 
@@ -40,3 +35,8 @@ double InvSumAggregator::GetResult(void) const
 {
 	return m_InvSum;
 }
+
+Aggregator::Ptr InvSumAggregator::Clone(void) const
+{
+	return boost::make_shared<InvSumAggregator>(GetAttribute());
+}
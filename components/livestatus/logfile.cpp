@@ -0,0 +1,699 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "livestatus/logfile.h"
+#include "icinga/compatutility.h"
+#include "base/logger_fwd.h"
+#include "base/exception.h"
+#include "base/convert.h"
+#include "base/utility.h"
+#include <boost/smart_ptr/make_shared.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread/mutex.hpp>
+#include <fstream>
+#include <limits>
+#include <list>
+#include <map>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#	include <sys/mman.h>
+#endif /* _WIN32 */
+
+using namespace icinga;
+using namespace livestatus;
+
+/* Number of lines between two index samples. */
+#define LOG_INDEX_INTERVAL 512
+
+/* Version of the on-disk index format. */
+#define LOG_INDEX_VERSION 1
+
+/* Maximum number of archive indexes which are kept in memory. */
+#define LOG_INDEX_CACHE_SIZE 256
+
+struct LogIndexCacheEntry
+{
+	shared_ptr<LogIndex> Index;
+	std::list<String>::iterator LruPosition;
+};
+
+static boost::mutex l_IndexCacheMutex;
+static std::map<String, LogIndexCacheEntry> l_IndexCache;
+static std::list<String> l_IndexCacheLru; /* most recently used first */
+
+/* Maximum length of the first line which is used to recognize the current
+ * log file after it has been rotated. */
+#define LOG_INDEX_HEAD_SIZE 256
+
+struct CurrentLogIndexEntry
+{
+	String Head;
+	shared_ptr<LogIndex> Index;
+};
+
+static boost::mutex l_CurrentIndexMutex;
+static std::map<String, CurrentLogIndexEntry> l_CurrentIndexes;
+
+/**
+ * Removes an archive's index from the index cache.
+ *
+ * @threadsafety Caller must hold l_IndexCacheMutex.
+ */
+static void EvictIndex(const String& path)
+{
+	std::map<String, LogIndexCacheEntry>::iterator it = l_IndexCache.find(path);
+
+	if (it == l_IndexCache.end())
+		return;
+
+	l_IndexCacheLru.erase(it->second.LruPosition);
+	l_IndexCache.erase(it);
+}
+
+/**
+ * Adds the lines after index->Size to a time index. There is a sample
+ * every LOG_INDEX_INTERVAL lines.
+ *
+ * @param index The index.
+ * @param data The contents of the log file.
+ * @param length The length of the data.
+ * @param partial Whether to index a last line which isn't terminated by a
+ *		  newline. That line might still be written to.
+ */
+static void ExtendIndex(LogIndex *index, const char *data, size_t length, bool partial)
+{
+	size_t offset = index->Size;
+
+	while (offset < length) {
+		const char *line = data + offset;
+		const char *eol = static_cast<const char *>(memchr(line, '\n', length - offset));
+
+		if (!eol && !partial)
+			break;
+
+		size_t lineLength = eol ? eol - line : length - offset;
+
+		if (index->LineCount % LOG_INDEX_INTERVAL == 0) {
+			LogIndexSample sample;
+			sample.Offset = offset;
+			sample.LineNo = index->LineCount;
+			sample.MaxTimeBefore = index->MaxTime;
+			sample.MinTimeAfter = 0;
+			index->Samples.push_back(sample);
+
+			index->BlockMinTimes.push_back(std::numeric_limits<double>::max());
+		}
+
+		double ts;
+
+		if (CompatUtility::ParseLogTimestamp(line, lineLength, &ts)) {
+			bool first = (index->MaxTime < 0);
+
+			if (first || ts < index->FirstTime)
+				index->FirstTime = ts;
+
+			if (first || ts > index->LastTime)
+				index->LastTime = ts;
+
+			if (ts > index->MaxTime)
+				index->MaxTime = ts;
+
+			if (ts < index->BlockMinTimes.back())
+				index->BlockMinTimes.back() = ts;
+		}
+
+		offset += lineLength + 1;
+		index->LineCount++;
+	}
+
+	index->Size = std::min(offset, length);
+
+	/* Turn the per-block minimums into suffix minimums. */
+	double suffixMin = std::numeric_limits<double>::max();
+
+	for (size_t i = index->Samples.size(); i-- > 0;) {
+		if (index->BlockMinTimes[i] < suffixMin)
+			suffixMin = index->BlockMinTimes[i];
+
+		index->Samples[i].MinTimeAfter = suffixMin;
+	}
+}
+
+/**
+ * Constructor for the LogFile class.
+ *
+ * @param path The path of the log file.
+ * @param length The number of bytes which should be read from the file,
+ *		 or -1 to read the whole file.
+ */
+LogFile::LogFile(const String& path, long length)
+	: m_Path(path), m_Length(length), m_Data(NULL), m_DataLength(0)
+#ifndef _WIN32
+	, m_Fd(-1)
+#endif /* _WIN32 */
+{ }
+
+LogFile::~LogFile(void)
+{
+	Unmap();
+}
+
+/**
+ * Opens an archived (i.e. read-only) log file. The file's time index is
+ * loaded from the index file next to the log file (or built and saved if
+ * there is no valid index file) and cached in memory.
+ *
+ * @param path The path of the log file.
+ * @returns The log file, or an empty pointer if the file could not be found.
+ */
+LogFile::Ptr LogFile::OpenArchive(const String& path)
+{
+	struct stat statbuf;
+
+	if (stat(path.CStr(), &statbuf) < 0) {
+		/* The archive was deleted, forget about its index. */
+		boost::mutex::scoped_lock lock(l_IndexCacheMutex);
+		EvictIndex(path);
+
+		return LogFile::Ptr();
+	}
+
+	long size = statbuf.st_size;
+	double mtime = statbuf.st_mtime;
+
+	bool compressed = CompatLogArchive::IsCompressed(path);
+
+	/* The original file is removed once the compressed archive is complete. */
+	if (compressed && stat(String(path.Begin(), path.End() - 3).CStr(), &statbuf) >= 0)
+		return LogFile::Ptr();
+
+	LogFile::Ptr logfile = boost::make_shared<LogFile>(path);
+
+	{
+		boost::mutex::scoped_lock lock(l_IndexCacheMutex);
+
+		std::map<String, LogIndexCacheEntry>::iterator it = l_IndexCache.find(path);
+
+		if (it != l_IndexCache.end()) {
+			const shared_ptr<LogIndex>& index = it->second.Index;
+
+			if (index->Size == size && index->MTime == mtime) {
+				l_IndexCacheLru.splice(l_IndexCacheLru.begin(), l_IndexCacheLru, it->second.LruPosition);
+				logfile->m_Index = index;
+				return logfile;
+			}
+		}
+	}
+
+	String indexPath = path + ".idx";
+	std::vector<CompatLogArchiveBlock> blocks;
+
+	if (compressed && CompatLogArchive::LoadBlocks(path, blocks)) {
+		logfile->BuildBlockIndex(blocks, size);
+		logfile->m_Index->MTime = mtime;
+	} else if (!logfile->LoadIndex(indexPath, size, mtime)) {
+		logfile->BuildIndex();
+
+		if (!logfile->m_Index)
+			return LogFile::Ptr();
+
+		logfile->m_Index->MTime = mtime;
+		logfile->SaveIndex(indexPath);
+	}
+
+	{
+		boost::mutex::scoped_lock lock(l_IndexCacheMutex);
+
+		EvictIndex(path);
+
+		l_IndexCacheLru.push_front(path);
+
+		LogIndexCacheEntry entry;
+		entry.Index = logfile->m_Index;
+		entry.LruPosition = l_IndexCacheLru.begin();
+		l_IndexCache[path] = entry;
+
+		while (l_IndexCache.size() > LOG_INDEX_CACHE_SIZE) {
+			String victim = l_IndexCacheLru.back();
+			EvictIndex(victim);
+		}
+	}
+
+	return logfile;
+}
+
+/**
+ * Opens the current log file. Its time index is extended with the lines
+ * which were appended since the last call, so only those are read from
+ * disk. The index is rebuilt when the file has been rotated.
+ *
+ * @param path The path of the log file.
+ * @param length The number of bytes which should be read from the file,
+ *		 or -1 to read the whole file. Only complete lines are indexed.
+ * @returns The log file.
+ */
+LogFile::Ptr LogFile::OpenCurrent(const String& path, long length)
+{
+	LogFile::Ptr logfile = boost::make_shared<LogFile>(path, length);
+
+	if (!logfile->Map())
+		return logfile;
+
+	const char *eol = static_cast<const char *>(memchr(logfile->m_Data, '\n',
+	    std::min(logfile->m_DataLength, static_cast<size_t>(LOG_INDEX_HEAD_SIZE))));
+	String head(logfile->m_Data, eol ? eol : logfile->m_Data + std::min(logfile->m_DataLength, static_cast<size_t>(LOG_INDEX_HEAD_SIZE)));
+
+	boost::mutex::scoped_lock lock(l_CurrentIndexMutex);
+
+	CurrentLogIndexEntry& entry = l_CurrentIndexes[path];
+
+	/* The file starts with the "LOG ROTATION" line, whose timestamp
+	 * changes when the file is rotated. */
+	if (!entry.Index || entry.Head != head || static_cast<size_t>(entry.Index->Size) > logfile->m_DataLength) {
+		entry.Head = head;
+		entry.Index = boost::make_shared<LogIndex>();
+	}
+
+	if (static_cast<size_t>(entry.Index->Size) < logfile->m_DataLength) {
+		/* Other readers might be using the old index. */
+		shared_ptr<LogIndex> index = boost::make_shared<LogIndex>(*entry.Index);
+		ExtendIndex(index.get(), logfile->m_Data, logfile->m_DataLength, false);
+		entry.Index = index;
+	}
+
+	logfile->m_Index = entry.Index;
+
+	return logfile;
+}
+
+String LogFile::GetPath(void) const
+{
+	return m_Path;
+}
+
+bool LogFile::HasIndex(void) const
+{
+	return static_cast<bool>(m_Index);
+}
+
+shared_ptr<LogIndex> LogFile::GetIndex(void) const
+{
+	return m_Index;
+}
+
+/**
+ * Returns the lowest timestamp in the log file. Only valid for indexed
+ * files.
+ */
+double LogFile::GetFirstTime(void) const
+{
+	ASSERT(m_Index);
+
+	return m_Index->FirstTime;
+}
+
+/**
+ * Returns the highest timestamp in the log file. Only valid for indexed
+ * files.
+ */
+double LogFile::GetLastTime(void) const
+{
+	ASSERT(m_Index);
+
+	return m_Index->LastTime;
+}
+
+static bool ProcessLines(const char *data, size_t offset, size_t end, double from, double until,
+    const LogFile::LineCallback& callback, long *lineno)
+{
+	while (offset < end) {
+		const char *line = data + offset;
+		const char *eol = static_cast<const char *>(memchr(line, '\n', end - offset));
+		size_t length = eol ? eol - line : end - offset;
+
+		offset += length + 1;
+		(*lineno)++;
+
+		double ts;
+
+		if (!CompatUtility::ParseLogTimestamp(line, length, &ts) || ts < from || ts > until)
+			continue;
+
+		if (!callback(line, length, *lineno))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Invokes the callback for each line whose timestamp lies within the
+ * specified time range. Lines without a valid timestamp are skipped.
+ *
+ * @param from The lower bound (inclusive) for the timestamp.
+ * @param until The upper bound (inclusive) for the timestamp.
+ * @param callback The callback which is invoked for each matching line. The
+ *		   line is not NUL-terminated. Reading stops when the callback
+ *		   returns false.
+ * @param[out] lastLine The number of the last line that was read.
+ * @returns false if reading was stopped by the callback, true otherwise.
+ */
+bool LogFile::ReadLines(double from, double until, const LineCallback& callback, long *lastLine)
+{
+	if (lastLine)
+		*lastLine = 0;
+
+	if (m_Index && !m_Index->Blocks.empty())
+		return ReadBlocks(from, until, callback, lastLine);
+
+	if (!Map())
+		return true;
+
+	size_t offset = 0, end = m_DataLength;
+	long lineno = 0;
+
+	if (m_Index) {
+		/* Skip all blocks whose lines are older than the lower bound
+		 * and stop at the first block whose lines are all newer than the
+		 * upper bound. */
+		for (std::vector<LogIndexSample>::const_iterator it = m_Index->Samples.begin(); it != m_Index->Samples.end(); it++) {
+			if (it->MaxTimeBefore < from) {
+				offset = it->Offset;
+				lineno = it->LineNo;
+			}
+
+			if (it->MinTimeAfter > until) {
+				end = it->Offset;
+				break;
+			}
+		}
+
+		if (end > m_DataLength)
+			end = m_DataLength;
+	}
+
+	if (!ProcessLines(m_Data, offset, end, from, until, callback, &lineno))
+		return false;
+
+	if (lastLine)
+		*lastLine = lineno;
+
+	return true;
+}
+
+/**
+ * Reads the blocks of a compressed archive which contain lines within the
+ * specified time range. See ReadLines() for the parameters.
+ */
+bool LogFile::ReadBlocks(double from, double until, const LineCallback& callback, long *lastLine)
+{
+	const std::vector<CompatLogArchiveBlock>& blocks = m_Index->Blocks;
+	size_t first = 0, last = blocks.size();
+
+	for (size_t i = 0; i < m_Index->Samples.size(); i++) {
+		const LogIndexSample& sample = m_Index->Samples[i];
+
+		if (sample.MaxTimeBefore < from)
+			first = i;
+
+		if (sample.MinTimeAfter > until) {
+			last = i;
+			break;
+		}
+	}
+
+	std::ifstream fp(m_Path.CStr(), std::ifstream::binary);
+
+	if (!fp)
+		return true;
+
+	std::vector<char> data;
+	long lineno = 0;
+
+	for (size_t i = first; i < last; i++) {
+		const CompatLogArchiveBlock& block = blocks[i];
+
+		/* Blocks in between might still be entirely out of range. */
+		if (block.LastTime < from || block.FirstTime > until)
+			continue;
+
+		lineno = block.LineNo;
+
+		if (!CompatLogArchive::ReadBlock(fp, block, data)) {
+			Log(LogWarning, "livestatus", "Could not read block at offset " + Convert::ToString(block.Offset)
+			    + " of log file '" + m_Path + "'.");
+			break;
+		}
+
+		if (!data.empty() && !ProcessLines(&data[0], 0, data.size(), from, until, callback, &lineno))
+			return false;
+	}
+
+	if (lastLine)
+		*lastLine = lineno;
+
+	return true;
+}
+
+bool LogFile::Map(void)
+{
+	if (m_Data)
+		return true;
+
+	/* Compressed archives without a block index are decompressed as a whole. */
+	if (CompatLogArchive::IsCompressed(m_Path)) {
+		if (!CompatLogArchive::ReadAll(m_Path, m_Buffer) || m_Buffer.empty()) {
+			m_Buffer.clear();
+			return false;
+		}
+
+		m_Data = &m_Buffer[0];
+		m_DataLength = m_Buffer.size();
+
+		return true;
+	}
+
+#ifndef _WIN32
+	m_Fd = open(m_Path.CStr(), O_RDONLY);
+
+	if (m_Fd < 0)
+		return false;
+
+	struct stat statbuf;
+
+	if (fstat(m_Fd, &statbuf) < 0) {
+		Unmap();
+		return false;
+	}
+
+	m_DataLength = statbuf.st_size;
+
+	if (m_Length >= 0 && static_cast<size_t>(m_Length) < m_DataLength)
+		m_DataLength = m_Length;
+
+	if (m_DataLength == 0) {
+		Unmap();
+		return false;
+	}
+
+	void *data = mmap(NULL, m_DataLength, PROT_READ, MAP_PRIVATE, m_Fd, 0);
+
+	if (data == MAP_FAILED) {
+		Log(LogWarning, "livestatus", "Could not map log file '" + m_Path + "': " + strerror(errno));
+		Unmap();
+		return false;
+	}
+
+	(void) madvise(data, m_DataLength, MADV_SEQUENTIAL);
+
+	m_Data = static_cast<const char *>(data);
+#else /* _WIN32 */
+	std::ifstream fp(m_Path.CStr(), std::ifstream::binary);
+
+	if (!fp)
+		return false;
+
+	fp.seekg(0, std::ifstream::end);
+	m_DataLength = fp.tellg();
+	fp.seekg(0, std::ifstream::beg);
+
+	if (m_Length >= 0 && static_cast<size_t>(m_Length) < m_DataLength)
+		m_DataLength = m_Length;
+
+	if (m_DataLength == 0)
+		return false;
+
+	m_Buffer.resize(m_DataLength);
+	fp.read(&m_Buffer[0], m_DataLength);
+	m_DataLength = fp.gcount();
+
+	m_Data = &m_Buffer[0];
+#endif /* _WIN32 */
+
+	return true;
+}
+
+void LogFile::Unmap(void)
+{
+#ifndef _WIN32
+	if (m_Data && m_Buffer.empty())
+		(void) munmap(const_cast<char *>(m_Data), m_DataLength);
+
+	if (m_Fd >= 0)
+		close(m_Fd);
+
+	m_Fd = -1;
+#endif /* _WIN32 */
+
+	m_Buffer.clear();
+
+	m_Data = NULL;
+	m_DataLength = 0;
+}
+
+void LogFile::BuildIndex(void)
+{
+	if (!Map())
+		return;
+
+	shared_ptr<LogIndex> index = boost::make_shared<LogIndex>();
+	ExtendIndex(index.get(), m_Data, m_DataLength, true);
+
+	m_Index = index;
+}
+
+/**
+ * Builds the time index for a compressed archive from its block index. There
+ * is one sample per block.
+ */
+void LogFile::BuildBlockIndex(const std::vector<CompatLogArchiveBlock>& blocks, long size)
+{
+	shared_ptr<LogIndex> index = boost::make_shared<LogIndex>();
+	index->Size = size;
+	index->MTime = 0;
+	index->FirstTime = 0;
+	index->LastTime = 0;
+	index->Blocks = blocks;
+
+	double maxTime = -1;
+	bool first = true;
+
+	BOOST_FOREACH(const CompatLogArchiveBlock& block, blocks) {
+		LogIndexSample sample;
+		sample.Offset = block.DataOffset;
+		sample.LineNo = block.LineNo;
+		sample.MaxTimeBefore = maxTime;
+		sample.MinTimeAfter = 0;
+		index->Samples.push_back(sample);
+
+		/* Blocks without any timestamps have LastTime < FirstTime. */
+		if (block.LastTime < block.FirstTime)
+			continue;
+
+		if (first || block.FirstTime < index->FirstTime)
+			index->FirstTime = block.FirstTime;
+
+		if (first || block.LastTime > index->LastTime)
+			index->LastTime = block.LastTime;
+
+		first = false;
+
+		if (block.LastTime > maxTime)
+			maxTime = block.LastTime;
+	}
+
+	double suffixMin = std::numeric_limits<double>::max();
+
+	for (size_t i = blocks.size(); i-- > 0;) {
+		if (blocks[i].FirstTime < suffixMin)
+			suffixMin = blocks[i].FirstTime;
+
+		index->Samples[i].MinTimeAfter = suffixMin;
+	}
+
+	m_Index = index;
+}
+
+bool LogFile::LoadIndex(const String& indexPath, long size, double mtime)
+{
+	std::ifstream fp(indexPath.CStr());
+
+	if (!fp)
+		return false;
+
+	String magic;
+	int version;
+	size_t count;
+
+	shared_ptr<LogIndex> index = boost::make_shared<LogIndex>();
+
+	fp >> magic >> version >> index->Size >> index->MTime
+	   >> index->FirstTime >> index->LastTime >> count;
+
+	if (!fp || magic != "icinga2-logindex" || version != LOG_INDEX_VERSION ||
+	    index->Size != size || index->MTime != mtime)
+		return false;
+
+	/* Each sample is at least LOG_INDEX_INTERVAL lines (and therefore
+	 * bytes) after the previous one. Don't trust a corrupt index. */
+	if (count > static_cast<size_t>(size) / LOG_INDEX_INTERVAL + 1)
+		return false;
+
+	index->Samples.resize(count);
+
+	for (size_t i = 0; i < count; i++) {
+		LogIndexSample& sample = index->Samples[i];
+		fp >> sample.Offset >> sample.LineNo >> sample.MaxTimeBefore >> sample.MinTimeAfter;
+	}
+
+	if (!fp)
+		return false;
+
+	m_Index = index;
+
+	return true;
+}
+
+void LogFile::SaveIndex(const String& indexPath) const
+{
+	String tempPath = indexPath + ".tmp";
+
+	std::ofstream fp(tempPath.CStr(), std::ofstream::out | std::ofstream::trunc);
+
+	if (!fp) {
+		Log(LogDebug, "livestatus", "Could not write log index '" + indexPath + "'.");
+		return;
+	}
+
+	fp.precision(17);
+
+	fp << "icinga2-logindex " << LOG_INDEX_VERSION << " " << m_Index->Size << " " << m_Index->MTime
+	   << " " << m_Index->FirstTime << " " << m_Index->LastTime << " " << m_Index->Samples.size() << "\n";
+
+	for (std::vector<LogIndexSample>::const_iterator it = m_Index->Samples.begin(); it != m_Index->Samples.end(); it++)
+		fp << it->Offset << " " << it->LineNo << " " << it->MaxTimeBefore << " " << it->MinTimeAfter << "\n";
+
+	fp.close();
+
+	if (!fp || rename(tempPath.CStr(), indexPath.CStr()) < 0) {
+		Log(LogDebug, "livestatus", "Could not write log index '" + indexPath + "'.");
+		(void) remove(tempPath.CStr());
+	}
+}
@@ -0,0 +1,130 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef LOGFILE_H
+#define LOGFILE_H
+
+#include "icinga/compatlogarchive.h"
+#include "base/object.h"
+#include "base/qstring.h"
+#include <boost/function.hpp>
+#include <vector>
+
+using namespace icinga;
+
+namespace livestatus
+{
+
+/**
+ * A seek position in a compat log file.
+ *
+ * @ingroup livestatus
+ */
+struct LogIndexSample
+{
+	long Offset; /**< The file offset of the line. */
+	long LineNo; /**< The line number. */
+	double MaxTimeBefore; /**< Highest timestamp of all previous lines. */
+	double MinTimeAfter; /**< Lowest timestamp of this and all following lines. */
+};
+
+/**
+ * Time index for a compat log file.
+ *
+ * @ingroup livestatus
+ */
+struct LogIndex
+{
+	long Size;
+	double MTime;
+	double FirstTime;
+	double LastTime;
+	std::vector<LogIndexSample> Samples;
+	std::vector<CompatLogArchiveBlock> Blocks; /**< Only set for compressed archives. */
+
+	/* These are only set for indexes which were built by reading the
+	 * file, they're needed to extend the index when lines are appended. */
+	long LineCount;
+	double MaxTime; /**< Highest timestamp, or -1 if there is none. */
+	std::vector<double> BlockMinTimes; /**< Lowest timestamp after each sample, up to the next one. */
+
+	LogIndex(void)
+		: Size(0), MTime(0), FirstTime(0), LastTime(0), LineCount(0), MaxTime(-1)
+	{ }
+};
+
+/**
+ * A compat log file. Log files are indexed by time so that readers can skip
+ * files and seek directly to the lines they are interested in. The index
+ * of the current log file is kept in memory and extended as lines are
+ * appended.
+ * Compressed archives are indexed by their block index, and only the blocks
+ * within the requested time range are decompressed.
+ *
+ * @ingroup livestatus
+ */
+class LogFile : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(LogFile);
+
+	typedef boost::function<bool (const char *, size_t, long)> LineCallback;
+
+	LogFile(const String& path, long length = -1);
+	~LogFile(void);
+
+	static LogFile::Ptr OpenArchive(const String& path);
+	static LogFile::Ptr OpenCurrent(const String& path, long length);
+
+	String GetPath(void) const;
+
+	bool HasIndex(void) const;
+	shared_ptr<LogIndex> GetIndex(void) const;
+	double GetFirstTime(void) const;
+	double GetLastTime(void) const;
+
+	bool ReadLines(double from, double until, const LineCallback& callback, long *lastLine = NULL);
+
+private:
+	String m_Path;
+	long m_Length;
+
+	shared_ptr<LogIndex> m_Index;
+
+	const char *m_Data;
+	size_t m_DataLength;
+#ifndef _WIN32
+	int m_Fd;
+#endif /* _WIN32 */
+	std::vector<char> m_Buffer;
+
+	bool Map(void);
+	void Unmap(void);
+
+	bool ReadBlocks(double from, double until, const LineCallback& callback, long *lastLine);
+
+	void BuildIndex(void);
+	void BuildBlockIndex(const std::vector<CompatLogArchiveBlock>& blocks, long size);
+	bool LoadIndex(const String& indexPath, long size, double mtime);
+	void SaveIndex(const String& indexPath) const;
+};
+
+}
+
+#endif /* LOGFILE_H */
@@ -20,12 +20,24 @@
 #include "livestatus/logtable.h"
 #include "icinga/icingaapplication.h"
 #include "icinga/cib.h"
+#include "icinga/service.h"
+#include "icinga/host.h"
+#include "icinga/compatlogbuffer.h"
+#include "icinga/compatutility.h"
+#include "base/utility.h"
+#include "base/convert.h"
 #include <boost/smart_ptr/make_shared.hpp>
+#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <algorithm>
 
 using namespace icinga;
 using namespace livestatus;
 
-LogTable::LogTable(void)
+LogTable::LogTable(const String& compat_log_path, double from, double until)
+	: m_CompatLogPath(compat_log_path), m_TimeFrom(from), m_TimeUntil(until)
 {
 	AddColumns(this);
 }
@@ -59,98 +71,345 @@ String LogTable::GetName(void) const
 
 void LogTable::FetchRows(const AddRowFunction& addRowFn)
 {
-	Object::Ptr obj = boost::make_shared<Object>();
+	LogFile::LineCallback callback = boost::bind(&LogTable::ProcessLine, boost::cref(addRowFn), _1, _2, _3);
 
-	/* Return a fake row. */
-	addRowFn(obj);
+	BOOST_FOREACH(const LogFile::Ptr& archive, GetArchives(m_CompatLogPath, m_TimeFrom, m_TimeUntil)) {
+		if (!archive->ReadLines(m_TimeFrom, m_TimeUntil, callback))
+			return;
+	}
+
+	ReadCurrentLogLines(m_CompatLogPath, m_TimeFrom, m_TimeUntil, callback);
+}
+
+/**
+ * Returns the archived log files which contain entries for the specified
+ * time range, sorted by time. Archived log files are immutable; their time
+ * index tells us whether we need to open them at all.
+ *
+ * @param compat_log_path The compat log directory.
+ * @param from The lower bound for the timestamps.
+ * @param until The upper bound for the timestamps.
+ * @returns The log files.
+ */
+std::vector<LogFile::Ptr> LogTable::GetArchives(const String& compat_log_path, double from, double until)
+{
+	std::vector<LogFile::Ptr> archives;
+
+	Utility::Glob(compat_log_path + "/archives/icinga-*.log",
+	    boost::bind(&LogTable::AddArchive, boost::ref(archives), from, until, _1));
+	Utility::Glob(compat_log_path + "/archives/icinga-*.log.gz",
+	    boost::bind(&LogTable::AddArchive, boost::ref(archives), from, until, _1));
+
+	std::sort(archives.begin(), archives.end(), &LogTable::CompareArchives);
+
+	return archives;
+}
+
+/**
+ * Parses the entries of the current (i.e. not yet archived) log file for the
+ * specified time range.
+ *
+ * @param compat_log_path The compat log directory.
+ * @param from The lower bound for the timestamps.
+ * @param until The upper bound for the timestamps.
+ * @param addRowFn The callback which is invoked for each parsed entry.
+ * @returns false if reading was stopped by the callback, true otherwise.
+ */
+bool LogTable::ReadCurrentLog(const String& compat_log_path, double from, double until, const AddRowFunction& addRowFn)
+{
+	return ReadCurrentLogLines(compat_log_path, from, until, boost::bind(&LogTable::ProcessLine, boost::cref(addRowFn), _1, _2, _3));
+}
+
+/**
+ * Reads the lines of the current log file for the specified time range.
+ * See LogFile::ReadLines() for the parameters.
+ */
+bool LogTable::ReadCurrentLogLines(const String& compat_log_path, double from, double until, const LogFile::LineCallback& callback)
+{
+	/* The most recent lines of the current log file are kept in memory by
+	 * the CompatLog writer. Only the part of the file which is no longer
+	 * buffered has to be read from disk. */
+	String path = compat_log_path + "/icinga.log";
+	long offset;
+	std::vector<String> lines;
+
+	if (!CompatLogBuffer::GetLines(path, &offset, lines))
+		offset = -1;
+
+	long lineno = 0;
+
+	if (offset != 0) {
+		LogFile::Ptr current = LogFile::OpenCurrent(path, offset);
+
+		if (!current->ReadLines(from, until, callback, &lineno))
+			return false;
+
+		/* ReadLines() stops at the last line within the time range. The
+		 * buffered lines start right after the indexed ones. */
+		if (offset > 0 && current->HasIndex())
+			lineno = current->GetIndex()->LineCount;
+	}
+
+	BOOST_FOREACH(const String& line, lines) {
+		lineno++;
+
+		double ts;
+
+		if (!CompatUtility::ParseLogTimestamp(line.CStr(), line.GetLength(), &ts) || ts < from || ts > until)
+			continue;
+
+		if (!callback(line.CStr(), line.GetLength(), lineno))
+			return false;
+	}
+
+	return true;
+}
+
+void LogTable::AddArchive(std::vector<LogFile::Ptr>& archives, double from, double until, const String& path)
+{
+	LogFile::Ptr archive = LogFile::OpenArchive(path);
+
+	if (!archive)
+		return;
+
+	if (archive->GetLastTime() < from || archive->GetFirstTime() > until)
+		return;
+
+	archives.push_back(archive);
+}
+
+bool LogTable::CompareArchives(const LogFile::Ptr& a, const LogFile::Ptr& b)
+{
+	return a->GetFirstTime() < b->GetFirstTime();
+}
+
+bool LogTable::ProcessLine(const AddRowFunction& addRowFn, const char *line, size_t length, long lineno)
+{
+	return addRowFn(ParseLine(String(line, line + length), lineno));
+}
+
+/**
+ * Parses a compat log line into a log table row.
+ *
+ * @param text The line.
+ * @param lineno The line number.
+ * @returns The row.
+ */
+Dictionary::Ptr LogTable::ParseLine(const String& text, long lineno)
+{
+	Dictionary::Ptr bag = boost::make_shared<Dictionary>();
+
+	size_t ts_end = text.FindFirstOf(']');
+
+	bag->Set("time", Convert::ToLong(text.SubStr(1, ts_end - 1)));
+	bag->Set("lineno", lineno);
+	bag->Set("class", LogClassInfo);
+
+	String message;
+
+	if (text.GetLength() > ts_end + 2)
+		message = text.SubStr(ts_end + 2);
+
+	bag->Set("message", message);
+
+	size_t colon = message.Find(": ");
+
+	if (colon == String::NPos)
+		return bag;
+
+	String type = message.SubStr(0, colon);
+	String options = message.SubStr(colon + 2);
+
+	bag->Set("type", type);
+	bag->Set("options", options);
+
+	std::vector<String> tokens;
+	boost::algorithm::split(tokens, options, boost::is_any_of(";"));
+
+	if (type == "HOST STATE" || type == "SERVICE STATE") {
+		/* "CURRENT;" or "INITIAL;" */
+		if (!tokens.empty())
+			tokens.erase(tokens.begin());
+
+		type = (type == "HOST STATE") ? "HOST ALERT" : "SERVICE ALERT";
+		bag->Set("class", LogClassState);
+	} else if (type == "SERVICE ALERT" || type == "HOST ALERT" ||
+	    type == "SERVICE FLAPPING ALERT" || type == "HOST FLAPPING ALERT" ||
+	    type == "SERVICE DOWNTIME ALERT" || type == "HOST DOWNTIME ALERT") {
+		bag->Set("class", LogClassAlert);
+	} else if (type == "SERVICE NOTIFICATION" || type == "HOST NOTIFICATION") {
+		bag->Set("class", LogClassNotification);
+	} else if (type == "LOG ROTATION" || type == "LOG VERSION") {
+		bag->Set("class", LogClassProgram);
+	} else if (type == "EXTERNAL COMMAND") {
+		bag->Set("class", LogClassCommand);
+	}
+
+	if (type == "SERVICE ALERT" && tokens.size() >= 5) {
+		bag->Set("host_name", tokens[0]);
+		bag->Set("service_description", tokens[1]);
+		bag->Set("state", Service::StateFromString(tokens[2]));
+		bag->Set("state_type", tokens[3]);
+		bag->Set("attempt", Convert::ToLong(tokens[4]));
+
+		if (tokens.size() > 5)
+			bag->Set("plugin_output", tokens[5]);
+	} else if (type == "HOST ALERT" && tokens.size() >= 4) {
+		bag->Set("host_name", tokens[0]);
+		bag->Set("state", Host::StateFromString(tokens[1]));
+		bag->Set("state_type", tokens[2]);
+		bag->Set("attempt", Convert::ToLong(tokens[3]));
+
+		if (tokens.size() > 4)
+			bag->Set("plugin_output", tokens[4]);
+	} else if ((type == "SERVICE FLAPPING ALERT" || type == "SERVICE DOWNTIME ALERT") && tokens.size() >= 3) {
+		bag->Set("host_name", tokens[0]);
+		bag->Set("service_description", tokens[1]);
+		bag->Set("state_type", tokens[2]);
+
+		if (tokens.size() > 3)
+			bag->Set("comment", tokens[3]);
+	} else if ((type == "HOST FLAPPING ALERT" || type == "HOST DOWNTIME ALERT") && tokens.size() >= 2) {
+		bag->Set("host_name", tokens[0]);
+		bag->Set("state_type", tokens[1]);
+
+		if (tokens.size() > 2)
+			bag->Set("comment", tokens[2]);
+	} else if (type == "SERVICE NOTIFICATION" && tokens.size() >= 5) {
+		/* contact;host;service;type (state);command;output */
+		bag->Set("contact_name", tokens[0]);
+		bag->Set("host_name", tokens[1]);
+		bag->Set("service_description", tokens[2]);
+		bag->Set("state_type", tokens[3]);
+		bag->Set("command_name", tokens[4]);
+
+		size_t paren = tokens[3].FindFirstOf('(');
+
+		if (paren != String::NPos)
+			bag->Set("state", Service::StateFromString(tokens[3].SubStr(paren + 1, tokens[3].GetLength() - paren - 2)));
+
+		if (tokens.size() > 5)
+			bag->Set("plugin_output", tokens[5]);
+	} else if (type == "HOST NOTIFICATION" && tokens.size() >= 4) {
+		/* contact;host;type (state);command;output */
+		bag->Set("contact_name", tokens[0]);
+		bag->Set("host_name", tokens[1]);
+		bag->Set("state_type", tokens[2]);
+		bag->Set("command_name", tokens[3]);
+
+		size_t paren = tokens[2].FindFirstOf('(');
+
+		if (paren != String::NPos)
+			bag->Set("state", Host::StateFromString(tokens[2].SubStr(paren + 1, tokens[2].GetLength() - paren - 2)));
+
+		if (tokens.size() > 4)
+			bag->Set("plugin_output", tokens[4]);
+	}
+
+	return bag;
 }
 
 Value LogTable::TimeAccessor(const Value& row)
 {
-	/* not supported */
-	return Empty;
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("time");
 }
 
 Value LogTable::LinenoAccessor(const Value& row)
 {
-	/* not supported */
-	return Empty;
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("lineno");
 }
 
 Value LogTable::ClassAccessor(const Value& row)
 {
-	/* not supported */
-	return Empty;
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("class");
 }
 
 Value LogTable::MessageAccessor(const Value& row)
 {
-	/* not supported */
-	return Empty;
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("message");
 }
 
 Value LogTable::TypeAccessor(const Value& row)
 {
-	/* not supported */
-	return Empty;
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("type");
 }
 
 Value LogTable::OptionsAccessor(const Value& row)
 {
-	/* not supported */
-	return Empty;
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("options");
 }
 
 Value LogTable::CommentAccessor(const Value& row)
 {
-	/* not supported */
-	return Empty;
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("comment");
 }
 
 Value LogTable::PluginOutputAccessor(const Value& row)
 {
-	/* not supported */
-	return Empty;
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("plugin_output");
 }
 
 Value LogTable::StateAccessor(const Value& row)
 {
-	/* not supported */
-	return Empty;
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("state");
 }
 
 Value LogTable::StateTypeAccessor(const Value& row)
 {
-	/* not supported */
-	return Empty;
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("state_type");
 }
 
 Value LogTable::AttemptAccessor(const Value& row)
 {
-	/* not supported */
-	return Empty;
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("attempt");
 }
 
 Value LogTable::ServiceDescriptionAccessor(const Value& row)
 {
-	/* not supported */
-	return Empty;
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("service_description");
 }
 
 Value LogTable::HostNameAccessor(const Value& row)
 {
-	/* not supported */
-	return Empty;
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("host_name");
 }
 
 Value LogTable::ContactNameAccessor(const Value& row)
 {
-	/* not supported */
-	return Empty;
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("contact_name");
 }
 
 Value LogTable::CommandNameAccessor(const Value& row)
 {
-	/* not supported */
-	return Empty;
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("command_name");
 }
@@ -21,12 +21,31 @@
 #define LOGTABLE_H
 
 #include "livestatus/table.h"
+#include "livestatus/logfile.h"
+#include "base/dictionary.h"
 
 using namespace icinga;
 
 namespace livestatus
 {
 
+/**
+ * Livestatus log entry classes.
+ *
+ * @ingroup livestatus
+ */
+enum LogEntryClass
+{
+	LogClassInfo = 0,
+	LogClassAlert = 1,
+	LogClassProgram = 2,
+	LogClassNotification = 3,
+	LogClassPassive = 4,
+	LogClassCommand = 5,
+	LogClassState = 6,
+	LogClassText = 7
+};
+
 /**
  * @ingroup livestatus
  */
@@ -35,13 +54,20 @@ class LogTable : public Table
 public:
 	DECLARE_PTR_TYPEDEFS(LogTable);
 
-	LogTable(void);
+	LogTable(const String& compat_log_path, double from, double until);
 
 	static void AddColumns(Table *table, const String& prefix = String(),
 	    const Column::ObjectAccessor& objectAccessor = Column::ObjectAccessor());
 
 	virtual String GetName(void) const;
 
+	static std::vector<LogFile::Ptr> GetArchives(const String& compat_log_path, double from, double until);
+	static bool ReadCurrentLog(const String& compat_log_path, double from, double until, const AddRowFunction& addRowFn);
+	static bool ReadCurrentLogLines(const String& compat_log_path, double from, double until, const LogFile::LineCallback& callback);
+
+	static bool ProcessLine(const AddRowFunction& addRowFn, const char *line, size_t length, long lineno);
+	static Dictionary::Ptr ParseLine(const String& text, long lineno);
+
 protected:
 	virtual void FetchRows(const AddRowFunction& addRowFn);
 
@@ -60,6 +86,14 @@ protected:
 	static Value HostNameAccessor(const Value& row);
 	static Value ContactNameAccessor(const Value& row);
 	static Value CommandNameAccessor(const Value& row);
+
+private:
+	String m_CompatLogPath;
+	double m_TimeFrom;
+	double m_TimeUntil;
+
+	static void AddArchive(std::vector<LogFile::Ptr>& archives, double from, double until, const String& path);
+	static bool CompareArchives(const LogFile::Ptr& a, const LogFile::Ptr& b);
 };
 
 }
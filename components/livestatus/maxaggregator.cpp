@@ -18,21 +18,16 @@
  ******************************************************************************/
 
 #include "livestatus/maxaggregator.h"
+#include <boost/smart_ptr/make_shared.hpp>
 
 using namespace livestatus;
 
 MaxAggregator::MaxAggregator(const String& attr)
-    : m_Max(0)
-{
-	m_MaxAttr = attr;
-}
+    : Aggregator(attr), m_Max(0)
+{ }
 
-void MaxAggregator::Apply(const Table::Ptr& table, const Value& row)
+void MaxAggregator::ApplyValue(const Value& value)
 {
-	Column column = table->GetColumn(m_MaxAttr);
-
-	Value value = column.ExtractValue(row);
-
 	if (value > m_Max)
 		m_Max = value;
 }
@@ -41,3 +36,8 @@ double MaxAggregator::GetResult(void) const
 {
 	return m_Max;
 }
+
+Aggregator::Ptr MaxAggregator::Clone(void) const
+{
+	return boost::make_shared<MaxAggregator>(GetAttribute());
+}
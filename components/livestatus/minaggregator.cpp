@@ -18,21 +18,16 @@
  ******************************************************************************/
 
 #include "livestatus/minaggregator.h"
+#include <boost/smart_ptr/make_shared.hpp>
 
 using namespace livestatus;
 
 MinAggregator::MinAggregator(const String& attr)
-    : m_Min(0)
-{
-	m_MinAttr = attr;
-}
+    : Aggregator(attr), m_Min(0)
+{ }
 
-void MinAggregator::Apply(const Table::Ptr& table, const Value& row)
+void MinAggregator::ApplyValue(const Value& value)
 {
-	Column column = table->GetColumn(m_MinAttr);
-
-	Value value = column.ExtractValue(row);
-
 	if (value < m_Min)
 		m_Min = value;
 }
@@ -41,3 +36,8 @@ double MinAggregator::GetResult(void) const
 {
 	return m_Min;
 }
+
+Aggregator::Ptr MinAggregator::Clone(void) const
+{
+	return boost::make_shared<MinAggregator>(GetAttribute());
+}
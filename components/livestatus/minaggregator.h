@@ -36,12 +36,12 @@ public:
 
 	MinAggregator(const String& attr);
 
-	virtual void Apply(const Table::Ptr& table, const Value& row);
+	virtual void ApplyValue(const Value& value);
 	virtual double GetResult(void) const;
+	virtual Aggregator::Ptr Clone(void) const;
 
 private:
 	double m_Min;
-	String m_MinAttr;
 };
 
 }
@@ -31,6 +31,8 @@
 #include "livestatus/orfilter.h"
 #include "livestatus/andfilter.h"
 #include "icinga/externalcommandprocessor.h"
+#include "icinga/host.h"
+#include "icinga/service.h"
 #include "base/debug.h"
 #include "base/convert.h"
 #include "base/objectlock.h"
@@ -40,6 +42,11 @@
 #include <boost/smart_ptr/make_shared.hpp>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string/split.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
 
 using namespace icinga;
 using namespace livestatus;
@@ -47,8 +54,16 @@ using namespace livestatus;
 static int l_ExternalCommands = 0;
 static boost::mutex l_QueryMutex;
 
-Query::Query(const std::vector<String>& lines)
-	: m_KeepAlive(false), m_OutputFormat("csv"), m_ColumnHeaders(true), m_Limit(-1)
+static boost::mutex l_TriggerMutex;
+static boost::condition_variable l_TriggerCV;
+static unsigned long l_TriggerCounters[TriggerCount];
+static unsigned long l_WaitGeneration;
+
+Query::Query(const std::vector<String>& lines, const String& compat_log_path)
+	: m_KeepAlive(false), m_OutputFormat("csv"), m_ColumnHeaders(true), m_Limit(-1), m_Offset(0),
+	  m_OrderDescending(false),
+	  m_WaitTrigger(TriggerAll), m_WaitTimeout(-1), m_CompatLogPath(compat_log_path),
+	  m_LogTimeFrom(0), m_LogTimeUntil(std::numeric_limits<double>::max())
 {
 	if (lines.size() == 0) {
 		m_Verb = "ERROR";
@@ -86,7 +101,7 @@ Query::Query(const std::vector<String>& lines)
 		return;
 	}
 
-	std::deque<Filter::Ptr> filters, stats;
+	std::deque<Filter::Ptr> filters, stats, waitconds;
 	std::deque<Aggregator::Ptr> aggregators;
 
 	for (unsigned int i = 1; i < lines.size(); i++) {
@@ -104,7 +119,7 @@ Query::Query(const std::vector<String>& lines)
 			m_ResponseHeader = params;
 		else if (header == "OutputFormat")
 			m_OutputFormat = params;
-		else if (header == "Columns")
+		else if (header == "Columns" || header == "StatsGroupBy")
 			boost::algorithm::split(m_Columns, params, boost::is_any_of(" "));
 		else if (header == "Separators")
 			boost::algorithm::split(separators, params, boost::is_any_of(" "));
@@ -119,6 +134,27 @@ Query::Query(const std::vector<String>& lines)
 				m_Separators[3] = String(1, static_cast<char>(Convert::ToLong(separators[3])));
 		else if (header == "ColumnHeaders")
 			m_ColumnHeaders = (params == "on");
+		else if (header == "Limit" || header == "Offset") {
+			long value = Convert::ToLong(params);
+
+			if (value < 0) {
+				m_Verb = "ERROR";
+				m_ErrorCode = LivestatusErrorQuery;
+				m_ErrorMessage = header + " must not be negative: " + line;
+				return;
+			}
+
+			if (header == "Limit")
+				m_Limit = value;
+			else
+				m_Offset = value;
+		} else if (header == "OrderBy") {
+			std::vector<String> tokens;
+			boost::algorithm::split(tokens, params, boost::is_any_of(" "));
+
+			m_OrderBy = tokens[0];
+			m_OrderDescending = (tokens.size() > 1 && tokens[1] == "desc");
+		}
 		else if (header == "Filter") {
 			Filter::Ptr filter = ParseFilter(params);
 
@@ -130,6 +166,48 @@ Query::Query(const std::vector<String>& lines)
 			}
 
 			filters.push_back(filter);
+		} else if (header == "WaitObject") {
+			m_WaitObject = params;
+			m_WaitObjectFilter = ParseWaitObject(m_Table, params);
+		} else if (header == "WaitCondition") {
+			Filter::Ptr filter = ParseFilter(params);
+
+			if (!filter) {
+				m_Verb = "ERROR";
+				m_ErrorCode = LivestatusErrorQuery;
+				m_ErrorMessage = "Invalid wait condition specification: " + line;
+				return;
+			}
+
+			waitconds.push_back(filter);
+		} else if (header == "WaitTrigger") {
+			if (params == "check")
+				m_WaitTrigger = TriggerCheck;
+			else if (params == "state")
+				m_WaitTrigger = TriggerState;
+			else if (params == "log")
+				m_WaitTrigger = TriggerLog;
+			else if (params == "downtime")
+				m_WaitTrigger = TriggerDowntime;
+			else if (params == "comment")
+				m_WaitTrigger = TriggerComment;
+			else if (params == "command")
+				m_WaitTrigger = TriggerCommand;
+			else if (params == "program")
+				m_WaitTrigger = TriggerProgram;
+			else if (params == "all")
+				m_WaitTrigger = TriggerAll;
+			else {
+				m_Verb = "ERROR";
+				m_ErrorCode = LivestatusErrorQuery;
+				m_ErrorMessage = "Invalid wait trigger: " + line;
+				return;
+			}
+
+			if (m_WaitTimeout == -1)
+				m_WaitTimeout = 0;
+		} else if (header == "WaitTimeout") {
+			m_WaitTimeout = Convert::ToLong(params);
 		} else if (header == "Stats") {
 			std::vector<String> tokens;
 			boost::algorithm::split(tokens, params, boost::is_any_of(" "));
@@ -178,13 +256,13 @@ Query::Query(const std::vector<String>& lines)
 			aggregators.push_back(aggregator);
 
 			stats.push_back(filter);
-		} else if (header == "Or" || header == "And") {
-			std::deque<Filter::Ptr>& deq = (header == "Or" || header == "And") ? filters : stats;
+		} else if (header == "Or" || header == "And" || header == "WaitConditionOr" || header == "WaitConditionAnd") {
+			std::deque<Filter::Ptr>& deq = (header == "Or" || header == "And") ? filters : waitconds;
 
 			int num = Convert::ToLong(params);
 			CombinerFilter::Ptr filter;
 
-			if (header == "Or" || header == "StatsOr")
+			if (header == "Or" || header == "StatsOr" || header == "WaitConditionOr")
 				filter = boost::make_shared<OrFilter>();
 			else
 				filter = boost::make_shared<AndFilter>();
@@ -202,8 +280,8 @@ Query::Query(const std::vector<String>& lines)
 			}
 
 			deq.push_back(filter);
-		} else if (header == "Negate" || header == "StatsNegate") {
-			std::deque<Filter::Ptr>& deq = (header == "Negate") ? filters : stats;
+		} else if (header == "Negate" || header == "StatsNegate" || header == "WaitConditionNegate") {
+			std::deque<Filter::Ptr>& deq = (header == "Negate") ? filters : ((header == "WaitConditionNegate") ? waitconds : stats);
 
 			if (deq.empty()) {
 				m_Verb = "ERROR";
@@ -224,7 +302,7 @@ Query::Query(const std::vector<String>& lines)
 
 			deq.push_back(boost::make_shared<NegateFilter>(filter));
 
-			if (deq == stats) {
+			if (&deq == &stats) {
 				Aggregator::Ptr aggregator = aggregators.back();
 				aggregator->SetFilter(filter);
 			}
@@ -236,10 +314,28 @@ Query::Query(const std::vector<String>& lines)
 
 	BOOST_FOREACH(const Filter::Ptr& filter, filters) {
 		top_filter->AddSubFilter(filter);
+		GetTimeBounds(filter, &m_LogTimeFrom, &m_LogTimeUntil);
 	}
 
 	m_Filter = top_filter;
 	m_Aggregators.swap(aggregators);
+
+	if (!waitconds.empty() || m_WaitObjectFilter) {
+		AndFilter::Ptr wait_filter = boost::make_shared<AndFilter>();
+
+		/* Check the (cheap) object filter first. */
+		if (m_WaitObjectFilter)
+			wait_filter->AddSubFilter(m_WaitObjectFilter);
+
+		BOOST_FOREACH(const Filter::Ptr& filter, waitconds) {
+			wait_filter->AddSubFilter(filter);
+		}
+
+		m_WaitCondition = wait_filter;
+
+		if (m_WaitTimeout == -1)
+			m_WaitTimeout = 0;
+	}
 }
 
 int Query::GetExternalCommands(void)
@@ -249,6 +345,63 @@ int Query::GetExternalCommands(void)
 	return l_ExternalCommands;
 }
 
+/**
+ * Wakes up all queries which are waiting for the specified trigger.
+ *
+ * @param trigger The trigger.
+ * @threadsafety Always.
+ */
+void Query::Trigger(LivestatusTrigger trigger)
+{
+	boost::mutex::scoped_lock lock(l_TriggerMutex);
+
+	l_TriggerCounters[trigger]++;
+
+	if (trigger != TriggerAll)
+		l_TriggerCounters[TriggerAll]++;
+
+	l_TriggerCV.notify_all();
+}
+
+/**
+ * Wakes up all waiting queries regardless of their wait trigger and wait
+ * timeout, e.g. when the livestatus component is stopped.
+ *
+ * @threadsafety Always.
+ */
+void Query::CancelWaits(void)
+{
+	boost::mutex::scoped_lock lock(l_TriggerMutex);
+
+	l_WaitGeneration++;
+
+	l_TriggerCV.notify_all();
+}
+
+/**
+ * Builds a filter which matches the object specified in a WaitObject
+ * header. Services are specified as "host;service" or "host service".
+ */
+Filter::Ptr Query::ParseWaitObject(const String& table, const String& params)
+{
+	if (table == "services") {
+		size_t sep = params.FindFirstOf(";");
+
+		if (sep == String::NPos)
+			sep = params.FindFirstOf(" ");
+
+		AndFilter::Ptr filter = boost::make_shared<AndFilter>();
+		filter->AddSubFilter(boost::make_shared<AttributeFilter>("host_name", "=", params.SubStr(0, sep)));
+
+		if (sep != String::NPos)
+			filter->AddSubFilter(boost::make_shared<AttributeFilter>("description", "=", params.SubStr(sep + 1)));
+
+		return filter;
+	}
+
+	return boost::make_shared<AttributeFilter>("name", "=", params);
+}
+
 Filter::Ptr Query::ParseFilter(const String& params)
 {
 	std::vector<String> tokens;
@@ -285,6 +438,35 @@ Filter::Ptr Query::ParseFilter(const String& params)
 	return filter;
 }
 
+/**
+ * Narrows the time range for the log table if the filter is a top-level
+ * filter on the "time" column.
+ */
+void Query::GetTimeBounds(const Filter::Ptr& filter, double *from, double *until)
+{
+	AttributeFilter::Ptr attrFilter = dynamic_pointer_cast<AttributeFilter>(filter);
+
+	if (!attrFilter || attrFilter->GetColumn() != "time")
+		return;
+
+	String op = attrFilter->GetOperator();
+	String operand = attrFilter->GetOperand();
+
+	/* Invalid operands are reported when the filter is evaluated, we
+	 * just don't use them to narrow the time range. */
+	char *end;
+	double ts = strtod(operand.CStr(), &end);
+
+	if (operand.IsEmpty() || *end != '\0')
+		return;
+
+	if ((op == ">" || op == ">=" || op == "=") && ts > *from)
+		*from = ts;
+
+	if ((op == "<" || op == "<=" || op == "=") && ts < *until)
+		*until = ts;
+}
+
 void Query::PrintResultSet(std::ostream& fp, const std::vector<String>& columns, const Array::Ptr& rs)
 {
 	if (m_OutputFormat == "csv" && m_Columns.size() == 0 && m_ColumnHeaders) {
@@ -346,11 +528,200 @@ void Query::PrintCsvArray(std::ostream& fp, const Array::Ptr& array, int level)
 	}
 }
 
+/**
+ * Compares two rows by their sort key. Numbers are compared numerically,
+ * everything else as strings.
+ */
+struct SortedRowLess
+{
+	bool Descending;
+
+	SortedRowLess(bool descending)
+		: Descending(descending)
+	{ }
+
+	bool operator()(const SortedRow& a, const SortedRow& b) const
+	{
+		const Value& lhs = Descending ? b.Key : a.Key;
+		const Value& rhs = Descending ? a.Key : b.Key;
+
+		if (lhs.GetType() == ValueNumber && rhs.GetType() == ValueNumber)
+			return static_cast<double>(lhs) < static_cast<double>(rhs);
+		else
+			return static_cast<String>(lhs) < static_cast<String>(rhs);
+	}
+};
+
+/**
+ * Returns the rows which should be included in the result set, taking
+ * into account the Limit, Offset and OrderBy headers.
+ */
+std::vector<Value> Query::SelectRows(const Table::Ptr& table)
+{
+	long limit = -1;
+
+	if (m_Limit >= 0)
+		limit = m_Offset + m_Limit;
+
+	std::vector<Value> objects;
+
+	if (m_OrderBy.IsEmpty()) {
+		/* Without sorting, fetching rows stops once we have enough. */
+		objects = table->FilterRows(m_Filter, limit);
+
+		if (m_Offset > 0)
+			objects.erase(objects.begin(), objects.begin() + std::min(static_cast<size_t>(m_Offset), objects.size()));
+
+		return objects;
+	}
+
+	if (limit == 0)
+		return objects;
+
+	Column column = table->GetColumn(m_OrderBy);
+	SortedRowLess less(m_OrderDescending);
+	std::vector<SortedRow> heap;
+
+	/* Keep the first 'limit' rows (in output order) in a max-heap so we
+	 * don't have to sort the whole result set. */
+	BOOST_FOREACH(const Value& object, table->FilterRows(m_Filter)) {
+		SortedRow row;
+		row.Key = column.ExtractValue(object);
+		row.Row = object;
+
+		if (limit == -1) {
+			heap.push_back(row);
+		} else if (static_cast<long>(heap.size()) < limit) {
+			heap.push_back(row);
+			std::push_heap(heap.begin(), heap.end(), less);
+		} else if (less(row, heap.front())) {
+			std::pop_heap(heap.begin(), heap.end(), less);
+			heap.back() = row;
+			std::push_heap(heap.begin(), heap.end(), less);
+		}
+	}
+
+	if (limit == -1)
+		std::sort(heap.begin(), heap.end(), less);
+	else
+		std::sort_heap(heap.begin(), heap.end(), less);
+
+	for (std::vector<SortedRow>::size_type i = m_Offset; i < heap.size(); i++)
+		objects.push_back(heap[i].Row);
+
+	return objects;
+}
+
+bool Query::IsWaitConditionSatisfied(const Table::Ptr& table)
+{
+	Value row;
+
+	/* Only the row for the WaitObject needs to be checked. */
+	if (GetWaitObjectRow(&row))
+		return !row.IsEmpty() && m_WaitCondition->Apply(table, row);
+
+	return !table->FilterRows(m_WaitCondition, 1).empty();
+}
+
+/**
+ * Looks up the row for the object specified in the WaitObject header.
+ *
+ * @param row The row, or an empty value if the object does not exist.
+ * @returns false if there's no WaitObject or the table does not support
+ *	    direct lookups, true otherwise.
+ */
+bool Query::GetWaitObjectRow(Value *row) const
+{
+	if (m_WaitObject.IsEmpty())
+		return false;
+
+	if (m_Table == "hosts") {
+		Host::Ptr host = Host::GetByName(m_WaitObject);
+
+		if (host)
+			*row = host;
+
+		return true;
+	} else if (m_Table == "services") {
+		size_t sep = m_WaitObject.FindFirstOf(";");
+
+		if (sep == String::NPos)
+			sep = m_WaitObject.FindFirstOf(" ");
+
+		if (sep == String::NPos)
+			return false;
+
+		Service::Ptr service = Service::GetByNamePair(m_WaitObject.SubStr(0, sep), m_WaitObject.SubStr(sep + 1));
+
+		if (service)
+			*row = service;
+
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Blocks until the wait condition holds, the wait trigger fired or the
+ * wait timeout expired - whichever comes first.
+ */
+void Query::WaitForCondition(const Table::Ptr& table)
+{
+	boost::system_time deadline;
+
+	if (m_WaitTimeout > 0)
+		deadline = boost::get_system_time() + boost::posix_time::milliseconds(m_WaitTimeout);
+
+	unsigned long generation;
+
+	{
+		boost::mutex::scoped_lock lock(l_TriggerMutex);
+		generation = l_WaitGeneration;
+	}
+
+	for (;;) {
+		unsigned long counter;
+
+		{
+			boost::mutex::scoped_lock lock(l_TriggerMutex);
+
+			if (l_WaitGeneration != generation)
+				return;
+
+			counter = l_TriggerCounters[m_WaitTrigger];
+		}
+
+		/* The condition is evaluated after taking a snapshot of the
+		 * trigger counter so we can't miss any events in between. */
+		if (m_WaitCondition && IsWaitConditionSatisfied(table))
+			return;
+
+		boost::mutex::scoped_lock lock(l_TriggerMutex);
+
+		while (l_TriggerCounters[m_WaitTrigger] == counter) {
+			if (l_WaitGeneration != generation)
+				return;
+
+			if (m_WaitTimeout > 0) {
+				if (!l_TriggerCV.timed_wait(lock, deadline))
+					return;
+			} else
+				l_TriggerCV.wait(lock);
+		}
+
+		/* Without a condition a single event is all we've been
+		 * waiting for. */
+		if (!m_WaitCondition)
+			return;
+	}
+}
+
 void Query::ExecuteGetHelper(const Stream::Ptr& stream)
 {
 	Log(LogInformation, "livestatus", "Table: " + m_Table);
 
-	Table::Ptr table = Table::GetByName(m_Table);
+	Table::Ptr table = Table::GetByName(m_Table, m_CompatLogPath, m_LogTimeFrom, m_LogTimeUntil);
 
 	if (!table) {
 		SendResponse(stream, LivestatusErrorNotFound, "Table '" + m_Table + "' does not exist.");
@@ -358,7 +729,9 @@ void Query::ExecuteGetHelper(const Stream::Ptr& stream)
 		return;
 	}
 
-	std::vector<Value> objects = table->FilterRows(m_Filter);
+	if (m_WaitTimeout != -1)
+		WaitForCondition(table);
+
 	std::vector<String> columns;
 	
 	if (m_Columns.size() > 0)
@@ -369,35 +742,142 @@ void Query::ExecuteGetHelper(const Stream::Ptr& stream)
 	Array::Ptr rs = boost::make_shared<Array>();
 
 	if (m_Aggregators.empty()) {
-		BOOST_FOREACH(const Value& object, objects) {
-			Array::Ptr row = boost::make_shared<Array>();
+		std::vector<Column> outputColumns;
 
-			BOOST_FOREACH(const String& columnName, columns) {
-				Column column = table->GetColumn(columnName);
+		BOOST_FOREACH(const String& columnName, columns) {
+			outputColumns.push_back(table->GetColumn(columnName));
+		}
 
+		BOOST_FOREACH(const Value& object, SelectRows(table)) {
+			Array::Ptr row = boost::make_shared<Array>();
+
+			BOOST_FOREACH(const Column& column, outputColumns) {
 				row->Add(column.ExtractValue(object));
 			}
 
 			rs->Add(row);
 		}
 	} else {
-		std::vector<double> stats(m_Aggregators.size(), 0);
+		std::vector<Value> objects = table->FilterRows(m_Filter);
+
+		/* Resolve each column which is referenced by one of the aggregators
+		 * exactly once. Aggregators which share a column share a slot in
+		 * the scratch buffer. */
+		std::vector<Column> statsColumns;
+		std::vector<int> slots;
+		std::map<String, int> slotIndex;
+
+		BOOST_FOREACH(const Aggregator::Ptr& aggregator, m_Aggregators) {
+			String attr = aggregator->GetAttribute();
+
+			if (attr.IsEmpty()) {
+				slots.push_back(-1);
+				continue;
+			}
+
+			std::map<String, int>::const_iterator it = slotIndex.find(attr);
+
+			if (it != slotIndex.end()) {
+				slots.push_back(it->second);
+				continue;
+			}
+
+			int slot = statsColumns.size();
+			statsColumns.push_back(table->GetColumn(attr));
+			slotIndex[attr] = slot;
+			slots.push_back(slot);
+		}
+
+		std::vector<Column> groupColumns;
+
+		BOOST_FOREACH(const String& columnName, m_Columns) {
+			groupColumns.push_back(table->GetColumn(columnName));
+		}
+
+		std::map<String, StatsGroup> groups;
+		std::vector<Value> scratch(statsColumns.size());
+
+		BOOST_FOREACH(const Value& object, objects) {
+			String key;
+			Array::Ptr groupValues;
+
+			if (!groupColumns.empty()) {
+				groupValues = boost::make_shared<Array>();
+
+				BOOST_FOREACH(const Column& column, groupColumns) {
+					groupValues->Add(column.ExtractValue(object));
+				}
+
+				key = Value(groupValues).Serialize();
+			}
+
+			std::map<String, StatsGroup>::iterator it = groups.find(key);
 
-		int index = 0;
-		BOOST_FOREACH(const Aggregator::Ptr aggregator, m_Aggregators) {
-			BOOST_FOREACH(const Value& object, objects) {
-				aggregator->Apply(table, object);
+			if (it == groups.end()) {
+				StatsGroup group;
+				group.Values = groupValues;
+
+				if (groupColumns.empty()) {
+					group.Aggregators.assign(m_Aggregators.begin(), m_Aggregators.end());
+				} else {
+					BOOST_FOREACH(const Aggregator::Ptr& aggregator, m_Aggregators) {
+						Aggregator::Ptr instance = aggregator->Clone();
+						instance->SetFilter(aggregator->GetFilter());
+						group.Aggregators.push_back(instance);
+					}
+				}
+
+				it = groups.insert(std::make_pair(key, group)).first;
+			}
+
+			for (std::vector<Column>::size_type i = 0; i < statsColumns.size(); i++)
+				scratch[i] = statsColumns[i].ExtractValue(object);
+
+			std::vector<Aggregator::Ptr>& aggregators = it->second.Aggregators;
+
+			for (std::vector<Aggregator::Ptr>::size_type i = 0; i < aggregators.size(); i++) {
+				if (slots[i] == -1)
+					aggregators[i]->Apply(table, object);
+				else
+					aggregators[i]->ApplyValue(scratch[slots[i]]);
 			}
-			
-			stats[index] = aggregator->GetResult();
-			index++;
 		}
 
-		Array::Ptr row = boost::make_shared<Array>();
-		for (int i = 0; i < m_Aggregators.size(); i++)
-			row->Add(stats[i]);
+		/* Without StatsGroupBy there's always exactly one result row, even
+		 * if no objects matched the filter. */
+		if (groupColumns.empty() && groups.empty()) {
+			StatsGroup group;
+			group.Aggregators.assign(m_Aggregators.begin(), m_Aggregators.end());
+			groups[String()] = group;
+		}
+
+		long index = 0;
+
+		String key;
+		StatsGroup group;
+		BOOST_FOREACH(boost::tie(key, group), groups) {
+			if (index++ < m_Offset)
+				continue;
 
-		rs->Add(row);
+			if (m_Limit >= 0 && index > m_Offset + m_Limit)
+				break;
+
+			Array::Ptr row = boost::make_shared<Array>();
+
+			if (group.Values) {
+				ObjectLock olock(group.Values);
+
+				BOOST_FOREACH(const Value& value, group.Values) {
+					row->Add(value);
+				}
+			}
+
+			BOOST_FOREACH(const Aggregator::Ptr& aggregator, group.Aggregators) {
+				row->Add(aggregator->GetResult());
+			}
+
+			rs->Add(row);
+		}
 
 		m_ColumnHeaders = false;
 	}
@@ -418,6 +898,7 @@ void Query::ExecuteCommandHelper(const Stream::Ptr& stream)
 
 	Log(LogInformation, "livestatus", "Executing command: " + m_Command);
 	ExternalCommandProcessor::Execute(m_Command);
+	Trigger(TriggerCommand);
 	SendResponse(stream, LivestatusErrorOK, "");
 }
 
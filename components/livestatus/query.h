@@ -39,6 +39,47 @@ enum LivestatusError
 	LivestatusErrorQuery = 452
 };
 
+/**
+ * Events which wake up queries that are waiting for a WaitTrigger.
+ *
+ * @ingroup livestatus
+ */
+enum LivestatusTrigger
+{
+	TriggerAll = 0,
+	TriggerCheck,
+	TriggerState,
+	TriggerLog,
+	TriggerDowntime,
+	TriggerComment,
+	TriggerCommand,
+	TriggerProgram,
+
+	TriggerCount
+};
+
+/**
+ * Per-group aggregator state for Stats queries.
+ *
+ * @ingroup livestatus
+ */
+struct StatsGroup
+{
+	Array::Ptr Values;
+	std::vector<Aggregator::Ptr> Aggregators;
+};
+
+/**
+ * A row and its sort key.
+ *
+ * @ingroup livestatus
+ */
+struct SortedRow
+{
+	Value Key;
+	Value Row;
+};
+
 /**
  * @ingroup livestatus
  */
@@ -47,12 +88,15 @@ class Query : public Object
 public:
 	DECLARE_PTR_TYPEDEFS(Query);
 
-	Query(const std::vector<String>& lines);
+	Query(const std::vector<String>& lines, const String& compat_log_path);
 
 	bool Execute(const Stream::Ptr& stream);
 
 	static int GetExternalCommands(void);
 
+	static void Trigger(LivestatusTrigger trigger);
+	static void CancelWaits(void);
+
 private:
 	String m_Verb;
 
@@ -68,7 +112,22 @@ private:
 
 	String m_OutputFormat;
 	bool m_ColumnHeaders;
-	int m_Limit;
+	long m_Limit;
+	long m_Offset;
+	String m_OrderBy;
+	bool m_OrderDescending;
+
+	/* Parameters for blocking queries. */
+	String m_WaitObject;
+	Filter::Ptr m_WaitObjectFilter;
+	Filter::Ptr m_WaitCondition;
+	LivestatusTrigger m_WaitTrigger;
+	long m_WaitTimeout;
+
+	/* Parameters for the log table. */
+	String m_CompatLogPath;
+	double m_LogTimeFrom;
+	double m_LogTimeUntil;
 
 	String m_ResponseHeader;
 
@@ -82,6 +141,12 @@ private:
 	void PrintResultSet(std::ostream& fp, const std::vector<String>& columns, const Array::Ptr& rs);
 	void PrintCsvArray(std::ostream& fp, const Array::Ptr& array, int level);
 
+	std::vector<Value> SelectRows(const Table::Ptr& table);
+
+	void WaitForCondition(const Table::Ptr& table);
+	bool IsWaitConditionSatisfied(const Table::Ptr& table);
+	bool GetWaitObjectRow(Value *row) const;
+
 	void ExecuteGetHelper(const Stream::Ptr& stream);
 	void ExecuteCommandHelper(const Stream::Ptr& stream);
 	void ExecuteErrorHelper(const Stream::Ptr& stream);
@@ -90,6 +155,8 @@ private:
 	void PrintFixed16(const Stream::Ptr& stream, int code, const String& data);
 	
 	static Filter::Ptr ParseFilter(const String& params);
+	static Filter::Ptr ParseWaitObject(const String& table, const String& params);
+	static void GetTimeBounds(const Filter::Ptr& filter, double *from, double *until);
 };
 
 }
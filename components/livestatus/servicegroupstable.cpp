@@ -60,8 +60,9 @@ String ServiceGroupsTable::GetName(void) const
 
 void ServiceGroupsTable::FetchRows(const AddRowFunction& addRowFn)
 {
-	BOOST_FOREACH(const ServiceGroup::Ptr& sg, DynamicType::GetObjects<ServiceGroup>()) {
-		addRowFn(sg);
+	BOOST_FOREACH(const ServiceGroup::Ptr& sg, DynamicType::GetSnapshot<ServiceGroup>()) {
+		if (!addRowFn(sg))
+			return;
 	}
 }
 
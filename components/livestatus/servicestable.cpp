@@ -136,8 +136,9 @@ String ServicesTable::GetName(void) const
 
 void ServicesTable::FetchRows(const AddRowFunction& addRowFn)
 {
-	BOOST_FOREACH(const Service::Ptr& service, DynamicType::GetObjects<Service>()) {
-		addRowFn(service);
+	BOOST_FOREACH(const Service::Ptr& service, DynamicType::GetSnapshot<Service>()) {
+		if (!addRowFn(service))
+			return;
 	}
 }
 
@@ -0,0 +1,799 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "livestatus/statehisttable.h"
+#include "livestatus/logtable.h"
+#include "icinga/host.h"
+#include "icinga/service.h"
+#include "icinga/compatutility.h"
+#include "base/dynamictype.h"
+#include "base/logger_fwd.h"
+#include "base/utility.h"
+#include <boost/smart_ptr/make_shared.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <fstream>
+#include <limits>
+#include <list>
+#include <string.h>
+
+using namespace icinga;
+using namespace livestatus;
+
+/* Maximum number of archives whose state changes are kept in memory. Evicted
+ * buckets are loaded from their .statehist file again. */
+#define STATEHIST_BUCKET_CACHE_SIZE 256
+
+/* Version of the .statehist file format. */
+#define STATEHIST_BUCKET_VERSION 1
+
+struct StateHistBucketCacheEntry
+{
+	shared_ptr<StateHistBucket> Bucket;
+	std::list<String>::iterator LruPosition;
+};
+
+static boost::mutex l_BucketCacheMutex;
+static std::map<String, StateHistBucketCacheEntry> l_BucketCache;
+static std::list<String> l_BucketCacheLru; /* most recently used first */
+
+typedef std::map<String, std::vector<StateHistChange> > StateHistChangeMap;
+typedef std::pair<String, std::vector<StateHistChange> > StateHistChangePair;
+
+/**
+ * Removes an entry from the bucket cache. The caller must hold
+ * l_BucketCacheMutex.
+ */
+static void EvictBucket(const String& path)
+{
+	std::map<String, StateHistBucketCacheEntry>::iterator it = l_BucketCache.find(path);
+
+	if (it == l_BucketCache.end())
+		return;
+
+	l_BucketCacheLru.erase(it->second.LruPosition);
+	l_BucketCache.erase(it);
+}
+
+StateHistTable::StateHistTable(const String& compat_log_path, double from, double until)
+	: m_CompatLogPath(compat_log_path), m_TimeFrom(from), m_TimeUntil(until)
+{
+	AddColumns(this);
+}
+
+void StateHistTable::AddColumns(Table *table, const String& prefix,
+    const Column::ObjectAccessor& objectAccessor)
+{
+	table->AddColumn(prefix + "time", Column(&StateHistTable::TimeAccessor, objectAccessor));
+	table->AddColumn(prefix + "lineno", Column(&StateHistTable::LinenoAccessor, objectAccessor));
+	table->AddColumn(prefix + "from", Column(&StateHistTable::FromAccessor, objectAccessor));
+	table->AddColumn(prefix + "until", Column(&StateHistTable::UntilAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration", Column(&StateHistTable::DurationAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration_part", Column(&StateHistTable::DurationPartAccessor, objectAccessor));
+	table->AddColumn(prefix + "state", Column(&StateHistTable::StateAccessor, objectAccessor));
+	table->AddColumn(prefix + "host_down", Column(&StateHistTable::HostDownAccessor, objectAccessor));
+	table->AddColumn(prefix + "in_downtime", Column(&StateHistTable::InDowntimeAccessor, objectAccessor));
+	table->AddColumn(prefix + "in_host_downtime", Column(&StateHistTable::InHostDowntimeAccessor, objectAccessor));
+	table->AddColumn(prefix + "is_flapping", Column(&StateHistTable::IsFlappingAccessor, objectAccessor));
+	table->AddColumn(prefix + "in_notification_period", Column(&StateHistTable::InNotificationPeriodAccessor, objectAccessor));
+	table->AddColumn(prefix + "notification_period", Column(&StateHistTable::NotificationPeriodAccessor, objectAccessor));
+	table->AddColumn(prefix + "debug_info", Column(&StateHistTable::DebugInfoAccessor, objectAccessor));
+	table->AddColumn(prefix + "host_name", Column(&StateHistTable::HostNameAccessor, objectAccessor));
+	table->AddColumn(prefix + "service_description", Column(&StateHistTable::ServiceDescriptionAccessor, objectAccessor));
+	table->AddColumn(prefix + "log_output", Column(&StateHistTable::LogOutputAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration_ok", Column(&StateHistTable::DurationOkAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration_part_ok", Column(&StateHistTable::DurationPartOkAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration_warning", Column(&StateHistTable::DurationWarningAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration_part_warning", Column(&StateHistTable::DurationPartWarningAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration_critical", Column(&StateHistTable::DurationCriticalAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration_part_critical", Column(&StateHistTable::DurationPartCriticalAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration_unknown", Column(&StateHistTable::DurationUnknownAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration_part_unknown", Column(&StateHistTable::DurationPartUnknownAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration_unmonitored", Column(&StateHistTable::DurationUnmonitoredAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration_part_unmonitored", Column(&StateHistTable::DurationPartUnmonitoredAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration_up", Column(&StateHistTable::DurationUpAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration_part_up", Column(&StateHistTable::DurationPartUpAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration_down", Column(&StateHistTable::DurationDownAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration_part_down", Column(&StateHistTable::DurationPartDownAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration_unreachable", Column(&StateHistTable::DurationUnreachableAccessor, objectAccessor));
+	table->AddColumn(prefix + "duration_part_unreachable", Column(&StateHistTable::DurationPartUnreachableAccessor, objectAccessor));
+}
+
+String StateHistTable::GetName(void) const
+{
+	return "statehist";
+}
+
+/**
+ * Adds the state changes from a map of state changes to the list of
+ * initial states (i.e. changes before the lower time bound) and the list
+ * of changes within the time range.
+ */
+static void MergeStateChanges(const StateHistChangeMap& source, double from, double until,
+    std::map<String, StateHistChange>& initial, StateHistChangeMap& changes)
+{
+	BOOST_FOREACH(const StateHistChangePair& kv, source) {
+		if (kv.second.back().Time < from) {
+			initial[kv.first] = kv.second.back();
+			continue;
+		}
+
+		BOOST_FOREACH(const StateHistChange& change, kv.second) {
+			if (change.Time < from)
+				initial[kv.first] = change;
+			else if (change.Time <= until)
+				changes[kv.first].push_back(change);
+		}
+	}
+}
+
+void StateHistTable::FetchRows(const AddRowFunction& addRowFn)
+{
+	double until = std::min(m_TimeUntil, Utility::GetTime());
+
+	std::map<String, StateHistChange> initial;
+	StateHistChangeMap changes;
+
+	StateHistChangeMap current;
+	LogTable::ReadCurrentLogLines(m_CompatLogPath, 0, until,
+	    boost::bind(&StateHistTable::AddStateChange, boost::ref(current), _1, _2));
+
+	double currentFirst = std::numeric_limits<double>::max();
+
+	BOOST_FOREACH(const StateHistChangePair& kv, current) {
+		if (kv.second[0].Time < currentFirst)
+			currentFirst = kv.second[0].Time;
+	}
+
+	std::vector<LogFile::Ptr> archives = LogTable::GetArchives(m_CompatLogPath, m_TimeFrom, until);
+
+	/* Each log file starts with a "HOST/SERVICE STATE: CURRENT" line for
+	 * every object, so the initial states are known if the first file
+	 * begins before the time range. Otherwise they are the last states
+	 * of the newest archive before the time range. */
+	double first = archives.empty() ? currentFirst : archives[0]->GetFirstTime();
+
+	if (m_TimeFrom > 0 && first > m_TimeFrom) {
+		std::vector<LogFile::Ptr> previous = LogTable::GetArchives(m_CompatLogPath, 0, m_TimeFrom);
+
+		if (!previous.empty())
+			archives.insert(archives.begin(), previous.back());
+	}
+
+	BOOST_FOREACH(const LogFile::Ptr& archive, archives) {
+		MergeStateChanges(GetBucket(archive)->Changes, m_TimeFrom, until, initial, changes);
+	}
+
+	MergeStateChanges(current, m_TimeFrom, until, initial, changes);
+
+	/* Objects without any log history use their current state. */
+	std::map<String, StateHistChange> known;
+
+	BOOST_FOREACH(const Service::Ptr& service, DynamicType::GetSnapshot<Service>()) {
+		Host::Ptr host = service->GetHost();
+
+		if (!host)
+			continue;
+
+		StateHistChange change;
+		change.Time = service->GetLastStateChange();
+		change.State = service->GetState();
+		known[host->GetName() + ";" + service->GetShortName()] = change;
+	}
+
+	BOOST_FOREACH(const Host::Ptr& host, DynamicType::GetSnapshot<Host>()) {
+		StateHistChange change;
+		change.Time = host->GetLastStateChange();
+		change.State = host->GetState();
+		known[host->GetName() + ";"] = change;
+	}
+
+	String key;
+	StateHistChange change;
+	BOOST_FOREACH(boost::tie(key, change), known) {
+		if (initial.find(key) != initial.end() || changes.find(key) != changes.end())
+			continue;
+
+		if (change.Time < m_TimeFrom)
+			initial[key] = change;
+		else if (change.Time <= until)
+			changes[key].push_back(change);
+	}
+
+	BOOST_FOREACH(boost::tie(key, change), initial) {
+		StateHistChangeMap::const_iterator it = changes.find(key);
+		bool more;
+
+		if (it == changes.end())
+			more = AddIntervals(addRowFn, key, &change, std::vector<StateHistChange>(), until);
+		else
+			more = AddIntervals(addRowFn, key, &change, it->second, until);
+
+		if (!more)
+			return;
+	}
+
+	BOOST_FOREACH(const StateHistChangePair& kv, changes) {
+		if (initial.find(kv.first) == initial.end() && !AddIntervals(addRowFn, kv.first, NULL, kv.second, until))
+			return;
+	}
+}
+
+/**
+ * Returns the state changes for an archived log file. The result is cached
+ * for as long as the log file is unchanged; only the most recently used
+ * archives are kept in memory.
+ */
+shared_ptr<StateHistBucket> StateHistTable::GetBucket(const LogFile::Ptr& archive)
+{
+	String path = archive->GetPath();
+	shared_ptr<LogIndex> index = archive->GetIndex();
+
+	{
+		boost::mutex::scoped_lock lock(l_BucketCacheMutex);
+
+		std::map<String, StateHistBucketCacheEntry>::iterator it = l_BucketCache.find(path);
+
+		if (it != l_BucketCache.end()) {
+			const shared_ptr<StateHistBucket>& bucket = it->second.Bucket;
+
+			if (bucket->Size == index->Size && bucket->MTime == index->MTime) {
+				l_BucketCacheLru.splice(l_BucketCacheLru.begin(), l_BucketCacheLru, it->second.LruPosition);
+				return bucket;
+			}
+		}
+	}
+
+	String bucketPath = path + ".statehist";
+	shared_ptr<StateHistBucket> bucket = LoadBucket(bucketPath, index->Size, index->MTime);
+
+	if (!bucket) {
+		bucket = boost::make_shared<StateHistBucket>();
+		bucket->Size = index->Size;
+		bucket->MTime = index->MTime;
+
+		archive->ReadLines(0, std::numeric_limits<double>::max(),
+		    boost::bind(&StateHistTable::AddStateChange, boost::ref(bucket->Changes), _1, _2));
+
+		SaveBucket(bucketPath, bucket);
+	}
+
+	{
+		boost::mutex::scoped_lock lock(l_BucketCacheMutex);
+
+		EvictBucket(path);
+
+		l_BucketCacheLru.push_front(path);
+
+		StateHistBucketCacheEntry entry;
+		entry.Bucket = bucket;
+		entry.LruPosition = l_BucketCacheLru.begin();
+		l_BucketCache[path] = entry;
+
+		while (l_BucketCache.size() > STATEHIST_BUCKET_CACHE_SIZE) {
+			String victim = l_BucketCacheLru.back();
+			EvictBucket(victim);
+		}
+	}
+
+	return bucket;
+}
+
+shared_ptr<StateHistBucket> StateHistTable::LoadBucket(const String& bucketPath, long size, double mtime)
+{
+	std::ifstream fp(bucketPath.CStr());
+
+	if (!fp)
+		return shared_ptr<StateHistBucket>();
+
+	String magic;
+	int version;
+	size_t count;
+
+	shared_ptr<StateHistBucket> bucket = boost::make_shared<StateHistBucket>();
+
+	fp >> magic >> version >> bucket->Size >> bucket->MTime >> count;
+
+	if (!fp || magic != "icinga2-statehist" || version != STATEHIST_BUCKET_VERSION ||
+	    bucket->Size != size || bucket->MTime != mtime)
+		return shared_ptr<StateHistBucket>();
+
+	fp.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+
+	/* <time> <state> <host>;<service>\t<output> */
+	for (size_t i = 0; i < count; i++) {
+		std::string line;
+
+		if (!std::getline(fp, line))
+			return shared_ptr<StateHistBucket>();
+
+		StateHistChange change;
+		char *end;
+
+		change.Time = strtod(line.c_str(), &end);
+
+		if (*end != ' ')
+			return shared_ptr<StateHistBucket>();
+
+		change.State = strtol(end + 1, &end, 10);
+
+		if (*end != ' ')
+			return shared_ptr<StateHistBucket>();
+
+		size_t keyOffset = end + 1 - line.c_str();
+		size_t tab = line.find('\t', keyOffset);
+
+		if (tab == std::string::npos)
+			return shared_ptr<StateHistBucket>();
+
+		change.Output = line.substr(tab + 1);
+
+		bucket->Changes[line.substr(keyOffset, tab - keyOffset)].push_back(change);
+	}
+
+	return bucket;
+}
+
+void StateHistTable::SaveBucket(const String& bucketPath, const shared_ptr<StateHistBucket>& bucket)
+{
+	size_t count = 0;
+
+	BOOST_FOREACH(const StateHistChangePair& kv, bucket->Changes) {
+		/* The host/service name is terminated by a tab. */
+		if (kv.first.FindFirstOf('\t') != String::NPos)
+			return;
+
+		count += kv.second.size();
+	}
+
+	String tempPath = bucketPath + ".tmp";
+
+	std::ofstream fp(tempPath.CStr(), std::ofstream::out | std::ofstream::trunc);
+
+	if (!fp) {
+		Log(LogDebug, "livestatus", "Could not write state history index '" + bucketPath + "'.");
+		return;
+	}
+
+	fp.precision(17);
+
+	fp << "icinga2-statehist " << STATEHIST_BUCKET_VERSION << " " << bucket->Size << " " << bucket->MTime
+	   << " " << count << "\n";
+
+	BOOST_FOREACH(const StateHistChangePair& kv, bucket->Changes) {
+		BOOST_FOREACH(const StateHistChange& change, kv.second) {
+			fp << change.Time << " " << change.State << " " << kv.first << "\t" << change.Output << "\n";
+		}
+	}
+
+	fp.close();
+
+	if (!fp || rename(tempPath.CStr(), bucketPath.CStr()) < 0) {
+		Log(LogDebug, "livestatus", "Could not write state history index '" + bucketPath + "'.");
+		(void) remove(tempPath.CStr());
+	}
+}
+
+/**
+ * Returns the part of a line after the specified prefix, or NULL if the
+ * line doesn't start with it.
+ */
+static const char *SkipPrefix(const char *line, const char *end, const char *prefix)
+{
+	size_t length = strlen(prefix);
+
+	if (static_cast<size_t>(end - line) < length || memcmp(line, prefix, length) != 0)
+		return NULL;
+
+	return line + length;
+}
+
+/**
+ * Adds a compat log line to the state changes if it is a host or service
+ * alert or state. Other lines are skipped without being split up; this
+ * matches the fields LogTable::ParseLine() would return.
+ */
+bool StateHistTable::AddStateChange(StateHistChangeMap& changes, const char *line, size_t length)
+{
+	double ts;
+
+	if (!CompatUtility::ParseLogTimestamp(line, length, &ts))
+		return true;
+
+	const char *end = line + length;
+	const char *message = static_cast<const char *>(memchr(line, ']', length));
+
+	if (!message || end - message < 2)
+		return true;
+
+	message += 2;
+
+	const char *options;
+	bool host, state;
+
+	if ((options = SkipPrefix(message, end, "SERVICE ALERT: "))) {
+		host = false;
+		state = false;
+	} else if ((options = SkipPrefix(message, end, "HOST ALERT: "))) {
+		host = true;
+		state = false;
+	} else if ((options = SkipPrefix(message, end, "SERVICE STATE: "))) {
+		host = false;
+		state = true;
+	} else if ((options = SkipPrefix(message, end, "HOST STATE: "))) {
+		host = true;
+		state = true;
+	} else
+		return true;
+
+	String text(options, end);
+	std::vector<String> tokens;
+	boost::algorithm::split(tokens, text, boost::is_any_of(";"));
+
+	/* "CURRENT;" or "INITIAL;" */
+	if (state && !tokens.empty())
+		tokens.erase(tokens.begin());
+
+	StateHistChange change;
+	change.Time = ts;
+
+	if (host) {
+		if (tokens.size() < 4)
+			return true;
+
+		change.State = Host::StateFromString(tokens[1]);
+
+		if (tokens.size() > 4)
+			change.Output = tokens[4];
+
+		changes[tokens[0] + ";"].push_back(change);
+	} else {
+		if (tokens.size() < 5)
+			return true;
+
+		change.State = Service::StateFromString(tokens[2]);
+
+		if (tokens.size() > 5)
+			change.Output = tokens[5];
+
+		changes[tokens[0] + ";" + tokens[1]].push_back(change);
+	}
+
+	return true;
+}
+
+/**
+ * Splits the time range for a host/service into intervals with the same
+ * state.
+ */
+bool StateHistTable::AddIntervals(const AddRowFunction& addRowFn, const String& key,
+    const StateHistChange *initial, const std::vector<StateHistChange>& changes, double until) const
+{
+	double start = m_TimeFrom;
+
+	/* Without a lower bound the history starts with the first state
+	 * change. */
+	if (!initial && start == 0) {
+		if (changes.empty())
+			return true;
+
+		start = changes[0].Time;
+	}
+
+	double span = until - start;
+
+	if (span <= 0)
+		return true;
+
+	StateHistChange current;
+
+	if (initial) {
+		current = *initial;
+	} else {
+		current.Time = start;
+		current.State = -1;
+	}
+
+	BOOST_FOREACH(const StateHistChange& change, changes) {
+		if (change.State == current.State)
+			continue;
+
+		if (change.Time > start && !AddInterval(addRowFn, key, start, change.Time, span, current))
+			return false;
+
+		current = change;
+
+		if (change.Time > start)
+			start = change.Time;
+	}
+
+	if (until > start)
+		return AddInterval(addRowFn, key, start, until, span, current);
+
+	return true;
+}
+
+bool StateHistTable::AddInterval(const AddRowFunction& addRowFn, const String& key, double from,
+    double until, double span, const StateHistChange& change) const
+{
+	size_t sep = key.FindFirstOf(';');
+	double duration = until - from;
+	double part = duration / span;
+
+	Dictionary::Ptr bag = boost::make_shared<Dictionary>();
+	bag->Set("time", from);
+	bag->Set("from", from);
+	bag->Set("until", until);
+	bag->Set("duration", duration);
+	bag->Set("duration_part", part);
+	bag->Set("state", change.State);
+	bag->Set("host_name", key.SubStr(0, sep));
+	bag->Set("service_description", key.SubStr(sep + 1));
+	bag->Set("log_output", change.Output);
+
+	/* Host keys have an empty service description. */
+	bool host = (sep == key.GetLength() - 1);
+	int serviceState = host ? -1 : change.State;
+	int hostState = host ? change.State : -1;
+
+	bag->Set("duration_ok", (serviceState == StateOK) ? duration : 0);
+	bag->Set("duration_part_ok", (serviceState == StateOK) ? part : 0);
+	bag->Set("duration_warning", (serviceState == StateWarning) ? duration : 0);
+	bag->Set("duration_part_warning", (serviceState == StateWarning) ? part : 0);
+	bag->Set("duration_critical", (serviceState == StateCritical) ? duration : 0);
+	bag->Set("duration_part_critical", (serviceState == StateCritical) ? part : 0);
+	bag->Set("duration_unknown", (serviceState == StateUnknown) ? duration : 0);
+	bag->Set("duration_part_unknown", (serviceState == StateUnknown) ? part : 0);
+	bag->Set("duration_up", (hostState == HostUp) ? duration : 0);
+	bag->Set("duration_part_up", (hostState == HostUp) ? part : 0);
+	bag->Set("duration_down", (hostState == HostDown) ? duration : 0);
+	bag->Set("duration_part_down", (hostState == HostDown) ? part : 0);
+	bag->Set("duration_unreachable", (hostState == HostUnreachable) ? duration : 0);
+	bag->Set("duration_part_unreachable", (hostState == HostUnreachable) ? part : 0);
+	bag->Set("duration_unmonitored", (change.State == -1) ? duration : 0);
+	bag->Set("duration_part_unmonitored", (change.State == -1) ? part : 0);
+
+	return addRowFn(bag);
+}
+
+Value StateHistTable::TimeAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("time");
+}
+
+Value StateHistTable::LinenoAccessor(const Value& row)
+{
+	/* not supported */
+	return 0;
+}
+
+Value StateHistTable::FromAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("from");
+}
+
+Value StateHistTable::UntilAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("until");
+}
+
+Value StateHistTable::DurationAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration");
+}
+
+Value StateHistTable::DurationPartAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration_part");
+}
+
+Value StateHistTable::StateAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("state");
+}
+
+Value StateHistTable::HostDownAccessor(const Value& row)
+{
+	/* not supported */
+	return 0;
+}
+
+Value StateHistTable::InDowntimeAccessor(const Value& row)
+{
+	/* not supported */
+	return 0;
+}
+
+Value StateHistTable::InHostDowntimeAccessor(const Value& row)
+{
+	/* not supported */
+	return 0;
+}
+
+Value StateHistTable::IsFlappingAccessor(const Value& row)
+{
+	/* not supported */
+	return 0;
+}
+
+Value StateHistTable::InNotificationPeriodAccessor(const Value& row)
+{
+	/* not supported */
+	return 1;
+}
+
+Value StateHistTable::NotificationPeriodAccessor(const Value& row)
+{
+	/* not supported */
+	return Empty;
+}
+
+Value StateHistTable::DebugInfoAccessor(const Value& row)
+{
+	/* not supported */
+	return Empty;
+}
+
+Value StateHistTable::HostNameAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("host_name");
+}
+
+Value StateHistTable::ServiceDescriptionAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("service_description");
+}
+
+Value StateHistTable::LogOutputAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("log_output");
+}
+
+Value StateHistTable::DurationOkAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration_ok");
+}
+
+Value StateHistTable::DurationPartOkAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration_part_ok");
+}
+
+Value StateHistTable::DurationWarningAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration_warning");
+}
+
+Value StateHistTable::DurationPartWarningAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration_part_warning");
+}
+
+Value StateHistTable::DurationCriticalAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration_critical");
+}
+
+Value StateHistTable::DurationPartCriticalAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration_part_critical");
+}
+
+Value StateHistTable::DurationUnknownAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration_unknown");
+}
+
+Value StateHistTable::DurationPartUnknownAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration_part_unknown");
+}
+
+Value StateHistTable::DurationUnmonitoredAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration_unmonitored");
+}
+
+Value StateHistTable::DurationPartUnmonitoredAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration_part_unmonitored");
+}
+
+Value StateHistTable::DurationUpAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration_up");
+}
+
+Value StateHistTable::DurationPartUpAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration_part_up");
+}
+
+Value StateHistTable::DurationDownAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration_down");
+}
+
+Value StateHistTable::DurationPartDownAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration_part_down");
+}
+
+Value StateHistTable::DurationUnreachableAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration_unreachable");
+}
+
+Value StateHistTable::DurationPartUnreachableAccessor(const Value& row)
+{
+	Dictionary::Ptr bag = row;
+
+	return bag->Get("duration_part_unreachable");
+}
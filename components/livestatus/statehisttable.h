@@ -0,0 +1,129 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef STATEHISTTABLE_H
+#define STATEHISTTABLE_H
+
+#include "livestatus/table.h"
+#include "livestatus/logfile.h"
+#include "base/dictionary.h"
+#include <map>
+
+using namespace icinga;
+
+namespace livestatus
+{
+
+/**
+ * A state change for a host or service.
+ *
+ * @ingroup livestatus
+ */
+struct StateHistChange
+{
+	double Time;
+	int State;
+	String Output;
+};
+
+/**
+ * The state changes per host/service which were found in an archived log
+ * file. Archived log files are immutable, so these are cached in memory
+ * and in a ".statehist" file next to the archive.
+ *
+ * @ingroup livestatus
+ */
+struct StateHistBucket
+{
+	long Size; /**< Size of the archive. */
+	double MTime; /**< Modification time of the archive. */
+	std::map<String, std::vector<StateHistChange> > Changes;
+};
+
+/**
+ * @ingroup livestatus
+ */
+class StateHistTable : public Table
+{
+public:
+	DECLARE_PTR_TYPEDEFS(StateHistTable);
+
+	StateHistTable(const String& compat_log_path, double from, double until);
+
+	static void AddColumns(Table *table, const String& prefix = String(),
+	    const Column::ObjectAccessor& objectAccessor = Column::ObjectAccessor());
+
+	virtual String GetName(void) const;
+
+protected:
+	virtual void FetchRows(const AddRowFunction& addRowFn);
+
+	static Value TimeAccessor(const Value& row);
+	static Value LinenoAccessor(const Value& row);
+	static Value FromAccessor(const Value& row);
+	static Value UntilAccessor(const Value& row);
+	static Value DurationAccessor(const Value& row);
+	static Value DurationPartAccessor(const Value& row);
+	static Value StateAccessor(const Value& row);
+	static Value HostDownAccessor(const Value& row);
+	static Value InDowntimeAccessor(const Value& row);
+	static Value InHostDowntimeAccessor(const Value& row);
+	static Value IsFlappingAccessor(const Value& row);
+	static Value InNotificationPeriodAccessor(const Value& row);
+	static Value NotificationPeriodAccessor(const Value& row);
+	static Value DebugInfoAccessor(const Value& row);
+	static Value HostNameAccessor(const Value& row);
+	static Value ServiceDescriptionAccessor(const Value& row);
+	static Value LogOutputAccessor(const Value& row);
+	static Value DurationOkAccessor(const Value& row);
+	static Value DurationPartOkAccessor(const Value& row);
+	static Value DurationWarningAccessor(const Value& row);
+	static Value DurationPartWarningAccessor(const Value& row);
+	static Value DurationCriticalAccessor(const Value& row);
+	static Value DurationPartCriticalAccessor(const Value& row);
+	static Value DurationUnknownAccessor(const Value& row);
+	static Value DurationPartUnknownAccessor(const Value& row);
+	static Value DurationUnmonitoredAccessor(const Value& row);
+	static Value DurationPartUnmonitoredAccessor(const Value& row);
+	static Value DurationUpAccessor(const Value& row);
+	static Value DurationPartUpAccessor(const Value& row);
+	static Value DurationDownAccessor(const Value& row);
+	static Value DurationPartDownAccessor(const Value& row);
+	static Value DurationUnreachableAccessor(const Value& row);
+	static Value DurationPartUnreachableAccessor(const Value& row);
+
+private:
+	String m_CompatLogPath;
+	double m_TimeFrom;
+	double m_TimeUntil;
+
+	static shared_ptr<StateHistBucket> GetBucket(const LogFile::Ptr& archive);
+	static shared_ptr<StateHistBucket> LoadBucket(const String& bucketPath, long size, double mtime);
+	static void SaveBucket(const String& bucketPath, const shared_ptr<StateHistBucket>& bucket);
+	static bool AddStateChange(std::map<String, std::vector<StateHistChange> >& changes, const char *line, size_t length);
+
+	bool AddIntervals(const AddRowFunction& addRowFn, const String& key,
+	    const StateHistChange *initial, const std::vector<StateHistChange>& changes, double until) const;
+	bool AddInterval(const AddRowFunction& addRowFn, const String& key, double from,
+	    double until, double span, const StateHistChange& change) const;
+};
+
+}
+
+#endif /* STATEHISTTABLE_H */
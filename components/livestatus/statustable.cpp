@@ -336,12 +336,12 @@ Value StatusTable::IntervalLengthAccessor(const Value& row)
 
 Value StatusTable::NumHostsAccessor(const Value& row)
 {
-	return DynamicType::GetObjects<Host>().size();
+	return DynamicType::GetSnapshot<Host>().GetLength();
 }
 
 Value StatusTable::NumServicesAccessor(const Value& row)
 {
-	return DynamicType::GetObjects<Service>().size();
+	return DynamicType::GetSnapshot<Service>().GetLength();
 }
 
 Value StatusTable::ProgramVersionAccessor(const Value& row)
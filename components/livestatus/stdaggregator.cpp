@@ -18,22 +18,17 @@
  ******************************************************************************/
 
 #include "livestatus/stdaggregator.h"
+#include <boost/smart_ptr/make_shared.hpp>
 #include <math.h>
 
 using namespace livestatus;
 
 StdAggregator::StdAggregator(const String& attr)
-    : m_StdSum(0), m_StdQSum(0), m_StdCount(0)
-{
-	m_StdAttr = attr;
-}
+    : Aggregator(attr), m_StdSum(0), m_StdQSum(0), m_StdCount(0)
+{ }
 
-void StdAggregator::Apply(const Table::Ptr& table, const Value& row)
+void StdAggregator::ApplyValue(const Value& value)
 {
-	Column column = table->GetColumn(m_StdAttr);
-
-	Value value = column.ExtractValue(row);
-
 	m_StdSum += value;
 	m_StdQSum += pow(value, 2);
 	m_StdCount++;
@@ -43,3 +38,8 @@ double StdAggregator::GetResult(void) const
 {
 	return sqrt((m_StdQSum - (1 / m_StdCount) * pow(m_StdSum, 2)) / (m_StdCount - 1));
 }
+
+Aggregator::Ptr StdAggregator::Clone(void) const
+{
+	return boost::make_shared<StdAggregator>(GetAttribute());
+}
@@ -36,14 +36,14 @@ public:
 
 	StdAggregator(const String& attr);
 
-	virtual void Apply(const Table::Ptr& table, const Value& row);
+	virtual void ApplyValue(const Value& value);
 	virtual double GetResult(void) const;
+	virtual Aggregator::Ptr Clone(void) const;
 
 private:
 	double m_StdSum;
 	double m_StdQSum;
 	double m_StdCount;
-	String m_StdAttr;
 };
 
 }
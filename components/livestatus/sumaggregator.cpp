@@ -18,21 +18,16 @@
  ******************************************************************************/
 
 #include "livestatus/sumaggregator.h"
+#include <boost/smart_ptr/make_shared.hpp>
 
 using namespace livestatus;
 
 SumAggregator::SumAggregator(const String& attr)
-    : m_Sum(0)
-{
-	m_SumAttr = attr;
-}
+    : Aggregator(attr), m_Sum(0)
+{ }
 
-void SumAggregator::Apply(const Table::Ptr& table, const Value& row)
+void SumAggregator::ApplyValue(const Value& value)
 {
-	Column column = table->GetColumn(m_SumAttr);
-
-	Value value = column.ExtractValue(row);
-
 	m_Sum += value;
 }
 
@@ -40,3 +35,8 @@ double SumAggregator::GetResult(void) const
 {
 	return m_Sum;
 }
+
+Aggregator::Ptr SumAggregator::Clone(void) const
+{
+	return boost::make_shared<SumAggregator>(GetAttribute());
+}
@@ -36,12 +36,12 @@ public:
 
 	SumAggregator(const String& attr);
 
-	virtual void Apply(const Table::Ptr& table, const Value& row);
+	virtual void ApplyValue(const Value& value);
 	virtual double GetResult(void) const;
+	virtual Aggregator::Ptr Clone(void) const;
 
 private:
 	double m_Sum;
-	String m_SumAttr;
 };
 
 }
@@ -30,6 +30,7 @@
 #include "livestatus/downtimestable.h"
 #include "livestatus/timeperiodstable.h"
 #include "livestatus/logtable.h"
+#include "livestatus/statehisttable.h"
 #include "livestatus/filter.h"
 #include "base/array.h"
 #include "base/dictionary.h"
@@ -44,7 +45,7 @@ using namespace livestatus;
 Table::Table(void)
 { }
 
-Table::Ptr Table::GetByName(const String& name)
+Table::Ptr Table::GetByName(const String& name, const String& compat_log_path, double from, double until)
 {
 	if (name == "status")
 		return boost::make_shared<StatusTable>();
@@ -69,7 +70,9 @@ Table::Ptr Table::GetByName(const String& name)
 	else if (name == "timeperiods")
 		return boost::make_shared<TimePeriodsTable>();
 	else if (name == "log")
-		return boost::make_shared<LogTable>();
+		return boost::make_shared<LogTable>(compat_log_path, from, until);
+	else if (name == "statehist")
+		return boost::make_shared<StateHistTable>(compat_log_path, from, until);
 
 	return Table::Ptr();
 }
@@ -106,19 +109,32 @@ std::vector<String> Table::GetColumnNames(void) const
 	return names;
 }
 
-std::vector<Value> Table::FilterRows(const Filter::Ptr& filter)
+/**
+ * Returns the rows which match the filter.
+ *
+ * @param filter The filter.
+ * @param limit The maximum number of rows, or -1 for no limit. Fetching
+ *		rows stops as soon as the limit is reached.
+ * @returns The rows.
+ */
+std::vector<Value> Table::FilterRows(const Filter::Ptr& filter, long limit)
 {
 	std::vector<Value> rs;
 
-	FetchRows(boost::bind(&Table::FilteredAddRow, this, boost::ref(rs), filter, _1));
+	if (limit == 0)
+		return rs;
+
+	FetchRows(boost::bind(&Table::FilteredAddRow, this, boost::ref(rs), filter, limit, _1));
 
 	return rs;
 }
 
-void Table::FilteredAddRow(std::vector<Value>& rs, const Filter::Ptr& filter, const Value& row)
+bool Table::FilteredAddRow(std::vector<Value>& rs, const Filter::Ptr& filter, long limit, const Value& row)
 {
 	if (!filter || filter->Apply(GetSelf(), row))
 		rs.push_back(row);
+
+	return (limit == -1 || static_cast<long>(rs.size()) < limit);
 }
 
 Value Table::ZeroAccessor(const Object::Ptr&)
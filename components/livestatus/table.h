@@ -38,14 +38,15 @@ class Table : public Object
 public:
 	DECLARE_PTR_TYPEDEFS(Table);
 
-	typedef boost::function<void (const Value&)> AddRowFunction;
+	typedef boost::function<bool (const Value&)> AddRowFunction;
 
-	static Table::Ptr GetByName(const String& name);
+	static Table::Ptr GetByName(const String& name, const String& compat_log_path,
+	    double from, double until);
 
 
 	virtual String GetName(void) const = 0;
 
-	std::vector<Value> FilterRows(const shared_ptr<Filter>& filter);
+	std::vector<Value> FilterRows(const shared_ptr<Filter>& filter, long limit = -1);
 
 	void AddColumn(const String& name, const Column& column);
 	Column GetColumn(const String& name) const;
@@ -65,7 +66,7 @@ protected:
 private:
 	std::map<String, Column> m_Columns;
 
-	void FilteredAddRow(std::vector<Value>& rs, const shared_ptr<Filter>& filter, const Value& row);
+	bool FilteredAddRow(std::vector<Value>& rs, const shared_ptr<Filter>& filter, long limit, const Value& row);
 };
 
 }
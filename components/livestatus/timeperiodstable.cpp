@@ -50,8 +50,9 @@ String TimePeriodsTable::GetName(void) const
 
 void TimePeriodsTable::FetchRows(const AddRowFunction& addRowFn)
 {
-	BOOST_FOREACH(const TimePeriod::Ptr& tp, DynamicType::GetObjects<TimePeriod>()) {
-		addRowFn(tp);
+	BOOST_FOREACH(const TimePeriod::Ptr& tp, DynamicType::GetSnapshot<TimePeriod>()) {
+		if (!addRowFn(tp))
+			return;
 	}
 }
 
@@ -24,7 +24,7 @@
 using namespace icinga;
 
 DynamicType::DynamicType(const String& name, const DynamicType::ObjectFactory& factory)
-	: m_Name(name), m_ObjectFactory(factory)
+	: m_Name(name), m_ObjectFactory(factory), m_ObjectVector(boost::make_shared<ObjectVector>())
 { }
 
 DynamicType::Ptr DynamicType::GetByName(const String& name)
@@ -60,17 +60,27 @@ DynamicType::TypeVector DynamicType::GetTypes(void)
 	return InternalGetTypeVector(); /* Making a copy of the vector here. */
 }
 
-std::vector<DynamicObject::Ptr> DynamicType::GetObjects(const String& type)
+shared_ptr<const DynamicType::ObjectVector> DynamicType::GetObjectVector(const String& type)
 {
 	DynamicType::Ptr dt = GetByName(type);
-	return dt->GetObjects();
+	return dt->GetObjectVector();
 }
 
-std::vector<DynamicObject::Ptr> DynamicType::GetObjects(void) const
+shared_ptr<const DynamicType::ObjectVector> DynamicType::GetObjectVector(void) const
 {
 	ObjectLock olock(this);
 
-	return m_ObjectVector; /* Making a copy of the vector here. */
+	return m_ObjectVector;
+}
+
+std::vector<DynamicObject::Ptr> DynamicType::GetObjects(void) const
+{
+	return *GetObjectVector(); /* Making a copy of the vector here. */
+}
+
+DynamicObjectSnapshot<DynamicObject> DynamicType::GetSnapshot(void) const
+{
+	return DynamicObjectSnapshot<DynamicObject>(GetObjectVector());
 }
 
 String DynamicType::GetName(void) const
@@ -95,7 +105,14 @@ void DynamicType::RegisterObject(const DynamicObject::Ptr& object)
 		}
 
 		m_ObjectMap[name] = object;
-		m_ObjectVector.push_back(object);
+
+		/* Existing snapshots must not change. Snapshots are only taken
+		 * while holding the lock so the vector can't become shared
+		 * while we're appending to it. */
+		if (!m_ObjectVector.unique())
+			m_ObjectVector = boost::make_shared<ObjectVector>(*m_ObjectVector);
+
+		m_ObjectVector->push_back(object);
 	}
 }
 
@@ -26,12 +26,129 @@
 #include "base/debug.h"
 #include <map>
 #include <set>
+#include <iterator>
 #include <boost/function.hpp>
 #include <boost/smart_ptr/make_shared.hpp>
 
 namespace icinga
 {
 
+/**
+ * A read-only view of the objects of a type. Objects which are registered
+ * after the snapshot was taken aren't included. Taking a snapshot doesn't
+ * copy the objects.
+ *
+ * @ingroup base
+ */
+template<typename T>
+class DynamicObjectSnapshot
+{
+public:
+	typedef std::vector<DynamicObject::Ptr> ObjectVector;
+
+	/**
+	 * Iterates over the objects of a snapshot. All objects of a type are
+	 * created by its factory so they're cast statically.
+	 */
+	class Iterator : public std::iterator<std::forward_iterator_tag, shared_ptr<T>,
+	    std::ptrdiff_t, const shared_ptr<T> *, shared_ptr<T> >
+	{
+	public:
+		Iterator(void)
+		{ }
+
+		explicit Iterator(const ObjectVector::const_iterator& it)
+			: m_It(it)
+		{ }
+
+		shared_ptr<T> operator*(void) const
+		{
+			return static_pointer_cast<T>(*m_It);
+		}
+
+		Iterator& operator++(void)
+		{
+			++m_It;
+			return *this;
+		}
+
+		Iterator operator++(int)
+		{
+			Iterator it = *this;
+			++m_It;
+			return it;
+		}
+
+		bool operator==(const Iterator& other) const
+		{
+			return m_It == other.m_It;
+		}
+
+		bool operator!=(const Iterator& other) const
+		{
+			return m_It != other.m_It;
+		}
+
+	private:
+		ObjectVector::const_iterator m_It;
+	};
+
+	explicit DynamicObjectSnapshot(const shared_ptr<const ObjectVector>& objects)
+		: m_Objects(objects)
+	{ }
+
+	Iterator Begin(void) const
+	{
+		return Iterator(m_Objects->begin());
+	}
+
+	Iterator End(void) const
+	{
+		return Iterator(m_Objects->end());
+	}
+
+	size_t GetLength(void) const
+	{
+		return m_Objects->size();
+	}
+
+	/**
+	 * Returns the untyped objects, e.g. for passing them to functions
+	 * which handle several types.
+	 */
+	const ObjectVector& GetObjects(void) const
+	{
+		return *m_Objects;
+	}
+
+private:
+	shared_ptr<const ObjectVector> m_Objects;
+};
+
+template<typename T>
+inline typename DynamicObjectSnapshot<T>::Iterator range_begin(DynamicObjectSnapshot<T>& x)
+{
+	return x.Begin();
+}
+
+template<typename T>
+inline typename DynamicObjectSnapshot<T>::Iterator range_begin(const DynamicObjectSnapshot<T>& x)
+{
+	return x.Begin();
+}
+
+template<typename T>
+inline typename DynamicObjectSnapshot<T>::Iterator range_end(DynamicObjectSnapshot<T>& x)
+{
+	return x.End();
+}
+
+template<typename T>
+inline typename DynamicObjectSnapshot<T>::Iterator range_end(const DynamicObjectSnapshot<T>& x)
+{
+	return x.End();
+}
+
 class I2_BASE_API DynamicType : public Object
 {
 public:
@@ -54,21 +171,24 @@ public:
 
 	static std::vector<DynamicType::Ptr> GetTypes(void);
 	std::vector<DynamicObject::Ptr> GetObjects(void) const;
+	DynamicObjectSnapshot<DynamicObject> GetSnapshot(void) const;
 
 	template<typename T>
 	static std::vector<shared_ptr<T> > GetObjects(void)
 	{
-		std::vector<shared_ptr<T> > objects;
-
-		BOOST_FOREACH(const DynamicObject::Ptr& object, GetObjects(T::GetTypeName())) {
-			shared_ptr<T> tobject = dynamic_pointer_cast<T>(object);
+		DynamicObjectSnapshot<T> snapshot = GetSnapshot<T>();
 
-			ASSERT(tobject);
-
-			objects.push_back(tobject);
-		}
+		return std::vector<shared_ptr<T> >(snapshot.Begin(), snapshot.End());
+	}
 
-		return objects;
+	/**
+	 * Returns a snapshot of all objects of the type T. Prefer this over
+	 * GetObjects() for scanning all objects.
+	 */
+	template<typename T>
+	static DynamicObjectSnapshot<T> GetSnapshot(void)
+	{
+		return DynamicObjectSnapshot<T>(GetObjectVector(T::GetTypeName()));
 	}
 
 private:
@@ -79,7 +199,10 @@ private:
 	typedef std::vector<DynamicObject::Ptr> ObjectVector;
 
 	ObjectMap m_ObjectMap;
-	ObjectVector m_ObjectVector;
+
+	/* Snapshots share this vector. RegisterObject() copies it before
+	 * appending to it while it's shared. */
+	shared_ptr<ObjectVector> m_ObjectVector;
 
 	typedef std::map<String, DynamicType::Ptr, string_iless> TypeMap;
 	typedef std::vector<DynamicType::Ptr> TypeVector;
@@ -88,7 +211,8 @@ private:
 	static TypeVector& InternalGetTypeVector(void);
 	static boost::mutex& GetStaticMutex(void);
 
-	static std::vector<DynamicObject::Ptr> GetObjects(const String& type);
+	shared_ptr<const ObjectVector> GetObjectVector(void) const;
+	static shared_ptr<const ObjectVector> GetObjectVector(const String& type);
 };
 
 /**
@@ -133,4 +257,21 @@ shared_ptr<T> DynamicObjectFactory(void)
 
 }
 
+namespace boost
+{
+
+template<typename T>
+struct range_mutable_iterator<icinga::DynamicObjectSnapshot<T> >
+{
+	typedef typename icinga::DynamicObjectSnapshot<T>::Iterator type;
+};
+
+template<typename T>
+struct range_const_iterator<icinga::DynamicObjectSnapshot<T> >
+{
+	typedef typename icinga::DynamicObjectSnapshot<T>::Iterator type;
+};
+
+}
+
 #endif /* DYNAMICTYPE_H */
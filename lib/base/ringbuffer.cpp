@@ -33,7 +33,7 @@ RingBuffer::SizeType RingBuffer::GetLength(void) const
 	return m_Slots.size();
 }
 
-void RingBuffer::InsertValue(RingBuffer::SizeType tv, int num)
+void RingBuffer::InsertValue(RingBuffer::SizeType tv, double num)
 {
 	ObjectLock olock(this);
 
@@ -58,7 +58,7 @@ void RingBuffer::InsertValue(RingBuffer::SizeType tv, int num)
 	m_Slots[offsetTarget] += num;
 }
 
-int RingBuffer::GetValues(RingBuffer::SizeType span) const
+double RingBuffer::GetValues(RingBuffer::SizeType span) const
 {
 	ObjectLock olock(this);
 
@@ -66,7 +66,7 @@ int RingBuffer::GetValues(RingBuffer::SizeType span) const
 		span = m_Slots.size();
 
 	int off = m_TimeValue % m_Slots.size();;
-	int sum = 0;
+	double sum = 0;
 	while (span > 0) {
 		sum += m_Slots[off];
 
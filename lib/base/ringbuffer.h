@@ -28,7 +28,8 @@ namespace icinga
 {
 
 /**
- * A ring buffer that holds a pre-defined number of integers.
+ * A ring buffer that holds a pre-defined number of values. The values are
+ * doubles so the sums of large values (e.g. check latencies) can't overflow.
  *
  * @ingroup base
  */
@@ -37,16 +38,16 @@ class I2_BASE_API RingBuffer : public Object
 public:
 	DECLARE_PTR_TYPEDEFS(RingBuffer);
 
-	typedef std::vector<int>::size_type SizeType;
+	typedef std::vector<double>::size_type SizeType;
 
 	RingBuffer(SizeType slots);
 
 	SizeType GetLength(void) const;
-	void InsertValue(SizeType tv, int num);
-	int GetValues(SizeType span) const;
+	void InsertValue(SizeType tv, double num);
+	double GetValues(SizeType span) const;
 
 private:
-	std::vector<int> m_Slots;
+	std::vector<double> m_Slots;
 	SizeType m_TimeValue;
 };
 
@@ -92,6 +92,10 @@ void Socket::Close(void)
 	ObjectLock olock(this);
 
 	if (m_FD != INVALID_SOCKET) {
+		/* Wakes up other threads which are blocked in send() or recv()
+		 * for this socket. closesocket() alone doesn't. */
+		(void) shutdown(m_FD, SD_BOTH);
+
 		closesocket(m_FD);
 		m_FD = INVALID_SOCKET;
 	}
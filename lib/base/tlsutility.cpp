@@ -148,4 +148,24 @@ shared_ptr<X509> GetX509Certificate(const String& pemfile)
 	return shared_ptr<X509>(cert, X509_free);
 }
 
+/**
+ * Calculates the SHA256 checksum of a string.
+ *
+ * @param s The string.
+ * @returns The checksum as a lower-case hex string.
+ */
+String SHA256(const String& s)
+{
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+
+	::SHA256(reinterpret_cast<const unsigned char *>(s.CStr()), s.GetLength(), digest);
+
+	char output[SHA256_DIGEST_LENGTH * 2 + 1];
+
+	for (int i = 0; i < SHA256_DIGEST_LENGTH; i++)
+		sprintf(output + 2 * i, "%02x", digest[i]);
+
+	return output;
+}
+
 }
@@ -41,6 +41,7 @@ typedef int SOCKET;
 #define INVALID_SOCKET (-1)
 
 #define closesocket close
+#define SD_BOTH SHUT_RDWR
 #define ioctlsocket ioctl
 
 #ifndef MAXPATHLEN
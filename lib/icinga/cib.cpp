@@ -23,6 +23,8 @@ using namespace icinga;
 
 RingBuffer CIB::m_ActiveChecksStatistics(15 * 60);
 RingBuffer CIB::m_PassiveChecksStatistics(15 * 60);
+RingBuffer CIB::m_ActiveChecksLatency(15 * 60);
+RingBuffer CIB::m_ActiveChecksExecutionTime(15 * 60);
 
 void CIB::UpdateActiveChecksStatistics(long tv, int num)
 {
@@ -31,7 +33,7 @@ void CIB::UpdateActiveChecksStatistics(long tv, int num)
 
 int CIB::GetActiveChecksStatistics(long timespan)
 {
-	return m_ActiveChecksStatistics.GetValues(timespan);
+	return static_cast<int>(m_ActiveChecksStatistics.GetValues(timespan));
 }
 
 void CIB::UpdatePassiveChecksStatistics(long tv, int num)
@@ -41,5 +43,42 @@ void CIB::UpdatePassiveChecksStatistics(long tv, int num)
 
 int CIB::GetPassiveChecksStatistics(long timespan)
 {
-	return m_PassiveChecksStatistics.GetValues(timespan);
+	return static_cast<int>(m_PassiveChecksStatistics.GetValues(timespan));
+}
+
+/**
+ * Records the latency and execution time (in seconds) of an active check.
+ */
+void CIB::UpdateActiveChecksTimes(long tv, double latency, double executionTime)
+{
+	m_ActiveChecksLatency.InsertValue(tv, latency);
+	m_ActiveChecksExecutionTime.InsertValue(tv, executionTime);
+}
+
+/**
+ * Returns the average latency (in seconds) of the active checks in the
+ * specified timespan.
+ */
+double CIB::GetActiveChecksLatency(long timespan)
+{
+	double count = m_ActiveChecksStatistics.GetValues(timespan);
+
+	if (count == 0)
+		return 0;
+
+	return m_ActiveChecksLatency.GetValues(timespan) / count;
+}
+
+/**
+ * Returns the average execution time (in seconds) of the active checks in
+ * the specified timespan.
+ */
+double CIB::GetActiveChecksExecutionTime(long timespan)
+{
+	double count = m_ActiveChecksStatistics.GetValues(timespan);
+
+	if (count == 0)
+		return 0;
+
+	return m_ActiveChecksExecutionTime.GetValues(timespan) / count;
 }
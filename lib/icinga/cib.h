@@ -41,12 +41,18 @@ public:
 	static void UpdatePassiveChecksStatistics(long tv, int num);
 	static int GetPassiveChecksStatistics(long timespan);
 
+	static void UpdateActiveChecksTimes(long tv, double latency, double executionTime);
+	static double GetActiveChecksLatency(long timespan);
+	static double GetActiveChecksExecutionTime(long timespan);
+
 private:
 	CIB(void);
 
 	static boost::mutex m_Mutex;
 	static RingBuffer m_ActiveChecksStatistics;
 	static RingBuffer m_PassiveChecksStatistics;
+	static RingBuffer m_ActiveChecksLatency;
+	static RingBuffer m_ActiveChecksExecutionTime;
 };
 
 }
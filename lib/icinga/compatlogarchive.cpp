@@ -0,0 +1,434 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "icinga/compatlogarchive.h"
+#include "icinga/compatutility.h"
+#include "base/logger_fwd.h"
+#include "base/convert.h"
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <sys/stat.h>
+
+#ifdef HAVE_ZLIB_H
+#	include <zlib.h>
+#endif /* HAVE_ZLIB_H */
+
+using namespace icinga;
+
+/* Uncompressed size of a block. Blocks always end at a line boundary. */
+#define COMPATLOG_ARCHIVE_BLOCK_SIZE (256 * 1024)
+
+/* Version of the on-disk block index format. */
+#define COMPATLOG_ARCHIVE_VERSION 1
+
+/* Minimum compressed size of a block: the gzip header and trailer. */
+#define COMPATLOG_ARCHIVE_MIN_BLOCK_LENGTH 18
+
+/**
+ * Checks whether archives can be compressed using the specified method.
+ *
+ * @param method The compression method ("none" or "gzip").
+ * @returns true if the method is supported, false otherwise.
+ * @threadsafety Always.
+ */
+bool CompatLogArchive::IsCompressionSupported(const String& method)
+{
+	if (method == "none")
+		return true;
+
+#ifdef HAVE_ZLIB_H
+	if (method == "gzip")
+		return true;
+#endif /* HAVE_ZLIB_H */
+
+	return false;
+}
+
+/**
+ * Checks whether a path refers to a compressed archive.
+ *
+ * @threadsafety Always.
+ */
+bool CompatLogArchive::IsCompressed(const String& path)
+{
+	size_t length = path.GetLength();
+
+	return (length > 3 && path.SubStr(length - 3) == ".gz");
+}
+
+#ifdef HAVE_ZLIB_H
+static bool CompressBlock(const char *data, size_t length, std::vector<char>& output)
+{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+
+	/* windowBits + 16 makes zlib write a gzip header and trailer. */
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+
+	output.resize(deflateBound(&zs, length) + 64);
+
+	zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+	zs.avail_in = length;
+	zs.next_out = reinterpret_cast<Bytef *>(&output[0]);
+	zs.avail_out = output.size();
+
+	int rc = deflate(&zs, Z_FINISH);
+
+	output.resize(output.size() - zs.avail_out);
+
+	deflateEnd(&zs);
+
+	return (rc == Z_STREAM_END);
+}
+#endif /* HAVE_ZLIB_H */
+
+/**
+ * Compresses an archived log file. On success the compressed archive and
+ * its block index replace the original file.
+ *
+ * @param path The path of the archived log file.
+ * @param method The compression method.
+ * @threadsafety Always.
+ */
+void CompatLogArchive::Compress(const String& path, const String& method)
+{
+	if (method == "none")
+		return;
+
+#ifdef HAVE_ZLIB_H
+	if (method != "gzip")
+		return;
+
+	std::ifstream in(path.CStr(), std::ifstream::binary);
+
+	if (!in) {
+		Log(LogWarning, "icinga", "Could not open compat log archive '" + path + "' for compression.");
+		return;
+	}
+
+	String archivePath = path + ".gz";
+	String blocksPath = archivePath + ".blocks";
+	String tempArchive = archivePath + ".tmp";
+	String tempBlocks = blocksPath + ".tmp";
+
+	std::ofstream out(tempArchive.CStr(), std::ofstream::binary | std::ofstream::trunc);
+
+	if (!out) {
+		Log(LogWarning, "icinga", "Could not write compressed compat log archive '" + tempArchive + "'.");
+		return;
+	}
+
+	std::vector<CompatLogArchiveBlock> blocks;
+	std::vector<char> buffer;
+	std::vector<char> compressed;
+	long offset = 0, dataOffset = 0, lineno = 0;
+	size_t carry = 0;
+	bool eof = false;
+
+	while (!eof || carry > 0) {
+		/* Fill the buffer up to the block size, keeping the incomplete
+		 * line from the previous round at the beginning. */
+		buffer.resize(COMPATLOG_ARCHIVE_BLOCK_SIZE);
+
+		size_t length = carry;
+
+		if (!eof) {
+			in.read(&buffer[carry], buffer.size() - carry);
+			length += in.gcount();
+			eof = !in;
+		}
+
+		if (length == 0)
+			break;
+
+		size_t blockLength = length;
+
+		if (!eof) {
+			const char *data = &buffer[0];
+			size_t i = length;
+
+			while (i > 0 && data[i - 1] != '\n')
+				i--;
+
+			/* Lines longer than a block are split across blocks. */
+			if (i > 0)
+				blockLength = i;
+		}
+
+		CompatLogArchiveBlock block;
+		block.Offset = offset;
+		block.DataOffset = dataOffset;
+		block.DataLength = blockLength;
+		block.LineNo = lineno;
+		block.FirstTime = std::numeric_limits<double>::max();
+		block.LastTime = -1;
+
+		const char *data = &buffer[0];
+		size_t pos = 0;
+
+		while (pos < blockLength) {
+			const char *line = data + pos;
+			const char *eol = static_cast<const char *>(memchr(line, '\n', blockLength - pos));
+			size_t lineLength = eol ? eol - line : blockLength - pos;
+
+			double ts;
+
+			if (CompatUtility::ParseLogTimestamp(line, lineLength, &ts)) {
+				if (ts < block.FirstTime)
+					block.FirstTime = ts;
+
+				if (ts > block.LastTime)
+					block.LastTime = ts;
+			}
+
+			pos += lineLength + 1;
+			lineno++;
+		}
+
+		if (!CompressBlock(data, blockLength, compressed)) {
+			Log(LogWarning, "icinga", "Could not compress compat log archive '" + path + "'.");
+			out.close();
+			(void) remove(tempArchive.CStr());
+			return;
+		}
+
+		out.write(&compressed[0], compressed.size());
+
+		block.Length = compressed.size();
+		blocks.push_back(block);
+
+		offset += block.Length;
+		dataOffset += blockLength;
+
+		carry = length - blockLength;
+		memmove(&buffer[0], &buffer[blockLength], carry);
+	}
+
+	out.close();
+
+	std::ofstream fp(tempBlocks.CStr(), std::ofstream::out | std::ofstream::trunc);
+
+	fp.precision(17);
+
+	fp << "icinga2-logblocks " << COMPATLOG_ARCHIVE_VERSION << " " << offset << " " << blocks.size() << "\n";
+
+	for (std::vector<CompatLogArchiveBlock>::const_iterator it = blocks.begin(); it != blocks.end(); it++)
+		fp << it->Offset << " " << it->Length << " " << it->DataOffset << " " << it->DataLength << " "
+		   << it->LineNo << " " << it->FirstTime << " " << it->LastTime << "\n";
+
+	fp.close();
+
+	if (!out || !fp || rename(tempBlocks.CStr(), blocksPath.CStr()) < 0 ||
+	    rename(tempArchive.CStr(), archivePath.CStr()) < 0) {
+		Log(LogWarning, "icinga", "Could not write compressed compat log archive '" + archivePath + "'.");
+		(void) remove(tempArchive.CStr());
+		(void) remove(tempBlocks.CStr());
+		(void) remove(blocksPath.CStr());
+		return;
+	}
+
+	/* Readers ignore the compressed archive for as long as the original
+	 * file still exists. */
+	(void) remove(path.CStr());
+	(void) remove((path + ".idx").CStr());
+	(void) remove((path + ".statehist").CStr());
+
+	Log(LogInformation, "icinga", "Compressed compat log archive '" + path + "' (" + Convert::ToString(dataOffset)
+	    + " -> " + Convert::ToString(offset) + " bytes, " + Convert::ToString(static_cast<long>(blocks.size())) + " blocks)");
+#endif /* HAVE_ZLIB_H */
+}
+
+/**
+ * Loads the block index for a compressed archive.
+ *
+ * @param archivePath The path of the compressed archive.
+ * @param[out] blocks The blocks.
+ * @returns true if the block index exists and matches the archive, false
+ *	    otherwise.
+ * @threadsafety Always.
+ */
+bool CompatLogArchive::LoadBlocks(const String& archivePath, std::vector<CompatLogArchiveBlock>& blocks)
+{
+	struct stat statbuf;
+
+	if (stat(archivePath.CStr(), &statbuf) < 0)
+		return false;
+
+	std::ifstream fp((archivePath + ".blocks").CStr());
+
+	if (!fp)
+		return false;
+
+	String magic;
+	int version;
+	long size;
+	size_t count;
+
+	fp >> magic >> version >> size >> count;
+
+	if (!fp || magic != "icinga2-logblocks" || version != COMPATLOG_ARCHIVE_VERSION || size != statbuf.st_size)
+		return false;
+
+	/* Don't trust a corrupt block index. */
+	if (count > static_cast<size_t>(size) / COMPATLOG_ARCHIVE_MIN_BLOCK_LENGTH)
+		return false;
+
+	blocks.resize(count);
+
+	for (size_t i = 0; i < count; i++) {
+		CompatLogArchiveBlock& block = blocks[i];
+		fp >> block.Offset >> block.Length >> block.DataOffset >> block.DataLength
+		   >> block.LineNo >> block.FirstTime >> block.LastTime;
+
+		/* ReadBlock() allocates buffers of these sizes, the caller
+		 * indexes the archive itself if we return false. */
+		if (!fp || block.Offset < 0 || block.Length < COMPATLOG_ARCHIVE_MIN_BLOCK_LENGTH ||
+		    block.Offset > size - block.Length || block.DataLength < 0 ||
+		    block.DataLength > COMPATLOG_ARCHIVE_BLOCK_SIZE) {
+			blocks.clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Reads and decompresses a single block.
+ *
+ * @param fp The compressed archive.
+ * @param block The block.
+ * @param[out] data The uncompressed data.
+ * @returns true if the block could be read, false otherwise.
+ * @threadsafety Always.
+ */
+bool CompatLogArchive::ReadBlock(std::istream& fp, const CompatLogArchiveBlock& block, std::vector<char>& data)
+{
+#ifdef HAVE_ZLIB_H
+	if (block.Length <= 0 || block.DataLength < 0 || block.DataLength > COMPATLOG_ARCHIVE_BLOCK_SIZE)
+		return false;
+
+	std::vector<char> compressed(block.Length);
+
+	fp.clear();
+	fp.seekg(block.Offset);
+
+	fp.read(&compressed[0], block.Length);
+
+	if (!fp)
+		return false;
+
+	data.resize(block.DataLength);
+
+	if (block.DataLength == 0)
+		return true;
+
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+
+	if (inflateInit2(&zs, 15 + 16) != Z_OK)
+		return false;
+
+	zs.next_in = reinterpret_cast<Bytef *>(&compressed[0]);
+	zs.avail_in = compressed.size();
+	zs.next_out = reinterpret_cast<Bytef *>(&data[0]);
+	zs.avail_out = data.size();
+
+	int rc = inflate(&zs, Z_FINISH);
+
+	inflateEnd(&zs);
+
+	return (rc == Z_STREAM_END && zs.avail_out == 0);
+#else /* HAVE_ZLIB_H */
+	return false;
+#endif /* HAVE_ZLIB_H */
+}
+
+/**
+ * Decompresses a whole archive. This is used for archives which don't have
+ * a (valid) block index.
+ *
+ * @param archivePath The path of the compressed archive.
+ * @param[out] data The uncompressed data.
+ * @returns true if the archive could be read, false otherwise.
+ * @threadsafety Always.
+ */
+bool CompatLogArchive::ReadAll(const String& archivePath, std::vector<char>& data)
+{
+#ifdef HAVE_ZLIB_H
+	std::ifstream fp(archivePath.CStr(), std::ifstream::binary);
+
+	if (!fp)
+		return false;
+
+	std::vector<char> compressed((std::istreambuf_iterator<char>(fp)), std::istreambuf_iterator<char>());
+
+	data.clear();
+
+	if (compressed.empty())
+		return true;
+
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+
+	if (inflateInit2(&zs, 15 + 16) != Z_OK)
+		return false;
+
+	zs.next_in = reinterpret_cast<Bytef *>(&compressed[0]);
+	zs.avail_in = compressed.size();
+
+	size_t length = 0;
+	int rc;
+
+	for (;;) {
+		if (data.size() - length < COMPATLOG_ARCHIVE_BLOCK_SIZE)
+			data.resize(data.size() + 4 * COMPATLOG_ARCHIVE_BLOCK_SIZE);
+
+		zs.next_out = reinterpret_cast<Bytef *>(&data[length]);
+		zs.avail_out = data.size() - length;
+
+		rc = inflate(&zs, Z_NO_FLUSH);
+
+		length = data.size() - zs.avail_out;
+
+		/* The archive consists of several gzip members. */
+		if (rc == Z_STREAM_END && zs.avail_in > 0) {
+			rc = inflateReset(&zs);
+
+			if (rc != Z_OK)
+				break;
+
+			continue;
+		}
+
+		if (rc != Z_OK)
+			break;
+	}
+
+	inflateEnd(&zs);
+
+	data.resize(length);
+
+	return (rc == Z_STREAM_END);
+#else /* HAVE_ZLIB_H */
+	return false;
+#endif /* HAVE_ZLIB_H */
+}
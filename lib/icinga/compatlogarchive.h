@@ -0,0 +1,76 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef COMPATLOGARCHIVE_H
+#define COMPATLOGARCHIVE_H
+
+#include "icinga/i2-icinga.h"
+#include "base/qstring.h"
+#include <istream>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * A block in a compressed compat log archive. Each block is compressed
+ * independently (as a gzip member), so readers can decompress just the
+ * blocks they need.
+ *
+ * @ingroup icinga
+ */
+struct CompatLogArchiveBlock
+{
+	long Offset; /**< The offset of the compressed block in the archive. */
+	long Length; /**< The length of the compressed block. */
+	long DataOffset; /**< The offset of the block's first line in the uncompressed log. */
+	long DataLength; /**< The uncompressed length of the block. */
+	long LineNo; /**< The number of lines before this block. */
+	double FirstTime; /**< The lowest timestamp in the block. */
+	double LastTime; /**< The highest timestamp in the block. */
+};
+
+/**
+ * Compresses rotated compat log files and reads them back.
+ *
+ * A compressed archive "icinga-....log.gz" is a regular multi-member gzip
+ * file which can be read with the usual tools. The block index next to it
+ * ("icinga-....log.gz.blocks") lists the blocks and their time ranges.
+ *
+ * @ingroup icinga
+ */
+class I2_ICINGA_API CompatLogArchive
+{
+public:
+	static bool IsCompressionSupported(const String& method);
+
+	static void Compress(const String& path, const String& method);
+
+	static bool IsCompressed(const String& path);
+	static bool LoadBlocks(const String& archivePath, std::vector<CompatLogArchiveBlock>& blocks);
+	static bool ReadBlock(std::istream& fp, const CompatLogArchiveBlock& block, std::vector<char>& data);
+	static bool ReadAll(const String& archivePath, std::vector<char>& data);
+
+private:
+	CompatLogArchive(void);
+};
+
+}
+
+#endif /* COMPATLOGARCHIVE_H */
@@ -0,0 +1,110 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "icinga/compatlogbuffer.h"
+
+using namespace icinga;
+
+/* Maximum number of lines the buffer holds before the oldest lines are
+ * discarded. */
+#define COMPATLOG_BUFFER_SIZE 16384
+
+boost::mutex CompatLogBuffer::m_Mutex;
+String CompatLogBuffer::m_Path;
+long CompatLogBuffer::m_EndOffset = 0;
+std::deque<CompatLogBufferEntry> CompatLogBuffer::m_Entries;
+boost::signals2::signal<void (const String&)> CompatLogBuffer::OnLineAdded;
+
+/**
+ * Discards all buffered lines. This should be called whenever the log file
+ * is (re-)opened.
+ *
+ * @param path The path of the log file.
+ * @param offset The current size of the log file.
+ * @threadsafety Always.
+ */
+void CompatLogBuffer::Reset(const String& path, long offset)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	m_Path = path;
+	m_EndOffset = offset;
+	m_Entries.clear();
+}
+
+/**
+ * Adds a line to the buffer.
+ *
+ * @param path The path of the log file the line was written to.
+ * @param offset The file offset at which the line starts.
+ * @param line The line, without the trailing newline.
+ * @threadsafety Always.
+ */
+void CompatLogBuffer::AddLine(const String& path, long offset, const String& line)
+{
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		if (path != m_Path)
+			return;
+
+		CompatLogBufferEntry entry;
+		entry.Offset = offset;
+		entry.Line = line;
+		m_Entries.push_back(entry);
+
+		m_EndOffset = offset + line.GetLength() + 1;
+
+		if (m_Entries.size() > COMPATLOG_BUFFER_SIZE)
+			m_Entries.pop_front();
+	}
+
+	OnLineAdded(line);
+}
+
+/**
+ * Retrieves the buffered lines for a log file.
+ *
+ * @param path The path of the log file.
+ * @param[out] offset The file offset of the first buffered line. Readers
+ *		      have to read the file up to this offset themselves.
+ * @param[out] lines The buffered lines.
+ * @returns true if the buffer holds lines for the specified file, false
+ *	    otherwise.
+ * @threadsafety Always.
+ */
+bool CompatLogBuffer::GetLines(const String& path, long *offset, std::vector<String>& lines)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	if (path != m_Path)
+		return false;
+
+	if (m_Entries.empty())
+		*offset = m_EndOffset;
+	else
+		*offset = m_Entries.front().Offset;
+
+	lines.reserve(lines.size() + m_Entries.size());
+
+	for (std::deque<CompatLogBufferEntry>::const_iterator it = m_Entries.begin(); it != m_Entries.end(); it++)
+		lines.push_back(it->Line);
+
+	return true;
+}
@@ -0,0 +1,72 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef COMPATLOGBUFFER_H
+#define COMPATLOGBUFFER_H
+
+#include "icinga/i2-icinga.h"
+#include "base/qstring.h"
+#include <boost/thread/mutex.hpp>
+#include <boost/signals2.hpp>
+#include <deque>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * An entry in the compat log buffer.
+ *
+ * @ingroup icinga
+ */
+struct CompatLogBufferEntry
+{
+	long Offset;
+	String Line;
+};
+
+/**
+ * Holds the most recent lines which were written to the current compat log
+ * file so that readers (e.g. livestatus) don't have to re-read the file
+ * while it's still being written.
+ *
+ * @ingroup icinga
+ */
+class I2_ICINGA_API CompatLogBuffer
+{
+public:
+	static void Reset(const String& path, long offset);
+	static void AddLine(const String& path, long offset, const String& line);
+
+	static bool GetLines(const String& path, long *offset, std::vector<String>& lines);
+
+	static boost::signals2::signal<void (const String&)> OnLineAdded;
+
+private:
+	CompatLogBuffer(void);
+
+	static boost::mutex m_Mutex;
+	static String m_Path;
+	static long m_EndOffset;
+	static std::deque<CompatLogBufferEntry> m_Entries;
+};
+
+}
+
+#endif /* COMPATLOGBUFFER_H */
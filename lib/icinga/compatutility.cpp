@@ -174,7 +174,6 @@ Dictionary::Ptr CompatUtility::GetServiceStatusAttributes(const Service::Ptr& se
 
 	ASSERT(service->OwnsLock());
 
-	String raw_output;
 	String output;
 	String long_output;
 	String perfdata;
@@ -190,22 +189,9 @@ Dictionary::Ptr CompatUtility::GetServiceStatusAttributes(const Service::Ptr& se
 	Dictionary::Ptr cr = service->GetLastCheckResult();
 
 	if (cr) {
-		raw_output = cr->Get("output");
-		size_t line_end = raw_output.Find("\n");
-
-		output = raw_output.SubStr(0, line_end);
-
-		if (line_end > 0 && line_end != String::NPos) {
-			long_output = raw_output.SubStr(line_end+1, raw_output.GetLength());
-			long_output = EscapeString(long_output);
-		}
-
-		boost::algorithm::replace_all(output, "\n", "\\n");
+		GetCheckResultOutput(cr, &output, &long_output, &perfdata);
 
 		schedule_end = cr->Get("schedule_end");
-
-		perfdata = cr->Get("performance_data_raw");
-		boost::algorithm::replace_all(perfdata, "\n", "\\n");
 	}
 
 	int state = service->GetState();
@@ -236,19 +222,9 @@ Dictionary::Ptr CompatUtility::GetServiceStatusAttributes(const Service::Ptr& se
 		attr->Set("last_time_unknown", service->GetLastStateUnknown());
 	}
 
-	double last_notification = 0;
-	double next_notification = 0;
-	int notification_number = 0;
-	BOOST_FOREACH(const Notification::Ptr& notification, service->GetNotifications()) {
-		if (notification->GetLastNotification() > last_notification)
-			last_notification = notification->GetLastNotification();
-
-		if (notification->GetNextNotification() < next_notification)
-			next_notification = notification->GetNextNotification();
-
-		if (notification->GetNotificationNumber() > notification_number)
-			notification_number = notification->GetNotificationNumber();
-	}
+	double last_notification, next_notification;
+	int notification_number;
+	GetNotificationTimes(service, &last_notification, &next_notification, &notification_number);
 
 	CheckCommand::Ptr checkcommand = service->GetCheckCommand();
 	if (checkcommand)
@@ -298,6 +274,51 @@ Dictionary::Ptr CompatUtility::GetServiceStatusAttributes(const Service::Ptr& se
 	return attr;
 }
 
+/**
+ * Splits a check result's output into the first line and the long output
+ * and escapes them (and the performance data) for the status formats.
+ */
+void CompatUtility::GetCheckResultOutput(const Dictionary::Ptr& cr, String *output, String *long_output, String *perfdata)
+{
+	String raw_output = cr->Get("output");
+	size_t line_end = raw_output.Find("\n");
+
+	*output = raw_output.SubStr(0, line_end);
+
+	if (line_end > 0 && line_end != String::NPos) {
+		*long_output = raw_output.SubStr(line_end+1, raw_output.GetLength());
+		*long_output = EscapeString(*long_output);
+	}
+
+	boost::algorithm::replace_all(*output, "\n", "\\n");
+
+	*perfdata = cr->Get("performance_data_raw");
+	boost::algorithm::replace_all(*perfdata, "\n", "\\n");
+}
+
+/**
+ * Returns the time of the last and next notification and the highest
+ * notification number over all of a service's notifications.
+ */
+void CompatUtility::GetNotificationTimes(const Service::Ptr& service, double *last_notification,
+    double *next_notification, int *notification_number)
+{
+	*last_notification = 0;
+	*next_notification = 0;
+	*notification_number = 0;
+
+	BOOST_FOREACH(const Notification::Ptr& notification, service->GetNotifications()) {
+		if (notification->GetLastNotification() > *last_notification)
+			*last_notification = notification->GetLastNotification();
+
+		if (notification->GetNextNotification() < *next_notification)
+			*next_notification = notification->GetNextNotification();
+
+		if (notification->GetNotificationNumber() > *notification_number)
+			*notification_number = notification->GetNotificationNumber();
+	}
+}
+
 Dictionary::Ptr CompatUtility::GetServiceConfigAttributes(const Service::Ptr& service)
 {
 	Dictionary::Ptr attr = boost::make_shared<Dictionary>();
@@ -499,3 +520,32 @@ String CompatUtility::EscapeString(const String& str)
 	boost::algorithm::replace_all(result, "\n", "\\n");
 	return result;
 }
+
+/**
+ * Parses the timestamp at the beginning of a compat log line
+ * ("[1234567890] ...").
+ *
+ * @param line The line. It doesn't have to be NUL-terminated.
+ * @param length The length of the line.
+ * @param[out] ts The timestamp.
+ * @returns true if the line starts with a valid timestamp, false otherwise.
+ * @threadsafety Always.
+ */
+bool CompatUtility::ParseLogTimestamp(const char *line, size_t length, double *ts)
+{
+	if (length < 3 || line[0] != '[')
+		return false;
+
+	double result = 0;
+	size_t i;
+
+	for (i = 1; i < length && line[i] >= '0' && line[i] <= '9'; i++)
+		result = result * 10 + (line[i] - '0');
+
+	if (i == 1 || i >= length || line[i] != ']')
+		return false;
+
+	*ts = result;
+
+	return true;
+}
@@ -52,11 +52,17 @@ public:
 	static Dictionary::Ptr GetServiceStatusAttributes(const Service::Ptr& service, CompatObjectType type);
 	static Dictionary::Ptr GetServiceConfigAttributes(const Service::Ptr& service);
 
+	static void GetCheckResultOutput(const Dictionary::Ptr& cr, String *output, String *long_output, String *perfdata);
+	static void GetNotificationTimes(const Service::Ptr& service, double *last_notification,
+	    double *next_notification, int *notification_number);
+
 	static Dictionary::Ptr GetCommandConfigAttributes(const Command::Ptr& command);
 
 	static Dictionary::Ptr GetCustomVariableConfig(const DynamicObject::Ptr& object);
 	static String EscapeString(const String& str);
 
+	static bool ParseLogTimestamp(const char *line, size_t length, double *ts);
+
 private:
 	CompatUtility(void);
 };
@@ -39,6 +39,7 @@ using namespace icinga;
 
 boost::once_flag ExternalCommandProcessor::m_InitializeOnce = BOOST_ONCE_INIT;
 boost::mutex ExternalCommandProcessor::m_Mutex;
+boost::signals2::signal<void (double, const String&, const std::vector<String>&)> ExternalCommandProcessor::OnNewExternalCommand;
 std::map<String, ExternalCommandProcessor::Callback> ExternalCommandProcessor::m_Commands;
 
 void ExternalCommandProcessor::Execute(const String& line)
@@ -46,7 +47,21 @@ void ExternalCommandProcessor::Execute(const String& line)
 	if (line.IsEmpty())
 		return;
 
-	if (line[0] != '[')
+	double ts;
+	String command;
+	std::vector<String> arguments;
+	Parse(line, &ts, &command, &arguments);
+
+	Execute(ts, command, arguments);
+}
+
+/**
+ * Splits an external command line into its timestamp, command name and
+ * arguments.
+ */
+void ExternalCommandProcessor::Parse(const String& line, double *time, String *command, std::vector<String> *arguments)
+{
+	if (line.IsEmpty() || line[0] != '[')
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Missing timestamp in command: " + line));
 
 	size_t pos = line.FindFirstOf("]");
@@ -68,8 +83,9 @@ void ExternalCommandProcessor::Execute(const String& line)
 	if (argv.empty())
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Missing arguments in command: " + line));
 
-	std::vector<String> argvExtra(argv.begin() + 1, argv.end());
-	Execute(ts, argv[0], argvExtra);
+	*time = ts;
+	*command = argv[0];
+	arguments->assign(argv.begin() + 1, argv.end());
 }
 
 void ExternalCommandProcessor::Execute(double time, const String& command, const std::vector<String>& arguments)
@@ -91,6 +107,8 @@ void ExternalCommandProcessor::Execute(double time, const String& command, const
 	}
 
 	callback(time, arguments);
+
+	OnNewExternalCommand(time, command, arguments);
 }
 
 void ExternalCommandProcessor::Initialize(void)
@@ -0,0 +1,47 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef GRAPHITEWRITER_H
+#define GRAPHITEWRITER_H
+
+#include "icinga/i2-icinga.h"
+#include "icinga/metricwriter.h"
+
+namespace icinga
+{
+
+/**
+ * Writes perfdata metrics to a Graphite (carbon) receiver using the plaintext protocol.
+ *
+ * @ingroup icinga
+ */
+class I2_ICINGA_API GraphiteWriter : public MetricWriter
+{
+public:
+	DECLARE_PTR_TYPEDEFS(GraphiteWriter);
+	DECLARE_TYPENAME(GraphiteWriter);
+
+protected:
+	virtual PerfdataFormat GetPerfdataFormat(void) const;
+	virtual String GetDefaultPort(void) const;
+};
+
+}
+
+#endif /* GRAPHITEWRITER_H */
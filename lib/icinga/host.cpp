@@ -574,6 +574,16 @@ StateType Host::GetStateType(void) const
 	return hc->GetStateType();
 }
 
+HostState Host::StateFromString(const String& state)
+{
+	if (state == "UP")
+		return HostUp;
+	else if (state == "DOWN")
+		return HostDown;
+	else
+		return HostUnreachable;
+}
+
 String Host::StateToString(HostState state)
 {
 	switch (state) {
@@ -119,6 +119,7 @@ public:
 	double GetLastStateDown(void) const;
 	double GetLastStateUnreachable(void) const;
 
+	static HostState StateFromString(const String& state);
 	static String StateToString(HostState state);
 
 	virtual bool ResolveMacro(const String& macro, const Dictionary::Ptr& cr, String *result) const;
@@ -0,0 +1,612 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "icinga/metricconnection.h"
+#include "base/tcpsocket.h"
+#include "base/networkstream.h"
+#include "base/logger_fwd.h"
+#include "base/utility.h"
+#include <boost/smart_ptr/make_shared.hpp>
+#include <boost/foreach.hpp>
+#include <boost/exception/diagnostic_information.hpp>
+#include <sys/stat.h>
+
+using namespace icinga;
+
+/* Maximum number of bytes which are sent with a single write. Producers wake
+ * up the sender thread once this much data is buffered. */
+#define METRIC_BATCH_SIZE (64 * 1024)
+
+/* Minimum number of bytes which may be waiting for the sender thread to
+ * spill them. */
+#define METRIC_SPILL_QUEUE_SIZE (1024 * 1024)
+
+/* How long Stop() waits for the sender thread to send the buffered metrics
+ * before it closes the connection. */
+#define METRIC_STOP_TIMEOUT 5
+
+/**
+ * Constructor for the MetricConnection class.
+ *
+ * @param host The receiver's host name or address.
+ * @param port The receiver's port.
+ * @param bufferSize Maximum number of bytes which are kept in memory while
+ *		     the receiver is unavailable.
+ * @param spillPath Path of the spill file, or an empty string to discard
+ *		    the oldest metrics when the buffer is full.
+ * @param maxSpillSize Maximum size of the spill file, or 0 for no limit.
+ */
+MetricConnection::MetricConnection(const String& host, const String& port, size_t bufferSize,
+    const String& spillPath, size_t maxSpillSize)
+	: m_Host(host), m_Port(port), m_BufferSize(bufferSize), m_SpillPath(spillPath),
+	  m_MaxSpillSize(maxSpillSize), m_FlushInterval(0), m_BufferedBytes(0),
+	  m_FlushRequested(false), m_Stopped(false), m_SpillQueueBytes(0), m_SpillFd(-1),
+	  m_SpillSize(0), m_SpillOffset(0), m_SpillFull(false), m_SentBytes(0), m_DroppedBytes(0)
+{ }
+
+MetricConnection::~MetricConnection(void)
+{
+	if (m_SpillFd >= 0)
+		(void) close(m_SpillFd);
+}
+
+/**
+ * Starts the sender thread and the reconnect timer.
+ *
+ * @param reconnectInterval How often to try to reconnect to the receiver.
+ * @param flushInterval How long to buffer metrics before sending them.
+ */
+void MetricConnection::Start(double reconnectInterval, double flushInterval)
+{
+	m_FlushInterval = flushInterval;
+
+	/* Replay metrics which were spilled by a previous run. */
+	struct stat statbuf;
+
+	if (!m_SpillPath.IsEmpty() && stat(m_SpillPath.CStr(), &statbuf) == 0 && statbuf.st_size > 0)
+		(void) OpenSpillFile();
+
+	m_SenderThread = boost::thread(boost::bind(&MetricConnection::SenderThreadProc, this));
+
+	m_ReconnectTimer = boost::make_shared<Timer>();
+	m_ReconnectTimer->SetInterval(reconnectInterval);
+	m_ReconnectTimer->OnTimerExpired.connect(boost::bind(&MetricConnection::ReconnectTimerHandler, this));
+	m_ReconnectTimer->Start();
+	m_ReconnectTimer->Reschedule(0);
+}
+
+/**
+ * Stops the connection. Buffered metrics are sent if the receiver is
+ * available, otherwise they're spilled (if enabled) or discarded. The
+ * connection is closed if sending them takes more than METRIC_STOP_TIMEOUT
+ * seconds.
+ */
+void MetricConnection::Stop(void)
+{
+	m_ReconnectTimer->Stop();
+
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+		m_Stopped = true;
+		m_CV.notify_all();
+	}
+
+	if (m_SenderThread.timed_join(boost::posix_time::seconds(METRIC_STOP_TIMEOUT)))
+		return;
+
+	/* The receiver stopped reading. Closing the connection makes the
+	 * sender thread's blocked write fail, so the unsent metrics are
+	 * spilled and we don't hang on shutdown. */
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		if (m_Stream)
+			m_Stream->Close();
+	}
+
+	m_SenderThread.join();
+}
+
+/**
+ * Queues metrics for the receiver. This never blocks on the network.
+ *
+ * @param lines One or more complete lines.
+ * @threadsafety Always.
+ */
+void MetricConnection::Send(const std::string& lines)
+{
+	if (lines.empty())
+		return;
+
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	if (m_Stopped)
+		return;
+
+	bool wasEmpty = m_Buffer.empty();
+
+	m_Buffer.push_back(lines);
+	m_BufferedBytes += lines.size();
+
+	TrimBuffer();
+
+	if (wasEmpty || !m_SpillQueue.empty()) {
+		m_CV.notify_all();
+	} else if (!m_FlushRequested && m_BufferedBytes >= METRIC_BATCH_SIZE) {
+		m_FlushRequested = true;
+		m_CV.notify_all();
+	}
+}
+
+bool MetricConnection::IsConnected(void) const
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+	return (m_Stream != NULL);
+}
+
+size_t MetricConnection::GetBufferedBytes(void) const
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+	return m_BufferedBytes;
+}
+
+size_t MetricConnection::GetSpilledBytes(void) const
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+	return m_SpillSize - m_SpillOffset;
+}
+
+size_t MetricConnection::GetSentBytes(void) const
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+	return m_SentBytes;
+}
+
+size_t MetricConnection::GetDroppedBytes(void) const
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+	return m_DroppedBytes;
+}
+
+/**
+ * Connects to the receiver unless we're already connected. Connecting
+ * happens on the timer thread so neither the producers nor the sender
+ * thread wait for it.
+ */
+void MetricConnection::ReconnectTimerHandler(void)
+{
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		if (m_Stream || m_Stopped)
+			return;
+	}
+
+	TcpSocket::Ptr socket = boost::make_shared<TcpSocket>();
+
+	try {
+		socket->Connect(m_Host, m_Port);
+	} catch (const std::exception&) {
+		Log(LogWarning, "icinga", "Could not connect to metric receiver '" + m_Host + ":" + m_Port + "'.");
+		return;
+	}
+
+	Stream::Ptr stream = boost::make_shared<NetworkStream>(socket);
+	bool stopped;
+
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		stopped = m_Stopped;
+
+		if (!stopped) {
+			m_Stream = stream;
+			m_CV.notify_all();
+		}
+	}
+
+	if (stopped) {
+		stream->Close();
+		return;
+	}
+
+	Log(LogInformation, "icinga", "Connected to metric receiver '" + m_Host + ":" + m_Port + "'.");
+}
+
+void MetricConnection::SenderThreadProc(void)
+{
+	Utility::SetThreadName("Metric Sender");
+
+	std::string batch;
+
+	for (;;) {
+		Stream::Ptr stream;
+		std::deque<std::string> buffer, spill;
+		bool replay;
+
+		{
+			boost::mutex::scoped_lock lock(m_Mutex);
+
+			while (!m_Stopped && m_SpillQueue.empty() && (!m_Stream || (m_Buffer.empty() && m_SpillOffset == m_SpillSize)))
+				m_CV.wait(lock);
+
+			/* Spill the lines which didn't fit into the buffer before
+			 * anything else so the spill file stays in order. */
+			if (!m_SpillQueue.empty()) {
+				spill.swap(m_SpillQueue);
+				m_SpillQueueBytes = 0;
+			}
+		}
+
+		if (!spill.empty()) {
+			SpillLines(spill);
+			continue;
+		}
+
+		{
+			boost::mutex::scoped_lock lock(m_Mutex);
+
+			/* Give the producers a chance to fill the batch. */
+			if (!m_Stopped && m_SpillOffset == m_SpillSize && !m_FlushRequested && m_FlushInterval > 0) {
+				m_CV.timed_wait(lock, boost::posix_time::milliseconds(
+				    static_cast<long>(m_FlushInterval * 1000)));
+			}
+
+			/* More lines were queued for the spill file while we were
+			 * spilling or waiting. They're older than the buffered ones. */
+			if (!m_SpillQueue.empty())
+				continue;
+
+			m_FlushRequested = false;
+			stream = m_Stream;
+
+			if (!stream || (m_Buffer.empty() && m_SpillOffset == m_SpillSize)) {
+				if (m_Stopped)
+					break;
+
+				continue;
+			}
+
+			/* The rest of the spill file is replayed by the next run. Metrics
+			 * which were already replayed are sent again then. */
+			if (m_Stopped && m_SpillOffset < m_SpillSize)
+				break;
+
+			/* Spilled metrics are older than the ones in the buffer. */
+			replay = (m_SpillOffset < m_SpillSize);
+
+			if (!replay) {
+				buffer.swap(m_Buffer);
+				m_BufferedBytes = 0;
+			}
+		}
+
+		if (replay) {
+			if (!ReplaySpillFile(stream))
+				Disconnect(stream);
+
+			continue;
+		}
+
+		while (!buffer.empty()) {
+			std::deque<std::string>::size_type count = 0;
+
+			batch.clear();
+
+			while (count < buffer.size() && (count == 0 || batch.size() + buffer[count].size() <= METRIC_BATCH_SIZE)) {
+				batch += buffer[count];
+				count++;
+			}
+
+			if (!WriteData(stream, batch.c_str(), batch.size()))
+				break;
+
+			buffer.erase(buffer.begin(), buffer.begin() + count);
+
+			boost::mutex::scoped_lock lock(m_Mutex);
+			m_SentBytes += batch.size();
+		}
+
+		if (!buffer.empty()) {
+			{
+				boost::mutex::scoped_lock lock(m_Mutex);
+
+				/* The receiver may have gotten part of the batch; it's sent
+				 * again after reconnecting. That's harmless because the
+				 * receivers overwrite datapoints with the same timestamp. */
+				BOOST_FOREACH(const std::string& lines, buffer) {
+					m_BufferedBytes += lines.size();
+				}
+
+				m_Buffer.insert(m_Buffer.begin(), buffer.begin(), buffer.end());
+
+				TrimBuffer();
+			}
+
+			Disconnect(stream);
+		}
+	}
+
+	std::deque<std::string> spill;
+
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		/* Keep whatever we couldn't send for the next run. */
+		if (!m_SpillPath.IsEmpty()) {
+			spill.swap(m_SpillQueue);
+			spill.insert(spill.end(), m_Buffer.begin(), m_Buffer.end());
+		} else {
+			m_DroppedBytes += m_BufferedBytes;
+		}
+
+		m_Buffer.clear();
+		m_BufferedBytes = 0;
+		m_SpillQueueBytes = 0;
+
+		if (m_Stream) {
+			m_Stream->Close();
+			m_Stream.reset();
+		}
+	}
+
+	SpillLines(spill);
+
+	if (m_SpillFd >= 0) {
+		(void) close(m_SpillFd);
+		m_SpillFd = -1;
+
+		if (m_SpillOffset == m_SpillSize)
+			(void) unlink(m_SpillPath.CStr());
+	}
+}
+
+/**
+ * Note: Must only be called by the sender thread.
+ */
+bool MetricConnection::WriteData(const Stream::Ptr& stream, const char *data, size_t length)
+{
+	try {
+		stream->Write(data, length);
+	} catch (const std::exception& ex) {
+		std::ostringstream msgbuf;
+		msgbuf << "Lost connection to metric receiver '" << m_Host << ":" << m_Port << "': " << boost::diagnostic_information(ex);
+		Log(LogWarning, "icinga", msgbuf.str());
+
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Note: Must only be called by the sender thread.
+ */
+void MetricConnection::Disconnect(const Stream::Ptr& stream)
+{
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		if (m_Stream == stream)
+			m_Stream.reset();
+	}
+
+	stream->Close();
+}
+
+/**
+ * Sends the contents of the spill file. The file is truncated once all of
+ * it has been sent.
+ *
+ * Note: Must only be called by the sender thread.
+ *
+ * @returns false if the connection was lost, true otherwise.
+ */
+bool MetricConnection::ReplaySpillFile(const Stream::Ptr& stream)
+{
+	std::vector<char> buffer(METRIC_BATCH_SIZE);
+
+	for (;;) {
+		int fd;
+		size_t offset, size;
+
+		{
+			boost::mutex::scoped_lock lock(m_Mutex);
+
+			if (m_SpillOffset == m_SpillSize) {
+				if (ftruncate(m_SpillFd, 0) < 0) {
+					Log(LogWarning, "icinga", "Could not truncate spill file '" + m_SpillPath + "': "
+					    + strerror(errno));
+				}
+
+				m_SpillOffset = 0;
+				m_SpillSize = 0;
+				m_SpillFull = false;
+
+				return true;
+			}
+
+			if (m_Stopped)
+				return true;
+
+			fd = m_SpillFd;
+			offset = m_SpillOffset;
+			size = m_SpillSize;
+		}
+
+		ssize_t rc = pread(fd, &buffer[0], std::min(size - offset, buffer.size()), offset);
+
+		if (rc <= 0) {
+			Log(LogCritical, "icinga", "Could not read spill file '" + m_SpillPath + "'. Discarding spilled metrics.");
+
+			boost::mutex::scoped_lock lock(m_Mutex);
+			m_DroppedBytes += m_SpillSize - m_SpillOffset;
+			m_SpillOffset = m_SpillSize;
+
+			continue;
+		}
+
+		size_t length = rc;
+
+		/* Only send complete lines so a lost connection doesn't leave
+		 * half a line for the next connection. */
+		if (offset + length < size) {
+			size_t eol = length;
+
+			while (eol > 0 && buffer[eol - 1] != '\n')
+				eol--;
+
+			if (eol > 0)
+				length = eol;
+		}
+
+		if (!WriteData(stream, &buffer[0], length))
+			return false;
+
+		boost::mutex::scoped_lock lock(m_Mutex);
+		m_SpillOffset += length;
+		m_SentBytes += length;
+	}
+}
+
+/**
+ * Removes the oldest metrics from the buffer until it fits within the
+ * configured size. They're queued for the sender thread to spill them so
+ * the producers don't wait for the disk. At most another buffer's worth
+ * (but no less than METRIC_SPILL_QUEUE_SIZE) of metrics is queued.
+ *
+ * Note: Caller must hold m_Mutex.
+ */
+void MetricConnection::TrimBuffer(void)
+{
+	size_t maxQueued = std::max(m_BufferSize, static_cast<size_t>(METRIC_SPILL_QUEUE_SIZE));
+
+	while (m_BufferedBytes > m_BufferSize && !m_Buffer.empty()) {
+		std::string& lines = m_Buffer.front();
+		size_t length = lines.size();
+
+		if (!m_SpillPath.IsEmpty() && m_SpillQueueBytes + length <= maxQueued) {
+			m_SpillQueue.push_back(std::string());
+			m_SpillQueue.back().swap(lines);
+			m_SpillQueueBytes += length;
+		} else
+			m_DroppedBytes += length;
+
+		m_BufferedBytes -= length;
+		m_Buffer.pop_front();
+	}
+}
+
+/**
+ * Note: Must only be called by the sender thread or before it's started.
+ */
+bool MetricConnection::OpenSpillFile(void)
+{
+	int fd = open(m_SpillPath.CStr(), O_RDWR | O_CREAT | O_APPEND, 0600);
+
+	if (fd < 0) {
+		Log(LogWarning, "icinga", "Could not open spill file '" + m_SpillPath + "': " + strerror(errno));
+		return false;
+	}
+
+	Utility::SetCloExec(fd);
+
+	struct stat statbuf;
+	size_t size = 0;
+
+	if (fstat(fd, &statbuf) == 0)
+		size = statbuf.st_size;
+
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	m_SpillFd = fd;
+	m_SpillSize = size;
+	m_SpillOffset = 0;
+
+	return true;
+}
+
+/**
+ * Appends metrics to the spill file. Metrics which can't be spilled are
+ * discarded.
+ *
+ * Note: Must only be called by the sender thread.
+ */
+void MetricConnection::SpillLines(const std::deque<std::string>& lines)
+{
+	size_t dropped = 0;
+
+	BOOST_FOREACH(const std::string& data, lines) {
+		if (!SpillData(data))
+			dropped += data.size();
+	}
+
+	if (dropped > 0) {
+		boost::mutex::scoped_lock lock(m_Mutex);
+		m_DroppedBytes += dropped;
+	}
+}
+
+/**
+ * Appends metrics to the spill file unless it's full.
+ *
+ * Note: Must only be called by the sender thread.
+ */
+bool MetricConnection::SpillData(const std::string& data)
+{
+	if (m_SpillFd < 0 && !OpenSpillFile())
+		return false;
+
+	/* Only the sender thread changes the spill file's size. */
+	size_t size = m_SpillSize;
+
+	if (m_MaxSpillSize > 0 && size + data.size() > m_MaxSpillSize) {
+		if (!m_SpillFull) {
+			Log(LogWarning, "icinga", "Spill file '" + m_SpillPath + "' is full. Discarding metrics.");
+			m_SpillFull = true;
+		}
+
+		return false;
+	}
+
+	size_t written = 0;
+
+	while (written < data.size()) {
+		ssize_t rc = write(m_SpillFd, data.c_str() + written, data.size() - written);
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+
+		if (rc < 0) {
+			Log(LogWarning, "icinga", "Could not write spill file '" + m_SpillPath + "': " + strerror(errno));
+
+			/* Don't leave a partial line behind. */
+			(void) ftruncate(m_SpillFd, size);
+
+			return false;
+		}
+
+		written += rc;
+	}
+
+	boost::mutex::scoped_lock lock(m_Mutex);
+	m_SpillSize += written;
+
+	return true;
+}
@@ -0,0 +1,109 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef METRICCONNECTION_H
+#define METRICCONNECTION_H
+
+#include "icinga/i2-icinga.h"
+#include "base/object.h"
+#include "base/timer.h"
+#include "base/stream.h"
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <deque>
+#include <string>
+
+namespace icinga
+{
+
+/**
+ * A persistent TCP connection to a metric receiver (e.g. carbon). Metrics
+ * are buffered while the receiver is unavailable; once the buffer is full
+ * the oldest metrics are either discarded or appended to a spill file
+ * which is replayed after reconnecting.
+ *
+ * @ingroup icinga
+ */
+class I2_ICINGA_API MetricConnection : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(MetricConnection);
+
+	MetricConnection(const String& host, const String& port, size_t bufferSize,
+	    const String& spillPath = String(), size_t maxSpillSize = 0);
+	~MetricConnection(void);
+
+	void Start(double reconnectInterval, double flushInterval);
+	void Stop(void);
+
+	void Send(const std::string& lines);
+
+	bool IsConnected(void) const;
+	size_t GetBufferedBytes(void) const;
+	size_t GetSpilledBytes(void) const;
+	size_t GetSentBytes(void) const;
+	size_t GetDroppedBytes(void) const;
+
+private:
+	String m_Host;
+	String m_Port;
+	size_t m_BufferSize;
+	String m_SpillPath;
+	size_t m_MaxSpillSize;
+	double m_FlushInterval;
+
+	mutable boost::mutex m_Mutex;
+	boost::condition_variable m_CV;
+	std::deque<std::string> m_Buffer; /**< Complete lines, one entry per Send() call. */
+	size_t m_BufferedBytes;
+	Stream::Ptr m_Stream;
+	bool m_FlushRequested;
+	bool m_Stopped;
+
+	std::deque<std::string> m_SpillQueue; /**< Lines which the sender thread has yet to spill. */
+	size_t m_SpillQueueBytes;
+
+	int m_SpillFd; /**< Only used by the sender thread once it's running. */
+	size_t m_SpillSize;
+	size_t m_SpillOffset; /**< How much of the spill file has been sent. */
+	bool m_SpillFull;
+
+	size_t m_SentBytes;
+	size_t m_DroppedBytes;
+
+	boost::thread m_SenderThread;
+
+	Timer::Ptr m_ReconnectTimer;
+	void ReconnectTimerHandler(void);
+
+	void SenderThreadProc(void);
+	bool WriteData(const Stream::Ptr& stream, const char *data, size_t length);
+	void Disconnect(const Stream::Ptr& stream);
+	bool ReplaySpillFile(const Stream::Ptr& stream);
+
+	void TrimBuffer(void);
+	bool OpenSpillFile(void);
+	void SpillLines(const std::deque<std::string>& lines);
+	bool SpillData(const std::string& data);
+};
+
+}
+
+#endif /* METRICCONNECTION_H */
@@ -0,0 +1,220 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "icinga/metricwriter.h"
+#include "base/dynamictype.h"
+#include "base/logger_fwd.h"
+#include "base/application.h"
+#include <boost/smart_ptr/make_shared.hpp>
+
+using namespace icinga;
+
+MetricWriter::MetricWriter(void)
+	: m_LastSentBytes(0), m_LastDroppedBytes(0)
+{ }
+
+void MetricWriter::Start(void)
+{
+	DynamicObject::Start();
+
+	String spillPath;
+
+	if (GetBufferOverflow() == "spill")
+		spillPath = GetSpillPath();
+	else if (GetBufferOverflow() != "drop")
+		Log(LogWarning, "icinga", "Invalid buffer_overflow '" + GetBufferOverflow() + "' for metric writer '"
+		    + GetName() + "'. Using 'drop' instead.");
+
+	m_Connection = boost::make_shared<MetricConnection>(GetHost(), GetPort(), GetBufferSize(), spillPath, GetSpillSize());
+	m_Connection->Start(GetReconnectInterval(), GetFlushInterval());
+
+	Service::OnNewCheckResult.connect(boost::bind(&MetricWriter::CheckResultHandler, this, _1, _2));
+
+	m_StatsTimer = boost::make_shared<Timer>();
+	m_StatsTimer->SetInterval(15);
+	m_StatsTimer->OnTimerExpired.connect(boost::bind(&MetricWriter::StatsTimerHandler, this));
+	m_StatsTimer->Start();
+}
+
+void MetricWriter::Stop(void)
+{
+	m_StatsTimer->Stop();
+
+	/* Sends or spills whatever is still buffered. */
+	m_Connection->Stop();
+
+	DynamicObject::Stop();
+}
+
+/**
+ * Retrieves the receiver's host name.
+ *
+ * @returns host from config, or "127.0.0.1"
+ */
+String MetricWriter::GetHost(void) const
+{
+	if (!m_Host.IsEmpty())
+		return m_Host;
+	else
+		return "127.0.0.1";
+}
+
+/**
+ * Retrieves the receiver's port.
+ *
+ * @returns port from config, or the writer's default port
+ */
+String MetricWriter::GetPort(void) const
+{
+	if (!m_Port.IsEmpty())
+		return m_Port;
+	else
+		return GetDefaultPort();
+}
+
+/**
+ * Retrieves how many bytes of metrics may be buffered while the receiver
+ * is unavailable.
+ *
+ * @returns buffer_size from config, or 16 MiB
+ */
+size_t MetricWriter::GetBufferSize(void) const
+{
+	if (!m_BufferSize.IsEmpty())
+		return static_cast<long>(m_BufferSize);
+	else
+		return 16 * 1024 * 1024;
+}
+
+/**
+ * Retrieves what to do with metrics when the buffer is full.
+ *
+ * @returns buffer_overflow from config, or "drop"
+ */
+String MetricWriter::GetBufferOverflow(void) const
+{
+	if (!m_BufferOverflow.IsEmpty())
+		return m_BufferOverflow;
+	else
+		return "drop";
+}
+
+String MetricWriter::GetSpillPath(void) const
+{
+	return Application::GetLocalStateDir() + "/lib/icinga2/" + GetType()->GetName() + "-" + GetName() + ".spill";
+}
+
+/**
+ * Retrieves how many bytes of metrics may be kept in the spill file.
+ *
+ * @returns spill_size from config, or 256 MiB
+ */
+size_t MetricWriter::GetSpillSize(void) const
+{
+	if (!m_SpillSize.IsEmpty())
+		return static_cast<long>(m_SpillSize);
+	else
+		return 256 * 1024 * 1024;
+}
+
+/**
+ * Retrieves how long metrics are buffered before they're sent.
+ *
+ * @returns flush_interval from config, or 1 second
+ */
+double MetricWriter::GetFlushInterval(void) const
+{
+	if (!m_FlushInterval.IsEmpty())
+		return m_FlushInterval;
+	else
+		return 1;
+}
+
+/**
+ * Retrieves how often to try to reconnect to the receiver.
+ *
+ * @returns reconnect_interval from config, or 10 seconds
+ */
+double MetricWriter::GetReconnectInterval(void) const
+{
+	if (!m_ReconnectInterval.IsEmpty())
+		return m_ReconnectInterval;
+	else
+		return 10;
+}
+
+void MetricWriter::CheckResultHandler(const Service::Ptr& service, const Dictionary::Ptr& cr)
+{
+	std::string lines;
+	PerfdataWriter::FormatCheckResult(lines, GetPerfdataFormat(), service, cr);
+
+	m_Connection->Send(lines);
+}
+
+void MetricWriter::StatsTimerHandler(void)
+{
+	size_t buffered = m_Connection->GetBufferedBytes();
+	size_t spilled = m_Connection->GetSpilledBytes();
+	size_t sent = m_Connection->GetSentBytes();
+	size_t dropped = m_Connection->GetDroppedBytes();
+
+	if (buffered == 0 && spilled == 0 && sent == m_LastSentBytes && dropped == m_LastDroppedBytes)
+		return;
+
+	std::ostringstream msgbuf;
+	msgbuf << "Metrics for '" << GetName() << "': Connected: " << (m_Connection->IsConnected() ? "yes" : "no")
+	    << "; Buffered bytes: " << buffered
+	    << "; Spilled bytes: " << spilled
+	    << "; Sent bytes: " << (sent - m_LastSentBytes)
+	    << "; Dropped bytes: " << (dropped - m_LastDroppedBytes);
+	Log(LogInformation, "icinga", msgbuf.str());
+
+	m_LastSentBytes = sent;
+	m_LastDroppedBytes = dropped;
+}
+
+void MetricWriter::InternalSerialize(const Dictionary::Ptr& bag, int attributeTypes) const
+{
+	DynamicObject::InternalSerialize(bag, attributeTypes);
+
+	if (attributeTypes & Attribute_Config) {
+		bag->Set("host", m_Host);
+		bag->Set("port", m_Port);
+		bag->Set("buffer_size", m_BufferSize);
+		bag->Set("buffer_overflow", m_BufferOverflow);
+		bag->Set("spill_size", m_SpillSize);
+		bag->Set("flush_interval", m_FlushInterval);
+		bag->Set("reconnect_interval", m_ReconnectInterval);
+	}
+}
+
+void MetricWriter::InternalDeserialize(const Dictionary::Ptr& bag, int attributeTypes)
+{
+	DynamicObject::InternalDeserialize(bag, attributeTypes);
+
+	if (attributeTypes & Attribute_Config) {
+		m_Host = bag->Get("host");
+		m_Port = bag->Get("port");
+		m_BufferSize = bag->Get("buffer_size");
+		m_BufferOverflow = bag->Get("buffer_overflow");
+		m_SpillSize = bag->Get("spill_size");
+		m_FlushInterval = bag->Get("flush_interval");
+		m_ReconnectInterval = bag->Get("reconnect_interval");
+	}
+}
@@ -0,0 +1,85 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef METRICWRITER_H
+#define METRICWRITER_H
+
+#include "icinga/i2-icinga.h"
+#include "icinga/service.h"
+#include "icinga/perfdatawriter.h"
+#include "icinga/metricconnection.h"
+#include "base/dynamicobject.h"
+#include "base/timer.h"
+
+namespace icinga
+{
+
+/**
+ * Base class for writers which stream perfdata metrics to a TCP receiver.
+ *
+ * @ingroup icinga
+ */
+class I2_ICINGA_API MetricWriter : public DynamicObject
+{
+public:
+	DECLARE_PTR_TYPEDEFS(MetricWriter);
+
+	MetricWriter(void);
+
+	String GetHost(void) const;
+	String GetPort(void) const;
+	size_t GetBufferSize(void) const;
+	String GetBufferOverflow(void) const;
+	String GetSpillPath(void) const;
+	size_t GetSpillSize(void) const;
+	double GetFlushInterval(void) const;
+	double GetReconnectInterval(void) const;
+
+protected:
+	virtual void Start(void);
+	virtual void Stop(void);
+
+	virtual PerfdataFormat GetPerfdataFormat(void) const = 0;
+	virtual String GetDefaultPort(void) const = 0;
+
+	virtual void InternalSerialize(const Dictionary::Ptr& bag, int attributeTypes) const;
+	virtual void InternalDeserialize(const Dictionary::Ptr& bag, int attributeTypes);
+
+private:
+	String m_Host;
+	Value m_Port;
+	Value m_BufferSize;
+	String m_BufferOverflow;
+	Value m_SpillSize;
+	Value m_FlushInterval;
+	Value m_ReconnectInterval;
+
+	MetricConnection::Ptr m_Connection;
+
+	void CheckResultHandler(const Service::Ptr& service, const Dictionary::Ptr& cr);
+
+	Timer::Ptr m_StatsTimer;
+	size_t m_LastSentBytes;
+	size_t m_LastDroppedBytes;
+	void StatsTimerHandler(void);
+};
+
+}
+
+#endif /* METRICWRITER_H */
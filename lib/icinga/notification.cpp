@@ -296,42 +296,59 @@ void Notification::BeginExecuteNotification(NotificationType type, const Diction
 		std::copy(members.begin(), members.end(), std::inserter(allUsers, allUsers.begin()));
 	}
 
+	std::set<User::Ptr> allNotifiedUsers;
+
 	BOOST_FOREACH(const User::Ptr& user, allUsers) {
+		if (!CheckNotificationUserFilters(type, user, force))
+			continue;
+
 		Log(LogDebug, "icinga", "Sending notification for user '" + user->GetName() + "'");
-		Utility::QueueAsyncCallback(boost::bind(&Notification::ExecuteNotificationHelper, this, type, user, cr, force, author, text));
+		Utility::QueueAsyncCallback(boost::bind(&Notification::ExecuteNotificationHelper, this, type, user, cr, author, text));
+
+		allNotifiedUsers.insert(user);
 	}
+
+	Service::OnNotificationSentToAllUsers(GetService(), allNotifiedUsers, type, cr, author, text);
 }
 
-void Notification::ExecuteNotificationHelper(NotificationType type, const User::Ptr& user, const Dictionary::Ptr& cr, bool force, const String& author, const String& text)
+bool Notification::CheckNotificationUserFilters(NotificationType type, const User::Ptr& user, bool force)
 {
 	ASSERT(!OwnsLock());
 
-	if (!force) {
-		TimePeriod::Ptr tp = user->GetNotificationPeriod();
+	if (force)
+		return true;
 
-		if (tp && !tp->IsInside(Utility::GetTime())) {
-			Log(LogInformation, "icinga", "Not sending notifications for notification object '" +
-			    GetName() + " and user '" + user->GetName() + "': user not in timeperiod");
-			return;
-		}
+	TimePeriod::Ptr tp = user->GetNotificationPeriod();
 
-		unsigned long ftype = 1 << type;
+	if (tp && !tp->IsInside(Utility::GetTime())) {
+		Log(LogInformation, "icinga", "Not sending notifications for notification object '" +
+		    GetName() + " and user '" + user->GetName() + "': user not in timeperiod");
+		return false;
+	}
 
-		if (!(ftype & user->GetNotificationTypeFilter())) {
-			Log(LogInformation, "icinga", "Not sending notifications for notification object '" +
-			    GetName() + " and user '" + user->GetName() + "': type filter does not match");
-			return;
-		}
+	unsigned long ftype = 1 << type;
 
-		unsigned long fstate = 1 << GetService()->GetState();
+	if (!(ftype & user->GetNotificationTypeFilter())) {
+		Log(LogInformation, "icinga", "Not sending notifications for notification object '" +
+		    GetName() + " and user '" + user->GetName() + "': type filter does not match");
+		return false;
+	}
 
-		if (!(fstate & user->GetNotificationStateFilter())) {
-			Log(LogInformation, "icinga", "Not sending notifications for notification object '" +
-			    GetName() + " and user '" + user->GetName() + "': state filter does not match");
-			return;
-		}
+	unsigned long fstate = 1 << GetService()->GetState();
+
+	if (!(fstate & user->GetNotificationStateFilter())) {
+		Log(LogInformation, "icinga", "Not sending notifications for notification object '" +
+		    GetName() + " and user '" + user->GetName() + "': state filter does not match");
+		return false;
 	}
 
+	return true;
+}
+
+void Notification::ExecuteNotificationHelper(NotificationType type, const User::Ptr& user, const Dictionary::Ptr& cr, const String& author, const String& text)
+{
+	ASSERT(!OwnsLock());
+
 	try {
 		GetNotificationCommand()->Execute(GetSelf(), user, cr, type);
 
@@ -341,7 +358,7 @@ void Notification::ExecuteNotificationHelper(NotificationType type, const User::
 			SetLastNotification(Utility::GetTime());
 		}
 
-		Service::OnNotificationSentChanged(GetSelf(), user, type, cr, author, text);
+		Service::OnNotificationSentChanged(GetService(), user, type, cr, author, text);
 
 		Log(LogInformation, "icinga", "Completed sending notification for service '" + GetService()->GetName() + "'");
 	} catch (const std::exception& ex) {
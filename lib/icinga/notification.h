@@ -115,7 +115,8 @@ private:
 	String m_HostName;
 	String m_Service;
 
-	void ExecuteNotificationHelper(NotificationType type, const User::Ptr& user, const Dictionary::Ptr& cr, bool force, const String& author = "", const String& text = "");
+	bool CheckNotificationUserFilters(NotificationType type, const User::Ptr& user, bool force);
+	void ExecuteNotificationHelper(NotificationType type, const User::Ptr& user, const Dictionary::Ptr& cr, const String& author = "", const String& text = "");
 };
 
 }
@@ -0,0 +1,119 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "icinga/perfdatavalue.h"
+#include <stdlib.h>
+
+using namespace icinga;
+
+/**
+ * Parses performance data. Values which can't be parsed (e.g. "U" for
+ * unknown) are skipped.
+ *
+ * @param perfdata The performance data.
+ * @param[out] values The parsed values are appended to this vector.
+ * @threadsafety Always.
+ */
+void PerfdataValue::Parse(const String& perfdata, std::vector<PerfdataValue>& values)
+{
+	const char *data = perfdata.CStr();
+	size_t length = perfdata.GetLength();
+	size_t i = 0;
+
+	while (i < length) {
+		while (i < length && data[i] == ' ')
+			i++;
+
+		if (i >= length)
+			break;
+
+		PerfdataValue value;
+
+		if (data[i] == '\'') {
+			/* Quoted labels may contain spaces and '' for a single quote. */
+			std::string label;
+
+			for (i++; i < length; i++) {
+				if (data[i] == '\'') {
+					if (i + 1 < length && data[i + 1] == '\'') {
+						label += '\'';
+						i++;
+						continue;
+					}
+
+					i++;
+					break;
+				}
+
+				label += data[i];
+			}
+
+			value.Label = label;
+		} else {
+			size_t start = i;
+
+			while (i < length && data[i] != '=' && data[i] != ' ')
+				i++;
+
+			value.Label = String(data + start, data + i);
+		}
+
+		if (i >= length || data[i] != '=') {
+			/* Invalid value, skip to the next one. */
+			while (i < length && data[i] != ' ')
+				i++;
+
+			continue;
+		}
+
+		i++;
+
+		size_t start = i;
+
+		while (i < length && data[i] != ' ')
+			i++;
+
+		/* Split value[UOM];warn;crit;min;max */
+		String fields[5];
+		size_t field = 0;
+		size_t fieldStart = start;
+
+		for (size_t k = start; k <= i && field < 5; k++) {
+			if (k == i || data[k] == ';') {
+				fields[field++] = String(data + fieldStart, data + k);
+				fieldStart = k + 1;
+			}
+		}
+
+		const char *number = fields[0].CStr();
+		char *unit;
+		value.Value = strtod(number, &unit);
+
+		if (unit == number)
+			continue;
+
+		value.Unit = unit;
+		value.Warn = fields[1];
+		value.Crit = fields[2];
+		value.Min = fields[3];
+		value.Max = fields[4];
+
+		values.push_back(value);
+	}
+}
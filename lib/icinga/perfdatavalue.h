@@ -0,0 +1,51 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef PERFDATAVALUE_H
+#define PERFDATAVALUE_H
+
+#include "icinga/i2-icinga.h"
+#include "base/qstring.h"
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * A single value from a plugin's performance data, i.e.
+ * 'label'=value[UOM];[warn];[crit];[min];[max]
+ *
+ * @ingroup icinga
+ */
+struct I2_ICINGA_API PerfdataValue
+{
+	String Label;
+	double Value;
+	String Unit;
+	String Warn;
+	String Crit;
+	String Min;
+	String Max;
+
+	static void Parse(const String& perfdata, std::vector<PerfdataValue>& values);
+};
+
+}
+
+#endif /* PERFDATAVALUE_H */
@@ -18,7 +18,9 @@
  ******************************************************************************/
 
 #include "icinga/perfdatawriter.h"
+#include "icinga/perfdatavalue.h"
 #include "icinga/service.h"
+#include "icinga/checkcommand.h"
 #include "icinga/macroprocessor.h"
 #include "icinga/icingaapplication.h"
 #include "base/dynamictype.h"
@@ -28,19 +30,43 @@
 #include "base/utility.h"
 #include "base/application.h"
 #include <boost/smart_ptr/make_shared.hpp>
+#include <boost/foreach.hpp>
+#include <boost/exception/diagnostic_information.hpp>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 using namespace icinga;
 
 REGISTER_TYPE(PerfdataWriter);
 
+/* Number of bytes a thread stages before it wakes up the flush thread. */
+#define PERFDATA_STAGING_SIZE (64 * 1024)
+
 PerfdataWriter::PerfdataWriter(void)
-	: m_RotationInterval(30)
+	: m_ParsedFormat(PerfdataFormatPnp), m_Segmented(false),
+	  m_StagingBuffer(&PerfdataWriter::ReleaseStagingBuffer), m_FlushRequested(false),
+	  m_RotateRequested(false), m_Stopped(false), m_Fd(-1), m_SegmentLength(0),
+	  m_SegmentOpened(0), m_SegmentSequence(0)
 { }
 
 void PerfdataWriter::Start(void)
 {
 	DynamicObject::Start();
 
+	if (!ParseFormat(GetFormat(), &m_ParsedFormat)) {
+		Log(LogWarning, "icinga", "Invalid perfdata format '" + GetFormat() + "' for perfdata writer '"
+		    + GetName() + "'. Using 'pnp' instead.");
+		m_ParsedFormat = PerfdataFormatPnp;
+	}
+
+	if (GetRotationMode() == "segment") {
+		m_Segmented = true;
+	} else if (GetRotationMode() != "rename") {
+		Log(LogWarning, "icinga", "Invalid rotation mode '" + GetRotationMode() + "' for perfdata writer '"
+		    + GetName() + "'. Using 'rename' instead.");
+	}
+
 	Service::OnNewCheckResult.connect(bind(&PerfdataWriter::CheckResultHandler, this, _1, _2));
 
 	m_RotationTimer = boost::make_shared<Timer>();
@@ -48,7 +74,24 @@ void PerfdataWriter::Start(void)
 	m_RotationTimer->SetInterval(GetRotationInterval());
 	m_RotationTimer->Start();
 
-	RotateFile();
+	/* The flush thread opens the perfdata file before it writes anything. */
+	m_FlushThread = boost::thread(boost::bind(&PerfdataWriter::FlushThreadProc, this));
+}
+
+void PerfdataWriter::Stop(void)
+{
+	m_RotationTimer->Stop();
+
+	{
+		boost::mutex::scoped_lock lock(m_StagingMutex);
+		m_Stopped = true;
+		m_StagingCV.notify_all();
+	}
+
+	/* The flush thread writes all staged lines before it exits. */
+	m_FlushThread.join();
+
+	DynamicObject::Stop();
 }
 
 String PerfdataWriter::GetPerfdataPath(void) const
@@ -77,54 +120,609 @@ String PerfdataWriter::GetFormatTemplate(void) const
 	}
 }
 
+/**
+ * Retrieves the output format.
+ *
+ * @returns format from config, "template" if a format_template was
+ *	    specified, or "pnp"
+ */
+String PerfdataWriter::GetFormat(void) const
+{
+	if (!m_Format.IsEmpty())
+		return m_Format;
+	else if (!m_FormatTemplate.IsEmpty())
+		return "template";
+	else
+		return "pnp";
+}
+
+/**
+ * Retrieves how the perfdata file is rotated.
+ *
+ * @returns rotation_mode from config, or "rename"
+ */
+String PerfdataWriter::GetRotationMode(void) const
+{
+	if (!m_RotationMode.IsEmpty())
+		return m_RotationMode;
+	else
+		return "rename";
+}
+
+/**
+ * Retrieves the rotation interval. In "segment" mode this is the maximum age
+ * of a segment.
+ *
+ * @returns rotation_interval from config, or 30 seconds ("rename" mode)
+ *	    respectively 300 seconds ("segment" mode)
+ */
 double PerfdataWriter::GetRotationInterval(void) const
 {
-	return m_RotationInterval;
+	if (!m_RotationInterval.IsEmpty())
+		return m_RotationInterval;
+	else if (GetRotationMode() == "segment")
+		return 300;
+	else
+		return 30;
 }
 
-void PerfdataWriter::CheckResultHandler(const Service::Ptr& service, const Dictionary::Ptr& cr)
+/**
+ * Retrieves the size after which a new segment is started.
+ *
+ * @returns segment_size from config, or 64 MiB
+ */
+size_t PerfdataWriter::GetSegmentSize(void) const
+{
+	if (!m_SegmentSize.IsEmpty())
+		return static_cast<long>(m_SegmentSize);
+	else
+		return 64 * 1024 * 1024;
+}
+
+/**
+ * Retrieves the path of the manifest which lists completed segments.
+ */
+String PerfdataWriter::GetManifestPath(void) const
+{
+	return GetPerfdataPath() + ".manifest";
+}
+
+/**
+ * Retrieves how long formatted lines may be staged before they're written.
+ *
+ * @returns flush_interval from config, or 1 second
+ */
+double PerfdataWriter::GetFlushInterval(void) const
+{
+	if (!m_FlushInterval.IsEmpty())
+		return m_FlushInterval;
+	else
+		return 1;
+}
+
+/**
+ * Converts the name of an output format.
+ *
+ * @param name The name ("template", "pnp", "graphite" or "influxdb").
+ * @param[out] format The format.
+ * @returns true if the name is valid, false otherwise.
+ */
+bool PerfdataWriter::ParseFormat(const String& name, PerfdataFormat *format)
+{
+	if (name == "template")
+		*format = PerfdataFormatTemplate;
+	else if (name == "pnp")
+		*format = PerfdataFormatPnp;
+	else if (name == "graphite")
+		*format = PerfdataFormatGraphite;
+	else if (name == "influxdb")
+		*format = PerfdataFormatInfluxDb;
+	else
+		return false;
+
+	return true;
+}
+
+static void AppendString(std::string& buffer, const String& str)
+{
+	buffer.append(str.CStr(), str.GetLength());
+}
+
+static void AppendNumber(std::string& buffer, double value)
+{
+	char buf[64];
+	int length = snprintf(buf, sizeof(buf), "%.15g", value);
+
+	if (length > 0)
+		buffer.append(buf, std::min(static_cast<size_t>(length), sizeof(buf) - 1));
+}
+
+static void AppendLong(std::string& buffer, long value)
+{
+	char buf[32];
+	int length = snprintf(buf, sizeof(buf), "%ld", value);
+
+	if (length > 0)
+		buffer.append(buf, std::min(static_cast<size_t>(length), sizeof(buf) - 1));
+}
+
+/**
+ * Appends a Graphite path component. Dots would start a new component and
+ * spaces would end the path.
+ */
+static void AppendGraphiteName(std::string& buffer, const String& name)
+{
+	for (const char *p = name.CStr(); *p; p++) {
+		if (*p == ' ' || *p == '.' || *p == '/' || *p == '\\')
+			buffer += '_';
+		else
+			buffer += *p;
+	}
+}
+
+/**
+ * Appends an InfluxDB line protocol identifier (measurement, tag key/value
+ * or field key) with commas, spaces and equal signs escaped.
+ */
+static void AppendInfluxDbName(std::string& buffer, const String& name)
+{
+	for (const char *p = name.CStr(); *p; p++) {
+		if (*p == ',' || *p == ' ' || *p == '=')
+			buffer += '\\';
+
+		buffer += *p;
+	}
+}
+
+static bool ParseNumber(const String& str, double *value)
+{
+	if (str.IsEmpty())
+		return false;
+
+	const char *begin = str.CStr();
+	char *end;
+	*value = strtod(begin, &end);
+
+	return (end != begin && *end == '\0');
+}
+
+static void AppendInfluxDbField(std::string& buffer, const char *key, const String& str)
+{
+	double value;
+
+	if (!ParseNumber(str, &value))
+		return;
+
+	buffer += ',';
+	buffer += key;
+	buffer += '=';
+	AppendNumber(buffer, value);
+}
+
+/**
+ * Formats a check result and appends the resulting line(s) to the buffer.
+ * This doesn't support PerfdataFormatTemplate.
+ *
+ * @threadsafety Always.
+ */
+void PerfdataWriter::FormatCheckResult(std::string& buffer, PerfdataFormat format,
+    const Service::Ptr& service, const Dictionary::Ptr& cr)
 {
 	Host::Ptr host = service->GetHost();
 
 	if (!host)
 		return;
 
-	std::vector<MacroResolver::Ptr> resolvers;
-	resolvers.push_back(service);
-	resolvers.push_back(host);
-	resolvers.push_back(IcingaApplication::GetInstance());
+	String perfdata = cr->Get("performance_data_raw");
+
+	if (format == PerfdataFormatPnp) {
+		Service::Ptr hc = host->GetHostCheckService();
+		CheckCommand::Ptr command = service->GetCheckCommand();
+
+		buffer += "DATATYPE::SERVICEPERFDATA\tTIMET::";
+		AppendLong(buffer, static_cast<long>(Utility::GetTime()));
+		buffer += "\tHOSTNAME::";
+		AppendString(buffer, host->GetName());
+		buffer += "\tSERVICEDESC::";
+		AppendString(buffer, service->GetShortName());
+		buffer += "\tSERVICEPERFDATA::";
+		AppendString(buffer, perfdata);
+		buffer += "\tSERVICECHECKCOMMAND::";
 
-	String line = MacroProcessor::ResolveMacros(GetFormatTemplate(), resolvers, cr);
+		if (command)
+			AppendString(buffer, command->GetName());
 
-	ObjectLock olock(this);
-	if (!m_OutputFile.good())
+		buffer += "\tHOSTSTATE::";
+
+		if (hc)
+			AppendLong(buffer, Host::CalculateState(hc->GetState(), host->IsReachable()));
+
+		buffer += "\tHOSTSTATETYPE::";
+
+		if (hc)
+			AppendString(buffer, Service::StateTypeToString(hc->GetStateType()));
+
+		buffer += "\tSERVICESTATE::";
+		AppendString(buffer, Service::StateToString(service->GetState()));
+		buffer += "\tSERVICESTATETYPE::";
+		AppendString(buffer, Service::StateTypeToString(service->GetStateType()));
+		buffer += '\n';
+
+		return;
+	}
+
+	if (perfdata.IsEmpty())
+		return;
+
+	std::vector<PerfdataValue> values;
+	PerfdataValue::Parse(perfdata, values);
+
+	if (values.empty())
 		return;
 
-	m_OutputFile << line << "\n";
+	long ts = static_cast<long>(static_cast<double>(cr->Get("execution_end")));
+
+	if (ts == 0)
+		ts = static_cast<long>(Utility::GetTime());
+
+	if (format == PerfdataFormatGraphite) {
+		/* icinga.<host>.<service>.<label> <value> <timestamp> */
+		std::string prefix = "icinga.";
+		AppendGraphiteName(prefix, host->GetName());
+		prefix += '.';
+		AppendGraphiteName(prefix, service->GetShortName());
+		prefix += '.';
+
+		BOOST_FOREACH(const PerfdataValue& value, values) {
+			buffer += prefix;
+			AppendGraphiteName(buffer, value.Label);
+			buffer += ' ';
+			AppendNumber(buffer, value.Value);
+			buffer += ' ';
+			AppendLong(buffer, ts);
+			buffer += '\n';
+		}
+	} else if (format == PerfdataFormatInfluxDb) {
+		/* <command>,hostname=<host>,service=<service>,metric=<label> value=<value>,... <timestamp> */
+		CheckCommand::Ptr command = service->GetCheckCommand();
+
+		std::string prefix;
+		AppendInfluxDbName(prefix, command ? command->GetName() : "icinga");
+		prefix += ",hostname=";
+		AppendInfluxDbName(prefix, host->GetName());
+		prefix += ",service=";
+		AppendInfluxDbName(prefix, service->GetShortName());
+		prefix += ",metric=";
+
+		BOOST_FOREACH(const PerfdataValue& value, values) {
+			buffer += prefix;
+			AppendInfluxDbName(buffer, value.Label);
+			buffer += " value=";
+			AppendNumber(buffer, value.Value);
+			AppendInfluxDbField(buffer, "warn", value.Warn);
+			AppendInfluxDbField(buffer, "crit", value.Crit);
+			AppendInfluxDbField(buffer, "min", value.Min);
+			AppendInfluxDbField(buffer, "max", value.Max);
+			buffer += ' ';
+			AppendLong(buffer, ts);
+			buffer += "000000000\n";
+		}
+	}
+}
+
+void PerfdataWriter::CheckResultHandler(const Service::Ptr& service, const Dictionary::Ptr& cr)
+{
+	PerfdataStagingBuffer *staging = GetStagingBuffer();
+	bool flush;
+
+	if (m_ParsedFormat == PerfdataFormatTemplate) {
+		Host::Ptr host = service->GetHost();
+
+		if (!host)
+			return;
+
+		std::vector<MacroResolver::Ptr> resolvers;
+		resolvers.push_back(service);
+		resolvers.push_back(host);
+		resolvers.push_back(IcingaApplication::GetInstance());
+
+		String line = MacroProcessor::ResolveMacros(GetFormatTemplate(), resolvers, cr);
+
+		boost::mutex::scoped_lock lock(staging->Mutex);
+		AppendString(staging->Data, line);
+		staging->Data += '\n';
+		flush = (staging->Data.size() >= PERFDATA_STAGING_SIZE);
+	} else {
+		/* Only the flush thread ever competes for this lock. */
+		boost::mutex::scoped_lock lock(staging->Mutex);
+		FormatCheckResult(staging->Data, m_ParsedFormat, service, cr);
+		flush = (staging->Data.size() >= PERFDATA_STAGING_SIZE);
+	}
+
+	if (flush) {
+		boost::mutex::scoped_lock lock(m_StagingMutex);
+
+		if (!m_FlushRequested) {
+			m_FlushRequested = true;
+			m_StagingCV.notify_all();
+		}
+	}
+}
+
+/**
+ * Returns the calling thread's staging buffer, creating it if necessary.
+ *
+ * @threadsafety Always.
+ */
+PerfdataStagingBuffer *PerfdataWriter::GetStagingBuffer(void)
+{
+	PerfdataStagingBuffer *buffer = m_StagingBuffer.get();
+
+	if (buffer)
+		return buffer;
+
+	shared_ptr<PerfdataStagingBuffer> newBuffer = boost::make_shared<PerfdataStagingBuffer>();
+	newBuffer->Orphaned = false;
+
+	{
+		boost::mutex::scoped_lock lock(m_StagingMutex);
+		m_StagingBuffers.push_back(newBuffer);
+	}
+
+	m_StagingBuffer.reset(newBuffer.get());
+
+	return newBuffer.get();
+}
+
+/**
+ * Called when a thread which has a staging buffer exits. The buffer is owned
+ * by m_StagingBuffers; the flush thread removes it once it's empty.
+ */
+void PerfdataWriter::ReleaseStagingBuffer(PerfdataStagingBuffer *buffer)
+{
+	boost::mutex::scoped_lock lock(buffer->Mutex);
+	buffer->Orphaned = true;
+}
+
+void PerfdataWriter::FlushThreadProc(void)
+{
+	Utility::SetThreadName("Perfdata Writer");
+
+	RotateFile();
+
+	std::vector<shared_ptr<PerfdataStagingBuffer> > buffers;
+	std::string data;
+
+	for (;;) {
+		bool rotate, stopped;
+
+		{
+			boost::mutex::scoped_lock lock(m_StagingMutex);
+
+			if (!m_FlushRequested && !m_RotateRequested && !m_Stopped) {
+				m_StagingCV.timed_wait(lock, boost::posix_time::milliseconds(
+				    static_cast<long>(GetFlushInterval() * 1000)));
+			}
+
+			rotate = m_RotateRequested;
+			stopped = m_Stopped;
+
+			m_FlushRequested = false;
+			m_RotateRequested = false;
+
+			buffers = m_StagingBuffers;
+		}
+
+		std::vector<PerfdataStagingBuffer *> orphaned;
+
+		BOOST_FOREACH(const shared_ptr<PerfdataStagingBuffer>& buffer, buffers) {
+			boost::mutex::scoped_lock lock(buffer->Mutex);
+
+			data.append(buffer->Data);
+			buffer->Data.clear();
+
+			if (buffer->Orphaned)
+				orphaned.push_back(buffer.get());
+		}
+
+		buffers.clear();
+
+		try {
+			WriteBuffer(data);
+		} catch (const std::exception& ex) {
+			std::ostringstream msgbuf;
+			msgbuf << "Exception while writing perfdata file: " << boost::diagnostic_information(ex);
+			Log(LogCritical, "icinga", msgbuf.str());
+		}
+
+		data.clear();
+
+		if (!orphaned.empty()) {
+			boost::mutex::scoped_lock lock(m_StagingMutex);
+
+			for (std::vector<shared_ptr<PerfdataStagingBuffer> >::iterator it = m_StagingBuffers.begin(); it != m_StagingBuffers.end(); ) {
+				if (std::find(orphaned.begin(), orphaned.end(), it->get()) != orphaned.end())
+					it = m_StagingBuffers.erase(it);
+				else
+					it++;
+			}
+		}
+
+		/* Empty segments aren't rotated; there's nothing to consume. */
+		if (rotate && (!m_Segmented || m_SegmentLength > 0 || m_Fd < 0))
+			RotateFile();
+
+		if (stopped)
+			break;
+	}
+
+	if (m_Fd >= 0) {
+		if (m_Segmented) {
+			/* Consumers only read segments which are listed in the manifest. */
+			(void) ftruncate(m_Fd, m_SegmentLength);
+			(void) close(m_Fd);
+			m_Fd = -1;
+
+			if (m_SegmentLength > 0)
+				FinishSegment(m_SegmentLength, m_SegmentOpened);
+		} else {
+			(void) close(m_Fd);
+			m_Fd = -1;
+		}
+	}
 }
 
+/**
+ * Note: Must only be called by the flush thread.
+ */
+void PerfdataWriter::WriteBuffer(const std::string& data)
+{
+	if (m_Segmented && m_SegmentLength > 0 && m_SegmentLength + data.size() > GetSegmentSize())
+		RotateSegment();
+
+	size_t written = 0;
+
+	while (m_Fd >= 0 && written < data.size()) {
+		ssize_t rc = write(m_Fd, data.c_str() + written, data.size() - written);
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+
+		if (rc < 0) {
+			Log(LogWarning, "icinga", "Could not write perfdata file '" + GetPerfdataPath() + "': "
+			    + strerror(errno) + ". Perfdata will be lost.");
+			return;
+		}
+
+		written += rc;
+	}
+
+	m_SegmentLength += written;
+}
+
+/**
+ * Note: Must only be called by the flush thread.
+ */
 void PerfdataWriter::RotateFile(void)
 {
-	ObjectLock olock(this);
+	if (m_Segmented) {
+		RotateSegment();
+		return;
+	}
 
 	String tempFile = GetPerfdataPath();
 
-	if (m_OutputFile.good()) {
-		m_OutputFile.close();
+	if (m_Fd >= 0) {
+		(void) close(m_Fd);
+		m_Fd = -1;
 
 		String finalFile = GetPerfdataPath() + "." + Convert::ToString((long)Utility::GetTime());
 		(void) rename(tempFile.CStr(), finalFile.CStr());
 	}
 
-	m_OutputFile.open(tempFile.CStr());
+	m_Fd = open(tempFile.CStr(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
 
-	if (!m_OutputFile.good())
+	if (m_Fd < 0) {
 		Log(LogWarning, "icinga", "Could not open perfdata file '" + tempFile + "' for writing. Perfdata will be lost.");
+		return;
+	}
+
+	Utility::SetCloExec(m_Fd);
+}
+
+/**
+ * Completes the current segment and starts a new one. The new segment is
+ * pre-allocated so appending to it doesn't have to allocate blocks.
+ *
+ * Note: Must only be called by the flush thread.
+ */
+void PerfdataWriter::RotateSegment(void)
+{
+	String tempFile = GetPerfdataPath();
+
+	if (m_Fd >= 0) {
+		/* Releases the pre-allocated blocks we didn't use (on most
+		 * file systems). */
+		(void) ftruncate(m_Fd, m_SegmentLength);
+		(void) close(m_Fd);
+		m_Fd = -1;
+
+		FinishSegment(m_SegmentLength, m_SegmentOpened);
+	} else {
+		/* The segment a previous run was writing when it crashed. */
+		struct stat statbuf;
+
+		if (stat(tempFile.CStr(), &statbuf) == 0 && statbuf.st_size > 0)
+			FinishSegment(statbuf.st_size, statbuf.st_mtime);
+	}
+
+	m_SegmentLength = 0;
+	m_SegmentOpened = Utility::GetTime();
+
+	m_Fd = open(tempFile.CStr(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+
+	if (m_Fd < 0) {
+		Log(LogWarning, "icinga", "Could not open perfdata file '" + tempFile + "' for writing. Perfdata will be lost.");
+		return;
+	}
+
+	Utility::SetCloExec(m_Fd);
+
+#ifdef HAVE_FALLOCATE
+	/* FALLOC_FL_KEEP_SIZE keeps the file size at the number of bytes
+	 * which have actually been written. Not all file systems support
+	 * this in which case blocks are allocated as usual. */
+	(void) fallocate(m_Fd, FALLOC_FL_KEEP_SIZE, 0, GetSegmentSize());
+#endif /* HAVE_FALLOCATE */
+}
+
+/**
+ * Renames the (closed) perfdata file to its final segment name and adds
+ * the segment to the manifest.
+ *
+ * Note: Must only be called by the flush thread.
+ */
+void PerfdataWriter::FinishSegment(size_t length, double opened)
+{
+	double now = Utility::GetTime();
+
+	String tempFile = GetPerfdataPath();
+	String segmentFile = tempFile + "." + Convert::ToString((long)now) + "." + Convert::ToString(m_SegmentSequence);
+	m_SegmentSequence++;
+
+	if (rename(tempFile.CStr(), segmentFile.CStr()) < 0) {
+		Log(LogWarning, "icinga", "Could not rename perfdata file '" + tempFile + "': " + strerror(errno));
+		return;
+	}
+
+	/* <segment path> <length> <opened> <closed> */
+	std::ostringstream msgbuf;
+	msgbuf << segmentFile << "\t" << length << "\t" << (long)opened << "\t" << (long)now << "\n";
+	String line = msgbuf.str();
+
+	String manifestFile = GetManifestPath();
+	int fd = open(manifestFile.CStr(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+	if (fd < 0) {
+		Log(LogWarning, "icinga", "Could not open perfdata manifest '" + manifestFile + "': " + strerror(errno));
+		return;
+	}
+
+	/* Writes with O_APPEND are atomic so consumers never see a partial line
+	 * unless the disk is full. */
+	if (write(fd, line.CStr(), line.GetLength()) < 0)
+		Log(LogWarning, "icinga", "Could not write perfdata manifest '" + manifestFile + "': " + strerror(errno));
+
+	(void) close(fd);
 }
 
 void PerfdataWriter::RotationTimerHandler(void)
 {
-	RotateFile();
+	/* The flush thread rotates the file after writing everything that has
+	 * been staged so far. */
+	boost::mutex::scoped_lock lock(m_StagingMutex);
+	m_RotateRequested = true;
+	m_StagingCV.notify_all();
 }
 
 void PerfdataWriter::InternalSerialize(const Dictionary::Ptr& bag, int attributeTypes) const
@@ -134,7 +732,11 @@ void PerfdataWriter::InternalSerialize(const Dictionary::Ptr& bag, int attribute
 	if (attributeTypes & Attribute_Config) {
 		bag->Set("perfdata_path", m_PerfdataPath);
 		bag->Set("format_template", m_FormatTemplate);
+		bag->Set("format", m_Format);
+		bag->Set("rotation_mode", m_RotationMode);
 		bag->Set("rotation_interval", m_RotationInterval);
+		bag->Set("segment_size", m_SegmentSize);
+		bag->Set("flush_interval", m_FlushInterval);
 	}
 }
 
@@ -145,6 +747,10 @@ void PerfdataWriter::InternalDeserialize(const Dictionary::Ptr& bag, int attribu
 	if (attributeTypes & Attribute_Config) {
 		m_PerfdataPath = bag->Get("perfdata_path");
 		m_FormatTemplate = bag->Get("format_template");
+		m_Format = bag->Get("format");
+		m_RotationMode = bag->Get("rotation_mode");
 		m_RotationInterval = bag->Get("rotation_interval");
+		m_SegmentSize = bag->Get("segment_size");
+		m_FlushInterval = bag->Get("flush_interval");
 	}
 }
@@ -24,11 +24,41 @@
 #include "icinga/service.h"
 #include "base/dynamicobject.h"
 #include "base/timer.h"
-#include <fstream>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/tss.hpp>
+#include <string>
 
 namespace icinga
 {
 
+/**
+ * Output formats for perfdata writers.
+ *
+ * @ingroup icinga
+ */
+enum PerfdataFormat
+{
+	PerfdataFormatTemplate,
+	PerfdataFormatPnp,
+	PerfdataFormatGraphite,
+	PerfdataFormatInfluxDb
+};
+
+/**
+ * Lines which were formatted by a single thread and which haven't been
+ * written yet.
+ *
+ * @ingroup icinga
+ */
+struct PerfdataStagingBuffer
+{
+	boost::mutex Mutex;
+	std::string Data;
+	bool Orphaned; /**< The thread which owned the buffer has exited. */
+};
+
 /**
  * An Icinga perfdata writer.
  *
@@ -44,10 +74,20 @@ public:
 
 	String GetPerfdataPath(void) const;
 	String GetFormatTemplate(void) const;
+	String GetFormat(void) const;
+	String GetRotationMode(void) const;
 	double GetRotationInterval(void) const;
+	size_t GetSegmentSize(void) const;
+	String GetManifestPath(void) const;
+	double GetFlushInterval(void) const;
+
+	static bool ParseFormat(const String& name, PerfdataFormat *format);
+	static void FormatCheckResult(std::string& buffer, PerfdataFormat format,
+	    const Service::Ptr& service, const Dictionary::Ptr& cr);
 
 protected:
 	virtual void Start(void);
+	virtual void Stop(void);
 
 	virtual void InternalSerialize(const Dictionary::Ptr& bag, int attributeTypes) const;
 	virtual void InternalDeserialize(const Dictionary::Ptr& bag, int attributeTypes);
@@ -55,15 +95,46 @@ protected:
 private:
 	String m_PerfdataPath;
 	String m_FormatTemplate;
-	double m_RotationInterval;
+	String m_Format;
+	String m_RotationMode;
+	Value m_RotationInterval;
+	Value m_SegmentSize;
+	Value m_FlushInterval;
+
+	PerfdataFormat m_ParsedFormat;
+	bool m_Segmented;
+
+	boost::thread_specific_ptr<PerfdataStagingBuffer> m_StagingBuffer;
+
+	boost::mutex m_StagingMutex;
+	boost::condition_variable m_StagingCV;
+	std::vector<shared_ptr<PerfdataStagingBuffer> > m_StagingBuffers;
+	bool m_FlushRequested;
+	bool m_RotateRequested;
+	bool m_Stopped;
+
+	boost::thread m_FlushThread;
+
+	/* Only used by the flush thread. */
+	int m_Fd;
+	size_t m_SegmentLength;
+	double m_SegmentOpened;
+	long m_SegmentSequence;
 
 	void CheckResultHandler(const Service::Ptr& service, const Dictionary::Ptr& cr);
 
+	PerfdataStagingBuffer *GetStagingBuffer(void);
+	static void ReleaseStagingBuffer(PerfdataStagingBuffer *buffer);
+
+	void FlushThreadProc(void);
+	void WriteBuffer(const std::string& data);
+
 	Timer::Ptr m_RotationTimer;
 	void RotationTimerHandler(void);
 
-	std::ofstream m_OutputFile;
 	void RotateFile(void);
+	void RotateSegment(void);
+	void FinishSegment(size_t length, double opened);
 };
 
 }
@@ -801,9 +801,10 @@ void Service::UpdateStatistics(const Dictionary::Ptr& cr)
 		ts = static_cast<time_t>(Utility::GetTime());
 
 	Value active = cr->Get("active");
-	if (active.IsEmpty() || static_cast<long>(active))
+	if (active.IsEmpty() || static_cast<long>(active)) {
 		CIB::UpdateActiveChecksStatistics(ts, 1);
-	else
+		CIB::UpdateActiveChecksTimes(ts, CalculateLatency(cr), CalculateExecutionTime(cr));
+	} else
 		CIB::UpdatePassiveChecksStatistics(ts, 1);
 }
 
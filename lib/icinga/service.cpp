@@ -56,8 +56,14 @@ void Service::Start(void)
 	AddCommentsToCache();
 
 	Host::Ptr host = GetHost();
-	if (host)
+	if (host) {
+		{
+			boost::mutex::scoped_lock lock(m_HostMutex);
+			m_Host = host;
+		}
+
 		host->AddService(GetSelf());
+	}
 }
 
 String Service::GetDisplayName(void) const
@@ -84,6 +90,19 @@ Service::Ptr Service::GetByNamePair(const String& hostName, const String& servic
 
 Host::Ptr Service::GetHost(void) const
 {
+	/* Bulk scans call this for every service; avoid the name lookup once
+	 * the service has been started. This doesn't use the object lock
+	 * because callers may already hold it. */
+	Host::Ptr host;
+
+	{
+		boost::mutex::scoped_lock lock(m_HostMutex);
+		host = m_Host.lock();
+	}
+
+	if (host)
+		return host;
+
 	return Host::GetByName(m_HostName);
 }
 
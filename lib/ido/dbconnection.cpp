@@ -18,18 +18,31 @@
  ******************************************************************************/
 
 #include "ido/dbconnection.h"
+#include "ido/dbtype.h"
 #include "ido/dbvalue.h"
 #include "icinga/icingaapplication.h"
 #include "icinga/host.h"
 #include "icinga/service.h"
+#include "icinga/cib.h"
 #include "base/dynamictype.h"
+#include "base/objectlock.h"
+#include "base/netstring.h"
+#include "base/tlsutility.h"
+#include "base/logger_fwd.h"
 #include "base/utility.h"
+#include "base/convert.h"
 #include "base/initialize.h"
+#include <cstdio>
+#include <boost/tuple/tuple.hpp>
+#include <boost/exception/diagnostic_information.hpp>
 #include <boost/foreach.hpp>
 
 using namespace icinga;
 
 Timer::Ptr DbConnection::m_ProgramStatusTimer;
+boost::mutex DbConnection::m_ObjectCountMutex;
+long DbConnection::m_HostCount = 0;
+long DbConnection::m_ServiceCount = 0;
 
 INITIALIZE_ONCE(DbConnection, &DbConnection::StaticInitialize);
 
@@ -37,13 +50,89 @@ void DbConnection::Start(void)
 {
 	DynamicObject::Start();
 
-	DbObject::OnRegistered.connect(boost::bind(&DbConnection::ActivateObject, this, _1));
-	DbObject::OnUnregistered.connect(boost::bind(&DbConnection::DeactivateObject, this, _1));
-	DbObject::OnQuery.connect(boost::bind(&DbConnection::ExecuteQuery, this, _1));
+	m_QueueStopped = false;
+	m_CapturedQueries = NULL;
+	m_SpillLength = 0;
+	m_ProcessedCount = 0;
+	m_DroppedCount = 0;
+	m_SpilledCount = 0;
+	m_LastLatency = 0;
+	m_MaxLatency = 0;
+	m_CommitCount = 0;
+	m_CommittedItems = 0;
+	m_MaxTransactionSize = 0;
+	m_ReplayCount = 0;
+	m_CommitTime = 0;
+	m_MaxCommitTime = 0;
+	m_TxStart = 0;
+	m_TxAttempts = 0;
+	m_TxCommitRequested = false;
+	m_TxGeneration = 1;
+	m_ItemGeneration = 1;
+	m_ItemUndoActive = false;
+	m_Connected = false;
+
+	/* Queries which were spilled by a previous run (including the ones it
+	 * was replaying) are kept until we're connected, see
+	 * ReplayOldSpillFile(). */
+	String path = GetSpillPath();
+
+	bool replaying = MoveToOldSpillFile(path + ".replay");
+
+	if (MoveToOldSpillFile(path) || replaying)
+		Log(LogInformation, "ido", "Found spilled queries from a previous run for DB connection '" + GetName() + "'.");
+
+	m_WriterThread = boost::thread(boost::bind(&DbConnection::WriterThreadProc, this));
+
+	m_QueueStatsTimer = boost::make_shared<Timer>();
+	m_QueueStatsTimer->SetInterval(15);
+	m_QueueStatsTimer->OnTimerExpired.connect(boost::bind(&DbConnection::QueueStatsTimerHandler, this));
+	m_QueueStatsTimer->Start();
+
+	if (GetStatusFlushInterval() > 0) {
+		m_StatusFlushTimer = boost::make_shared<Timer>();
+		m_StatusFlushTimer->SetInterval(GetStatusFlushInterval());
+		m_StatusFlushTimer->OnTimerExpired.connect(boost::bind(&DbConnection::FlushStatusUpdates, this));
+		m_StatusFlushTimer->Start();
+	}
+
+	m_CleanUpTimer = boost::make_shared<Timer>();
+	m_CleanUpTimer->SetInterval(60);
+	m_CleanUpTimer->OnTimerExpired.connect(boost::bind(&DbConnection::CleanUpTimerHandler, this));
+	m_CleanUpTimer->Start();
+
+	DbObject::OnRegistered.connect(boost::bind(&DbConnection::RegisteredHandler, this, _1));
+	DbObject::OnUnregistered.connect(boost::bind(&DbConnection::UnregisteredHandler, this, _1));
+	DbObject::OnQuery.connect(boost::bind(&DbConnection::QueryHandler, this, _1));
+}
+
+void DbConnection::Stop(void)
+{
+	if (m_StatusFlushTimer)
+		m_StatusFlushTimer->Stop();
+
+	m_CleanUpTimer->Stop();
+
+	FlushStatusUpdates();
+
+	{
+		boost::mutex::scoped_lock lock(m_QueueMutex);
+		m_QueueStopped = true;
+		m_QueueCV.notify_all();
+		m_QueueFullCV.notify_all();
+	}
+
+	/* The writer thread drains the queue before it exits. */
+	m_WriterThread.join();
+
+	DynamicObject::Stop();
 }
 
 void DbConnection::StaticInitialize(void)
 {
+	DynamicObject::OnStarted.connect(boost::bind(&DbConnection::ObjectStartedHandler, _1));
+	DynamicObject::OnStopped.connect(boost::bind(&DbConnection::ObjectStoppedHandler, _1));
+
 	m_ProgramStatusTimer = boost::make_shared<Timer>();
 	m_ProgramStatusTimer->SetInterval(10);
 	m_ProgramStatusTimer->OnTimerExpired.connect(boost::bind(&DbConnection::ProgramStatusHandler));
@@ -58,125 +147,252 @@ String DbConnection::GetTablePrefix(void) const
 		return m_TablePrefix;
 }
 
-void DbConnection::InsertRuntimeVariable(const String& key, const Value& value)
+DbQueueOverflow DbConnection::GetQueueOverflow(void) const
+{
+	if (m_QueueOverflow == "drop_status")
+		return DbQueueDropStatus;
+	else if (m_QueueOverflow == "spill")
+		return DbQueueSpill;
+	else
+		return DbQueueBlock;
+}
+
+size_t DbConnection::GetQueueSize(void) const
+{
+	if (m_QueueSize.IsEmpty())
+		return 50000;
+	else
+		return static_cast<long>(m_QueueSize);
+}
+
+double DbConnection::GetStatusFlushInterval(void) const
+{
+	if (m_StatusFlushInterval.IsEmpty())
+		return 5;
+	else
+		return m_StatusFlushInterval;
+}
+
+/**
+ * Returns the number of work items after which the writer thread commits
+ * the current transaction.
+ */
+size_t DbConnection::GetTransactionSize(void) const
+{
+	if (m_TransactionSize.IsEmpty())
+		return 1000;
+	else
+		return static_cast<long>(m_TransactionSize);
+}
+
+/**
+ * Returns how long (in seconds) a transaction may stay open before the
+ * writer thread commits it.
+ */
+double DbConnection::GetTransactionInterval(void) const
+{
+	if (m_TransactionInterval.IsEmpty())
+		return 1;
+	else
+		return m_TransactionInterval;
+}
+
+/**
+ * Returns how long rows are kept in a history table, in seconds. Rows are
+ * kept forever when this is 0.
+ */
+double DbConnection::GetCleanUpAge(const String& table) const
+{
+	if (!m_CleanUp)
+		return 0;
+
+	Value age = m_CleanUp->Get(table + "_age");
+
+	if (age.IsEmpty())
+		return 0;
+	else
+		return age;
+}
+
+/**
+ * Returns the number of queued work items, including spilled queries.
+ *
+ * @threadsafety Always.
+ */
+size_t DbConnection::GetQueueLength(void) const
+{
+	boost::mutex::scoped_lock lock(m_QueueMutex);
+
+	return m_WorkItems.size() + m_SpillLength;
+}
+
+/**
+ * Returns how long the oldest queued work item has been waiting.
+ *
+ * @threadsafety Always.
+ */
+double DbConnection::GetQueueLatency(void) const
+{
+	boost::mutex::scoped_lock lock(m_QueueMutex);
+
+	if (m_WorkItems.empty())
+		return 0;
+
+	return Utility::GetTime() - m_WorkItems.front().Timestamp;
+}
+
+/**
+ * Keeps track of the number of hosts and services so that we don't have to
+ * count them for every program status update.
+ */
+void DbConnection::ObjectStartedHandler(const DynamicObject::Ptr& object)
+{
+	UpdateObjectCount(object, 1);
+}
+
+void DbConnection::ObjectStoppedHandler(const DynamicObject::Ptr& object)
+{
+	UpdateObjectCount(object, -1);
+}
+
+void DbConnection::UpdateObjectCount(const DynamicObject::Ptr& object, int delta)
+{
+	boost::mutex::scoped_lock lock(m_ObjectCountMutex);
+
+	if (boost::dynamic_pointer_cast<Service>(object))
+		m_ServiceCount += delta;
+	else if (boost::dynamic_pointer_cast<Host>(object))
+		m_HostCount += delta;
+}
+
+void DbConnection::UpdateRuntimeVariable(const String& key, const Value& value)
 {
 	DbQuery query;
 	query.Table = "runtimevariables";
-	query.Type = DbQueryInsert;
+	query.Type = DbQueryInsert | DbQueryUpdate;
 	query.Fields = boost::make_shared<Dictionary>();
 	query.Fields->Set("instance_id", 0); /* DbConnection class fills in real ID */
 	query.Fields->Set("varname", key);
 	query.Fields->Set("varvalue", value);
+	query.WhereCriteria = boost::make_shared<Dictionary>();
+	query.WhereCriteria->Set("instance_id", 0); /* DbConnection class fills in real ID */
+	query.WhereCriteria->Set("varname", key);
 	DbObject::OnQuery(query);
 }
 
+/**
+ * Formats a statistic for the last 1, 5 and 15 minutes.
+ */
+template<typename T>
+static String FormatCheckStatistics(T (*func)(long))
+{
+	std::ostringstream msgbuf;
+	msgbuf << func(60) << "," << func(5 * 60) << "," << func(15 * 60);
+	return msgbuf.str();
+}
+
+/**
+ * Updates the programstatus row and the runtime variables. Both are
+ * upserted in place: programstatus has one row per instance and the
+ * runtime variables are unique per instance and name.
+ */
 void DbConnection::ProgramStatusHandler(void)
 {
-	DbQuery query1;
-	query1.Table = "programstatus";
-	query1.Type = DbQueryDelete;
-	query1.WhereCriteria = boost::make_shared<Dictionary>();
-	query1.WhereCriteria->Set("instance_id", 0);  /* DbConnection class fills in real ID */
-	DbObject::OnQuery(query1);
-
-	DbQuery query2;
-	query2.Table = "programstatus";
-	query2.Type = DbQueryInsert;
-
-	query2.Fields = boost::make_shared<Dictionary>();
-	query2.Fields->Set("instance_id", 0); /* DbConnection class fills in real ID */
-	query2.Fields->Set("status_update_time", DbValue::FromTimestamp(Utility::GetTime()));
-	query2.Fields->Set("program_start_time", DbValue::FromTimestamp(IcingaApplication::GetInstance()->GetStartTime()));
-	query2.Fields->Set("is_currently_running", 1);
-	query2.Fields->Set("process_id", Utility::GetPid());
-	query2.Fields->Set("daemon_mode", 1);
-	query2.Fields->Set("last_command_check", DbValue::FromTimestamp(Utility::GetTime()));
-	query2.Fields->Set("notifications_enabled", 1);
-	query2.Fields->Set("active_service_checks_enabled", 1);
-	query2.Fields->Set("passive_service_checks_enabled", 1);
-	query2.Fields->Set("event_handlers_enabled", 1);
-	query2.Fields->Set("flap_detection_enabled", 1);
-	query2.Fields->Set("failure_prediction_enabled", 1);
-	query2.Fields->Set("process_performance_data", 1);
-	DbObject::OnQuery(query2);
-
-	DbQuery query3;
-	query3.Table = "runtimevariables";
-	query3.Type = DbQueryDelete;
-	query3.WhereCriteria = boost::make_shared<Dictionary>();
-	query3.WhereCriteria->Set("instance_id", 0);  /* DbConnection class fills in real ID */
-	DbObject::OnQuery(query3);
-
-	InsertRuntimeVariable("total_services", DynamicType::GetObjects<Service>().size());
-	InsertRuntimeVariable("total_scheduled_services", DynamicType::GetObjects<Service>().size());
-	InsertRuntimeVariable("total_hosts", DynamicType::GetObjects<Host>().size());
-	InsertRuntimeVariable("total_scheduled_hosts", DynamicType::GetObjects<Host>().size());
+	DbQuery query;
+	query.Table = "programstatus";
+	query.Type = DbQueryInsert | DbQueryUpdate;
+
+	query.Fields = boost::make_shared<Dictionary>();
+	query.Fields->Set("instance_id", 0); /* DbConnection class fills in real ID */
+	query.Fields->Set("status_update_time", DbValue::FromTimestamp(Utility::GetTime()));
+	query.Fields->Set("program_start_time", DbValue::FromTimestamp(IcingaApplication::GetInstance()->GetStartTime()));
+	query.Fields->Set("is_currently_running", 1);
+	query.Fields->Set("process_id", Utility::GetPid());
+	query.Fields->Set("daemon_mode", 1);
+	query.Fields->Set("last_command_check", DbValue::FromTimestamp(Utility::GetTime()));
+	query.Fields->Set("notifications_enabled", 1);
+	query.Fields->Set("active_service_checks_enabled", 1);
+	query.Fields->Set("passive_service_checks_enabled", 1);
+	query.Fields->Set("event_handlers_enabled", 1);
+	query.Fields->Set("flap_detection_enabled", 1);
+	query.Fields->Set("failure_prediction_enabled", 1);
+	query.Fields->Set("process_performance_data", 1);
+
+	query.WhereCriteria = boost::make_shared<Dictionary>();
+	query.WhereCriteria->Set("instance_id", 0); /* DbConnection class fills in real ID */
+	DbObject::OnQuery(query);
+
+	long hosts, services;
+
+	{
+		boost::mutex::scoped_lock lock(m_ObjectCountMutex);
+		hosts = m_HostCount;
+		services = m_ServiceCount;
+	}
+
+	UpdateRuntimeVariable("total_services", services);
+	UpdateRuntimeVariable("total_scheduled_services", services);
+	UpdateRuntimeVariable("total_hosts", hosts);
+	UpdateRuntimeVariable("total_scheduled_hosts", hosts);
+
+	UpdateRuntimeVariable("active_scheduled_service_check_stats", FormatCheckStatistics(&CIB::GetActiveChecksStatistics));
+	UpdateRuntimeVariable("passive_service_check_stats", FormatCheckStatistics(&CIB::GetPassiveChecksStatistics));
+	UpdateRuntimeVariable("active_service_check_latency_stats", FormatCheckStatistics(&CIB::GetActiveChecksLatency));
+	UpdateRuntimeVariable("active_service_check_execution_time_stats", FormatCheckStatistics(&CIB::GetActiveChecksExecutionTime));
 }
 
 void DbConnection::SetObjectID(const DbObject::Ptr& dbobj, const DbReference& dbref)
 {
-	if (dbref.IsValid())
-		m_ObjectIDs[dbobj] = dbref;
-	else
-		m_ObjectIDs.erase(dbobj);
+	SaveObjectState(dbobj).ObjectID = dbref;
 }
 
 DbReference DbConnection::GetObjectID(const DbObject::Ptr& dbobj) const
 {
-	std::map<DbObject::Ptr, DbReference>::const_iterator it;
-
-	it = m_ObjectIDs.find(dbobj);
+	const DbObjectState *state = m_ObjectStates.Find(dbobj);
 
-	if (it == m_ObjectIDs.end())
+	if (!state)
 		return DbReference();
 
-	return it->second;
+	return state->ObjectID;
 }
 
 void DbConnection::SetInsertID(const DbObject::Ptr& dbobj, const DbReference& dbref)
 {
-	if (dbref.IsValid())
-		m_InsertIDs[dbobj] = dbref;
-	else
-		m_InsertIDs.erase(dbobj);
+	SaveObjectState(dbobj).InsertID = dbref;
 }
 
 DbReference DbConnection::GetInsertID(const DbObject::Ptr& dbobj) const
 {
-	std::map<DbObject::Ptr, DbReference>::const_iterator it;
-
-	it = m_InsertIDs.find(dbobj);
+	const DbObjectState *state = m_ObjectStates.Find(dbobj);
 
-	if (it == m_InsertIDs.end())
+	if (!state)
 		return DbReference();
 
-	return it->second;
+	return state->InsertID;
 }
 
 void DbConnection::SetConfigUpdate(const DbObject::Ptr& dbobj, bool hasupdate)
 {
-	if (hasupdate)
-		m_ConfigUpdates.insert(dbobj);
-	else
-		m_ConfigUpdates.erase(dbobj);
+	SaveObjectState(dbobj).ConfigUpdate = hasupdate;
 }
 
 bool DbConnection::GetConfigUpdate(const DbObject::Ptr& dbobj) const
 {
-	return (m_ConfigUpdates.find(dbobj) != m_ConfigUpdates.end());
+	const DbObjectState *state = m_ObjectStates.Find(dbobj);
+
+	return (state && state->ConfigUpdate);
 }
 
 void DbConnection::SetStatusUpdate(const DbObject::Ptr& dbobj, bool hasupdate)
 {
-	if (hasupdate)
-		m_StatusUpdates.insert(dbobj);
-	else
-		m_StatusUpdates.erase(dbobj);
+	SaveObjectState(dbobj).StatusUpdate = hasupdate;
 }
 
 bool DbConnection::GetStatusUpdate(const DbObject::Ptr& dbobj) const
 {
-	return (m_StatusUpdates.find(dbobj) != m_StatusUpdates.end());
+	const DbObjectState *state = m_ObjectStates.Find(dbobj);
+
+	return (state && state->StatusUpdate);
 }
 
 void DbConnection::ExecuteQuery(const DbQuery&)
@@ -184,34 +400,1487 @@ void DbConnection::ExecuteQuery(const DbQuery&)
 	/* Default handler does nothing. */
 }
 
-void DbConnection::UpdateAllObjects(void)
+void DbConnection::QueryHandler(const DbQuery& query)
 {
-	DynamicType::Ptr type;
-	BOOST_FOREACH(const DynamicType::Ptr& dt, DynamicType::GetTypes()) {
-		BOOST_FOREACH(const DynamicObject::Ptr& object, dt->GetObjects()) {
-			DbObject::Ptr dbobj = DbObject::GetOrCreateByObject(object);
+	if (boost::this_thread::get_id() == m_WriterThread.get_id() && m_CapturedQueries) {
+		m_CapturedQueries->push_back(query);
+		return;
+	}
 
-			if (dbobj) {
-				ActivateObject(dbobj);
-				dbobj->SendConfigUpdate();
-				dbobj->SendStatusUpdate();
+	/* Only the most recent status update for each object is written to
+	 * the database, see FlushStatusUpdates(). */
+	if (query.StatusUpdate && query.Object && m_StatusFlushTimer) {
+		boost::mutex::scoped_lock lock(m_StatusMutex);
+		m_PendingStatusUpdates[query.Object] = query;
+		return;
+	}
+
+	WorkItem item;
+	item.Query = query;
+	item.IsQuery = true;
+
+	EnqueueItem(item);
+}
+
+void DbConnection::RegisteredHandler(const DbObject::Ptr& dbobj)
+{
+	Enqueue(boost::bind(&DbConnection::ActivateObject, this, dbobj));
+}
+
+void DbConnection::UnregisteredHandler(const DbObject::Ptr& dbobj)
+{
+	Enqueue(boost::bind(&DbConnection::DeactivateObject, this, dbobj));
+}
+
+/**
+ * Queues a callback which is run on the writer thread, in order with
+ * the queries. Backends use this for anything that talks to the database.
+ *
+ * @param callback The callback.
+ * @threadsafety Always.
+ */
+void DbConnection::Enqueue(const WorkFunction& callback)
+{
+	WorkItem item;
+	item.Callback = callback;
+
+	EnqueueItem(item);
+}
+
+/**
+ * Runs a callback on the writer thread and collects the queries it
+ * generates instead of queueing them.
+ *
+ * @param callback The callback, e.g. DbObject::SendConfigUpdate.
+ * @param queries The queries.
+ */
+void DbConnection::CaptureQueries(const WorkFunction& callback, std::vector<DbQuery> *queries)
+{
+	ASSERT(boost::this_thread::get_id() == m_WriterThread.get_id());
+
+	m_CapturedQueries = queries;
+
+	try {
+		callback();
+	} catch (...) {
+		m_CapturedQueries = NULL;
+		throw;
+	}
+
+	m_CapturedQueries = NULL;
+}
+
+void DbConnection::EnqueueItem(const WorkItem& item)
+{
+	WorkItem wi = item;
+	wi.Timestamp = Utility::GetTime();
+
+	/* The writer thread itself queues more work (e.g. when re-syncing all
+	 * objects after a reconnect) and must never wait for the queue to drain. */
+	if (boost::this_thread::get_id() == m_WriterThread.get_id()) {
+		boost::mutex::scoped_lock lock(m_QueueMutex);
+		m_WorkItems.push_back(wi);
+		m_QueueCV.notify_one();
+		return;
+	}
+
+	DbQueueOverflow overflow = GetQueueOverflow();
+	size_t size = GetQueueSize();
+
+	if (overflow == DbQueueSpill) {
+		/* Serializes the producers while they write to the spill file
+		 * without blocking the writer thread. */
+		boost::mutex::scoped_lock slock(m_SpillMutex);
+
+		{
+			boost::mutex::scoped_lock lock(m_QueueMutex);
+
+			/* Once we've started spilling, all later work items have to go
+			 * to the spill file too so they're executed in order. */
+			if (m_SpillLength == 0 && m_WorkItems.size() < size) {
+				m_WorkItems.push_back(wi);
+				m_QueueCV.notify_one();
+				return;
+			}
+		}
+
+		if (SpillItem(wi)) {
+			boost::mutex::scoped_lock lock(m_QueueMutex);
+
+			m_SpillLength++;
+			m_SpilledCount++;
+
+			m_QueueCV.notify_one();
+			return;
+		}
+
+		/* The spill file isn't available, wait for the queue instead. */
+	}
+
+	boost::mutex::scoped_lock lock(m_QueueMutex);
+
+	if (m_WorkItems.size() >= size) {
+		/* Status rows are fully rewritten by the object's next status
+		 * update, so losing one of them is harmless. */
+		if (wi.IsQuery && wi.Query.StatusUpdate && overflow == DbQueueDropStatus) {
+			m_DroppedCount++;
+			return;
+		}
+
+		while (m_WorkItems.size() >= size && !m_QueueStopped)
+			m_QueueFullCV.wait(lock);
+	}
+
+	m_WorkItems.push_back(wi);
+	m_QueueCV.notify_one();
+}
+
+void DbConnection::WriterThreadProc(void)
+{
+	Utility::SetThreadName("DB Writer");
+
+	for (;;) {
+		WorkItem item;
+		bool replay = false;
+		bool commit = false;
+		bool stopped = false;
+
+		{
+			boost::mutex::scoped_lock lock(m_QueueMutex);
+
+			while (m_WorkItems.empty() && m_SpillLength == 0 && !m_QueueStopped) {
+				if (m_TxItems.empty()) {
+					m_QueueCV.wait(lock);
+					continue;
+				}
+
+				/* Don't leave the transaction open while we're idle. */
+				double wait = m_TxStart + GetTransactionInterval() - Utility::GetTime();
+
+				if (wait <= 0) {
+					commit = true;
+					break;
+				}
+
+				m_QueueCV.timed_wait(lock, boost::posix_time::milliseconds(static_cast<long>(wait * 1000)));
+			}
+
+			if (commit) {
+				/* Nothing to do. */
+			} else if (m_WorkItems.empty()) {
+				if (m_SpillLength == 0)
+					stopped = true;
+				else
+					/* Spilled queries are newer than anything that was in the
+					 * queue when we started spilling. */
+					replay = true;
+			} else {
+				item = m_WorkItems.front();
+				m_WorkItems.pop_front();
+
+				m_QueueFullCV.notify_all();
 			}
 		}
+
+		if (stopped) {
+			CommitTransaction();
+			break;
+		}
+
+		if (commit) {
+			CommitTransaction();
+			continue;
+		}
+
+		if (replay) {
+			ReplaySpilledQueries();
+			continue;
+		}
+
+		double latency = Utility::GetTime() - item.Timestamp;
+
+		ProcessWorkItem(item);
+
+		{
+			boost::mutex::scoped_lock lock(m_QueueMutex);
+
+			m_ProcessedCount++;
+			m_LastLatency = latency;
+
+			if (latency > m_MaxLatency)
+				m_MaxLatency = latency;
+		}
 	}
 }
 
-void DbConnection::InternalSerialize(const Dictionary::Ptr& bag, int attributeTypes) const
+/**
+ * Executes a work item as part of the current transaction. The transaction
+ * is committed once it has 'transaction_size' work items or has been open
+ * for 'transaction_interval' seconds, whichever comes first.
+ */
+void DbConnection::ProcessWorkItem(const WorkItem& item)
 {
-	DynamicObject::InternalSerialize(bag, attributeTypes);
+	if (m_TxItems.empty())
+		m_TxStart = Utility::GetTime();
 
-	if (attributeTypes & Attribute_Config)
-		bag->Set("table_prefix", m_TablePrefix);
+	/* Keep the work item until the transaction is committed so we can
+	 * execute it again if the transaction is rolled back. */
+	m_TxItems.push_back(item);
+
+	WorkItemResult result = ExecuteWorkItem(item, false);
+
+	if (result == WorkItemDeadlock)
+		ReplayTransaction(false);
+	else if (result == WorkItemRollback)
+		ReplayTransaction(true);
+
+	if (IsTransactionDue())
+		CommitTransaction();
 }
 
-void DbConnection::InternalDeserialize(const Dictionary::Ptr& bag, int attributeTypes)
+/**
+ * Executes a work item. Isolated work items are wrapped in a savepoint: If
+ * one of them fails only its own statements are rolled back.
+ *
+ * @param item The work item.
+ * @param isolated Whether to use a savepoint.
+ * @returns Whether the work item and/or the transaction were rolled back.
+ */
+DbConnection::WorkItemResult DbConnection::ExecuteWorkItem(const WorkItem& item, bool isolated)
 {
-	DynamicObject::InternalDeserialize(bag, attributeTypes);
+	try {
+		if (isolated) {
+			m_ItemUndoObjects.clear();
+			m_ItemGeneration++;
+			m_ItemUndoActive = true;
 
-	if (attributeTypes & Attribute_Config)
-		m_TablePrefix = bag->Get("table_prefix");
+			SetSavepoint();
+		}
+
+		if (item.IsQuery)
+			ExecuteQuery(item.Query);
+		else
+			item.Callback();
+
+		if (isolated) {
+			ReleaseSavepoint();
+
+			m_ItemUndoActive = false;
+		}
+
+		return WorkItemDone;
+	} catch (const DbDeadlockError& ex) {
+		m_ItemUndoActive = false;
+
+		Log(LogWarning, "ido", "Transaction was rolled back: " + String(ex.what()));
+		return WorkItemDeadlock;
+	} catch (const DbRollbackError& ex) {
+		m_ItemUndoActive = false;
+
+		Log(LogWarning, "ido", "Transaction was rolled back after an error, executing its work items again one by one: " + String(ex.what()));
+		return WorkItemRollback;
+	} catch (const std::exception& ex) {
+		std::ostringstream msgbuf;
+		msgbuf << "Exception during database operation: " << std::endl
+		       << boost::diagnostic_information(ex);
+
+		Log(LogCritical, "ido", msgbuf.str());
+	} catch (...) {
+		Log(LogCritical, "ido", "Exception of unknown type during database operation.");
+	}
+
+	if (!isolated)
+		return WorkItemDone;
+
+	m_ItemUndoActive = false;
+
+	/* The work item's rows aren't in the database. */
+	RestoreObjectStates(m_ItemUndoObjects, &DbObjectState::ItemUndo, m_ItemGeneration);
+
+	try {
+		RollbackSavepoint();
+	} catch (const DbDeadlockError& ex) {
+		Log(LogWarning, "ido", "Transaction was rolled back: " + String(ex.what()));
+		return WorkItemDeadlock;
+	} catch (const std::exception& ex) {
+		std::ostringstream msgbuf;
+		msgbuf << "Could not roll back failed database operation: " << std::endl
+		       << boost::diagnostic_information(ex);
+
+		Log(LogCritical, "ido", msgbuf.str());
+	}
+
+	return WorkItemFailed;
+}
+
+/**
+ * Sets a savepoint so that a failing work item can be rolled back without
+ * losing the rest of the transaction. This is only necessary for databases
+ * which abort the whole transaction on errors, the default implementation
+ * does nothing.
+ */
+void DbConnection::SetSavepoint(void)
+{
+	/* Default handler does nothing. */
+}
+
+/**
+ * Releases the savepoint after the work item has finished successfully.
+ */
+void DbConnection::ReleaseSavepoint(void)
+{
+	/* Default handler does nothing. */
+}
+
+/**
+ * Rolls back to the savepoint after the work item has failed.
+ */
+void DbConnection::RollbackSavepoint(void)
+{
+	/* Default handler does nothing. */
+}
+
+bool DbConnection::IsTransactionDue(void) const
+{
+	if (m_TxItems.empty())
+		return false;
+
+	return (m_TxCommitRequested || m_TxItems.size() >= GetTransactionSize() ||
+	    Utility::GetTime() - m_TxStart >= GetTransactionInterval());
+}
+
+/**
+ * Asks the writer thread to commit the current transaction once the work
+ * item which is being executed has finished, e.g. so that rows deleted by
+ * the history cleanup aren't locked any longer than necessary.
+ *
+ * Note: Must only be called on the writer thread.
+ */
+void DbConnection::RequestCommit(void)
+{
+	ASSERT(boost::this_thread::get_id() == m_WriterThread.get_id());
+
+	m_TxCommitRequested = true;
+}
+
+/**
+ * Commits the current transaction. If the database rolls it back its work
+ * items are executed again in a new transaction, see ReplayTransaction().
+ */
+void DbConnection::CommitTransaction(void)
+{
+	while (!m_TxItems.empty()) {
+		double start = Utility::GetTime();
+
+		try {
+			NewTransaction();
+		} catch (const DbDeadlockError& ex) {
+			Log(LogWarning, "ido", "Commit was rolled back: " + String(ex.what()));
+			ReplayTransaction(false);
+			continue;
+		} catch (const DbRollbackError& ex) {
+			/* Backends which defer rows (COPY, pipelining) only see
+			 * their errors when the transaction is flushed. */
+			Log(LogWarning, "ido", "Commit was rolled back after an error, executing its work items again one by one: " + String(ex.what()));
+			ReplayTransaction(true);
+			continue;
+		} catch (const std::exception& ex) {
+			std::ostringstream msgbuf;
+			msgbuf << "Could not commit transaction with " << m_TxItems.size() << " work items: " << std::endl
+			       << boost::diagnostic_information(ex);
+			Log(LogCritical, "ido", msgbuf.str());
+
+			/* None of the transaction's rows made it into the database. */
+			RestoreObjectStates(m_TxUndoObjects, &DbObjectState::TxUndo, m_TxGeneration);
+		}
+
+		double duration = Utility::GetTime() - start;
+		long size = m_TxItems.size();
+
+		m_TxItems.clear();
+		ClearTransactionUndo();
+		m_TxAttempts = 0;
+		m_TxCommitRequested = false;
+
+		boost::mutex::scoped_lock lock(m_QueueMutex);
+
+		m_CommitCount++;
+		m_CommittedItems += size;
+		m_CommitTime += duration;
+
+		if (size > m_MaxTransactionSize)
+			m_MaxTransactionSize = size;
+
+		if (duration > m_MaxCommitTime)
+			m_MaxCommitTime = duration;
+	}
+
+	m_TxCommitRequested = false;
+}
+
+/**
+ * Executes the work items of a rolled back transaction again. The backend
+ * has already started a new transaction. The object IDs, insert IDs and
+ * update flags which the work items had set are reset first so the rows
+ * are written again rather than updated.
+ *
+ * After a deadlock the work items are simply executed again. We give up
+ * after three attempts. When the transaction was rolled back because of an
+ * error, each work item is isolated by a savepoint so that the failing one
+ * is the only one we lose.
+ *
+ * @param isolated Whether to isolate the work items.
+ */
+void DbConnection::ReplayTransaction(bool isolated)
+{
+	for (;;) {
+		m_TxAttempts++;
+
+		RestoreObjectStates(m_TxUndoObjects, &DbObjectState::TxUndo, m_TxGeneration);
+
+		if (m_TxAttempts > 3) {
+			std::ostringstream msgbuf;
+			msgbuf << "Dropping transaction with " << m_TxItems.size() << " work items after "
+			       << m_TxAttempts - 1 << " attempts.";
+			Log(LogCritical, "ido", msgbuf.str());
+
+			m_TxItems.clear();
+			ClearTransactionUndo();
+			m_TxAttempts = 0;
+			m_TxCommitRequested = false;
+			return;
+		}
+
+		{
+			boost::mutex::scoped_lock lock(m_QueueMutex);
+			m_ReplayCount++;
+		}
+
+		std::vector<WorkItem> items;
+		items.swap(m_TxItems);
+		m_TxStart = Utility::GetTime();
+
+		bool rolledBack = false;
+		long failed = 0;
+
+		for (std::vector<WorkItem>::size_type i = 0; i < items.size(); i++) {
+			m_TxItems.push_back(items[i]);
+
+			WorkItemResult result = ExecuteWorkItem(items[i], isolated);
+
+			if (result == WorkItemFailed) {
+				/* Its savepoint has been rolled back, there's nothing to
+				 * replay for this work item. */
+				m_TxItems.pop_back();
+				failed++;
+			} else if (result != WorkItemDone) {
+				if (result == WorkItemRollback)
+					isolated = true;
+
+				m_TxItems.insert(m_TxItems.end(), items.begin() + i + 1, items.end());
+				rolledBack = true;
+				break;
+			}
+		}
+
+		if (failed > 0) {
+			std::ostringstream msgbuf;
+			msgbuf << "Skipped " << failed << " failed work items while replaying a transaction with " << items.size() << " work items.";
+			Log(LogWarning, "ido", msgbuf.str());
+		}
+
+		if (!rolledBack)
+			return;
+	}
+}
+
+/**
+ * Tells the writer thread that the backend has committed the current
+ * transaction by itself, e.g. after re-syncing all objects: Its work
+ * items don't need to be replayed any more.
+ *
+ * Note: Must only be called on the writer thread.
+ */
+void DbConnection::TransactionCommitted(void)
+{
+	ASSERT(boost::this_thread::get_id() == m_WriterThread.get_id());
+
+	m_TxItems.clear();
+	ClearTransactionUndo();
+	m_TxAttempts = 0;
+	m_TxCommitRequested = false;
+}
+
+/**
+ * Remembers an object's state before the current transaction (and the
+ * current isolated work item) changes it for the first time. The saved
+ * state is kept in the object's slot and stamped with the transaction's
+ * (or work item's) generation.
+ *
+ * @returns The object's state.
+ */
+DbObjectState& DbConnection::SaveObjectState(const DbObject::Ptr& dbobj)
+{
+	DbObjectState& state = m_ObjectStates.Get(dbobj);
+
+	if (state.TxUndo.Generation != m_TxGeneration) {
+		state.TxUndo.Generation = m_TxGeneration;
+		state.TxUndo.ObjectID = state.ObjectID;
+		state.TxUndo.InsertID = state.InsertID;
+		state.TxUndo.ConfigUpdate = state.ConfigUpdate;
+		state.TxUndo.StatusUpdate = state.StatusUpdate;
+
+		m_TxUndoObjects.push_back(dbobj);
+	}
+
+	if (m_ItemUndoActive && state.ItemUndo.Generation != m_ItemGeneration) {
+		state.ItemUndo.Generation = m_ItemGeneration;
+		state.ItemUndo.ObjectID = state.ObjectID;
+		state.ItemUndo.InsertID = state.InsertID;
+		state.ItemUndo.ConfigUpdate = state.ConfigUpdate;
+		state.ItemUndo.StatusUpdate = state.StatusUpdate;
+
+		m_ItemUndoObjects.push_back(dbobj);
+	}
+
+	return state;
+}
+
+/**
+ * Resets the state of all objects which were changed by a rolled back
+ * transaction or work item to what is in the database.
+ *
+ * @param objects The objects which were changed.
+ * @param undo The saved state, i.e. DbObjectState::TxUndo or
+ *	       DbObjectState::ItemUndo.
+ * @param generation The transaction's or work item's generation.
+ */
+void DbConnection::RestoreObjectStates(const std::vector<DbObject::Ptr>& objects,
+    DbObjectUndo DbObjectState::*undo, unsigned long generation)
+{
+	BOOST_FOREACH(const DbObject::Ptr& dbobj, objects) {
+		DbObjectState& state = m_ObjectStates.Get(dbobj);
+		const DbObjectUndo& saved = state.*undo;
+
+		if (saved.Generation != generation)
+			continue;
+
+		state.ObjectID = saved.ObjectID;
+		state.InsertID = saved.InsertID;
+		state.ConfigUpdate = saved.ConfigUpdate;
+		state.StatusUpdate = saved.StatusUpdate;
+	}
+}
+
+/**
+ * Forgets the saved object states once the transaction has ended.
+ */
+void DbConnection::ClearTransactionUndo(void)
+{
+	m_TxUndoObjects.clear();
+	m_TxGeneration++;
+}
+
+String DbConnection::GetSpillPath(void) const
+{
+	return Application::GetLocalStateDir() + "/lib/icinga2/ido-" + GetName() + ".spill";
+}
+
+static Value SerializeField(const Value& value)
+{
+	if (value.IsObjectType<DynamicObject>()) {
+		DynamicObject::Ptr object = value;
+
+		Dictionary::Ptr result = boost::make_shared<Dictionary>();
+		result->Set("object_type", object->GetType()->GetName());
+		result->Set("object_name", object->GetName());
+		return result;
+	} else if (value.IsObjectType<DbValue>()) {
+		DbValue::Ptr dbv = value;
+
+		Dictionary::Ptr result = boost::make_shared<Dictionary>();
+		result->Set("db_type", dbv->GetType());
+		result->Set("db_value", SerializeField(dbv->GetValue()));
+
+		/* Queries which share a row ID placeholder have to share it
+		 * again after they've been replayed. */
+		if (dbv->GetType() == DbValueRowInsertID) {
+			std::ostringstream msgbuf;
+			msgbuf << static_cast<void *>(dbv.get());
+			result->Set("db_ref", String(msgbuf.str()));
+		}
+
+		return result;
+	}
+
+	return value;
+}
+
+typedef std::map<String, DbValue::Ptr> DbValueRefMap;
+
+static bool DeserializeField(const Value& value, Value *result, DbValueRefMap *refs)
+{
+	if (!value.IsObjectType<Dictionary>()) {
+		*result = value;
+		return true;
+	}
+
+	Dictionary::Ptr dict = value;
+
+	if (dict->Contains("object_type")) {
+		DynamicType::Ptr dt = DynamicType::GetByName(dict->Get("object_type"));
+
+		if (!dt)
+			return false;
+
+		DynamicObject::Ptr object = dt->GetObject(dict->Get("object_name"));
+
+		if (!object)
+			return false;
+
+		*result = object;
+		return true;
+	} else if (dict->Contains("db_type")) {
+		Value dbvalue;
+
+		if (!DeserializeField(dict->Get("db_value"), &dbvalue, refs))
+			return false;
+
+		switch (static_cast<int>(dict->Get("db_type"))) {
+			case DbValueTimestamp:
+				*result = DbValue::FromTimestamp(dbvalue);
+				break;
+			case DbValueTimestampNow:
+				*result = DbValue::FromTimestampNow();
+				break;
+			case DbValueObjectInsertID:
+				*result = DbValue::FromObjectInsertID(dbvalue);
+				break;
+			case DbValueRowInsertID:
+				if (!dbvalue.IsEmpty()) {
+					/* The row had already been inserted. */
+					DbValue::Ptr ref = static_cast<DbValue::Ptr>(DbValue::FromRowInsertID());
+					ref->SetValue(dbvalue);
+					*result = ref;
+				} else {
+					DbValue::Ptr& ref = (*refs)[dict->Get("db_ref")];
+
+					if (!ref)
+						ref = static_cast<DbValue::Ptr>(DbValue::FromRowInsertID());
+
+					*result = ref;
+				}
+				break;
+			default:
+				return false;
+		}
+
+		return true;
+	}
+
+	*result = value;
+	return true;
+}
+
+static Dictionary::Ptr SerializeFields(const Dictionary::Ptr& fields)
+{
+	if (!fields)
+		return Dictionary::Ptr();
+
+	Dictionary::Ptr result = boost::make_shared<Dictionary>();
+
+	ObjectLock olock(fields);
+
+	String key;
+	Value value;
+	BOOST_FOREACH(boost::tie(key, value), fields) {
+		result->Set(key, SerializeField(value));
+	}
+
+	return result;
+}
+
+static bool DeserializeFields(const Dictionary::Ptr& fields, Dictionary::Ptr *result, DbValueRefMap *refs)
+{
+	if (!fields)
+		return true;
+
+	*result = boost::make_shared<Dictionary>();
+
+	ObjectLock olock(fields);
+
+	String key;
+	Value value;
+	BOOST_FOREACH(boost::tie(key, value), fields) {
+		Value field;
+
+		if (!DeserializeField(value, &field, refs))
+			return false;
+
+		(*result)->Set(key, field);
+	}
+
+	return true;
+}
+
+static Dictionary::Ptr SerializeQuery(const DbQuery& query)
+{
+	Dictionary::Ptr squery = boost::make_shared<Dictionary>();
+	squery->Set("type", query.Type);
+	squery->Set("table", query.Table);
+
+	if (query.Schema) {
+		Dictionary::Ptr whereCriteria = boost::make_shared<Dictionary>();
+		whereCriteria->Set(query.Schema->GetColumnName(0), query.Row[0]);
+
+		squery->Set("fields", SerializeFields(query.Schema->ToDictionary(query.Row)));
+		squery->Set("where_criteria", SerializeFields(whereCriteria));
+	} else {
+		squery->Set("fields", SerializeFields(query.Fields));
+		squery->Set("where_criteria", SerializeFields(query.WhereCriteria));
+	}
+
+	if (query.Object)
+		squery->Set("object", SerializeField(query.Object->GetObject()));
+
+	squery->Set("config_update", query.ConfigUpdate);
+	squery->Set("status_update", query.StatusUpdate);
+
+	if (query.InsertID)
+		squery->Set("insert_id", SerializeField(query.InsertID));
+
+	return squery;
+}
+
+/**
+ * Calculates a checksum for an object's config queries. Objects are
+ * identified by their names, so the checksum is independent of the
+ * database's object IDs.
+ *
+ * @param queries The queries.
+ * @returns The checksum.
+ */
+String DbConnection::CalculateConfigHash(const std::vector<DbQuery>& queries)
+{
+	Array::Ptr squeries = boost::make_shared<Array>();
+
+	BOOST_FOREACH(const DbQuery& query, queries) {
+		squeries->Add(SerializeQuery(query));
+	}
+
+	return SHA256(Value(squeries).Serialize());
+}
+
+/**
+ * Appends a work item to the spill file. Callbacks can't be serialized, so
+ * they're kept in memory and only their position is recorded in the file.
+ *
+ * Note: Caller must hold m_SpillMutex.
+ */
+bool DbConnection::SpillItem(const WorkItem& item)
+{
+	if (!m_SpillStream) {
+		String path = GetSpillPath();
+
+		m_SpillFile.clear();
+		m_SpillFile.open(path.CStr(), std::ios_base::out | std::ios_base::app);
+
+		if (!m_SpillFile) {
+			Log(LogWarning, "ido", "Could not open spill file '" + path + "'.");
+			m_SpillFile.close();
+			return false;
+		}
+
+		m_SpillStream = boost::make_shared<StdioStream>(&m_SpillFile, false);
+	}
+
+	Dictionary::Ptr record;
+
+	if (item.IsQuery) {
+		record = SerializeQuery(item.Query);
+	} else {
+		record = boost::make_shared<Dictionary>();
+		record->Set("callback", true);
+
+		m_SpilledCallbacks.push_back(item.Callback);
+	}
+
+	NetString::WriteStringToStream(m_SpillStream, Value(record).Serialize());
+
+	return true;
+}
+
+/**
+ * Appends a spill file from a previous run to the old spill file.
+ *
+ * @returns Whether the spill file existed.
+ */
+bool DbConnection::MoveToOldSpillFile(const String& path) const
+{
+	String oldPath = GetSpillPath() + ".old";
+
+	std::ifstream in(path.CStr(), std::ios_base::in | std::ios_base::binary);
+
+	if (!in)
+		return false;
+
+	{
+		std::ofstream out(oldPath.CStr(), std::ios_base::out | std::ios_base::app | std::ios_base::binary);
+
+		if (in.peek() != EOF)
+			out << in.rdbuf();
+
+		if (!out) {
+			Log(LogWarning, "ido", "Could not write spill file '" + oldPath + "'.");
+			return true;
+		}
+	}
+
+	in.close();
+
+	(void) std::remove(path.CStr());
+
+	return true;
+}
+
+/**
+ * Replays the history rows which were spilled by a previous run. Config
+ * and status rows are skipped because they have been re-synced already.
+ * Reconnect() calls this once the objects have been synced.
+ *
+ * Note: Must only be called on the writer thread.
+ */
+void DbConnection::ReplayOldSpillFile(void)
+{
+	ASSERT(boost::this_thread::get_id() == m_WriterThread.get_id());
+
+	ReplaySpillFile(GetSpillPath() + ".old", NULL);
+}
+
+void DbConnection::ReplaySpilledQueries(void)
+{
+	String path = GetSpillPath();
+	String replayPath = path + ".replay";
+	std::deque<WorkFunction> callbacks;
+
+	{
+		boost::mutex::scoped_lock slock(m_SpillMutex);
+		boost::mutex::scoped_lock lock(m_QueueMutex);
+
+		callbacks.swap(m_SpilledCallbacks);
+
+		if (m_SpillStream) {
+			m_SpillStream->Close();
+			m_SpillStream.reset();
+		}
+
+		m_SpillFile.close();
+		m_SpillLength = 0;
+
+#ifdef _WIN32
+		_unlink(replayPath.CStr());
+#endif /* _WIN32 */
+
+		if (rename(path.CStr(), replayPath.CStr()) < 0) {
+			Log(LogCritical, "ido", "Could not rename spill file '" + path + "'.");
+
+			/* The spill file is appended to and replayed later on. */
+			m_SpilledCallbacks.swap(callbacks);
+			return;
+		}
+	}
+
+	ReplaySpillFile(replayPath, &callbacks);
+}
+
+/**
+ * Executes the work items from a spill file and removes the file.
+ *
+ * @param path The path of the spill file.
+ * @param callbacks The spilled callbacks, in order. NULL if the file was
+ *		    written by a previous run: Its callbacks are lost and
+ *		    only its history rows are replayed.
+ */
+void DbConnection::ReplaySpillFile(const String& path, std::deque<WorkFunction> *callbacks)
+{
+	std::fstream fp;
+	fp.open(path.CStr(), std::ios_base::in);
+
+	if (!fp)
+		return;
+
+	StdioStream::Ptr sfp = boost::make_shared<StdioStream>(&fp, false);
+
+	long replayed = 0, skipped = 0;
+	DbValueRefMap refs;
+
+	String message;
+	while (NetString::ReadStringFromStream(sfp, &message)) {
+		Dictionary::Ptr squery = Value::Deserialize(message);
+
+		WorkItem item;
+
+		if (squery->Get("callback")) {
+			if (!callbacks || callbacks->empty()) {
+				skipped++;
+				continue;
+			}
+
+			item.Callback = callbacks->front();
+			callbacks->pop_front();
+
+			ProcessWorkItem(item);
+			replayed++;
+			continue;
+		}
+
+		item.IsQuery = true;
+		item.Query.Type = squery->Get("type");
+		item.Query.Table = squery->Get("table");
+		item.Query.ConfigUpdate = squery->Get("config_update");
+		item.Query.StatusUpdate = squery->Get("status_update");
+
+		if (!callbacks && (item.Query.ConfigUpdate || item.Query.StatusUpdate)) {
+			skipped++;
+			continue;
+		}
+
+		Value object;
+
+		/* Skip queries for objects which no longer exist. */
+		if (!DeserializeFields(squery->Get("fields"), &item.Query.Fields, &refs) ||
+		    !DeserializeFields(squery->Get("where_criteria"), &item.Query.WhereCriteria, &refs) ||
+		    !DeserializeField(squery->Get("object"), &object, &refs)) {
+			skipped++;
+			continue;
+		}
+
+		if (squery->Contains("insert_id")) {
+			Dictionary::Ptr sinsertId = squery->Get("insert_id");
+
+			/* The placeholder's address may be reused by a later
+			 * notification, so its queries get a new one. */
+			DbValue::Ptr insertId = static_cast<DbValue::Ptr>(DbValue::FromRowInsertID());
+			refs[sinsertId->Get("db_ref")] = insertId;
+
+			item.Query.InsertID = insertId;
+		}
+
+		if (!object.IsEmpty()) {
+			item.Query.Object = DbObject::GetOrCreateByObject(object);
+
+			if (!item.Query.Object) {
+				skipped++;
+				continue;
+			}
+		}
+
+		ProcessWorkItem(item);
+		replayed++;
+	}
+
+	sfp->Close();
+	fp.close();
+
+	(void) std::remove(path.CStr());
+
+	std::ostringstream msgbuf;
+	msgbuf << "Replayed " << replayed << " spilled queries (" << skipped << " skipped) for DB connection '" << GetName() << "'.";
+	Log(LogInformation, "ido", msgbuf.str());
+}
+
+/**
+ * Queues the pending status update for each object which has changed
+ * since the last flush.
+ */
+void DbConnection::FlushStatusUpdates(void)
+{
+	std::map<DbObject::Ptr, DbQuery> updates;
+
+	{
+		boost::mutex::scoped_lock lock(m_StatusMutex);
+		updates.swap(m_PendingStatusUpdates);
+	}
+
+	DbQuery query;
+	BOOST_FOREACH(boost::tie(boost::tuples::ignore, query), updates) {
+		WorkItem item;
+		item.Query = query;
+		item.IsQuery = true;
+
+		EnqueueItem(item);
+	}
+}
+
+/**
+ * History tables and the column which holds the time of their rows.
+ */
+static const struct {
+	const char *Table;
+	const char *TimeColumn;
+} l_HistoryTables[] = {
+	{ "statehistory", "state_time" },
+	{ "notifications", "start_time" },
+	{ "contactnotifications", "start_time" },
+	{ "flappinghistory", "event_time" },
+	{ "downtimehistory", "entry_time" }
+};
+
+void DbConnection::CleanUpTimerHandler(void)
+{
+	double now = Utility::GetTime();
+
+	for (size_t i = 0; i < sizeof(l_HistoryTables) / sizeof(l_HistoryTables[0]); i++) {
+		double age = GetCleanUpAge(l_HistoryTables[i].Table);
+
+		if (age <= 0)
+			continue;
+
+		Enqueue(boost::bind(&DbConnection::CleanUpTable, this,
+		    l_HistoryTables[i].Table, l_HistoryTables[i].TimeColumn, now - age));
+	}
+}
+
+/**
+ * Deletes one chunk of expired rows from a history table. When there may
+ * be more rows the next chunk is queued behind the work which arrived in
+ * the meantime, so that housekeeping never holds up the other updates.
+ */
+void DbConnection::CleanUpTable(const String& table, const String& timeColumn, double maxTime)
+{
+	const long limit = 1000;
+
+	long deleted = CleanUpExecuteQuery(table, timeColumn, maxTime, limit);
+
+	if (deleted > 0) {
+		std::ostringstream msgbuf;
+		msgbuf << "Deleted " << deleted << " expired rows from table '" << table << "'.";
+		Log(LogDebug, "ido", msgbuf.str());
+	}
+
+	/* Release the locks on the deleted rows. */
+	RequestCommit();
+
+	if (deleted >= limit)
+		Enqueue(boost::bind(&DbConnection::CleanUpTable, this, table, timeColumn, maxTime));
+}
+
+/**
+ * Deletes at most 'limit' rows older than 'maxTime' from a history table.
+ * The default implementation does nothing.
+ *
+ * @returns The number of deleted rows.
+ */
+long DbConnection::CleanUpExecuteQuery(const String&, const String&, double, long)
+{
+	return 0;
+}
+
+void DbConnection::QueueStatsTimerHandler(void)
+{
+	size_t pending, spilled;
+	long processed, dropped, spills;
+	double latency, maxLatency;
+	long commits, committed, maxSize, replays;
+	double commitTime, maxCommitTime;
+
+	{
+		boost::mutex::scoped_lock lock(m_QueueMutex);
+
+		pending = m_WorkItems.size();
+		spilled = m_SpillLength;
+		processed = m_ProcessedCount;
+		dropped = m_DroppedCount;
+		spills = m_SpilledCount;
+		latency = m_LastLatency;
+		maxLatency = m_MaxLatency;
+		commits = m_CommitCount;
+		committed = m_CommittedItems;
+		maxSize = m_MaxTransactionSize;
+		replays = m_ReplayCount;
+		commitTime = m_CommitTime;
+		maxCommitTime = m_MaxCommitTime;
+
+		m_ProcessedCount = 0;
+		m_DroppedCount = 0;
+		m_SpilledCount = 0;
+		m_MaxLatency = 0;
+		m_CommitCount = 0;
+		m_CommittedItems = 0;
+		m_MaxTransactionSize = 0;
+		m_ReplayCount = 0;
+		m_CommitTime = 0;
+		m_MaxCommitTime = 0;
+	}
+
+	if (pending == 0 && spilled == 0 && processed == 0 && dropped == 0 && commits == 0)
+		return;
+
+	std::ostringstream msgbuf;
+	msgbuf << "Query queue for '" << GetName() << "': Pending items: " << pending
+	    << "; Spilled items: " << spilled
+	    << "; Processed: " << processed
+	    << "; Dropped: " << dropped
+	    << "; Newly spilled: " << spills
+	    << "; Latency: " << (long)(latency * 1000) << "ms"
+	    << "; Max latency: " << (long)(maxLatency * 1000) << "ms";
+	Log(LogInformation, "ido", msgbuf.str());
+
+	if (commits == 0 && replays == 0)
+		return;
+
+	std::ostringstream txbuf;
+	txbuf << "Transactions for '" << GetName() << "': Commits: " << commits
+	    << "; Avg size: " << (commits > 0 ? committed / commits : 0)
+	    << "; Max size: " << maxSize
+	    << "; Avg commit latency: " << (long)(commits > 0 ? commitTime * 1000 / commits : 0) << "ms"
+	    << "; Max commit latency: " << (long)(maxCommitTime * 1000) << "ms"
+	    << "; Replayed: " << replays;
+	Log(LogInformation, "ido", txbuf.str());
+}
+
+void DbConnection::UpdateAllObjects(void)
+{
+	DynamicType::Ptr type;
+	BOOST_FOREACH(const DynamicType::Ptr& dt, DynamicType::GetTypes()) {
+		BOOST_FOREACH(const DynamicObject::Ptr& object, dt->GetSnapshot()) {
+			DbObject::Ptr dbobj = DbObject::GetOrCreateByObject(object);
+
+			if (dbobj) {
+				ActivateObject(dbobj);
+				dbobj->SendConfigUpdate();
+				dbobj->SendStatusUpdate();
+			}
+		}
+	}
+}
+
+/**
+ * Connects to the database (unless the current connection still works)
+ * and brings it up to date with all objects. This is called by the
+ * backends' reconnect timer and runs on the writer thread.
+ */
+void DbConnection::Reconnect(void)
+{
+	std::map<DbObject::Ptr, String> configHashes;
+
+	{
+		boost::mutex::scoped_lock lock(m_ConnectionMutex);
+
+		if (!Connect())
+			return;
+
+		m_InstanceID = LoadInstanceID();
+		m_HasConfigHash = HasConfigHashColumn();
+
+		/* Without config hashes we can't tell which rows are up to date. */
+		if (!m_HasConfigHash) {
+			Log(LogInformation, "ido", "Table '" + GetTablePrefix() + "objects' has no 'config_hash' column, rewriting all config tables.");
+			ClearConfigTables();
+		}
+
+		std::ostringstream q1buf;
+		q1buf << "UPDATE " + GetTablePrefix() + "objects SET is_active = 0 WHERE instance_id = " << static_cast<long>(m_InstanceID);
+		Query(q1buf.str());
+
+		std::ostringstream q2buf;
+		q2buf << "SELECT object_id, objecttype_id, name1, name2" << (m_HasConfigHash ? ", config_hash" : "")
+		      << " FROM " + GetTablePrefix() + "objects WHERE instance_id = " << static_cast<long>(m_InstanceID);
+		Array::Ptr rows = Query(q2buf.str());
+
+		std::map<long, DbObject::Ptr> objectsByID;
+
+		ObjectLock olock(rows);
+		BOOST_FOREACH(const Dictionary::Ptr& row, rows) {
+			DbType::Ptr dbtype = DbType::GetByID(row->Get("objecttype_id"));
+
+			if (!dbtype)
+				continue;
+
+			DbObject::Ptr dbobj = dbtype->GetOrCreateObjectByName(row->Get("name1"), row->Get("name2"));
+			SetObjectID(dbobj, DbReference(row->Get("object_id")));
+
+			if (m_HasConfigHash) {
+				objectsByID[row->Get("object_id")] = dbobj;
+				configHashes[dbobj] = row->Get("config_hash");
+			}
+		}
+
+		/* Rows we don't rewrite are referenced by their insert IDs. */
+		if (m_HasConfigHash)
+			LoadInsertIDs(objectsByID);
+
+		Query("BEGIN");
+	}
+
+	try {
+		SyncAllObjects(configHashes);
+
+		/* Replaying this work item after a rollback wouldn't sync the
+		 * objects again, so the synced rows are committed right away. */
+		NewTransaction();
+	} catch (const DbDeadlockError&) {
+		boost::mutex::scoped_lock lock(m_ConnectionMutex);
+
+		/* Start over with a new connection when the work item is
+		 * replayed. */
+		if (m_Connected)
+			Disconnect();
+
+		throw;
+	} catch (const DbRollbackError&) {
+		boost::mutex::scoped_lock lock(m_ConnectionMutex);
+
+		if (m_Connected)
+			Disconnect();
+
+		throw;
+	}
+
+	TransactionCommitted();
+
+	/* History rows from a previous run go after the synced objects. */
+	ReplayOldSpillFile();
+}
+
+/**
+ * Loads the IDs of the existing config rows for all object types.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ */
+void DbConnection::LoadInsertIDs(const std::map<long, DbObject::Ptr>& objectsByID)
+{
+	BOOST_FOREACH(const DbType::Ptr& type, DbType::GetAllTypes()) {
+		std::ostringstream qbuf;
+		qbuf << "SELECT " << type->GetTable() << "_id AS id, " << type->GetIDColumn() << " AS object_id"
+		     << " FROM " << GetTablePrefix() << type->GetTable() << "s WHERE instance_id = " << static_cast<long>(m_InstanceID);
+		Array::Ptr rows = Query(qbuf.str());
+
+		ObjectLock olock(rows);
+		BOOST_FOREACH(const Dictionary::Ptr& row, rows) {
+			std::map<long, DbObject::Ptr>::const_iterator it = objectsByID.find(row->Get("object_id"));
+
+			if (it == objectsByID.end())
+				continue;
+
+			SetInsertID(it->second, DbReference(row->Get("id")));
+			SetConfigUpdate(it->second, true);
+		}
+	}
+}
+
+/**
+ * Brings the database up to date with all objects after (re-)connecting:
+ * Objects are re-activated in bulk, config rows are only rewritten for
+ * objects whose config has changed and status rows are upserted.
+ *
+ * This runs on the writer thread. m_ConnectionMutex is only held for
+ * individual statements.
+ */
+void DbConnection::SyncAllObjects(const std::map<DbObject::Ptr, String>& configHashes)
+{
+	double start = Utility::GetTime();
+
+	std::vector<DbObject::Ptr> dbobjs;
+
+	BOOST_FOREACH(const DynamicType::Ptr& dt, DynamicType::GetTypes()) {
+		BOOST_FOREACH(const DynamicObject::Ptr& object, dt->GetSnapshot()) {
+			DbObject::Ptr dbobj = DbObject::GetOrCreateByObject(object);
+
+			if (dbobj)
+				dbobjs.push_back(dbobj);
+		}
+	}
+
+	std::vector<long> objectIDs;
+
+	BOOST_FOREACH(const DbObject::Ptr& dbobj, dbobjs) {
+		DbReference dbref = GetObjectID(dbobj);
+
+		if (dbref.IsValid())
+			objectIDs.push_back(dbref);
+		else
+			ActivateObject(dbobj);
+	}
+
+	for (std::vector<long>::size_type i = 0; i < objectIDs.size(); i += 1000) {
+		std::ostringstream qbuf;
+		qbuf << "UPDATE " << GetTablePrefix() << "objects SET is_active = 1 WHERE object_id IN (";
+
+		for (std::vector<long>::size_type k = i; k < objectIDs.size() && k < i + 1000; k++) {
+			if (k != i)
+				qbuf << ", ";
+
+			qbuf << objectIDs[k];
+		}
+
+		qbuf << ")";
+
+		boost::mutex::scoped_lock lock(m_ConnectionMutex);
+
+		if (!m_Connected)
+			return;
+
+		Query(qbuf.str());
+	}
+
+	long rewritten = 0;
+
+	BOOST_FOREACH(const DbObject::Ptr& dbobj, dbobjs) {
+		std::vector<DbQuery> queries;
+		CaptureQueries(boost::bind(&DbObject::SendConfigUpdate, dbobj), &queries);
+
+		String hash;
+
+		if (m_HasConfigHash) {
+			hash = CalculateConfigHash(queries);
+
+			std::map<DbObject::Ptr, String>::const_iterator it = configHashes.find(dbobj);
+
+			if (it != configHashes.end() && it->second == hash && (queries.empty() || GetInsertID(dbobj).IsValid()))
+				continue;
+		}
+
+		BOOST_FOREACH(const DbQuery& query, queries) {
+			ExecuteQuery(query);
+		}
+
+		rewritten++;
+
+		if (!m_HasConfigHash)
+			continue;
+
+		boost::mutex::scoped_lock lock(m_ConnectionMutex);
+
+		if (!m_Connected)
+			return;
+
+		UpdateConfigHash(GetObjectID(dbobj), hash);
+	}
+
+	BOOST_FOREACH(const DbObject::Ptr& dbobj, dbobjs) {
+		std::vector<DbQuery> queries;
+		CaptureQueries(boost::bind(&DbObject::SendStatusUpdate, dbobj), &queries);
+
+		BOOST_FOREACH(const DbQuery& query, queries) {
+			ExecuteQuery(query);
+		}
+	}
+
+	{
+		boost::mutex::scoped_lock lock(m_ConnectionMutex);
+
+		if (!m_Connected)
+			return;
+
+		FlushQueries();
+	}
+
+	std::ostringstream msgbuf;
+	msgbuf << "Synchronized " << dbobjs.size() << " objects (" << rewritten << " config updates) in "
+	       << Utility::GetTime() - start << " seconds.";
+	Log(LogInformation, "ido", msgbuf.str());
+}
+
+/* caller must hold m_ConnectionMutex */
+void DbConnection::ClearConfigTables(void)
+{
+	/* TODO make hardcoded table names modular */
+	ClearConfigTable("commands");
+	ClearConfigTable("contact_addresses");
+	ClearConfigTable("contact_notificationcommands");
+	ClearConfigTable("contactgroup_members");
+	ClearConfigTable("contactgroups");
+	ClearConfigTable("contacts");
+	ClearConfigTable("customvariables");
+	ClearConfigTable("host_contactgroups");
+	ClearConfigTable("host_contacts");
+	ClearConfigTable("host_parenthosts");
+	ClearConfigTable("hostdependencies");
+	ClearConfigTable("hostgroup_members");
+	ClearConfigTable("hostgroups");
+	ClearConfigTable("hosts");
+	ClearConfigTable("service_contactgroups");
+	ClearConfigTable("service_contacts");
+	ClearConfigTable("servicedependencies");
+	ClearConfigTable("servicegroup_members");
+	ClearConfigTable("servicegroups");
+	ClearConfigTable("services");
+	ClearConfigTable("timeperiod_timeranges");
+	ClearConfigTable("timeperiods");
+}
+
+/* caller must hold m_ConnectionMutex */
+void DbConnection::ClearConfigTable(const String& table)
+{
+	Query("DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " + Convert::ToString(static_cast<long>(m_InstanceID)));
+}
+
+/**
+ * Resolves object columns to the ID of the object, activating the object
+ * first if it isn't in the database yet.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ */
+bool DbConnection::FieldToReference(const Value& value, Value *result)
+{
+	DbObject::Ptr dbobjcol = DbObject::GetOrCreateByObject(DbValue::ExtractValue(value));
+
+	if (!dbobjcol) {
+		*result = 0;
+		return true;
+	}
+
+	DbReference dbrefcol;
+
+	if (DbValue::IsObjectInsertID(value)) {
+		dbrefcol = GetInsertID(dbobjcol);
+
+		ASSERT(dbrefcol.IsValid());
+	} else {
+		dbrefcol = GetObjectID(dbobjcol);
+
+		if (!dbrefcol.IsValid()) {
+			InternalActivateObject(dbobjcol);
+
+			dbrefcol = GetObjectID(dbobjcol);
+
+			if (!dbrefcol.IsValid())
+				return false;
+		}
+	}
+
+	*result = static_cast<long>(dbrefcol);
+
+	return true;
+}
+
+void DbConnection::InternalSerialize(const Dictionary::Ptr& bag, int attributeTypes) const
+{
+	DynamicObject::InternalSerialize(bag, attributeTypes);
+
+	if (attributeTypes & Attribute_Config) {
+		bag->Set("table_prefix", m_TablePrefix);
+		bag->Set("queue_overflow", m_QueueOverflow);
+		bag->Set("queue_size", m_QueueSize);
+		bag->Set("status_flush_interval", m_StatusFlushInterval);
+		bag->Set("transaction_size", m_TransactionSize);
+		bag->Set("transaction_interval", m_TransactionInterval);
+		bag->Set("cleanup", m_CleanUp);
+	}
+}
+
+void DbConnection::InternalDeserialize(const Dictionary::Ptr& bag, int attributeTypes)
+{
+	DynamicObject::InternalDeserialize(bag, attributeTypes);
+
+	if (attributeTypes & Attribute_Config) {
+		m_TablePrefix = bag->Get("table_prefix");
+		m_QueueOverflow = bag->Get("queue_overflow");
+		m_QueueSize = bag->Get("queue_size");
+		m_StatusFlushInterval = bag->Get("status_flush_interval");
+		m_TransactionSize = bag->Get("transaction_size");
+		m_TransactionInterval = bag->Get("transaction_interval");
+		m_CleanUp = bag->Get("cleanup");
+	}
 }
\ No newline at end of file
@@ -20,14 +20,64 @@
 #ifndef DBCONNECTION_H
 #define DBCONNECTION_H
 
+#include "base/array.h"
 #include "base/dynamicobject.h"
 #include "base/timer.h"
+#include "base/stdiostream.h"
 #include "ido/dbobject.h"
+#include "ido/dbobjectstatemap.h"
 #include "ido/dbquery.h"
+#include <deque>
+#include <fstream>
+#include <stdexcept>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 
 namespace icinga
 {
 
+/**
+ * What to do with new queries when the write queue is full.
+ *
+ * @ingroup ido
+ */
+enum DbQueueOverflow
+{
+	DbQueueBlock,
+	DbQueueDropStatus,
+	DbQueueSpill
+};
+
+/**
+ * Thrown by the database backends when the database rolled back the
+ * current transaction to resolve a deadlock.
+ *
+ * @ingroup ido
+ */
+class DbDeadlockError : public std::runtime_error
+{
+public:
+	explicit DbDeadlockError(const String& message)
+		: std::runtime_error(message)
+	{ }
+};
+
+/**
+ * Thrown by the database backends when the database rolled back the
+ * current transaction because one of its statements failed.
+ *
+ * @ingroup ido
+ */
+class DbRollbackError : public std::runtime_error
+{
+public:
+	explicit DbRollbackError(const String& message)
+		: std::runtime_error(message)
+	{ }
+};
+
 /**
  * A database connection.
  *
@@ -53,9 +103,21 @@ public:
 	bool GetStatusUpdate(const DbObject::Ptr& dbobj) const;
 
 	String GetTablePrefix(void) const;
+	DbQueueOverflow GetQueueOverflow(void) const;
+	size_t GetQueueSize(void) const;
+	double GetStatusFlushInterval(void) const;
+	size_t GetTransactionSize(void) const;
+	double GetTransactionInterval(void) const;
+	double GetCleanUpAge(const String& table) const;
+
+	size_t GetQueueLength(void) const;
+	double GetQueueLatency(void) const;
 
 protected:
+	typedef boost::function<void (void)> WorkFunction;
+
 	virtual void Start(void);
+	virtual void Stop(void);
 
 	virtual void InternalSerialize(const Dictionary::Ptr& bag, int attributeTypes) const;
 	virtual void InternalDeserialize(const Dictionary::Ptr& bag, int attributeTypes);
@@ -66,17 +128,160 @@ protected:
 
 	void UpdateAllObjects(void);
 
+	void Enqueue(const WorkFunction& callback);
+
+	void CaptureQueries(const WorkFunction& callback, std::vector<DbQuery> *queries);
+	static String CalculateConfigHash(const std::vector<DbQuery>& queries);
+
+	virtual long CleanUpExecuteQuery(const String& table, const String& timeColumn, double maxTime, long limit);
+
+	virtual void NewTransaction(void) = 0;
+	void RequestCommit(void);
+	void TransactionCommitted(void);
+
+	virtual void SetSavepoint(void);
+	virtual void ReleaseSavepoint(void);
+	virtual void RollbackSavepoint(void);
+
+	void Reconnect(void);
+
+	virtual bool Connect(void) = 0;
+	virtual void Disconnect(void) = 0;
+	virtual DbReference LoadInstanceID(void) = 0;
+	virtual bool HasConfigHashColumn(void) = 0;
+	virtual Array::Ptr Query(const String& query) = 0;
+	virtual void UpdateConfigHash(const DbReference& objectid, const String& hash) = 0;
+	virtual void FlushQueries(void) = 0;
+	virtual void InternalActivateObject(const DbObject::Ptr& dbobj) = 0;
+
+	bool FieldToReference(const Value& value, Value *result);
+
+	boost::mutex m_ConnectionMutex;
+	bool m_Connected;
+	DbReference m_InstanceID;
+	bool m_HasConfigHash;
+
 private:
 	String m_TablePrefix;
+	String m_QueueOverflow;
+	Value m_QueueSize;
+	Value m_StatusFlushInterval;
+	Value m_TransactionSize;
+	Value m_TransactionInterval;
+	Dictionary::Ptr m_CleanUp;
+
+	struct WorkItem
+	{
+		WorkFunction Callback;
+		DbQuery Query;
+		bool IsQuery;
+		double Timestamp;
+
+		WorkItem(void)
+			: IsQuery(false), Timestamp(0)
+		{ }
+	};
+
+	enum WorkItemResult
+	{
+		WorkItemDone,
+		WorkItemFailed, /**< Only the work item was rolled back. */
+		WorkItemDeadlock,
+		WorkItemRollback
+	};
+
+	mutable boost::mutex m_QueueMutex;
+	boost::condition_variable m_QueueCV;
+	boost::condition_variable m_QueueFullCV;
+	std::deque<WorkItem> m_WorkItems;
+	bool m_QueueStopped;
+	boost::thread m_WriterThread;
+	std::vector<DbQuery> *m_CapturedQueries;
+
+	boost::mutex m_SpillMutex;
+	std::fstream m_SpillFile;
+	StdioStream::Ptr m_SpillStream;
+	std::deque<WorkFunction> m_SpilledCallbacks;
+	long m_SpillLength;
+
+	long m_ProcessedCount;
+	long m_DroppedCount;
+	long m_SpilledCount;
+	double m_LastLatency;
+	double m_MaxLatency;
+	long m_CommitCount;
+	long m_CommittedItems;
+	long m_MaxTransactionSize;
+	long m_ReplayCount;
+	double m_CommitTime;
+	double m_MaxCommitTime;
+	Timer::Ptr m_QueueStatsTimer;
 
-	std::map<DbObject::Ptr, DbReference> m_ObjectIDs;
-	std::map<DbObject::Ptr, DbReference> m_InsertIDs;
-	std::set<DbObject::Ptr> m_ConfigUpdates;
-	std::set<DbObject::Ptr> m_StatusUpdates;
+	std::vector<WorkItem> m_TxItems;
+	unsigned long m_TxGeneration;
+	std::vector<DbObject::Ptr> m_TxUndoObjects;
+	unsigned long m_ItemGeneration;
+	std::vector<DbObject::Ptr> m_ItemUndoObjects;
+	bool m_ItemUndoActive;
+	double m_TxStart;
+	int m_TxAttempts;
+	bool m_TxCommitRequested;
+
+	boost::mutex m_StatusMutex;
+	std::map<DbObject::Ptr, DbQuery> m_PendingStatusUpdates;
+	Timer::Ptr m_StatusFlushTimer;
+
+	Timer::Ptr m_CleanUpTimer;
+
+	DbObjectStateMap m_ObjectStates;
 	static Timer::Ptr m_ProgramStatusTimer;
 
-	static void InsertRuntimeVariable(const String& key, const Value& value);
+	static boost::mutex m_ObjectCountMutex;
+	static long m_HostCount;
+	static long m_ServiceCount;
+
+	static void ObjectStartedHandler(const DynamicObject::Ptr& object);
+	static void ObjectStoppedHandler(const DynamicObject::Ptr& object);
+	static void UpdateObjectCount(const DynamicObject::Ptr& object, int delta);
+
+	static void UpdateRuntimeVariable(const String& key, const Value& value);
 	static void ProgramStatusHandler(void);
+
+	void QueryHandler(const DbQuery& query);
+	void RegisteredHandler(const DbObject::Ptr& dbobj);
+	void UnregisteredHandler(const DbObject::Ptr& dbobj);
+	void EnqueueItem(const WorkItem& item);
+
+	void WriterThreadProc(void);
+	void ProcessWorkItem(const WorkItem& item);
+	WorkItemResult ExecuteWorkItem(const WorkItem& item, bool isolated);
+	bool IsTransactionDue(void) const;
+	void CommitTransaction(void);
+	void ReplayTransaction(bool isolated);
+
+	DbObjectState& SaveObjectState(const DbObject::Ptr& dbobj);
+	void RestoreObjectStates(const std::vector<DbObject::Ptr>& objects,
+	    DbObjectUndo DbObjectState::*undo, unsigned long generation);
+	void ClearTransactionUndo(void);
+
+	String GetSpillPath(void) const;
+	bool SpillItem(const WorkItem& item);
+	void ReplaySpilledQueries(void);
+	void ReplaySpillFile(const String& path, std::deque<WorkFunction> *callbacks);
+	bool MoveToOldSpillFile(const String& path) const;
+	void ReplayOldSpillFile(void);
+
+	void LoadInsertIDs(const std::map<long, DbObject::Ptr>& objectsByID);
+	void SyncAllObjects(const std::map<DbObject::Ptr, String>& configHashes);
+
+	void ClearConfigTables(void);
+	void ClearConfigTable(const String& table);
+
+	void QueueStatsTimerHandler(void);
+	void FlushStatusUpdates(void);
+
+	void CleanUpTimerHandler(void);
+	void CleanUpTable(const String& table, const String& timeColumn, double maxTime);
 };
 
 }
@@ -100,20 +100,36 @@ void DbObject::SendConfigUpdate(void)
 
 void DbObject::SendStatusUpdate(void)
 {
-	Dictionary::Ptr fields = GetStatusFields();
+	DbQuery query;
+	DbSchema::Ptr schema = GetStatusSchema();
 
-	if (!fields)
-		return;
+	if (schema) {
+		query.Row.resize(schema->GetColumnCount());
+
+		if (GetStatusRow(&query.Row))
+			query.Schema = schema;
+	}
+
+	if (query.Schema) {
+		query.Table = schema->GetTable();
+		query.Row[DbStatusColumnObject] = GetObject();
+		query.Row[DbStatusColumnUpdateTime] = Utility::GetTime();
+	} else {
+		Dictionary::Ptr fields = GetStatusFields();
+
+		if (!fields)
+			return;
+
+		query.Table = GetType()->GetTable() + "status";
+		query.Fields = fields;
+		query.Fields->Set(GetType()->GetIDColumn(), GetObject());
+		query.Fields->Set("instance_id", 0); /* DbConnection class fills in real ID */
+		query.Fields->Set("status_update_time", DbValue::FromTimestamp(Utility::GetTime()));
+		query.WhereCriteria = boost::make_shared<Dictionary>();
+		query.WhereCriteria->Set(GetType()->GetIDColumn(), GetObject());
+	}
 
-	DbQuery query;
-	query.Table = GetType()->GetTable() + "status";
 	query.Type = DbQueryInsert | DbQueryUpdate;
-	query.Fields = fields;
-	query.Fields->Set(GetType()->GetIDColumn(), GetObject());
-	query.Fields->Set("instance_id", 0); /* DbConnection class fills in real ID */
-	query.Fields->Set("status_update_time", DbValue::FromTimestamp(Utility::GetTime()));
-	query.WhereCriteria = boost::make_shared<Dictionary>();
-	query.WhereCriteria->Set(GetType()->GetIDColumn(), GetObject());
 	query.Object = GetSelf();
 	query.StatusUpdate = true;
 	OnQuery(query);
@@ -138,6 +154,75 @@ bool DbObject::IsStatusAttribute(const String&) const
 	return false;
 }
 
+/**
+ * Returns the column layout for the object's status rows. Types which
+ * don't have one only provide their status as a dictionary.
+ */
+DbSchema::Ptr DbObject::GetStatusSchema(void) const
+{
+	return DbSchema::Ptr();
+}
+
+/**
+ * Fills in the type-specific columns of a status row. The row is already
+ * sized according to the status schema and values are stored as described
+ * by the columns' types, e.g. timestamps as plain numbers.
+ *
+ * @param row The row.
+ * @returns false if GetStatusFields() should be used instead.
+ */
+bool DbObject::GetStatusRow(std::vector<Value> *) const
+{
+	return false;
+}
+
+/**
+ * Returns the type-specific columns of the object's status row as a
+ * dictionary. Types with a status schema can use this to implement
+ * GetStatusFields().
+ */
+Dictionary::Ptr DbObject::GetStatusRowFields(void) const
+{
+	DbSchema::Ptr schema = GetStatusSchema();
+
+	if (!schema)
+		return Dictionary::Ptr();
+
+	std::vector<Value> row(schema->GetColumnCount());
+
+	if (!GetStatusRow(&row))
+		return Dictionary::Ptr();
+
+	Dictionary::Ptr fields = schema->ToDictionary(row);
+
+	for (int i = 0; i < DbStatusColumnCount; i++)
+		fields->Remove(schema->GetColumnName(i));
+
+	return fields;
+}
+
+/**
+ * Creates a status schema. The columns in DbStatusColumn are added in
+ * front of the type-specific columns.
+ */
+DbSchema::Ptr DbObject::MakeStatusSchema(const String& table, const String& idcolumn, const DbColumn *columns, size_t count)
+{
+	std::vector<DbColumn> all;
+
+	DbColumn object = { idcolumn.CStr(), DbColumnObject };
+	all.push_back(object);
+
+	DbColumn instance = { "instance_id", DbColumnInstance };
+	all.push_back(instance);
+
+	DbColumn updateTime = { "status_update_time", DbColumnTimestamp };
+	all.push_back(updateTime);
+
+	all.insert(all.end(), columns, columns + count);
+
+	return boost::make_shared<DbSchema>(table, all);
+}
+
 void DbObject::OnConfigUpdate(void)
 {
 	/* Default handler does nothing. */
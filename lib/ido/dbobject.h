@@ -23,6 +23,7 @@
 #include "ido/dbreference.h"
 #include "ido/dbquery.h"
 #include "ido/dbtype.h"
+#include "ido/dbschema.h"
 #include "base/dynamicobject.h"
 #include <boost/smart_ptr.hpp>
 
@@ -51,6 +52,19 @@ enum DbObjectType
 	DbObjectTypeCommand = 12,
 };
 
+/**
+ * Columns which are at the beginning of every status row.
+ *
+ * @ingroup ido
+ */
+enum DbStatusColumn
+{
+	DbStatusColumnObject,
+	DbStatusColumnInstance,
+	DbStatusColumnUpdateTime,
+	DbStatusColumnCount
+};
+
 /**
  * A database object.
  *
@@ -73,6 +87,9 @@ public:
 	virtual Dictionary::Ptr GetConfigFields(void) const = 0;
 	virtual Dictionary::Ptr GetStatusFields(void) const = 0;
 
+	virtual DbSchema::Ptr GetStatusSchema(void) const;
+	virtual bool GetStatusRow(std::vector<Value> *row) const;
+
 	static DbObject::Ptr GetOrCreateByObject(const DynamicObject::Ptr& object);
 
 	static boost::signals2::signal<void (const DbObject::Ptr&)> OnRegistered;
@@ -90,6 +107,10 @@ protected:
 
 	virtual bool IsStatusAttribute(const String& attribute) const;
 
+	Dictionary::Ptr GetStatusRowFields(void) const;
+
+	static DbSchema::Ptr MakeStatusSchema(const String& table, const String& idcolumn, const DbColumn *columns, size_t count);
+
 	virtual void OnConfigUpdate(void);
 	virtual void OnStatusUpdate(void);
 
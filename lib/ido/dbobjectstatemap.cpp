@@ -0,0 +1,109 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "ido/dbobjectstatemap.h"
+#include <boost/foreach.hpp>
+
+using namespace icinga;
+
+DbObjectStateMap::DbObjectStateMap(void)
+	: m_Count(0)
+{ }
+
+/**
+ * Returns the index of the slot which holds the specified object or of
+ * the free slot where it would be inserted.
+ */
+size_t DbObjectStateMap::GetSlot(const DbObject *dbobj) const
+{
+	size_t mask = m_Slots.size() - 1;
+
+	/* The low bits are the same for all objects because of the
+	 * allocator's alignment. */
+	size_t hash = reinterpret_cast<size_t>(dbobj) >> 4;
+	hash ^= hash >> 16;
+	hash *= 0x9e3779b1U;
+
+	size_t index = hash & mask;
+
+	for (;;) {
+		const DbObjectState& slot = m_Slots[index];
+
+		if (!slot.Object || slot.Object.get() == dbobj)
+			return index;
+
+		index = (index + 1) & mask;
+	}
+}
+
+/**
+ * Looks up the state for an object.
+ *
+ * @returns The state, or NULL if the object has no state yet.
+ */
+const DbObjectState *DbObjectStateMap::Find(const DbObject::Ptr& dbobj) const
+{
+	if (m_Count == 0)
+		return NULL;
+
+	const DbObjectState& slot = m_Slots[GetSlot(dbobj.get())];
+
+	if (!slot.Object)
+		return NULL;
+
+	return &slot;
+}
+
+/**
+ * Returns the state for an object, adding it if necessary. The reference
+ * is valid until the next object is added.
+ */
+DbObjectState& DbObjectStateMap::Get(const DbObject::Ptr& dbobj)
+{
+	/* Keep the load factor below 0.5 so that probe sequences stay short. */
+	if ((m_Count + 1) * 2 > m_Slots.size())
+		Grow();
+
+	DbObjectState& slot = m_Slots[GetSlot(dbobj.get())];
+
+	if (!slot.Object) {
+		slot.Object = dbobj;
+		m_Count++;
+	}
+
+	return slot;
+}
+
+size_t DbObjectStateMap::GetLength(void) const
+{
+	return m_Count;
+}
+
+void DbObjectStateMap::Grow(void)
+{
+	std::vector<DbObjectState> slots;
+	slots.swap(m_Slots);
+
+	m_Slots.resize(slots.empty() ? 64 : slots.size() * 2);
+
+	BOOST_FOREACH(const DbObjectState& state, slots) {
+		if (state.Object)
+			m_Slots[GetSlot(state.Object.get())] = state;
+	}
+}
@@ -0,0 +1,100 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef DBOBJECTSTATEMAP_H
+#define DBOBJECTSTATEMAP_H
+
+#include "ido/dbobject.h"
+#include "ido/dbreference.h"
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * An object's state from before a transaction or an isolated work item
+ * changed it. It is restored when the database rolls back the changes.
+ *
+ * @ingroup ido
+ */
+struct DbObjectUndo
+{
+	unsigned long Generation; /**< The transaction or work item which saved the state, 0 if none. */
+	DbReference ObjectID;
+	DbReference InsertID;
+	bool ConfigUpdate;
+	bool StatusUpdate;
+
+	DbObjectUndo(void)
+		: Generation(0), ConfigUpdate(false), StatusUpdate(false)
+	{ }
+};
+
+/**
+ * What a database connection knows about a database object.
+ *
+ * @ingroup ido
+ */
+struct DbObjectState
+{
+	DbObject::Ptr Object;
+	DbReference ObjectID;
+	DbReference InsertID;
+	bool ConfigUpdate;
+	bool StatusUpdate;
+
+	DbObjectUndo TxUndo;
+	DbObjectUndo ItemUndo;
+
+	DbObjectState(void)
+		: ConfigUpdate(false), StatusUpdate(false)
+	{ }
+};
+
+/**
+ * An open-addressing hash table which maps database objects to their
+ * per-connection state. Lookups hash the object's address, so they don't
+ * need to compare shared pointers, and entries are stored inline.
+ *
+ * Entries are never removed: database objects live as long as their
+ * DbType.
+ *
+ * @ingroup ido
+ */
+class DbObjectStateMap
+{
+public:
+	DbObjectStateMap(void);
+
+	const DbObjectState *Find(const DbObject::Ptr& dbobj) const;
+	DbObjectState& Get(const DbObject::Ptr& dbobj);
+
+	size_t GetLength(void) const;
+
+private:
+	std::vector<DbObjectState> m_Slots;
+	size_t m_Count;
+
+	size_t GetSlot(const DbObject *dbobj) const;
+	void Grow(void);
+};
+
+}
+
+#endif /* DBOBJECTSTATEMAP_H */
@@ -21,6 +21,9 @@
 #define DBQUERY_H
 
 #include "base/dictionary.h"
+#include "ido/dbschema.h"
+#include "ido/dbvalue.h"
+#include <vector>
 
 namespace icinga
 {
@@ -40,9 +43,12 @@ struct DbQuery
 	String Table;
 	Dictionary::Ptr Fields;
 	Dictionary::Ptr WhereCriteria;
+	DbSchema::Ptr Schema; /* Fields are in Row instead of Fields */
+	std::vector<Value> Row;
 	boost::shared_ptr<DbObject> Object;
 	bool ConfigUpdate;
 	bool StatusUpdate;
+	DbValue::Ptr InsertID; /* set to the ID of the inserted row, see DbValue::FromRowInsertID() */
 
 	DbQuery(void)
 		: Type(0), ConfigUpdate(false), StatusUpdate(false)
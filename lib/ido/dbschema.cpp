@@ -0,0 +1,95 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "ido/dbschema.h"
+#include "ido/dbvalue.h"
+#include "base/debug.h"
+#include <boost/smart_ptr/make_shared.hpp>
+#include <boost/foreach.hpp>
+
+using namespace icinga;
+
+DbSchema::DbSchema(const String& table, const std::vector<DbColumn>& columns)
+	: m_Table(table)
+{
+	m_Names.reserve(columns.size());
+	m_Types.reserve(columns.size());
+
+	BOOST_FOREACH(const DbColumn& column, columns) {
+		m_Names.push_back(column.Name);
+		m_Types.push_back(column.Type);
+	}
+}
+
+String DbSchema::GetTable(void) const
+{
+	return m_Table;
+}
+
+size_t DbSchema::GetColumnCount(void) const
+{
+	return m_Names.size();
+}
+
+const String& DbSchema::GetColumnName(size_t index) const
+{
+	ASSERT(index < m_Names.size());
+
+	return m_Names[index];
+}
+
+DbColumnType DbSchema::GetColumnType(size_t index) const
+{
+	ASSERT(index < m_Types.size());
+
+	return m_Types[index];
+}
+
+/**
+ * Converts a row into a dictionary which maps column names to values, in
+ * the format used by DbQuery::Fields.
+ *
+ * @param row The row.
+ * @returns The dictionary.
+ */
+Dictionary::Ptr DbSchema::ToDictionary(const std::vector<Value>& row) const
+{
+	ASSERT(row.size() == m_Names.size());
+
+	Dictionary::Ptr fields = boost::make_shared<Dictionary>();
+
+	for (std::vector<String>::size_type i = 0; i < m_Names.size(); i++) {
+		switch (m_Types[i]) {
+			case DbColumnTimestamp:
+				if (!row[i].IsEmpty())
+					fields->Set(m_Names[i], DbValue::FromTimestamp(row[i]));
+				else
+					fields->Set(m_Names[i], Empty);
+
+				break;
+			case DbColumnInstance:
+				fields->Set(m_Names[i], 0); /* DbConnection class fills in real ID */
+				break;
+			default:
+				fields->Set(m_Names[i], row[i]);
+		}
+	}
+
+	return fields;
+}
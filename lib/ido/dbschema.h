@@ -0,0 +1,85 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef DBSCHEMA_H
+#define DBSCHEMA_H
+
+#include "base/object.h"
+#include "base/dictionary.h"
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * How a column's values are stored in a row.
+ *
+ * @ingroup ido
+ */
+enum DbColumnType
+{
+	DbColumnString,
+	DbColumnNumber,
+	DbColumnTimestamp, /**< seconds since the epoch */
+	DbColumnObject, /**< a DynamicObject, written as its object ID */
+	DbColumnInstance /**< filled in by the connection */
+};
+
+/**
+ * A column of a database table.
+ *
+ * @ingroup ido
+ */
+struct DbColumn
+{
+	const char *Name;
+	DbColumnType Type;
+};
+
+/**
+ * The columns of a database table in a fixed order. Rows for the table
+ * are flat vectors of values in the same order. The first column
+ * identifies the row. Empty values are written as NULL.
+ *
+ * @ingroup ido
+ */
+class DbSchema : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(DbSchema);
+
+	DbSchema(const String& table, const std::vector<DbColumn>& columns);
+
+	String GetTable(void) const;
+
+	size_t GetColumnCount(void) const;
+	const String& GetColumnName(size_t index) const;
+	DbColumnType GetColumnType(size_t index) const;
+
+	Dictionary::Ptr ToDictionary(const std::vector<Value>& row) const;
+
+private:
+	String m_Table;
+	std::vector<String> m_Names;
+	std::vector<DbColumnType> m_Types;
+};
+
+}
+
+#endif /* DBSCHEMA_H */
@@ -99,6 +99,20 @@ DbObject::Ptr DbType::GetOrCreateObjectByName(const String& name1, const String&
 	return dbobj;
 }
 
+std::vector<DbType::Ptr> DbType::GetAllTypes(void)
+{
+	std::vector<DbType::Ptr> types;
+
+	boost::mutex::scoped_lock lock(m_StaticMutex);
+
+	DbType::Ptr type;
+	BOOST_FOREACH(boost::tie(boost::tuples::ignore, type), GetTypes()) {
+		types.push_back(type);
+	}
+
+	return types;
+}
+
 /**
  * Caller must hold m_StaticMutex.
  */
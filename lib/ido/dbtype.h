@@ -54,6 +54,7 @@ public:
 
 	static DbType::Ptr GetByName(const String& name);
 	static DbType::Ptr GetByID(long tid);
+	static std::vector<DbType::Ptr> GetAllTypes(void);
 
 	boost::shared_ptr<DbObject> GetOrCreateObjectByName(const String& name1, const String& name2);
 
@@ -48,6 +48,16 @@ Value DbValue::FromObjectInsertID(const Value& value)
 	return boost::make_shared<DbValue>(DbValueObjectInsertID, value);
 }
 
+/**
+ * Creates a placeholder for the ID of a row which is inserted by a query
+ * that hasn't been executed yet (see DbQuery::InsertID). Its value is set
+ * once the row has been inserted.
+ */
+Value DbValue::FromRowInsertID(void)
+{
+	return boost::make_shared<DbValue>(DbValueRowInsertID, Empty);
+}
+
 bool DbValue::IsTimestamp(const Value& value)
 {
 	if (!value.IsObjectType<DbValue>())
@@ -75,6 +85,15 @@ bool DbValue::IsObjectInsertID(const Value& value)
 	return dbv->GetType() == DbValueObjectInsertID;
 }
 
+bool DbValue::IsRowInsertID(const Value& value)
+{
+	if (!value.IsObjectType<DbValue>())
+		return false;
+
+	DbValue::Ptr dbv = value;
+	return dbv->GetType() == DbValueRowInsertID;
+}
+
 Value DbValue::ExtractValue(const Value& value)
 {
 	if (!value.IsObjectType<DbValue>())
@@ -93,3 +112,8 @@ Value DbValue::GetValue(void) const
 {
 	return m_Value;
 }
+
+void DbValue::SetValue(const Value& value)
+{
+	m_Value = value;
+}
@@ -32,6 +32,7 @@ enum DbValueType
 	DbValueTimestamp,
 	DbValueTimestampNow,
 	DbValueObjectInsertID,
+	DbValueRowInsertID
 };
 
 /**
@@ -48,14 +49,17 @@ public:
 	static Value FromTimestampNow(void);
 	static Value FromValue(const Value& value);
 	static Value FromObjectInsertID(const Value& value);
+	static Value FromRowInsertID(void);
 
 	static bool IsTimestamp(const Value& value);
 	static bool IsTimestampNow(const Value& value);
 	static bool IsObjectInsertID(const Value& value);
+	static bool IsRowInsertID(const Value& value);
 	static Value ExtractValue(const Value& value);
 
 	DbValueType GetType(void) const;
 	Value GetValue(void) const;
+	void SetValue(const Value& value);
 
 protected:
 	DbValue(DbValueType type, const Value& value);
@@ -35,6 +35,54 @@ using namespace icinga;
 
 REGISTER_DBTYPE(Host, "host", DbObjectTypeHost, "host_object_id", HostDbObject);
 
+static const DbColumn l_HostStatusColumns[] = {
+	{ "output", DbColumnString },
+	{ "long_output", DbColumnString },
+	{ "perfdata", DbColumnString },
+	{ "current_state", DbColumnNumber },
+	{ "has_been_checked", DbColumnNumber },
+	{ "should_be_scheduled", DbColumnNumber },
+	{ "current_check_attempt", DbColumnNumber },
+	{ "max_check_attempts", DbColumnNumber },
+	{ "last_check", DbColumnTimestamp },
+	{ "next_check", DbColumnTimestamp },
+	{ "check_type", DbColumnNumber },
+	{ "last_state_change", DbColumnTimestamp },
+	{ "last_hard_state_change", DbColumnTimestamp },
+	{ "last_time_up", DbColumnTimestamp },
+	{ "last_time_down", DbColumnTimestamp },
+	{ "last_time_unreachable", DbColumnTimestamp },
+	{ "state_type", DbColumnNumber },
+	{ "last_notification", DbColumnTimestamp },
+	{ "next_notification", DbColumnTimestamp },
+	{ "no_more_notifications", DbColumnNumber },
+	{ "notifications_enabled", DbColumnNumber },
+	{ "problem_has_been_acknowledged", DbColumnNumber },
+	{ "acknowledgement_type", DbColumnNumber },
+	{ "current_notification_number", DbColumnNumber },
+	{ "passive_checks_enabled", DbColumnNumber },
+	{ "active_checks_enabled", DbColumnNumber },
+	{ "eventhandler_enabled", DbColumnNumber },
+	{ "flap_detection_enabled", DbColumnNumber },
+	{ "is_flapping", DbColumnNumber },
+	{ "percent_state_change", DbColumnNumber },
+	{ "latency", DbColumnNumber },
+	{ "execution_time", DbColumnNumber },
+	{ "scheduled_downtime_depth", DbColumnNumber },
+	{ "failure_prediction_enabled", DbColumnNumber },
+	{ "process_performance_data", DbColumnNumber },
+	{ "obsess_over_host", DbColumnNumber },
+	{ "modified_host_attributes", DbColumnNumber },
+	{ "event_handler", DbColumnString },
+	{ "check_command", DbColumnString },
+	{ "normal_check_interval", DbColumnNumber },
+	{ "retry_check_interval", DbColumnNumber },
+	{ "check_timeperiod_object_id", DbColumnObject }
+};
+
+DbSchema::Ptr HostDbObject::m_StatusSchema = MakeStatusSchema("hoststatus", "host_object_id",
+    l_HostStatusColumns, sizeof(l_HostStatusColumns) / sizeof(l_HostStatusColumns[0]));
+
 HostDbObject::HostDbObject(const DbType::Ptr& type, const String& name1, const String& name2)
 	: DbObject(type, name1, name2)
 { }
@@ -124,69 +172,107 @@ Dictionary::Ptr HostDbObject::GetConfigFields(void) const
 
 Dictionary::Ptr HostDbObject::GetStatusFields(void) const
 {
-	Dictionary::Ptr fields = boost::make_shared<Dictionary>();
+	Dictionary::Ptr fields = GetStatusRowFields();
+
+	if (fields)
+		return fields;
+
+	/* dump a pending hoststatus */
+	fields = boost::make_shared<Dictionary>();
+	fields->Set("has_been_checked", 0);
+	fields->Set("last_check", DbValue::FromTimestamp(0));
+	fields->Set("next_check", DbValue::FromTimestamp(0));
+	fields->Set("active_checks_enabled", 0);
+
+	return fields;
+}
+
+DbSchema::Ptr HostDbObject::GetStatusSchema(void) const
+{
+	return m_StatusSchema;
+}
+
+bool HostDbObject::GetStatusRow(std::vector<Value> *row) const
+{
 	Host::Ptr host = static_pointer_cast<Host>(GetObject());
 	Service::Ptr service = host->GetHostCheckService();
 
-	Dictionary::Ptr attrs;
+	/* hosts without a check service use GetStatusFields() */
+	if (!service)
+		return false;
 
-	/* fetch service status, or dump a pending hoststatus */
-	if (service) {
+	ObjectLock olock(service);
 
-		ObjectLock olock(service);
-		attrs = CompatUtility::GetServiceStatusAttributes(service, CompatTypeHost);
-
-		fields->Set("output", attrs->Get("plugin_output"));
-		fields->Set("long_output", attrs->Get("long_plugin_output"));
-		fields->Set("perfdata", attrs->Get("performance_data"));
-		fields->Set("current_state", attrs->Get("current_state"));
-		fields->Set("has_been_checked", attrs->Get("has_been_checked"));
-		fields->Set("should_be_scheduled", attrs->Get("should_be_scheduled"));
-		fields->Set("current_check_attempt", attrs->Get("current_attempt"));
-		fields->Set("max_check_attempts", attrs->Get("max_attempts"));
-		fields->Set("last_check", DbValue::FromTimestamp(attrs->Get("last_check")));
-		fields->Set("next_check", DbValue::FromTimestamp(attrs->Get("next_check")));
-		fields->Set("check_type", attrs->Get("check_type"));
-		fields->Set("last_state_change", DbValue::FromTimestamp(attrs->Get("last_state_change")));
-		fields->Set("last_hard_state_change", DbValue::FromTimestamp(attrs->Get("last_hard_state_change")));
-		fields->Set("last_time_up", DbValue::FromTimestamp(attrs->Get("last_time_up")));
-		fields->Set("last_time_down", DbValue::FromTimestamp(attrs->Get("last_time_down")));
-		fields->Set("last_time_unreachable", DbValue::FromTimestamp(attrs->Get("last_time_unreachable")));
-		fields->Set("state_type", attrs->Get("state_type"));
-		fields->Set("last_notification", DbValue::FromTimestamp(attrs->Get("last_notification")));
-		fields->Set("next_notification", DbValue::FromTimestamp(attrs->Get("next_notification")));
-		fields->Set("no_more_notifications", Empty);
-		fields->Set("notifications_enabled", attrs->Get("notifications_enabled"));
-		fields->Set("problem_has_been_acknowledged", attrs->Get("problem_has_been_acknowledged"));
-		fields->Set("acknowledgement_type", attrs->Get("acknowledgement_type"));
-		fields->Set("current_notification_number", attrs->Get("current_notification_number"));
-		fields->Set("passive_checks_enabled", attrs->Get("passive_checks_enabled"));
-		fields->Set("active_checks_enabled", attrs->Get("active_checks_enabled"));
-		fields->Set("eventhandler_enabled", attrs->Get("eventhandler_enabled"));
-		fields->Set("flap_detection_enabled", attrs->Get("flap_detection_enabled"));
-		fields->Set("is_flapping", attrs->Get("is_flapping"));
-		fields->Set("percent_state_change", attrs->Get("percent_state_change"));
-		fields->Set("latency", attrs->Get("check_latency"));
-		fields->Set("execution_time", attrs->Get("check_execution_time"));
-		fields->Set("scheduled_downtime_depth", attrs->Get("scheduled_downtime_depth"));
-		fields->Set("failure_prediction_enabled", Empty);
-		fields->Set("process_performance_data", attrs->Get("process_performance_data"));
-		fields->Set("obsess_over_host", Empty);
-		fields->Set("modified_host_attributes", Empty);
-		fields->Set("event_handler", attrs->Get("event_handler"));
-		fields->Set("check_command", attrs->Get("check_command"));
-		fields->Set("normal_check_interval", attrs->Get("check_interval"));
-		fields->Set("retry_check_interval", attrs->Get("retry_interval"));
-		fields->Set("check_timeperiod_object_id", service->GetCheckPeriod());
-	}
-	else {
-		fields->Set("has_been_checked", 0);
-		fields->Set("last_check", DbValue::FromTimestamp(0));
-		fields->Set("next_check", DbValue::FromTimestamp(0));
-		fields->Set("active_checks_enabled", 0);
+	Dictionary::Ptr cr = service->GetLastCheckResult();
+
+	String output, long_output, perfdata;
+	double schedule_end = -1;
+
+	if (cr) {
+		CompatUtility::GetCheckResultOutput(cr, &output, &long_output, &perfdata);
+		schedule_end = cr->Get("schedule_end");
 	}
 
-	return fields;
+	int state = service->GetState();
+
+	if (!host->IsReachable())
+		state = 2; /* UNREACHABLE */
+	else if (state == StateOK || state == StateWarning)
+		state = 0; /* UP */
+	else
+		state = 1; /* DOWN */
+
+	double last_notification, next_notification;
+	int notification_number;
+	CompatUtility::GetNotificationTimes(service, &last_notification, &next_notification, &notification_number);
+
+	CheckCommand::Ptr checkcommand = service->GetCheckCommand();
+	EventCommand::Ptr eventcommand = service->GetEventCommand();
+
+	(*row)[HostStatusOutput] = output;
+	(*row)[HostStatusLongOutput] = long_output;
+	(*row)[HostStatusPerfdata] = perfdata;
+	(*row)[HostStatusCurrentState] = state;
+	(*row)[HostStatusHasBeenChecked] = (cr ? 1 : 0);
+	(*row)[HostStatusShouldBeScheduled] = 1;
+	(*row)[HostStatusCurrentCheckAttempt] = service->GetCurrentCheckAttempt();
+	(*row)[HostStatusMaxCheckAttempts] = service->GetMaxCheckAttempts();
+	(*row)[HostStatusLastCheck] = schedule_end;
+	(*row)[HostStatusNextCheck] = service->GetNextCheck();
+	(*row)[HostStatusCheckType] = (service->GetEnableActiveChecks() ? 1 : 0);
+	(*row)[HostStatusLastStateChange] = service->GetLastStateChange();
+	(*row)[HostStatusLastHardStateChange] = service->GetLastHardStateChange();
+	(*row)[HostStatusLastTimeUp] = host->GetLastStateUp();
+	(*row)[HostStatusLastTimeDown] = host->GetLastStateDown();
+	(*row)[HostStatusLastTimeUnreachable] = host->GetLastStateUnreachable();
+	(*row)[HostStatusStateType] = service->GetStateType();
+	(*row)[HostStatusLastNotification] = last_notification;
+	(*row)[HostStatusNextNotification] = next_notification;
+	(*row)[HostStatusNoMoreNotifications] = Empty;
+	(*row)[HostStatusNotificationsEnabled] = (service->GetEnableNotifications() ? 1 : 0);
+	(*row)[HostStatusProblemHasBeenAcknowledged] = (service->GetAcknowledgement() != AcknowledgementNone ? 1 : 0);
+	(*row)[HostStatusAcknowledgementType] = static_cast<int>(service->GetAcknowledgement());
+	(*row)[HostStatusCurrentNotificationNumber] = notification_number;
+	(*row)[HostStatusPassiveChecksEnabled] = (service->GetEnablePassiveChecks() ? 1 : 0);
+	(*row)[HostStatusActiveChecksEnabled] = (service->GetEnableActiveChecks() ? 1 : 0);
+	(*row)[HostStatusEventhandlerEnabled] = 1; /* always enabled */
+	(*row)[HostStatusFlapDetectionEnabled] = (service->GetEnableFlapping() ? 1 : 0);
+	(*row)[HostStatusIsFlapping] = (service->IsFlapping() ? 1 : 0);
+	(*row)[HostStatusPercentStateChange] = service->GetFlappingCurrent();
+	(*row)[HostStatusLatency] = Service::CalculateLatency(cr);
+	(*row)[HostStatusExecutionTime] = Service::CalculateExecutionTime(cr);
+	(*row)[HostStatusScheduledDowntimeDepth] = (service->IsInDowntime() ? 1 : 0);
+	(*row)[HostStatusFailurePredictionEnabled] = Empty;
+	(*row)[HostStatusProcessPerformanceData] = 1; /* always enabled */
+	(*row)[HostStatusObsessOverHost] = Empty;
+	(*row)[HostStatusModifiedHostAttributes] = Empty;
+	(*row)[HostStatusEventHandler] = (eventcommand ? Value("event_" + eventcommand->GetName()) : Empty);
+	(*row)[HostStatusCheckCommand] = (checkcommand ? Value("check_" + checkcommand->GetName()) : Empty);
+	(*row)[HostStatusNormalCheckInterval] = service->GetCheckInterval() / 60.0;
+	(*row)[HostStatusRetryCheckInterval] = service->GetRetryInterval() / 60.0;
+	(*row)[HostStatusCheckTimeperiodObjectId] = service->GetCheckPeriod();
+
+	return true;
 }
 
 void HostDbObject::OnConfigUpdate(void)
@@ -26,6 +26,58 @@
 namespace icinga
 {
 
+/**
+ * Columns of the hoststatus table.
+ *
+ * @ingroup ido
+ */
+enum HostStatusColumn
+{
+	HostStatusOutput = DbStatusColumnCount,
+	HostStatusLongOutput,
+	HostStatusPerfdata,
+	HostStatusCurrentState,
+	HostStatusHasBeenChecked,
+	HostStatusShouldBeScheduled,
+	HostStatusCurrentCheckAttempt,
+	HostStatusMaxCheckAttempts,
+	HostStatusLastCheck,
+	HostStatusNextCheck,
+	HostStatusCheckType,
+	HostStatusLastStateChange,
+	HostStatusLastHardStateChange,
+	HostStatusLastTimeUp,
+	HostStatusLastTimeDown,
+	HostStatusLastTimeUnreachable,
+	HostStatusStateType,
+	HostStatusLastNotification,
+	HostStatusNextNotification,
+	HostStatusNoMoreNotifications,
+	HostStatusNotificationsEnabled,
+	HostStatusProblemHasBeenAcknowledged,
+	HostStatusAcknowledgementType,
+	HostStatusCurrentNotificationNumber,
+	HostStatusPassiveChecksEnabled,
+	HostStatusActiveChecksEnabled,
+	HostStatusEventhandlerEnabled,
+	HostStatusFlapDetectionEnabled,
+	HostStatusIsFlapping,
+	HostStatusPercentStateChange,
+	HostStatusLatency,
+	HostStatusExecutionTime,
+	HostStatusScheduledDowntimeDepth,
+	HostStatusFailurePredictionEnabled,
+	HostStatusProcessPerformanceData,
+	HostStatusObsessOverHost,
+	HostStatusModifiedHostAttributes,
+	HostStatusEventHandler,
+	HostStatusCheckCommand,
+	HostStatusNormalCheckInterval,
+	HostStatusRetryCheckInterval,
+	HostStatusCheckTimeperiodObjectId,
+	HostStatusColumnCount
+};
+
 /**
  * A Host database object.
  *
@@ -41,7 +93,12 @@ public:
 	virtual Dictionary::Ptr GetConfigFields(void) const;
 	virtual Dictionary::Ptr GetStatusFields(void) const;
 
+	virtual DbSchema::Ptr GetStatusSchema(void) const;
+	virtual bool GetStatusRow(std::vector<Value> *row) const;
+
 private:
+	static DbSchema::Ptr m_StatusSchema;
+
 	virtual void OnConfigUpdate(void);
 	virtual void OnStatusUpdate(void);
 };
@@ -24,6 +24,7 @@
 #include "base/objectlock.h"
 #include "base/initialize.h"
 #include "base/dynamictype.h"
+#include "base/utility.h"
 #include "icinga/notification.h"
 #include "icinga/checkcommand.h"
 #include "icinga/eventcommand.h"
@@ -37,6 +38,52 @@ REGISTER_DBTYPE(Service, "service", DbObjectTypeService, "service_object_id", Se
 
 INITIALIZE_ONCE(ServiceDbObject, &ServiceDbObject::StaticInitialize);
 
+static const DbColumn l_ServiceStatusColumns[] = {
+	{ "output", DbColumnString },
+	{ "long_output", DbColumnString },
+	{ "perfdata", DbColumnString },
+	{ "current_state", DbColumnNumber },
+	{ "has_been_checked", DbColumnNumber },
+	{ "should_be_scheduled", DbColumnNumber },
+	{ "current_check_attempt", DbColumnNumber },
+	{ "max_check_attempts", DbColumnNumber },
+	{ "last_check", DbColumnTimestamp },
+	{ "next_check", DbColumnTimestamp },
+	{ "check_type", DbColumnNumber },
+	{ "last_state_change", DbColumnTimestamp },
+	{ "last_hard_state_change", DbColumnTimestamp },
+	{ "last_time_ok", DbColumnTimestamp },
+	{ "last_time_warning", DbColumnTimestamp },
+	{ "last_time_critical", DbColumnTimestamp },
+	{ "last_time_unknown", DbColumnTimestamp },
+	{ "state_type", DbColumnNumber },
+	{ "last_notification", DbColumnTimestamp },
+	{ "next_notification", DbColumnTimestamp },
+	{ "no_more_notifications", DbColumnNumber },
+	{ "notifications_enabled", DbColumnNumber },
+	{ "problem_has_been_acknowledged", DbColumnNumber },
+	{ "acknowledgement_type", DbColumnNumber },
+	{ "current_notification_number", DbColumnNumber },
+	{ "passive_checks_enabled", DbColumnNumber },
+	{ "active_checks_enabled", DbColumnNumber },
+	{ "event_handler_enabled", DbColumnNumber },
+	{ "flap_detection_enabled", DbColumnNumber },
+	{ "is_flapping", DbColumnNumber },
+	{ "percent_state_change", DbColumnNumber },
+	{ "latency", DbColumnNumber },
+	{ "execution_time", DbColumnNumber },
+	{ "scheduled_downtime_depth", DbColumnNumber },
+	{ "process_performance_data", DbColumnNumber },
+	{ "event_handler", DbColumnString },
+	{ "check_command", DbColumnString },
+	{ "normal_check_interval", DbColumnNumber },
+	{ "retry_check_interval", DbColumnNumber },
+	{ "check_timeperiod_object_id", DbColumnObject }
+};
+
+DbSchema::Ptr ServiceDbObject::m_StatusSchema = MakeStatusSchema("servicestatus", "service_object_id",
+    l_ServiceStatusColumns, sizeof(l_ServiceStatusColumns) / sizeof(l_ServiceStatusColumns[0]));
+
 void ServiceDbObject::StaticInitialize(void)
 {
 	Service::OnCommentAdded.connect(boost::bind(&ServiceDbObject::AddComment, _1, _2));
@@ -44,6 +91,12 @@ void ServiceDbObject::StaticInitialize(void)
 	Service::OnDowntimeAdded.connect(boost::bind(&ServiceDbObject::AddDowntime, _1, _2));
 	Service::OnDowntimeRemoved.connect(boost::bind(&ServiceDbObject::RemoveDowntime, _1, _2));
 	Service::OnDowntimeTriggered.connect(boost::bind(&ServiceDbObject::TriggerDowntime, _1, _2));
+
+	/* history */
+	Service::OnNewCheckResult.connect(boost::bind(&ServiceDbObject::AddCheckResultHistory, _1, _2));
+	Service::OnNotificationSentToAllUsers.connect(boost::bind(&ServiceDbObject::AddNotificationHistory, _1, _2, _3, _4));
+	Service::OnFlappingChanged.connect(boost::bind(&ServiceDbObject::AddFlappingHistory, _1, _2));
+	Service::OnDowntimeAdded.connect(boost::bind(&ServiceDbObject::AddDowntimeHistory, _1, _2));
 }
 
 ServiceDbObject::ServiceDbObject(const DbType::Ptr& type, const String& name1, const String& name2)
@@ -121,57 +174,84 @@ Dictionary::Ptr ServiceDbObject::GetConfigFields(void) const
 
 Dictionary::Ptr ServiceDbObject::GetStatusFields(void) const
 {
-	Dictionary::Ptr fields = boost::make_shared<Dictionary>();
+	return GetStatusRowFields();
+}
+
+DbSchema::Ptr ServiceDbObject::GetStatusSchema(void) const
+{
+	return m_StatusSchema;
+}
+
+bool ServiceDbObject::GetStatusRow(std::vector<Value> *row) const
+{
 	Service::Ptr service = static_pointer_cast<Service>(GetObject());
-	Dictionary::Ptr attrs;
 
-	{
-		ObjectLock olock(service);
-		attrs = CompatUtility::GetServiceStatusAttributes(service, CompatTypeService);
-	}
+	ObjectLock olock(service);
 
-	fields->Set("output", attrs->Get("plugin_output"));
-	fields->Set("long_output", attrs->Get("long_plugin_output"));
-	fields->Set("perfdata", attrs->Get("performance_data"));
-	fields->Set("current_state", attrs->Get("current_state"));
-	fields->Set("has_been_checked", attrs->Get("has_been_checked"));
-	fields->Set("should_be_scheduled", attrs->Get("should_be_scheduled"));
-	fields->Set("current_check_attempt", attrs->Get("current_attempt"));
-	fields->Set("max_check_attempts", attrs->Get("max_attempts"));
-	fields->Set("last_check", DbValue::FromTimestamp(attrs->Get("last_check")));
-	fields->Set("next_check", DbValue::FromTimestamp(attrs->Get("next_check")));
-	fields->Set("check_type", attrs->Get("check_type"));
-	fields->Set("last_state_change", DbValue::FromTimestamp(attrs->Get("last_state_change")));
-	fields->Set("last_hard_state_change", DbValue::FromTimestamp(attrs->Get("last_hard_state_change")));
-	fields->Set("last_time_ok", DbValue::FromTimestamp(attrs->Get("last_time_ok")));
-	fields->Set("last_time_warning", DbValue::FromTimestamp(attrs->Get("last_time_warn")));
-	fields->Set("last_time_critical", DbValue::FromTimestamp(attrs->Get("last_time_critical")));
-	fields->Set("last_time_unknown", DbValue::FromTimestamp(attrs->Get("last_time_unknown")));
-	fields->Set("state_type", attrs->Get("state_type"));
-	fields->Set("last_notification", DbValue::FromTimestamp(attrs->Get("last_notification")));
-	fields->Set("next_notification", DbValue::FromTimestamp(attrs->Get("next_notification")));
-	fields->Set("no_more_notifications", Empty);
-	fields->Set("notifications_enabled", attrs->Get("notifications_enabled"));
-	fields->Set("problem_has_been_acknowledged", attrs->Get("problem_has_been_acknowledged"));
-	fields->Set("acknowledgement_type", attrs->Get("acknowledgement_type"));
-	fields->Set("current_notification_number", attrs->Get("current_notification_number"));
-	fields->Set("passive_checks_enabled", attrs->Get("passive_checks_enabled"));
-	fields->Set("active_checks_enabled", attrs->Get("active_checks_enabled"));
-	fields->Set("event_handler_enabled", attrs->Get("event_handler_enabled"));
-	fields->Set("flap_detection_enabled", attrs->Get("flap_detection_enabled"));
-	fields->Set("is_flapping", attrs->Get("is_flapping"));
-	fields->Set("percent_state_change", attrs->Get("percent_state_change"));
-	fields->Set("latency", attrs->Get("check_latency"));
-	fields->Set("execution_time", attrs->Get("check_execution_time"));
-	fields->Set("scheduled_downtime_depth", attrs->Get("scheduled_downtime_depth"));
-	fields->Set("process_performance_data", attrs->Get("process_performance_data"));
-	fields->Set("event_handler", attrs->Get("event_handler"));
-	fields->Set("check_command", attrs->Get("check_command"));
-	fields->Set("normal_check_interval", attrs->Get("check_interval"));
-	fields->Set("retry_check_interval", attrs->Get("retry_interval"));
-	fields->Set("check_timeperiod_object_id", service->GetCheckPeriod());
+	Dictionary::Ptr cr = service->GetLastCheckResult();
 
-	return fields;
+	String output, long_output, perfdata;
+	double schedule_end = -1;
+
+	if (cr) {
+		CompatUtility::GetCheckResultOutput(cr, &output, &long_output, &perfdata);
+		schedule_end = cr->Get("schedule_end");
+	}
+
+	int state = service->GetState();
+
+	if (state > StateUnknown)
+		state = StateUnknown;
+
+	double last_notification, next_notification;
+	int notification_number;
+	CompatUtility::GetNotificationTimes(service, &last_notification, &next_notification, &notification_number);
+
+	CheckCommand::Ptr checkcommand = service->GetCheckCommand();
+	EventCommand::Ptr eventcommand = service->GetEventCommand();
+
+	(*row)[ServiceStatusOutput] = output;
+	(*row)[ServiceStatusLongOutput] = long_output;
+	(*row)[ServiceStatusPerfdata] = perfdata;
+	(*row)[ServiceStatusCurrentState] = state;
+	(*row)[ServiceStatusHasBeenChecked] = (cr ? 1 : 0);
+	(*row)[ServiceStatusShouldBeScheduled] = 1;
+	(*row)[ServiceStatusCurrentCheckAttempt] = service->GetCurrentCheckAttempt();
+	(*row)[ServiceStatusMaxCheckAttempts] = service->GetMaxCheckAttempts();
+	(*row)[ServiceStatusLastCheck] = schedule_end;
+	(*row)[ServiceStatusNextCheck] = service->GetNextCheck();
+	(*row)[ServiceStatusCheckType] = (service->GetEnableActiveChecks() ? 1 : 0);
+	(*row)[ServiceStatusLastStateChange] = service->GetLastStateChange();
+	(*row)[ServiceStatusLastHardStateChange] = service->GetLastHardStateChange();
+	(*row)[ServiceStatusLastTimeOk] = service->GetLastStateOK();
+	(*row)[ServiceStatusLastTimeWarning] = service->GetLastStateWarning();
+	(*row)[ServiceStatusLastTimeCritical] = service->GetLastStateCritical();
+	(*row)[ServiceStatusLastTimeUnknown] = service->GetLastStateUnknown();
+	(*row)[ServiceStatusStateType] = service->GetStateType();
+	(*row)[ServiceStatusLastNotification] = last_notification;
+	(*row)[ServiceStatusNextNotification] = next_notification;
+	(*row)[ServiceStatusNoMoreNotifications] = Empty;
+	(*row)[ServiceStatusNotificationsEnabled] = (service->GetEnableNotifications() ? 1 : 0);
+	(*row)[ServiceStatusProblemHasBeenAcknowledged] = (service->GetAcknowledgement() != AcknowledgementNone ? 1 : 0);
+	(*row)[ServiceStatusAcknowledgementType] = static_cast<int>(service->GetAcknowledgement());
+	(*row)[ServiceStatusCurrentNotificationNumber] = notification_number;
+	(*row)[ServiceStatusPassiveChecksEnabled] = (service->GetEnablePassiveChecks() ? 1 : 0);
+	(*row)[ServiceStatusActiveChecksEnabled] = (service->GetEnableActiveChecks() ? 1 : 0);
+	(*row)[ServiceStatusEventHandlerEnabled] = 1; /* always enabled */
+	(*row)[ServiceStatusFlapDetectionEnabled] = (service->GetEnableFlapping() ? 1 : 0);
+	(*row)[ServiceStatusIsFlapping] = (service->IsFlapping() ? 1 : 0);
+	(*row)[ServiceStatusPercentStateChange] = service->GetFlappingCurrent();
+	(*row)[ServiceStatusLatency] = Service::CalculateLatency(cr);
+	(*row)[ServiceStatusExecutionTime] = Service::CalculateExecutionTime(cr);
+	(*row)[ServiceStatusScheduledDowntimeDepth] = (service->IsInDowntime() ? 1 : 0);
+	(*row)[ServiceStatusProcessPerformanceData] = 1; /* always enabled */
+	(*row)[ServiceStatusEventHandler] = (eventcommand ? Value("event_" + eventcommand->GetName()) : Empty);
+	(*row)[ServiceStatusCheckCommand] = (checkcommand ? Value("check_" + checkcommand->GetName()) : Empty);
+	(*row)[ServiceStatusNormalCheckInterval] = service->GetCheckInterval() / 60.0;
+	(*row)[ServiceStatusRetryCheckInterval] = service->GetRetryInterval() / 60.0;
+	(*row)[ServiceStatusCheckTimeperiodObjectId] = service->GetCheckPeriod();
+
+	return true;
 }
 
 bool ServiceDbObject::IsStatusAttribute(const String& attribute) const
@@ -465,10 +545,378 @@ void ServiceDbObject::AddDowntimeByType(const DynamicObject::Ptr& object, const
 
 void ServiceDbObject::RemoveDowntime(const Service::Ptr& service, const Dictionary::Ptr& downtime)
 {
-	/* TODO: implement */
+	Host::Ptr host = service->GetHost();
+
+	if (!host)
+		return;
+
+	double now = Utility::GetTime();
+
+	Dictionary::Ptr fields1 = boost::make_shared<Dictionary>();
+	fields1->Set("actual_end_time", DbValue::FromTimestamp(now));
+	fields1->Set("was_cancelled", (now < downtime->Get("end_time")) ? 1 : 0);
+
+	UpdateDowntimeHistory(service, downtime, fields1);
+
+	if (host->GetHostCheckService() == service)
+		UpdateDowntimeHistory(host, downtime, fields1);
 }
 
 void ServiceDbObject::TriggerDowntime(const Service::Ptr& service, const Dictionary::Ptr& downtime)
 {
-	/* TODO: implement */
+	Host::Ptr host = service->GetHost();
+
+	if (!host)
+		return;
+
+	Dictionary::Ptr fields1 = boost::make_shared<Dictionary>();
+	fields1->Set("was_started", 1);
+	fields1->Set("actual_start_time", DbValue::FromTimestamp(downtime->Get("trigger_time")));
+
+	UpdateDowntimeHistory(service, downtime, fields1);
+
+	if (host->GetHostCheckService() == service)
+		UpdateDowntimeHistory(host, downtime, fields1);
+}
+
+/**
+ * Appends a statehistory row when a check result changed the service's
+ * state, state type, attempt or reachability.
+ */
+void ServiceDbObject::AddCheckResultHistory(const Service::Ptr& service, const Dictionary::Ptr& cr)
+{
+	Host::Ptr host = service->GetHost();
+
+	if (!host)
+		return;
+
+	Dictionary::Ptr vars_after = cr->Get("vars_after");
+	Dictionary::Ptr vars_before = cr->Get("vars_before");
+
+	if (!vars_after)
+		return;
+
+	long state_after = vars_after->Get("state");
+	long stateType_after = vars_after->Get("state_type");
+	long attempt_after = vars_after->Get("attempt");
+	bool reachable_after = vars_after->Get("reachable");
+	bool host_reachable_after = vars_after->Get("host_reachable");
+
+	long state_before = state_after;
+
+	if (vars_before) {
+		state_before = vars_before->Get("state");
+		long stateType_before = vars_before->Get("state_type");
+		long attempt_before = vars_before->Get("attempt");
+		bool reachable_before = vars_before->Get("reachable");
+
+		if (state_before == state_after && stateType_before == stateType_after &&
+		    attempt_before == attempt_after && reachable_before == reachable_after)
+			return; /* Nothing changed, ignore this checkresult. */
+	}
+
+	double now = Utility::GetTime();
+	unsigned long state_time = static_cast<long>(now);
+	unsigned long state_time_usec = (now - state_time) * 1000 * 1000;
+
+	String output, long_output;
+	String raw_output = cr->Get("output");
+	size_t line_end = raw_output.Find("\n");
+
+	output = raw_output.SubStr(0, line_end);
+
+	if (line_end != String::NPos)
+		long_output = raw_output.SubStr(line_end + 1);
+
+	Dictionary::Ptr fields1 = boost::make_shared<Dictionary>();
+	fields1->Set("state_time", DbValue::FromTimestamp(state_time));
+	fields1->Set("state_time_usec", state_time_usec);
+	fields1->Set("object_id", service);
+	fields1->Set("state_change", (state_before != state_after) ? 1 : 0);
+	fields1->Set("state", state_after);
+	fields1->Set("state_type", stateType_after);
+	fields1->Set("current_check_attempt", attempt_after);
+	fields1->Set("max_check_attempts", service->GetMaxCheckAttempts());
+	fields1->Set("last_state", state_before);
+	fields1->Set("last_hard_state", service->GetLastHardState());
+	fields1->Set("output", output);
+	fields1->Set("long_output", long_output);
+	fields1->Set("instance_id", 0); /* DbConnection class fills in real ID */
+
+	DbQuery query1;
+	query1.Table = "statehistory";
+	query1.Type = DbQueryInsert;
+	query1.Fields = fields1;
+	OnQuery(query1);
+
+	if (host->GetHostCheckService() != service)
+		return;
+
+	long host_state_after = Host::CalculateState(static_cast<ServiceState>(state_after), host_reachable_after);
+	long host_state_before = host_state_after;
+
+	if (vars_before)
+		host_state_before = Host::CalculateState(static_cast<ServiceState>(state_before), vars_before->Get("host_reachable"));
+
+	Dictionary::Ptr fields2 = fields1->ShallowClone();
+	fields2->Set("object_id", host);
+	fields2->Set("state_change", (host_state_before != host_state_after) ? 1 : 0);
+	fields2->Set("state", host_state_after);
+	fields2->Set("last_state", host_state_before);
+	fields2->Set("last_hard_state", host->GetLastHardState());
+
+	DbQuery query2;
+	query2.Table = "statehistory";
+	query2.Type = DbQueryInsert;
+	query2.Fields = fields2;
+	OnQuery(query2);
+}
+
+/**
+ * Maps notification types to the notification reasons used in the
+ * notifications table.
+ */
+static int NotificationTypeToReason(NotificationType type)
+{
+	switch (type) {
+		case NotificationAcknowledgement:
+			return 1;
+		case NotificationFlappingStart:
+			return 2;
+		case NotificationFlappingEnd:
+			return 3;
+		case NotificationDowntimeStart:
+			return 5;
+		case NotificationDowntimeEnd:
+			return 6;
+		case NotificationDowntimeRemoved:
+			return 7;
+		case NotificationCustom:
+			return 8;
+		default:
+			return 0;
+	}
+}
+
+/**
+ * Appends a notifications row for a notification and a contactnotifications
+ * row for each user who was notified.
+ */
+void ServiceDbObject::AddNotificationHistory(const Service::Ptr& service, const std::set<User::Ptr>& users,
+    NotificationType type, const Dictionary::Ptr& cr)
+{
+	Host::Ptr host = service->GetHost();
+
+	if (!host || users.empty())
+		return;
+
+	double now = Utility::GetTime();
+	unsigned long start_time = static_cast<long>(now);
+	unsigned long start_time_usec = (now - start_time) * 1000 * 1000;
+
+	String output, long_output;
+
+	if (cr) {
+		String raw_output = cr->Get("output");
+		size_t line_end = raw_output.Find("\n");
+
+		output = raw_output.SubStr(0, line_end);
+
+		if (line_end != String::NPos)
+			long_output = raw_output.SubStr(line_end + 1);
+	}
+
+	Dictionary::Ptr fields1 = boost::make_shared<Dictionary>();
+	fields1->Set("notification_type", 1); /* service */
+	fields1->Set("notification_reason", NotificationTypeToReason(type));
+	fields1->Set("object_id", service);
+	fields1->Set("start_time", DbValue::FromTimestamp(start_time));
+	fields1->Set("start_time_usec", start_time_usec);
+	fields1->Set("end_time", DbValue::FromTimestamp(start_time));
+	fields1->Set("end_time_usec", start_time_usec);
+	fields1->Set("state", service->GetState());
+	fields1->Set("output", output);
+	fields1->Set("long_output", long_output);
+	fields1->Set("escalated", 0);
+	fields1->Set("contacts_notified", static_cast<long>(users.size()));
+	fields1->Set("instance_id", 0); /* DbConnection class fills in real ID */
+
+	AddNotificationRows(fields1, users);
+
+	if (host->GetHostCheckService() != service)
+		return;
+
+	Dictionary::Ptr fields2 = fields1->ShallowClone();
+	fields2->Set("notification_type", 0); /* host */
+	fields2->Set("object_id", host);
+	fields2->Set("state", host->GetState());
+
+	AddNotificationRows(fields2, users);
+}
+
+/**
+ * Inserts a notifications row and a contactnotifications row for each user,
+ * which refer to the notifications row by its ID.
+ */
+void ServiceDbObject::AddNotificationRows(const Dictionary::Ptr& fields, const std::set<User::Ptr>& users)
+{
+	DbQuery query1;
+	query1.Table = "notifications";
+	query1.Type = DbQueryInsert;
+	query1.Fields = fields;
+	query1.InsertID = DbValue::FromRowInsertID();
+	OnQuery(query1);
+
+	BOOST_FOREACH(const User::Ptr& user, users) {
+		Dictionary::Ptr fields2 = boost::make_shared<Dictionary>();
+		fields2->Set("contact_object_id", user);
+		fields2->Set("notification_id", query1.InsertID);
+		fields2->Set("start_time", fields->Get("start_time"));
+		fields2->Set("start_time_usec", fields->Get("start_time_usec"));
+		fields2->Set("end_time", fields->Get("end_time"));
+		fields2->Set("end_time_usec", fields->Get("end_time_usec"));
+		fields2->Set("instance_id", 0); /* DbConnection class fills in real ID */
+
+		DbQuery query2;
+		query2.Table = "contactnotifications";
+		query2.Type = DbQueryInsert;
+		query2.Fields = fields2;
+		OnQuery(query2);
+	}
+}
+
+/**
+ * Appends a flappinghistory row when flapping starts or stops or when flap
+ * detection is disabled.
+ */
+void ServiceDbObject::AddFlappingHistory(const Service::Ptr& service, FlappingState flapping_state)
+{
+	Host::Ptr host = service->GetHost();
+
+	if (!host)
+		return;
+
+	int event_type, reason_type;
+
+	switch (flapping_state) {
+		case FlappingStarted:
+			event_type = 1000;
+			reason_type = 0;
+			break;
+		case FlappingStopped:
+			event_type = 1001;
+			reason_type = 1;
+			break;
+		case FlappingDisabled:
+			event_type = 1001;
+			reason_type = 2;
+			break;
+		default:
+			return;
+	}
+
+	double now = Utility::GetTime();
+	unsigned long event_time = static_cast<long>(now);
+	unsigned long event_time_usec = (now - event_time) * 1000 * 1000;
+
+	Dictionary::Ptr fields1 = boost::make_shared<Dictionary>();
+	fields1->Set("event_time", DbValue::FromTimestamp(event_time));
+	fields1->Set("event_time_usec", event_time_usec);
+	fields1->Set("event_type", event_type);
+	fields1->Set("reason_type", reason_type);
+	fields1->Set("flapping_type", 1); /* service */
+	fields1->Set("object_id", service);
+	fields1->Set("percent_state_change", service->GetFlappingCurrent());
+	fields1->Set("low_threshold", service->GetFlappingThreshold());
+	fields1->Set("high_threshold", service->GetFlappingThreshold());
+	fields1->Set("instance_id", 0); /* DbConnection class fills in real ID */
+
+	DbQuery query1;
+	query1.Table = "flappinghistory";
+	query1.Type = DbQueryInsert;
+	query1.Fields = fields1;
+	OnQuery(query1);
+
+	if (host->GetHostCheckService() != service)
+		return;
+
+	Dictionary::Ptr fields2 = fields1->ShallowClone();
+	fields2->Set("flapping_type", 0); /* host */
+	fields2->Set("object_id", host);
+
+	DbQuery query2;
+	query2.Table = "flappinghistory";
+	query2.Type = DbQueryInsert;
+	query2.Fields = fields2;
+	OnQuery(query2);
+}
+
+/**
+ * Appends a downtimehistory row for a new downtime. The row is updated when
+ * the downtime is triggered or removed.
+ */
+void ServiceDbObject::AddDowntimeHistory(const Service::Ptr& service, const Dictionary::Ptr& downtime)
+{
+	Host::Ptr host = service->GetHost();
+
+	if (!host)
+		return;
+
+	/* The author and the text are stored in the downtime's comment. */
+	Dictionary::Ptr comment = Service::GetCommentByID(downtime->Get("comment_id"));
+	Value author, text;
+
+	if (comment) {
+		author = comment->Get("author");
+		text = comment->Get("text");
+	}
+
+	Dictionary::Ptr fields1 = boost::make_shared<Dictionary>();
+	fields1->Set("downtime_type", 1); /* service */
+	fields1->Set("object_id", service);
+	fields1->Set("entry_time", DbValue::FromTimestamp(downtime->Get("entry_time")));
+	fields1->Set("author_name", author);
+	fields1->Set("comment_data", text);
+	fields1->Set("internal_downtime_id", downtime->Get("legacy_id"));
+	fields1->Set("triggered_by_id", downtime->Get("triggered_by"));
+	fields1->Set("is_fixed", downtime->Get("fixed"));
+	fields1->Set("duration", downtime->Get("duration"));
+	fields1->Set("scheduled_start_time", DbValue::FromTimestamp(downtime->Get("start_time")));
+	fields1->Set("scheduled_end_time", DbValue::FromTimestamp(downtime->Get("end_time")));
+	fields1->Set("was_started", 0);
+	fields1->Set("was_cancelled", 0);
+	fields1->Set("instance_id", 0); /* DbConnection class fills in real ID */
+
+	DbQuery query1;
+	query1.Table = "downtimehistory";
+	query1.Type = DbQueryInsert;
+	query1.Fields = fields1;
+	OnQuery(query1);
+
+	if (host->GetHostCheckService() != service)
+		return;
+
+	Dictionary::Ptr fields2 = fields1->ShallowClone();
+	fields2->Set("downtime_type", 2); /* host */
+	fields2->Set("object_id", host);
+
+	DbQuery query2;
+	query2.Table = "downtimehistory";
+	query2.Type = DbQueryInsert;
+	query2.Fields = fields2;
+	OnQuery(query2);
+}
+
+void ServiceDbObject::UpdateDowntimeHistory(const DynamicObject::Ptr& object, const Dictionary::Ptr& downtime, const Dictionary::Ptr& fields)
+{
+	DbQuery query1;
+	query1.Table = "downtimehistory";
+	query1.Type = DbQueryUpdate;
+	query1.Fields = fields;
+	query1.WhereCriteria = boost::make_shared<Dictionary>();
+	query1.WhereCriteria->Set("object_id", object);
+	query1.WhereCriteria->Set("entry_time", DbValue::FromTimestamp(downtime->Get("entry_time")));
+	query1.WhereCriteria->Set("internal_downtime_id", downtime->Get("legacy_id"));
+	query1.WhereCriteria->Set("instance_id", 0); /* DbConnection class fills in real ID */
+	OnQuery(query1);
 }
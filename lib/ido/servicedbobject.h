@@ -23,10 +23,62 @@
 #include "ido/dbobject.h"
 #include "base/dynamicobject.h"
 #include "icinga/service.h"
+#include "icinga/notification.h"
+#include "icinga/user.h"
 
 namespace icinga
 {
 
+/**
+ * Columns of the servicestatus table.
+ *
+ * @ingroup ido
+ */
+enum ServiceStatusColumn
+{
+	ServiceStatusOutput = DbStatusColumnCount,
+	ServiceStatusLongOutput,
+	ServiceStatusPerfdata,
+	ServiceStatusCurrentState,
+	ServiceStatusHasBeenChecked,
+	ServiceStatusShouldBeScheduled,
+	ServiceStatusCurrentCheckAttempt,
+	ServiceStatusMaxCheckAttempts,
+	ServiceStatusLastCheck,
+	ServiceStatusNextCheck,
+	ServiceStatusCheckType,
+	ServiceStatusLastStateChange,
+	ServiceStatusLastHardStateChange,
+	ServiceStatusLastTimeOk,
+	ServiceStatusLastTimeWarning,
+	ServiceStatusLastTimeCritical,
+	ServiceStatusLastTimeUnknown,
+	ServiceStatusStateType,
+	ServiceStatusLastNotification,
+	ServiceStatusNextNotification,
+	ServiceStatusNoMoreNotifications,
+	ServiceStatusNotificationsEnabled,
+	ServiceStatusProblemHasBeenAcknowledged,
+	ServiceStatusAcknowledgementType,
+	ServiceStatusCurrentNotificationNumber,
+	ServiceStatusPassiveChecksEnabled,
+	ServiceStatusActiveChecksEnabled,
+	ServiceStatusEventHandlerEnabled,
+	ServiceStatusFlapDetectionEnabled,
+	ServiceStatusIsFlapping,
+	ServiceStatusPercentStateChange,
+	ServiceStatusLatency,
+	ServiceStatusExecutionTime,
+	ServiceStatusScheduledDowntimeDepth,
+	ServiceStatusProcessPerformanceData,
+	ServiceStatusEventHandler,
+	ServiceStatusCheckCommand,
+	ServiceStatusNormalCheckInterval,
+	ServiceStatusRetryCheckInterval,
+	ServiceStatusCheckTimeperiodObjectId,
+	ServiceStatusColumnCount
+};
+
 /**
  * A Service database object.
  *
@@ -44,6 +96,9 @@ public:
 	virtual Dictionary::Ptr GetConfigFields(void) const;
 	virtual Dictionary::Ptr GetStatusFields(void) const;
 
+	virtual DbSchema::Ptr GetStatusSchema(void) const;
+	virtual bool GetStatusRow(std::vector<Value> *row) const;
+
 protected:
 	virtual bool IsStatusAttribute(const String& attribute) const;
 
@@ -51,6 +106,8 @@ protected:
 	virtual void OnStatusUpdate(void);
 
 private:
+	static DbSchema::Ptr m_StatusSchema;
+
 	static void AddComments(const Service::Ptr& service);
 	static void AddComment(const Service::Ptr& service, const Dictionary::Ptr& comment);
 	static void AddCommentByType(const DynamicObject::Ptr& object, const Dictionary::Ptr& comment);
@@ -61,6 +118,14 @@ private:
 	static void AddDowntimeByType(const DynamicObject::Ptr& object, const Dictionary::Ptr& downtime);
 	static void RemoveDowntime(const Service::Ptr& service, const Dictionary::Ptr& downtime);
 	static void TriggerDowntime(const Service::Ptr& service, const Dictionary::Ptr& downtime);
+
+	static void AddCheckResultHistory(const Service::Ptr& service, const Dictionary::Ptr& cr);
+	static void AddNotificationHistory(const Service::Ptr& service, const std::set<User::Ptr>& users,
+	    NotificationType type, const Dictionary::Ptr& cr);
+	static void AddNotificationRows(const Dictionary::Ptr& fields, const std::set<User::Ptr>& users);
+	static void AddFlappingHistory(const Service::Ptr& service, FlappingState flapping_state);
+	static void AddDowntimeHistory(const Service::Ptr& service, const Dictionary::Ptr& downtime);
+	static void UpdateDowntimeHistory(const DynamicObject::Ptr& object, const Dictionary::Ptr& downtime, const Dictionary::Ptr& fields);
 };
 
 }
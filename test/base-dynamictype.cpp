@@ -0,0 +1,93 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "base/dynamictype.h"
+#include "base/dynamicobject.h"
+#include "base/dictionary.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/smart_ptr/make_shared.hpp>
+#include <boost/foreach.hpp>
+
+using namespace icinga;
+
+class TestObject : public DynamicObject
+{
+public:
+	DECLARE_PTR_TYPEDEFS(TestObject);
+	DECLARE_TYPENAME(TestObject);
+};
+
+REGISTER_TYPE(TestObject);
+
+static TestObject::Ptr CreateTestObject(const String& name)
+{
+	Dictionary::Ptr update = boost::make_shared<Dictionary>();
+	update->Set("__name", name);
+	update->Set("__type", "TestObject");
+
+	DynamicObject::Ptr object = DynamicType::GetByName("TestObject")->CreateObject(update);
+	object->Register();
+
+	return static_pointer_cast<TestObject>(object);
+}
+
+BOOST_AUTO_TEST_SUITE(base_dynamictype)
+
+BOOST_AUTO_TEST_CASE(snapshot)
+{
+	TestObject::Ptr object1 = CreateTestObject("snapshot1");
+
+	DynamicObjectSnapshot<TestObject> snapshot1 = DynamicType::GetSnapshot<TestObject>();
+	size_t length = snapshot1.GetLength();
+	BOOST_CHECK(length >= 1);
+
+	TestObject::Ptr object2 = CreateTestObject("snapshot2");
+
+	/* Existing snapshots don't change. */
+	BOOST_CHECK(snapshot1.GetLength() == length);
+
+	DynamicObjectSnapshot<TestObject> snapshot2 = DynamicType::GetSnapshot<TestObject>();
+	BOOST_CHECK(snapshot2.GetLength() == length + 1);
+
+	bool found1 = false, found2 = false;
+
+	BOOST_FOREACH(const TestObject::Ptr& object, snapshot2) {
+		if (object == object1)
+			found1 = true;
+		else if (object == object2)
+			found2 = true;
+	}
+
+	BOOST_CHECK(found1 && found2);
+
+	BOOST_FOREACH(const TestObject::Ptr& object, snapshot1) {
+		BOOST_CHECK(object != object2);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(getobjects)
+{
+	CreateTestObject("getobjects1");
+
+	std::vector<TestObject::Ptr> objects = DynamicType::GetObjects<TestObject>();
+	BOOST_CHECK(objects.size() == DynamicType::GetSnapshot<TestObject>().GetLength());
+	BOOST_CHECK(DynamicType::GetByName("TestObject")->GetSnapshot().GetLength() == objects.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
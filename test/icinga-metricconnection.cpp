@@ -0,0 +1,239 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "icinga/metricconnection.h"
+#include "base/tcpsocket.h"
+#include "base/timer.h"
+#include "base/utility.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/smart_ptr/make_shared.hpp>
+#include <fstream>
+
+using namespace icinga;
+
+struct MetricConnectionFixture
+{
+	MetricConnectionFixture(void)
+	{
+		Timer::Initialize();
+
+		/* The listener isn't accepting connections until Listen() is
+		 * called, so the connection fails until then. */
+		Listener = boost::make_shared<TcpSocket>();
+		Listener->Bind("127.0.0.1", "0", AF_INET);
+
+		/* GetClientAddress() returns "[address]:port". */
+		std::string address = Listener->GetClientAddress();
+		Port = address.substr(address.rfind(':') + 1);
+	}
+
+	~MetricConnectionFixture(void)
+	{
+		Listener->Close();
+
+		Timer::Uninitialize();
+	}
+
+	TcpSocket::Ptr Listener;
+	String Port;
+};
+
+static std::string ReadLines(const Socket::Ptr& client, size_t length)
+{
+	std::string result;
+	char buffer[512];
+
+	while (result.size() < length) {
+		size_t rc = client->Read(buffer, sizeof(buffer));
+
+		if (rc == 0)
+			break;
+
+		result.append(buffer, rc);
+	}
+
+	return result;
+}
+
+static void WaitForSpilledBytes(const MetricConnection::Ptr& connection, size_t bytes)
+{
+	for (int i = 0; i < 50 && connection->GetSpilledBytes() != bytes; i++)
+		Utility::Sleep(0.1);
+}
+
+BOOST_FIXTURE_TEST_SUITE(icinga_metricconnection, MetricConnectionFixture)
+
+BOOST_AUTO_TEST_CASE(send)
+{
+	Listener->Listen();
+
+	MetricConnection::Ptr connection = boost::make_shared<MetricConnection>("127.0.0.1", Port, 1024);
+	connection->Start(0.1, 0.1);
+
+	connection->Send("icinga.host.ping.rta 0.5 1370000000\n");
+	connection->Send("icinga.host.ping.pl 0 1370000000\n");
+
+	Socket::Ptr client = Listener->Accept();
+	BOOST_CHECK(ReadLines(client, 69) == "icinga.host.ping.rta 0.5 1370000000\n"
+	    "icinga.host.ping.pl 0 1370000000\n");
+
+	connection->Stop();
+	BOOST_CHECK(connection->GetSentBytes() == 69);
+	BOOST_CHECK(connection->GetDroppedBytes() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(reconnect)
+{
+	MetricConnection::Ptr connection = boost::make_shared<MetricConnection>("127.0.0.1", Port, 1024);
+	connection->Start(0.1, 0);
+
+	connection->Send("a 1 1\n");
+	connection->Send("b 2 2\n");
+
+	Utility::Sleep(0.5);
+	BOOST_CHECK(!connection->IsConnected());
+	BOOST_CHECK(connection->GetBufferedBytes() == 12);
+
+	Listener->Listen();
+
+	Socket::Ptr client = Listener->Accept();
+	BOOST_CHECK(ReadLines(client, 12) == "a 1 1\nb 2 2\n");
+
+	connection->Stop();
+	BOOST_CHECK(connection->GetBufferedBytes() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(overflow)
+{
+	MetricConnection::Ptr connection = boost::make_shared<MetricConnection>("127.0.0.1", Port, 12);
+	connection->Start(0.1, 0);
+
+	connection->Send("a 1 1\n");
+	connection->Send("b 2 2\n");
+	connection->Send("c 3 3\n");
+
+	/* The oldest line is discarded. */
+	BOOST_CHECK(connection->GetBufferedBytes() == 12);
+	BOOST_CHECK(connection->GetDroppedBytes() == 6);
+
+	Listener->Listen();
+
+	Socket::Ptr client = Listener->Accept();
+	BOOST_CHECK(ReadLines(client, 12) == "b 2 2\nc 3 3\n");
+
+	connection->Stop();
+}
+
+BOOST_AUTO_TEST_CASE(spill)
+{
+	String spillPath = "icinga-metricconnection.spill";
+	(void) unlink(spillPath.CStr());
+
+	MetricConnection::Ptr connection = boost::make_shared<MetricConnection>("127.0.0.1", Port, 6, spillPath);
+	connection->Start(0.1, 0);
+
+	connection->Send("a 1 1\n");
+	connection->Send("b 2 2\n");
+	connection->Send("c 3 3\n");
+
+	/* The sender thread writes the spill file. */
+	WaitForSpilledBytes(connection, 12);
+
+	BOOST_CHECK(connection->GetBufferedBytes() == 6);
+	BOOST_CHECK(connection->GetSpilledBytes() == 12);
+	BOOST_CHECK(connection->GetDroppedBytes() == 0);
+
+	/* Spilled lines are sent before the buffered ones. */
+	Listener->Listen();
+
+	Socket::Ptr client = Listener->Accept();
+	BOOST_CHECK(ReadLines(client, 18) == "a 1 1\nb 2 2\nc 3 3\n");
+
+	WaitForSpilledBytes(connection, 0);
+	BOOST_CHECK(connection->GetSpilledBytes() == 0);
+
+	connection->Stop();
+
+	(void) unlink(spillPath.CStr());
+}
+
+BOOST_AUTO_TEST_CASE(spill_size)
+{
+	String spillPath = "icinga-metricconnection.spill";
+	(void) unlink(spillPath.CStr());
+
+	MetricConnection::Ptr connection = boost::make_shared<MetricConnection>("127.0.0.1", Port, 6, spillPath, 6);
+	connection->Start(0.1, 0);
+
+	connection->Send("a 1 1\n");
+	connection->Send("b 2 2\n");
+	WaitForSpilledBytes(connection, 6);
+
+	/* The spill file is full. */
+	connection->Send("c 3 3\n");
+
+	for (int i = 0; i < 50 && connection->GetDroppedBytes() != 6; i++)
+		Utility::Sleep(0.1);
+
+	BOOST_CHECK(connection->GetBufferedBytes() == 6);
+	BOOST_CHECK(connection->GetSpilledBytes() == 6);
+	BOOST_CHECK(connection->GetDroppedBytes() == 6);
+
+	Listener->Listen();
+
+	Socket::Ptr client = Listener->Accept();
+	BOOST_CHECK(ReadLines(client, 12) == "a 1 1\nc 3 3\n");
+
+	connection->Stop();
+
+	(void) unlink(spillPath.CStr());
+}
+
+BOOST_AUTO_TEST_CASE(spill_restart)
+{
+	String spillPath = "icinga-metricconnection.spill";
+	(void) unlink(spillPath.CStr());
+
+	/* Lines which couldn't be sent before stopping are kept... */
+	MetricConnection::Ptr connection = boost::make_shared<MetricConnection>("127.0.0.1", Port, 1024, spillPath);
+	connection->Start(0.1, 0);
+	connection->Send("a 1 1\n");
+	connection->Stop();
+
+	std::ifstream fp(spillPath.CStr());
+	std::string line;
+	BOOST_CHECK(std::getline(fp, line) && line == "a 1 1");
+	fp.close();
+
+	/* ...and sent by the next run. */
+	Listener->Listen();
+
+	connection = boost::make_shared<MetricConnection>("127.0.0.1", Port, 1024, spillPath);
+	connection->Start(0.1, 0);
+	connection->Send("b 2 2\n");
+
+	Socket::Ptr client = Listener->Accept();
+	BOOST_CHECK(ReadLines(client, 12) == "a 1 1\nb 2 2\n");
+
+	connection->Stop();
+
+	(void) unlink(spillPath.CStr());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,130 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "icinga/perfdatavalue.h"
+#include "base/utility.h"
+#include <boost/test/unit_test.hpp>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(icinga_perfdatavalue)
+
+BOOST_AUTO_TEST_CASE(parse)
+{
+	std::vector<PerfdataValue> values;
+	PerfdataValue::Parse("rta=0.5ms;100;500;0 pl=0%;20;60;0;100", values);
+
+	BOOST_REQUIRE(values.size() == 2);
+
+	BOOST_CHECK(values[0].Label == "rta");
+	BOOST_CHECK(values[0].Value == 0.5);
+	BOOST_CHECK(values[0].Unit == "ms");
+	BOOST_CHECK(values[0].Warn == "100");
+	BOOST_CHECK(values[0].Crit == "500");
+	BOOST_CHECK(values[0].Min == "0");
+	BOOST_CHECK(values[0].Max == "");
+
+	BOOST_CHECK(values[1].Label == "pl");
+	BOOST_CHECK(values[1].Value == 0);
+	BOOST_CHECK(values[1].Unit == "%");
+	BOOST_CHECK(values[1].Max == "100");
+}
+
+BOOST_AUTO_TEST_CASE(quoted)
+{
+	std::vector<PerfdataValue> values;
+	PerfdataValue::Parse("'disk usage'=5GB 'it''s'=1 ''''=2", values);
+
+	BOOST_REQUIRE(values.size() == 3);
+	BOOST_CHECK(values[0].Label == "disk usage");
+	BOOST_CHECK(values[0].Value == 5);
+	BOOST_CHECK(values[0].Unit == "GB");
+	BOOST_CHECK(values[1].Label == "it's");
+	BOOST_CHECK(values[1].Value == 1);
+	BOOST_CHECK(values[2].Label == "'");
+	BOOST_CHECK(values[2].Value == 2);
+}
+
+BOOST_AUTO_TEST_CASE(unknown)
+{
+	std::vector<PerfdataValue> values;
+	PerfdataValue::Parse("a=U;1;2 b=3", values);
+
+	BOOST_REQUIRE(values.size() == 1);
+	BOOST_CHECK(values[0].Label == "b");
+	BOOST_CHECK(values[0].Value == 3);
+}
+
+BOOST_AUTO_TEST_CASE(missing_fields)
+{
+	std::vector<PerfdataValue> values;
+	PerfdataValue::Parse("load1=0.5;;;0 load5=0.25", values);
+
+	BOOST_REQUIRE(values.size() == 2);
+	BOOST_CHECK(values[0].Unit == "");
+	BOOST_CHECK(values[0].Warn == "");
+	BOOST_CHECK(values[0].Crit == "");
+	BOOST_CHECK(values[0].Min == "0");
+	BOOST_CHECK(values[0].Max == "");
+	BOOST_CHECK(values[1].Warn == "");
+	BOOST_CHECK(values[1].Max == "");
+}
+
+BOOST_AUTO_TEST_CASE(invalid)
+{
+	std::vector<PerfdataValue> values;
+
+	PerfdataValue::Parse("", values);
+	PerfdataValue::Parse("   ", values);
+	BOOST_CHECK(values.empty());
+
+	PerfdataValue::Parse("foo a= b=ms c=1 'unterminated=2", values);
+
+	BOOST_REQUIRE(values.size() == 1);
+	BOOST_CHECK(values[0].Label == "c");
+	BOOST_CHECK(values[0].Value == 1);
+}
+
+BOOST_AUTO_TEST_CASE(throughput)
+{
+	/* Same perfdata as test/perfdata/run_benchmark. */
+	String perfdata = "rta=0.5ms;100;500;0 pl=0%;20;60;0;100";
+	const int count = 100000;
+
+	std::vector<PerfdataValue> values;
+	values.reserve(2);
+
+	size_t parsed = 0;
+	double start = Utility::GetTime();
+
+	for (int i = 0; i < count; i++) {
+		values.clear();
+		PerfdataValue::Parse(perfdata, values);
+		parsed += values.size();
+	}
+
+	double duration = Utility::GetTime() - start;
+
+	BOOST_CHECK(parsed == 2 * count);
+
+	BOOST_TEST_MESSAGE("Parsed " << count << " perfdata strings in " << duration << " seconds ("
+	    << static_cast<long>(count / std::max(duration, 0.001)) << " strings/s).");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
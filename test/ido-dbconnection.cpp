@@ -0,0 +1,360 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012 Icinga Development Team (http://www.icinga.org/)        *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "ido/dbconnection.h"
+#include "ido/dbtype.h"
+#include "base/dynamictype.h"
+#include "base/timer.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/smart_ptr/make_shared.hpp>
+#include <boost/foreach.hpp>
+
+using namespace icinga;
+
+enum TestFailure
+{
+	TestFailDeadlock,
+	TestFailError,
+	TestFailDeferred
+};
+
+/**
+ * A database backend which doesn't need a server. Work items write
+ * their names to a log; failures are injected the way the PostgreSQL
+ * backend reports them: An error outside of a savepoint aborts the
+ * whole transaction and deferred errors (COPY, pipelining) only show
+ * up when the rows are flushed, i.e. at the next savepoint or commit.
+ */
+class TestDbConnection : public DbConnection
+{
+public:
+	DECLARE_PTR_TYPEDEFS(TestDbConnection);
+	DECLARE_TYPENAME(TestDbConnection);
+
+	TestDbConnection(void)
+		: m_PendingError(false), m_Savepoint(false)
+	{ }
+
+	virtual void Start(void)
+	{
+		DbConnection::Start();
+	}
+
+	virtual void Stop(void)
+	{
+		DbConnection::Stop();
+	}
+
+	void Fail(const String& name, TestFailure failure, int count)
+	{
+		m_Failures[name] = std::make_pair(failure, count);
+	}
+
+	void Run(const String& name)
+	{
+		Enqueue(boost::bind(&TestDbConnection::Work, this, name, DbObject::Ptr()));
+	}
+
+	void Run(const String& name, const DbObject::Ptr& dbobj)
+	{
+		Enqueue(boost::bind(&TestDbConnection::Work, this, name, dbobj));
+	}
+
+	/* Only valid once Stop() has joined the writer thread. */
+	String GetLog(void) const
+	{
+		String result;
+
+		BOOST_FOREACH(const String& entry, m_Log) {
+			if (!result.IsEmpty())
+				result += " ";
+
+			result += entry;
+		}
+
+		return result;
+	}
+
+protected:
+	virtual void ExecuteQuery(const DbQuery&)
+	{
+		m_Log.push_back("query");
+	}
+
+	virtual void ActivateObject(const DbObject::Ptr&)
+	{ }
+
+	virtual void DeactivateObject(const DbObject::Ptr&)
+	{ }
+
+	virtual void NewTransaction(void)
+	{
+		Flush();
+		m_Log.push_back("commit");
+	}
+
+	virtual void SetSavepoint(void)
+	{
+		m_Log.push_back("savepoint");
+		Flush();
+		m_Savepoint = true;
+	}
+
+	virtual void ReleaseSavepoint(void)
+	{
+		m_Log.push_back("release");
+		Flush();
+		m_Savepoint = false;
+	}
+
+	virtual void RollbackSavepoint(void)
+	{
+		m_Log.push_back("rollback");
+		m_PendingError = false;
+		m_Savepoint = false;
+	}
+
+	virtual bool Connect(void)
+	{
+		return true;
+	}
+
+	virtual void Disconnect(void)
+	{ }
+
+	virtual DbReference LoadInstanceID(void)
+	{
+		return DbReference(1);
+	}
+
+	virtual bool HasConfigHashColumn(void)
+	{
+		return true;
+	}
+
+	virtual Array::Ptr Query(const String&)
+	{
+		return boost::make_shared<Array>();
+	}
+
+	virtual void UpdateConfigHash(const DbReference&, const String&)
+	{ }
+
+	virtual void FlushQueries(void)
+	{ }
+
+	virtual void InternalActivateObject(const DbObject::Ptr&)
+	{ }
+
+private:
+	std::map<String, std::pair<TestFailure, int> > m_Failures;
+	std::vector<String> m_Log;
+	bool m_PendingError;
+	bool m_Savepoint;
+
+	void Work(const String& name, const DbObject::Ptr& dbobj)
+	{
+		m_Log.push_back(name);
+
+		if (dbobj) {
+			/* The ID must have been reset if the transaction was
+			 * rolled back. */
+			if (GetObjectID(dbobj).IsValid())
+				m_Log.push_back("stale");
+
+			SetObjectID(dbobj, DbReference(5));
+		}
+
+		std::map<String, std::pair<TestFailure, int> >::iterator it = m_Failures.find(name);
+
+		if (it == m_Failures.end() || it->second.second == 0)
+			return;
+
+		it->second.second--;
+
+		switch (it->second.first) {
+			case TestFailDeadlock:
+				m_PendingError = false;
+				BOOST_THROW_EXCEPTION(DbDeadlockError("deadlock detected"));
+			case TestFailError:
+				ThrowError();
+			case TestFailDeferred:
+				m_PendingError = true;
+				break;
+		}
+	}
+
+	void Flush(void)
+	{
+		if (!m_PendingError)
+			return;
+
+		m_PendingError = false;
+		ThrowError();
+	}
+
+	void ThrowError(void)
+	{
+		if (m_Savepoint)
+			BOOST_THROW_EXCEPTION(std::runtime_error("statement failed"));
+		else
+			BOOST_THROW_EXCEPTION(DbRollbackError("statement failed"));
+	}
+};
+
+REGISTER_TYPE(TestDbConnection);
+
+struct DbConnectionFixture
+{
+	DbConnectionFixture(void)
+	{
+		Timer::Initialize();
+
+		Dictionary::Ptr update = boost::make_shared<Dictionary>();
+		update->Set("__name", "ido-dbconnection-test");
+		update->Set("__type", "TestDbConnection");
+
+		/* Transactions are only committed by Stop(). */
+		update->Set("transaction_interval", 3600);
+
+		Connection = static_pointer_cast<TestDbConnection>(DynamicType::GetByName("TestDbConnection")->CreateObject(update));
+	}
+
+	~DbConnectionFixture(void)
+	{
+		Timer::Uninitialize();
+	}
+
+	TestDbConnection::Ptr Connection;
+};
+
+static DbObject::Ptr GetHostDbObject(const String& name)
+{
+	return DbType::GetByName("Host")->GetOrCreateObjectByName(name, "");
+}
+
+BOOST_FIXTURE_TEST_SUITE(ido_dbconnection, DbConnectionFixture)
+
+BOOST_AUTO_TEST_CASE(commit)
+{
+	Connection->Start();
+	Connection->Run("a");
+	Connection->Run("b");
+	Connection->Stop();
+
+	BOOST_CHECK(Connection->GetLog() == "a b commit");
+}
+
+BOOST_AUTO_TEST_CASE(deadlock_replay)
+{
+	Connection->Fail("b", TestFailDeadlock, 1);
+
+	Connection->Start();
+	Connection->Run("a");
+	Connection->Run("b");
+	Connection->Run("c");
+	Connection->Stop();
+
+	BOOST_CHECK(Connection->GetLog() == "a b a b c commit");
+}
+
+BOOST_AUTO_TEST_CASE(deadlock_give_up)
+{
+	Connection->Fail("b", TestFailDeadlock, 10);
+
+	Connection->Start();
+	Connection->Run("a");
+	Connection->Run("b");
+	Connection->Run("c");
+	Connection->Stop();
+
+	/* The transaction is dropped after three replays. */
+	BOOST_CHECK(Connection->GetLog() == "a b a b a b a b c commit");
+}
+
+BOOST_AUTO_TEST_CASE(savepoint_replay)
+{
+	Connection->Fail("b", TestFailError, 2);
+
+	Connection->Start();
+	Connection->Run("a");
+	Connection->Run("b");
+	Connection->Run("c");
+	Connection->Stop();
+
+	BOOST_CHECK(Connection->GetLog() == "a b savepoint a release savepoint b rollback c commit");
+}
+
+BOOST_AUTO_TEST_CASE(deferred_error_at_commit)
+{
+	Connection->Fail("b", TestFailDeferred, 2);
+
+	Connection->Start();
+	Connection->Run("a");
+	Connection->Run("b");
+	Connection->Run("c");
+	Connection->Stop();
+
+	BOOST_CHECK(Connection->GetLog() == "a b c savepoint a release savepoint b release rollback savepoint c release commit");
+}
+
+BOOST_AUTO_TEST_CASE(deferred_error_replayed)
+{
+	/* The error only happens once, none of the work items are lost. */
+	Connection->Fail("b", TestFailDeferred, 1);
+
+	Connection->Start();
+	Connection->Run("a");
+	Connection->Run("b");
+	Connection->Stop();
+
+	BOOST_CHECK(Connection->GetLog() == "a b savepoint a release savepoint b release commit");
+}
+
+BOOST_AUTO_TEST_CASE(object_ids_reset_on_replay)
+{
+	DbObject::Ptr dbobj = GetHostDbObject("ido-dbconnection-replay");
+
+	Connection->Fail("b", TestFailDeadlock, 1);
+
+	Connection->Start();
+	Connection->Run("a", dbobj);
+	Connection->Run("b");
+	Connection->Stop();
+
+	BOOST_CHECK(Connection->GetLog() == "a b a b commit");
+	BOOST_CHECK(Connection->GetObjectID(dbobj) == 5);
+}
+
+BOOST_AUTO_TEST_CASE(object_ids_reset_for_failed_item)
+{
+	DbObject::Ptr dbobj = GetHostDbObject("ido-dbconnection-failed");
+
+	Connection->Fail("b", TestFailError, 2);
+
+	Connection->Start();
+	Connection->Run("a");
+	Connection->Run("b", dbobj);
+	Connection->Stop();
+
+	BOOST_CHECK(Connection->GetLog() == "a b savepoint a release savepoint b rollback commit");
+	BOOST_CHECK(!Connection->GetObjectID(dbobj).IsValid());
+}
+
+BOOST_AUTO_TEST_SUITE_END()